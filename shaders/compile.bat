@@ -1,3 +1,6 @@
 A:\Depending\VulkanSDK\1.1.126.0\Bin32\glslangValidator.exe -V shader.vert
 A:\Depending\VulkanSDK\1.1.126.0\Bin32\glslangValidator.exe -V shader.frag
+A:\Depending\VulkanSDK\1.1.126.0\Bin32\glslangValidator.exe -V shader_packed.vert -o vert_packed.spv
+A:\Depending\VulkanSDK\1.1.126.0\Bin32\glslangValidator.exe -V meshlet_cull.comp -o cull.spv
+A:\Depending\VulkanSDK\1.1.126.0\Bin32\glslangValidator.exe -V mip_downsample.comp -o mips.spv
 pause
\ No newline at end of file
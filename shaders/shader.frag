@@ -6,10 +6,16 @@ layout(location = 1) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
-layout(binding  = 1) uniform sampler2D texSampler;
+// every loaded texture, in the slots VkApp registered them in; the
+// pipeline specializes the size to the layout's descriptor count
+layout(constant_id = 0) const uint TEXTURE_SLOTS = 1;
+layout(binding  = 1) uniform sampler2D textures[TEXTURE_SLOTS];
+
+// the slot of the drawn material's texture, pushed per draw
+layout(push_constant) uniform Material {
+	uint textureSlot;
+} material;
 
 void main() {
-	//outColor = vec4(fragColor * texture(texSampler, fragTexCoord).rgb, 1.0);
-	//outColor = texture(texSampler, fragTexCoord);
-	outColor = vec4(fragColor, 1.0f);
+	outColor = vec4(fragColor * texture(textures[material.textureSlot], fragTexCoord).rgb, 1.0);
 }
\ No newline at end of file
@@ -12,7 +12,7 @@ layout(location = 1) in vec3  inColor;
 layout(location = 2) in vec3  inTextCoord;
 
 layout(location = 0) out vec3 fragColor;
-layout(location = 1) out vec3 fragTexCoord;
+layout(location = 1) out vec2 fragTexCoord;
 
 out gl_PerVertex {
 	vec4 gl_Position;
@@ -22,5 +22,5 @@ void main() {
 	gl_Position = ubo.proj * ubo.view * ubo.model * //
 		vec4(inPosition, 1.0);
 	fragColor   = inColor;
-	fragTexCoord= inTextCoord;
+	fragTexCoord= inTextCoord.xy;
 }
\ No newline at end of file
@@ -0,0 +1,39 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(binding = 0) uniform UniformBufferObject {
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+} ubo;
+
+// PackedVertex (vertex_format.h): snorm16 positions inside the mesh bounds,
+// the model matrix carries the dequantization; inPosition.w overlaps the
+// normal and is ignored
+layout(location = 0) in vec4  inPosition;
+layout(location = 1) in vec4  inColor;
+layout(location = 2) in vec2  inTexCoord;
+layout(location = 3) in vec2  inNormal;		// octahedral
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+out gl_PerVertex {
+	vec4 gl_Position;
+};
+
+vec3 octDecode(vec2 e) {
+	vec3  n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main() {
+	gl_Position = ubo.proj * ubo.view * ubo.model *
+		vec4(inPosition.xyz, 1.0);
+	// same picture as the float layout, which stores the normal as color
+	fragColor   = inColor.rgb * (octDecode(inNormal) * 0.5 + 0.5);
+	fragTexCoord= inTexCoord;
+}
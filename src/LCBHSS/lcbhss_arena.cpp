@@ -0,0 +1,125 @@
+#include "lcbhss_arena.h"
+#include "lcbhss_pool.h"
+
+#include <new>
+#include <cstdlib>
+
+namespace {
+
+thread_local uint64_t t_heapAllocations = 0;
+
+constexpr size_t OVERFLOW_HEADER_SIZE = 64;
+
+}
+
+uint64_t heapAllocationCount() {
+    return t_heapAllocations;
+}
+
+void countHeapAllocation() {
+    t_heapAllocations++;
+}
+
+#ifdef _DEBUG
+void* operator new(size_t size) {
+    t_heapAllocations++;
+    if (void* data = malloc(size ? size : 1)) {
+        return data;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    t_heapAllocations++;
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* data) noexcept {
+    free(data);
+}
+
+void operator delete[](void* data) noexcept {
+    free(data);
+}
+
+void operator delete(void* data, size_t) noexcept {
+    free(data);
+}
+
+void operator delete[](void* data, size_t) noexcept {
+    free(data);
+}
+#endif // _DEBUG
+
+//-----------------------------------------------------------------------------
+
+LinearArena::LinearArena(size_t capacity) {
+    if (capacity) {
+        m_base     = static_cast<char*>(poolMalloc(capacity, 64));
+        m_capacity = m_base ? capacity : 0;
+    }
+}
+
+LinearArena::~LinearArena() {
+    _freeOverflow();
+    poolFree(m_base);
+}
+
+void* LinearArena::allocate(size_t size, size_t alignment) {
+    size_t start = (m_offset + alignment - 1) & ~(alignment - 1);
+    if (start + size <= m_capacity) {
+        m_offset = start + size;
+        if (m_offset + m_overflowBytes > m_highWater) {
+            m_highWater = m_offset + m_overflowBytes;
+        }
+        return m_base + start;
+    }
+
+    // keep serving this frame, the next reset() makes the arena big enough
+    size_t offset = (OVERFLOW_HEADER_SIZE + alignment - 1) & ~(alignment - 1);
+    void*  chunk  = poolMalloc(offset + size, alignment < 64 ? 64 : alignment);
+    if (!chunk) {
+        throw std::bad_alloc();
+    }
+    Overflow* overflow = static_cast<Overflow*>(chunk);
+    overflow->next = m_overflow;
+    m_overflow     = overflow;
+
+    m_overflowBytes += size + alignment;
+    m_overflowCount++;
+    if (m_offset + m_overflowBytes > m_highWater) {
+        m_highWater = m_offset + m_overflowBytes;
+    }
+    return static_cast<char*>(chunk) + offset;
+}
+
+void LinearArena::reset() {
+    _freeOverflow();
+    m_offset = 0;
+
+    if (m_highWater > m_capacity) {
+        size_t capacity = m_highWater + m_highWater / 2;
+        if (void* base = poolMalloc(capacity, 64)) {
+            poolFree(m_base);
+            m_base     = static_cast<char*>(base);
+            m_capacity = capacity;
+        }
+    }
+}
+
+void LinearArena::_freeOverflow() {
+    while (m_overflow) {
+        Overflow* next = m_overflow->next;
+        poolFree(m_overflow);
+        m_overflow = next;
+    }
+    m_overflowBytes = 0;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+/* Linear scratch arena and heap allocation counter, see lcbhss_arena.cpp */
+
+#include <new>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Bump allocator for data that dies all at once, e.g. everything a frame
+// builds on the CPU. reset() rewinds it; nothing is destructed, so only
+// trivially destructible types belong in here. A request that does not fit
+// is served from the pool and the arena grows to the high-water mark on
+// the next reset(), after which the same workload causes no heap traffic.
+class LinearArena {
+public:
+    explicit LinearArena(size_t capacity = 64 * 1024);
+    ~LinearArena();
+    LinearArena(const LinearArena&)            = delete;
+    LinearArena& operator=(const LinearArena&) = delete;
+
+    // alignment must be a power of two
+    void* allocate(size_t size, size_t alignment = 16);
+
+    template<typename T>
+    T* allocArray(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value,
+            "arena memory is never destructed");
+        T* data = static_cast<T*>(allocate(count * sizeof(T),
+            alignof(T) < 16 ? 16 : alignof(T)));
+        for (size_t i = 0; i < count; i++) {
+            new (data + i) T();
+        }
+        return data;
+    }
+
+    void reset();
+
+    size_t   used()          const { return m_offset + m_overflowBytes; }
+    size_t   capacity()      const { return m_capacity; }
+    size_t   highWater()     const { return m_highWater; }
+    uint32_t overflowCount() const { return m_overflowCount; }
+
+private:
+    struct Overflow {
+        Overflow* next;
+    };
+
+    void _freeOverflow();
+
+    char*     m_base          = nullptr;
+    size_t    m_capacity      = 0;
+    size_t    m_offset        = 0;
+    size_t    m_highWater     = 0;
+
+    Overflow* m_overflow      = nullptr;
+    size_t    m_overflowBytes = 0;
+    uint32_t  m_overflowCount = 0;
+};
+
+template<typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(LinearArena& arena) noexcept : m_arena(&arena) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : m_arena(other.arena()) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(m_arena->allocate(n * sizeof(T),
+            alignof(T) < 16 ? 16 : alignof(T)));
+    }
+    void deallocate(T*, size_t) noexcept {}
+
+    LinearArena* arena() const noexcept { return m_arena; }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept { return m_arena == other.arena(); }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const noexcept { return m_arena != other.arena(); }
+
+private:
+    LinearArena* m_arena;
+};
+
+// reserve() up front: growing one of these leaves the old storage behind
+// in the arena until the next reset()
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// Heap allocations made by the calling thread: pool allocations always,
+// global operator new as well in _DEBUG builds, where it is replaced by a
+// counting version. Take the difference around a piece of code.
+uint64_t heapAllocationCount();
+void     countHeapAllocation();
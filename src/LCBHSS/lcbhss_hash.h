@@ -0,0 +1,12 @@
+#pragma once
+
+/* Content hashing, see lcbhss_hash.cpp */
+
+#include <cstddef>
+#include <cstdint>
+
+// XXH64 of `size` bytes: 32 bytes a step in four independent lanes, fast
+// enough to key resources by their whole contents. Matches the reference
+// implementation, so hashes can be checked with the xxhsum tool.
+uint64_t hash64(
+    const void* data, size_t size, uint64_t seed = 0);
@@ -0,0 +1,195 @@
+#include "lcbhss_lz4.h"
+
+#include <cstring>
+
+namespace {
+
+// the block format's end rules: the last 5 bytes are always literals and
+// the last match starts at least 12 bytes before the end
+constexpr size_t   MIN_MATCH     = 4;
+constexpr size_t   LAST_LITERALS = 5;
+constexpr size_t   MATCH_LIMIT   = 12;
+constexpr size_t   MAX_OFFSET    = 65535;
+constexpr uint32_t HASH_BITS     = 13;
+
+uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// length in the token nibble, the rest as 255 runs; false when out of room
+bool writeLength(uint8_t*& op, const uint8_t* end, size_t length) {
+    for (; length >= 255; length -= 255) {
+        if (op == end) {
+            return false;
+        }
+        *op++ = 255;
+    }
+    if (op == end) {
+        return false;
+    }
+    *op++ = static_cast<uint8_t>(length);
+    return true;
+}
+
+bool writeSequence(
+    uint8_t*& op, const uint8_t* end,
+    const uint8_t* literals, size_t literalCount,
+    size_t offset, size_t matchLength     // 0 for the closing literals
+) {
+    if (op == end) {
+        return false;
+    }
+    uint8_t* token = op++;
+    *token = static_cast<uint8_t>((literalCount >= 15 ? 15 : literalCount) << 4);
+    if (literalCount >= 15 && !writeLength(op, end, literalCount - 15)) {
+        return false;
+    }
+    if (literalCount > static_cast<size_t>(end - op)) {
+        return false;
+    }
+    // empty buffers may come as null pointers, memcpy must not see them
+    if (literalCount > 0) {
+        memcpy(op, literals, literalCount);
+        op += literalCount;
+    }
+    if (matchLength == 0) {
+        return true;
+    }
+
+    if (end - op < 2) {
+        return false;
+    }
+    *op++ = static_cast<uint8_t>(offset);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+    size_t length = matchLength - MIN_MATCH;
+    *token |= static_cast<uint8_t>(length >= 15 ? 15 : length);
+    return length < 15 || writeLength(op, end, length - 15);
+}
+
+}
+
+size_t lz4CompressBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+size_t lz4Compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity) {
+    uint8_t*       op     = dst;
+    const uint8_t* end    = dst + capacity;
+    size_t         anchor = 0;
+
+    if (size > MATCH_LIMIT) {
+        uint32_t table[1u << HASH_BITS] = {};
+        size_t   limit    = size - MATCH_LIMIT;
+        size_t   matchEnd = size - LAST_LITERALS;
+
+        size_t ip = 1;
+        while (ip < limit) {
+            uint32_t sequence = read32(src + ip);
+            uint32_t& slot    = table[hash(sequence)];
+            size_t    ref     = slot;
+            slot = static_cast<uint32_t>(ip);
+            if (ip - ref > MAX_OFFSET || read32(src + ref) != sequence) {
+                // skip faster through data that does not match
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                ip--;
+                ref--;
+            }
+            size_t length = MIN_MATCH;
+            while (ip + length < matchEnd && src[ip + length] == src[ref + length]) {
+                length++;
+            }
+            if (!writeSequence(op, end, src + anchor, ip - anchor, ip - ref, length)) {
+                return 0;
+            }
+            ip    += length;
+            anchor = ip;
+            if (ip - 2 < limit) {
+                table[hash(read32(src + ip - 2))] = static_cast<uint32_t>(ip - 2);
+            }
+        }
+    }
+    if (!writeSequence(op, end, src + anchor, size - anchor, 0, 0)) {
+        return 0;
+    }
+    return static_cast<size_t>(op - dst);
+}
+
+bool lz4Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+    const uint8_t* ip     = src;
+    const uint8_t* ipEnd  = src + srcSize;
+    uint8_t*       op     = dst;
+    uint8_t*       opEnd  = dst + dstSize;
+
+    auto readLength = [&](size_t& length) {
+        uint8_t byte;
+        do {
+            if (ip == ipEnd) {
+                return false;
+            }
+            byte    = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    for (;;) {
+        if (ip == ipEnd) {
+            return false;
+        }
+        uint8_t token    = *ip++;
+        size_t  literals = token >> 4;
+        if (literals == 15 && !readLength(literals)) {
+            return false;
+        }
+        if (literals > static_cast<size_t>(ipEnd - ip) ||
+            literals > static_cast<size_t>(opEnd - op)) {
+            return false;
+        }
+        if (literals > 0) {
+            memcpy(op, ip, literals);
+            ip += literals;
+            op += literals;
+        }
+        if (ip == ipEnd) {
+            break;
+        }
+
+        if (ipEnd - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        size_t length = token & 15;
+        if (length == 15 && !readLength(length)) {
+            return false;
+        }
+        length += MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst) ||
+            length > static_cast<size_t>(opEnd - op)) {
+            return false;
+        }
+
+        // overlapping matches repeat the bytes they have just written
+        const uint8_t* match = op - offset;
+        if (offset >= length) {
+            memcpy(op, match, length);
+            op += length;
+        }
+        else {
+            for (size_t i = 0; i < length; i++) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return op == opEnd;
+}
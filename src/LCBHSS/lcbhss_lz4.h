@@ -0,0 +1,20 @@
+#pragma once
+
+/* LZ4 block compression, see lcbhss_lz4.cpp */
+
+#include <cstddef>
+#include <cstdint>
+
+// Raw LZ4 blocks (no frame header, no checksum), readable by any LZ4 block
+// decoder. The compressor is the single pass greedy one LZ4 itself uses
+// for its fast mode; decoding is bounds checked against both buffers.
+
+// worst case compressed size of `size` bytes
+size_t lz4CompressBound(
+    size_t size);
+// compressed size, 0 when the result would not fit `capacity`
+size_t lz4Compress(
+    const uint8_t* src, size_t size, uint8_t* dst, size_t capacity);
+// false unless `src` decodes to exactly `dstSize` bytes
+bool   lz4Decompress(
+    const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
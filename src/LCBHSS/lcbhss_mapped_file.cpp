@@ -0,0 +1,213 @@
+#include "lcbhss_mapped_file.h"
+#include "lcbhss_pack.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& fileName) {
+    close();
+
+    const AssetPack* pack  = mountedAssetPack();
+    const PackEntry* entry = pack ? pack->find(fileName) : nullptr;
+    if (!entry) {
+        return openFromDisk(fileName);
+    }
+    if (entry->size == 0) {
+        return false;
+    }
+
+    if (entry->flags & PACK_ENTRY_STORED) {
+        m_data = pack->mapped(*entry);
+    }
+    else {
+        m_owned.reset(new uint8_t[static_cast<size_t>(entry->size)]);
+        if (!pack->read(*entry, m_owned.get())) {
+            m_owned.reset();
+            return false;
+        }
+        m_data = m_owned.get();
+    }
+    m_size = static_cast<size_t>(entry->size);
+    return true;
+}
+
+bool fileStamp(const std::string& fileName, uint64_t& size, uint64_t& writeTime) {
+    const AssetPack* pack  = mountedAssetPack();
+    const PackEntry* entry = pack ? pack->find(fileName) : nullptr;
+    if (entry) {
+        size      = entry->size;
+        writeTime = entry->sourceTime;
+        return true;
+    }
+    return fileStampOnDisk(fileName, size, writeTime);
+}
+
+bool fileStampOnDisk(const std::string& fileName, uint64_t& size, uint64_t& writeTime) {
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(fileName.c_str(), &info) != 0) {
+        return false;
+    }
+#else
+    struct stat info;
+    if (stat(fileName.c_str(), &info) != 0) {
+        return false;
+    }
+#endif
+    size      = static_cast<uint64_t>(info.st_size);
+    writeTime = static_cast<uint64_t>(info.st_mtime);
+    return true;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::openFromDisk(const std::string& fileName) {
+    close();
+
+    HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ,
+        nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void*  view    = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+
+    m_file    = file;
+    m_mapping = mapping;
+    m_mapped  = true;
+    m_data    = static_cast<const uint8_t*>(view);
+    m_size    = static_cast<size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+    if (m_mapped) {
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+    }
+    m_owned.reset();
+    m_mapped  = false;
+    m_data    = nullptr;
+    m_size    = 0;
+    m_file    = nullptr;
+    m_mapping = nullptr;
+}
+
+bool listFiles(const std::string& directory, std::vector<std::string>& files) {
+    WIN32_FIND_DATAA found;
+    HANDLE find = FindFirstFileA((directory + "/*").c_str(), &found);
+    if (find == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    do {
+        std::string name = found.cFileName;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            listFiles(directory + "/" + name, files);
+        }
+        else {
+            files.push_back(directory + "/" + name);
+        }
+    } while (FindNextFileA(find, &found));
+    FindClose(find);
+    return true;
+}
+
+#else
+
+bool MappedFile::openFromDisk(const std::string& fileName) {
+    close();
+
+    int file = ::open(fileName.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0) {
+        ::close(file);
+        return false;
+    }
+
+    // the mapping keeps its own reference to the file
+    void* view = mmap(nullptr, static_cast<size_t>(info.st_size),
+        PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+
+    m_mapped = true;
+    m_data   = static_cast<const uint8_t*>(view);
+    m_size   = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (m_mapped) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+    m_owned.reset();
+    m_mapped = false;
+    m_data   = nullptr;
+    m_size   = 0;
+}
+
+bool listFiles(const std::string& directory, std::vector<std::string>& files) {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        return false;
+    }
+    while (dirent* found = readdir(dir)) {
+        std::string name = found->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        std::string path = directory + "/" + name;
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            continue;
+        }
+        if (S_ISDIR(info.st_mode)) {
+            listFiles(path, files);
+        }
+        else if (S_ISREG(info.st_mode)) {
+            files.push_back(path);
+        }
+    }
+    closedir(dir);
+    return true;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#pragma once
+
+/* Read-only memory mapped files, see lcbhss_mapped_file.cpp */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+// Maps a whole file read-only. Pages are faulted in on first touch and
+// shared with the OS file cache, so a file read a moment ago costs no copy
+// and no I/O. Empty files cannot be mapped.
+//
+// open() looks in the mounted asset pack first (see lcbhss_pack.h): an
+// entry stored uncompressed is used in place in the pack's mapping, a
+// compressed one is decompressed into memory the MappedFile owns.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // false when the file is missing, empty or cannot be mapped
+    bool open(const std::string& fileName);
+    // the file on disk, even when a mounted pack has it
+    bool openFromDisk(const std::string& fileName);
+    void close();
+
+    const uint8_t* data()   const { return m_data; }
+    size_t         size()   const { return m_size; }
+    bool           isOpen() const { return m_data != nullptr; }
+
+private:
+    const uint8_t* m_data    = nullptr;
+    size_t         m_size    = 0;
+    bool           m_mapped  = false;       // m_data is this file's own mapping
+    std::unique_ptr<uint8_t[]> m_owned;     // a decompressed pack entry
+#ifdef _WIN32
+    void*          m_file    = nullptr;
+    void*          m_mapping = nullptr;
+#endif
+};
+
+// size and last write time of a file, false when it does not exist; for a
+// file in the mounted pack those of the file the pack was built from
+bool fileStamp(const std::string& fileName, uint64_t& size, uint64_t& writeTime);
+bool fileStampOnDisk(const std::string& fileName, uint64_t& size, uint64_t& writeTime);
+
+// appends the regular files below `directory` as "directory/sub/name",
+// false when it can not be read
+bool listFiles(const std::string& directory, std::vector<std::string>& files);
@@ -0,0 +1,412 @@
+#include "lcbhss_pack.h"
+#include "lcbhss_lz4.h"
+#include "lcbhss_hash.h"
+#include "lcbhss_space.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+std::unique_ptr<AssetPack> g_mountedPack;
+
+std::string normalizePath(const std::string& path) {
+    std::string normal;
+    normal.reserve(path.size());
+    for (char c : path) {
+        if (c == '\\') {
+            c = '/';
+        }
+        if (c == '/' && !normal.empty() && normal.back() == '/') {
+            continue;
+        }
+        normal.push_back(static_cast<char>(tolower(static_cast<unsigned char>(c))));
+    }
+    while (normal.compare(0, 2, "./") == 0) {
+        normal.erase(0, 2);
+    }
+    return normal;
+}
+
+uint64_t fnv1a(const std::string& text) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : text) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// read as they are stored or already compressed
+bool storedUncompressed(const std::string& path) {
+    static const char* const EXTENSIONS[] = { ".dds", ".vkmesh", ".png", ".jpg", ".jpeg" };
+    for (const char* extension : EXTENSIONS) {
+        size_t length = strlen(extension);
+        if (path.size() >= length &&
+            path.compare(path.size() - length, length, extension) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t chunkCount(uint64_t size) {
+    return static_cast<uint32_t>((size + PACK_CHUNK_SIZE - 1) / PACK_CHUNK_SIZE);
+}
+
+// runs body(i) for i in [0, count) on up to `threads` threads
+template<typename Body>
+void parallelFor(uint32_t count, uint32_t threads, const Body& body) {
+    std::atomic<uint32_t> next(0);
+    auto work = [&] {
+        for (uint32_t i = next++; i < count; i = next++) {
+            body(i);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < threads; i++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+uint32_t defaultThreads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+}
+
+uint64_t packPathHash(const std::string& path) {
+    return fnv1a(normalizePath(path));
+}
+
+bool AssetPack::open(const std::string& fileName) {
+    close();
+    if (!m_file.openFromDisk(fileName) || m_file.size() < sizeof(PackHeader)) {
+        m_file.close();
+        return false;
+    }
+
+    const uint8_t*    data   = m_file.data();
+    uint64_t          size   = m_file.size();
+    const PackHeader* header = reinterpret_cast<const PackHeader*>(data);
+    bool valid =
+        memcmp(header->magic, PACK_MAGIC, sizeof(PACK_MAGIC)) == 0 &&
+        header->version   == PACK_VERSION &&
+        header->chunkSize == PACK_CHUNK_SIZE &&
+        header->fileSize  == size &&
+        header->entryOffset % 8 == 0 && header->chunkOffset % 8 == 0 &&
+        header->chunkOffset + uint64_t(header->chunkCount) * sizeof(PackChunk) <= size &&
+        header->entryOffset + uint64_t(header->entryCount) * sizeof(PackEntry) <= size &&
+        header->nameOffset  + header->nameBytes <= size &&
+        (header->nameBytes == 0 || data[header->nameOffset + header->nameBytes - 1] == '\0');
+
+    const PackEntry* entries = reinterpret_cast<const PackEntry*>(data + header->entryOffset);
+    const PackChunk* chunks  = reinterpret_cast<const PackChunk*>(data + header->chunkOffset);
+    for (uint32_t i = 0; valid && i < header->entryCount; i++) {
+        const PackEntry& entry = entries[i];
+        valid = entry.nameOffset < header->nameBytes;
+        if (entry.flags & PACK_ENTRY_STORED) {
+            valid = valid && entry.offset + entry.size <= size;
+        }
+        else {
+            valid = valid && entry.offset + chunkCount(entry.size) <= header->chunkCount;
+        }
+    }
+    for (uint32_t i = 0; valid && i < header->chunkCount; i++) {
+        valid = chunks[i].compressedSize <= PACK_CHUNK_SIZE &&
+            chunks[i].offset + chunks[i].compressedSize <= size;
+    }
+    if (!valid) {
+        Log("pack: %s is not a valid pack", fileName.c_str());
+        m_file.close();
+        return false;
+    }
+
+    m_header  = header;
+    m_entries = entries;
+    m_chunks  = chunks;
+    m_names   = reinterpret_cast<const char*>(data + header->nameOffset);
+    return true;
+}
+
+void AssetPack::close() {
+    m_file.close();
+    m_header  = nullptr;
+    m_entries = nullptr;
+    m_chunks  = nullptr;
+    m_names   = nullptr;
+}
+
+const PackEntry* AssetPack::find(const std::string& path) const {
+    if (!m_header) {
+        return nullptr;
+    }
+    std::string normal = normalizePath(path);
+    uint64_t    hash   = fnv1a(normal);
+    const PackEntry* end   = m_entries + m_header->entryCount;
+    const PackEntry* entry = std::lower_bound(m_entries, end, hash,
+        [](const PackEntry& e, uint64_t h) { return e.hash < h; });
+    for (; entry != end && entry->hash == hash; entry++) {
+        if (normal == name(*entry)) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+bool AssetPack::_readChunk(const PackEntry& entry, uint32_t index, uint8_t* dst) const {
+    const PackChunk& chunk = m_chunks[entry.offset + index];
+    uint64_t         first = uint64_t(index) * PACK_CHUNK_SIZE;
+    size_t           size  = static_cast<size_t>(
+        std::min<uint64_t>(PACK_CHUNK_SIZE, entry.size - first));
+    const uint8_t*   src   = m_file.data() + chunk.offset;
+
+    if (chunk.compressedSize == size) {
+        memcpy(dst + first, src, size);
+        return true;
+    }
+    return lz4Decompress(src, chunk.compressedSize, dst + first, size);
+}
+
+bool AssetPack::read(const PackEntry& entry, void* dst, uint32_t threads) const {
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    if (entry.flags & PACK_ENTRY_STORED) {
+        memcpy(out, mapped(entry), static_cast<size_t>(entry.size));
+        return true;
+    }
+
+    // a thread is only worth starting for a few chunks
+    uint32_t chunks = chunkCount(entry.size);
+    threads = std::min(threads ? threads : defaultThreads(), std::max(1u, chunks / 4));
+
+    std::atomic<bool> intact(true);
+    parallelFor(chunks, threads, [&](uint32_t i) {
+        if (!_readChunk(entry, i, out)) {
+            intact = false;
+        }
+    });
+    return intact;
+}
+
+void buildAssetPack(const std::string& fileName, const std::vector<std::string>& directories) {
+    auto begin = std::chrono::high_resolution_clock::now();
+
+    struct Source {
+        std::string name;               // normalized
+        MappedFile  file;
+        uint64_t    size       = 0;
+        uint64_t    time       = 0;
+        uint64_t    hash       = 0;
+        bool        stored     = false;
+        uint64_t    offset     = 0;
+        uint32_t    firstChunk = 0;
+    };
+    std::vector<std::string> paths;
+    for (const std::string& directory : directories) {
+        std::string root = directory;
+        while (root.size() > 1 && (root.back() == '/' || root.back() == '\\')) {
+            root.pop_back();
+        }
+        if (!listFiles(root, paths)) {
+            throw std::runtime_error("failed to list " + directory);
+        }
+    }
+    std::string packName = normalizePath(fileName);
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<std::unique_ptr<Source>> sources;
+    for (const std::string& path : paths) {
+        std::string name = normalizePath(path);
+        if (name == packName || name == packName + ".tmp") {
+            continue;
+        }
+        std::unique_ptr<Source> source(new Source());
+        source->name = name;
+        // a mounted pack must not feed the new one
+        if (!fileStampOnDisk(path, source->size, source->time) || source->size == 0) {
+            continue;
+        }
+        if (!source->file.openFromDisk(path)) {
+            throw std::runtime_error("failed to map " + path);
+        }
+        source->stored = storedUncompressed(name);
+        sources.push_back(std::move(source));
+    }
+
+    // entries sorted by hash, distinct names never share one in practice
+    std::sort(sources.begin(), sources.end(),
+        [](const std::unique_ptr<Source>& a, const std::unique_ptr<Source>& b) {
+            return fnv1a(a->name) < fnv1a(b->name);
+        });
+    for (size_t i = 1; i < sources.size(); i++) {
+        if (fnv1a(sources[i - 1]->name) == fnv1a(sources[i]->name)) {
+            throw std::runtime_error("failed to pack, " + sources[i - 1]->name +
+                " and " + sources[i]->name + " share a hash");
+        }
+    }
+
+    parallelFor(static_cast<uint32_t>(sources.size()), defaultThreads(), [&](uint32_t i) {
+        sources[i]->hash = hash64(sources[i]->file.data(), static_cast<size_t>(sources[i]->size));
+    });
+
+    // compress every chunk of every compressed file at once
+    struct ChunkJob {
+        const Source*        source;
+        uint32_t             index;
+        std::vector<uint8_t> data;      // empty when kept raw
+    };
+    std::vector<ChunkJob> chunks;
+    for (auto& source : sources) {
+        if (source->stored) {
+            continue;
+        }
+        source->firstChunk = static_cast<uint32_t>(chunks.size());
+        for (uint32_t i = 0; i < chunkCount(source->size); i++) {
+            chunks.push_back({ source.get(), i, {} });
+        }
+    }
+    parallelFor(static_cast<uint32_t>(chunks.size()), defaultThreads(), [&](uint32_t i) {
+        ChunkJob& job   = chunks[i];
+        uint64_t  first = uint64_t(job.index) * PACK_CHUNK_SIZE;
+        size_t    size  = static_cast<size_t>(
+            std::min<uint64_t>(PACK_CHUNK_SIZE, job.source->size - first));
+        job.data.resize(size - 1);
+        size_t compressed = lz4Compress(job.source->file.data() + first, size,
+            job.data.data(), job.data.size());
+        job.data.resize(compressed);
+    });
+
+    PackHeader header = {};
+    memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+    header.version    = PACK_VERSION;
+    header.entryCount = static_cast<uint32_t>(sources.size());
+    header.chunkCount = static_cast<uint32_t>(chunks.size());
+    header.chunkSize  = PACK_CHUNK_SIZE;
+
+    std::string tempName = fileName + ".tmp";
+    uint64_t    storedBytes = 0, packedBytes = 0, compressibleBytes = 0;
+    {
+        std::ofstream file(tempName, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("failed to create " + tempName);
+        }
+
+        uint64_t written = 0;
+        auto put = [&](const void* data, uint64_t size) {
+            file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            written += size;
+        };
+        auto pad = [&](uint64_t alignment) {
+            static const char zeros[PACK_PAYLOAD_ALIGNMENT] = {};
+            put(zeros, alignUp(written, alignment) - written);
+        };
+        put(&header, sizeof(header));
+
+        for (auto& source : sources) {
+            if (source->stored) {
+                pad(PACK_PAYLOAD_ALIGNMENT);
+                source->offset = written;
+                put(source->file.data(), source->size);
+                storedBytes += source->size;
+            }
+        }
+
+        std::vector<PackChunk> table(chunks.size());
+        for (size_t i = 0; i < chunks.size(); i++) {
+            const ChunkJob& job   = chunks[i];
+            uint64_t        first = uint64_t(job.index) * PACK_CHUNK_SIZE;
+            uint64_t        size  = std::min<uint64_t>(PACK_CHUNK_SIZE, job.source->size - first);
+            table[i].offset = written;
+            if (job.data.empty()) {
+                table[i].compressedSize = static_cast<uint32_t>(size);
+                put(job.source->file.data() + first, size);
+            }
+            else {
+                table[i].compressedSize = static_cast<uint32_t>(job.data.size());
+                put(job.data.data(), job.data.size());
+            }
+            compressibleBytes += size;
+            packedBytes       += table[i].compressedSize;
+        }
+        pad(8);
+        header.chunkOffset = written;
+        put(table.data(), table.size() * sizeof(PackChunk));
+
+        std::vector<PackEntry> entries(sources.size());
+        std::string            names;
+        for (size_t i = 0; i < sources.size(); i++) {
+            const Source& source = *sources[i];
+            entries[i].hash        = fnv1a(source.name);
+            entries[i].size        = source.size;
+            entries[i].offset      = source.stored ? source.offset : source.firstChunk;
+            entries[i].sourceTime  = source.time;
+            entries[i].contentHash = source.hash;
+            entries[i].nameOffset  = static_cast<uint32_t>(names.size());
+            entries[i].flags       = source.stored ? PACK_ENTRY_STORED : 0;
+            names.append(source.name.c_str(), source.name.size() + 1);
+        }
+        header.entryOffset = written;
+        put(entries.data(), entries.size() * sizeof(PackEntry));
+        header.nameOffset  = written;
+        header.nameBytes   = static_cast<uint32_t>(names.size());
+        put(names.data(), names.size());
+        header.fileSize    = written;
+
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!file) {
+            file.close();
+            std::remove(tempName.c_str());
+            throw std::runtime_error("failed to write " + tempName);
+        }
+    }
+
+    // rename does not replace an existing file on Windows
+    std::remove(fileName.c_str());
+    if (std::rename(tempName.c_str(), fileName.c_str()) != 0) {
+        std::remove(tempName.c_str());
+        throw std::runtime_error("failed to replace " + fileName);
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - begin).count();
+    Log("pack: wrote %s, %u files, %.2f MB stored, %.2f MB in %u chunks packed to %.2f MB (%.0f%%), %.2f MB total in %.1f ms",
+        fileName.c_str(), header.entryCount, storedBytes / 1048576.0,
+        compressibleBytes / 1048576.0, header.chunkCount, packedBytes / 1048576.0,
+        packedBytes * 100.0 / std::max<uint64_t>(compressibleBytes, 1),
+        header.fileSize / 1048576.0, ms);
+}
+
+bool mountAssetPack(const std::string& fileName) {
+    std::unique_ptr<AssetPack> pack(new AssetPack());
+    if (!pack->open(fileName)) {
+        return false;
+    }
+    g_mountedPack = std::move(pack);
+    Log("pack: mounted %s, %u files", fileName.c_str(), g_mountedPack->entryCount());
+    return true;
+}
+
+void unmountAssetPack() {
+    g_mountedPack.reset();
+}
+
+const AssetPack* mountedAssetPack() {
+    return g_mountedPack.get();
+}
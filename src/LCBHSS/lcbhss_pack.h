@@ -0,0 +1,108 @@
+#pragma once
+
+/* Asset pack files, see lcbhss_pack.cpp */
+
+#include "lcbhss_mapped_file.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// One file holding the contents of asset directories, mapped whole at run
+// time. Files that are read as they are stored (DDS textures, cooked
+// meshes) or that do not compress (PNG, JPEG) are stored uncompressed at
+// PACK_PAYLOAD_ALIGNMENT, so their bytes are used in place in the mapping.
+// Everything else is cut into PACK_CHUNK_SIZE chunks compressed one by one
+// as LZ4 blocks; a chunk LZ4 would not shrink is kept raw. Chunks
+// decompress independently, so a large file fans out over threads.
+//
+// File layout: PackHeader, the stored payloads, the compressed chunks, then
+// the chunk table, the entry table sorted by hash and the names. Entries
+// are found by the hash of their path normalized to lower case with '/'
+// separators, and carry the hash64() of their contents.
+
+const char     PACK_MAGIC[4]          = { 'V', 'K', 'P', 'K' };
+const uint32_t PACK_VERSION           = 2;
+const uint32_t PACK_CHUNK_SIZE        = 64 * 1024;
+const uint32_t PACK_PAYLOAD_ALIGNMENT = 4096;
+
+const uint32_t PACK_ENTRY_STORED      = 0x1;
+
+struct PackHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t chunkCount;
+    uint32_t chunkSize;
+    uint32_t nameBytes;
+    uint64_t entryOffset;
+    uint64_t chunkOffset;
+    uint64_t nameOffset;
+    uint64_t fileSize;
+};
+
+struct PackEntry {
+    uint64_t hash;
+    uint64_t size;
+    uint64_t offset;        // of the payload when stored, else the first chunk
+    uint64_t sourceTime;    // last write time of the packed file
+    uint64_t contentHash;
+    uint32_t nameOffset;
+    uint32_t flags;
+};
+
+struct PackChunk {
+    uint64_t offset;
+    uint32_t compressedSize;    // equal to the chunk's size when kept raw
+    uint32_t reserved;
+};
+
+static_assert(sizeof(PackHeader) == 56, "pack header layout");
+static_assert(sizeof(PackEntry)  == 48, "pack entry layout");
+static_assert(sizeof(PackChunk)  == 16, "pack chunk layout");
+
+uint64_t packPathHash(
+    const std::string& path);
+
+class AssetPack {
+public:
+    // false when the file is missing or not a valid pack
+    bool open(const std::string& fileName);
+    void close();
+    bool isOpen() const { return m_header != nullptr; }
+
+    // nullptr when the pack does not hold `path`
+    const PackEntry* find(const std::string& path) const;
+    // the bytes of a PACK_ENTRY_STORED entry in the mapping
+    const uint8_t*   mapped(const PackEntry& entry) const { return m_file.data() + entry.offset; }
+    // copies or decompresses the whole entry, over up to `threads` threads
+    // (0 for one per core); false when a chunk is corrupt
+    bool             read(const PackEntry& entry, void* dst, uint32_t threads = 0) const;
+
+    uint32_t         entryCount()           const { return m_header ? m_header->entryCount : 0; }
+    const PackEntry& entry(uint32_t index)  const { return m_entries[index]; }
+    const char*      name(const PackEntry& entry) const { return m_names + entry.nameOffset; }
+
+private:
+    bool _readChunk(const PackEntry& entry, uint32_t index, uint8_t* dst) const;
+
+    MappedFile        m_file;
+    const PackHeader* m_header  = nullptr;
+    const PackEntry*  m_entries = nullptr;
+    const PackChunk*  m_chunks  = nullptr;
+    const char*       m_names   = nullptr;
+};
+
+// Packs every file below `directories`, stored under its path as given
+// ("textures/a.png"). Throws when a file can not be read or the pack can
+// not be written.
+void buildAssetPack(
+    const std::string& fileName, const std::vector<std::string>& directories);
+
+// The pack MappedFile::open(), fileStamp() and readFile() look in before
+// the disk, so it shadows the loose files it holds. Mount before and
+// unmount after every file opened from it; neither is thread safe.
+bool             mountAssetPack(
+    const std::string& fileName);
+void             unmountAssetPack();
+const AssetPack* mountedAssetPack();
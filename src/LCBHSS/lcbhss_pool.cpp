@@ -0,0 +1,455 @@
+#include "lcbhss_pool.h"
+#include "lcbhss_arena.h"
+#include "lcbhss_space.h"
+
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+
+namespace {
+
+// Layout: every span is POOL_SPAN_SIZE aligned and starts with its header,
+// so the header of any block is found by masking the block address. Small
+// spans are split into equal blocks behind the header; a large allocation
+// is one block behind the header of a span of its own size.
+constexpr uint32_t SMALL_CLASS_COUNT = 36;
+constexpr uint32_t LARGE_CLASS       = UINT32_MAX;
+constexpr size_t   SPAN_HEADER_SIZE  = 128;
+constexpr size_t   SPAN_CACHE_LIMIT  = 32;
+
+struct ThreadHeap;
+
+struct Span {
+    ThreadHeap*           owner;
+    uint32_t              sizeClass;
+    uint32_t              blockSize;
+    uint32_t              capacity;
+    uint32_t              used;            // includes blocks on remoteFree
+    uint32_t              bumped;          // blocks never handed out start here
+    bool                  inPartial;
+    void*                 freeList;
+    Span*                 prev;            // owner's partial list
+    Span*                 next;
+    size_t                largeSize;
+    std::atomic<void*>    remoteFree;
+    std::atomic<bool>     queued;          // on the owner's delayed list
+    std::atomic<uint32_t> remoteWriters;   // threads inside freeRemote
+    Span*                 nextDelayed;
+};
+static_assert(sizeof(Span) <= SPAN_HEADER_SIZE, "span header too large");
+
+struct ThreadHeap {
+    Span*               active[SMALL_CLASS_COUNT];
+    Span*               partial[SMALL_CLASS_COUNT];
+    // spans that received remote frees, pushed by the freeing threads
+    std::atomic<Span*>  delayed;
+    ThreadHeap*         nextRetired;
+};
+
+// never destroyed: blocks may still be freed while statics are torn down
+struct PoolGlobals {
+    std::mutex          mutex;
+    std::vector<Span*>  spanCache;
+    ThreadHeap*         retiredHeaps = nullptr;
+
+    std::atomic<size_t> spanCount  { 0 };
+    std::atomic<size_t> largeCount { 0 };
+    std::atomic<size_t> largeBytes { 0 };
+};
+
+PoolGlobals& globals() {
+    static PoolGlobals* g = new PoolGlobals;
+    return *g;
+}
+
+// 16 byte steps up to 128, then four classes per power of two; a constant
+// table so allocations made during static initialization find it filled in
+const uint32_t s_classSize[SMALL_CLASS_COUNT] = {
+       16,    32,    48,    64,    80,    96,   112,   128,
+      160,   192,   224,   256,   320,   384,   448,   512,
+      640,   768,   896,  1024,  1280,  1536,  1792,  2048,
+     2560,  3072,  3584,  4096,  5120,  6144,  7168,  8192,
+    10240, 12288, 14336, 16384
+};
+
+uint32_t sizeToClass(size_t size) {
+    if (size <= 128) {
+        return size == 0 ? 0 : static_cast<uint32_t>((size - 1) / 16);
+    }
+    uint32_t lg = 7;
+    while ((size_t(1) << (lg + 1)) < size) {
+        lg++;
+    }
+    size_t quarter = (size_t(1) << lg) / 4;
+    uint32_t step  = static_cast<uint32_t>(
+        (size - (size_t(1) << lg) + quarter - 1) / quarter);
+    return 8 + (lg - 7) * 4 + (step - 1);
+}
+
+void* osAlloc(size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, POOL_SPAN_SIZE);
+#else
+    return aligned_alloc(POOL_SPAN_SIZE,
+        (size + POOL_SPAN_SIZE - 1) & ~(POOL_SPAN_SIZE - 1));
+#endif
+}
+
+void osFree(void* data) {
+#ifdef _WIN32
+    _aligned_free(data);
+#else
+    std::free(data);
+#endif
+}
+
+Span* spanOf(const void* data) {
+    return reinterpret_cast<Span*>(
+        reinterpret_cast<uintptr_t>(data) & ~uintptr_t(POOL_SPAN_SIZE - 1));
+}
+
+char* spanData(Span* span) {
+    return reinterpret_cast<char*>(span) + SPAN_HEADER_SIZE;
+}
+
+//-----------------------------------------------------------------------------
+// thread heaps are handed over to the next thread on exit instead of being
+// destroyed, spans never outlive the heap they point to
+
+thread_local ThreadHeap* t_heap = nullptr;
+
+struct HeapRetirer {
+    ~HeapRetirer() {
+        if (!t_heap) {
+            return;
+        }
+        PoolGlobals& g = globals();
+        std::lock_guard<std::mutex> lock(g.mutex);
+        t_heap->nextRetired = g.retiredHeaps;
+        g.retiredHeaps      = t_heap;
+        t_heap              = nullptr;
+    }
+};
+thread_local HeapRetirer t_heapRetirer;
+
+ThreadHeap* localHeap() {
+    if (t_heap) {
+        return t_heap;
+    }
+    PoolGlobals& g = globals();
+    {
+        std::lock_guard<std::mutex> lock(g.mutex);
+        if (g.retiredHeaps) {
+            t_heap         = g.retiredHeaps;
+            g.retiredHeaps = t_heap->nextRetired;
+        }
+    }
+    if (!t_heap) {
+        t_heap = new ThreadHeap();
+        t_heap->delayed.store(nullptr, std::memory_order_relaxed);
+    }
+    (void)t_heapRetirer;        // odr-use so the destructor gets registered
+    return t_heap;
+}
+
+//-----------------------------------------------------------------------------
+
+void unlinkPartial(ThreadHeap* heap, Span* span) {
+    if (span->prev) {
+        span->prev->next = span->next;
+    }
+    else {
+        heap->partial[span->sizeClass] = span->next;
+    }
+    if (span->next) {
+        span->next->prev = span->prev;
+    }
+    span->prev = span->next = nullptr;
+    span->inPartial = false;
+}
+
+void linkPartial(ThreadHeap* heap, Span* span) {
+    span->prev = nullptr;
+    span->next = heap->partial[span->sizeClass];
+    if (span->next) {
+        span->next->prev = span;
+    }
+    heap->partial[span->sizeClass] = span;
+    span->inPartial = true;
+}
+
+void releaseSpan(ThreadHeap* heap, Span* span) {
+    if (span->inPartial) {
+        unlinkPartial(heap, span);
+    }
+    PoolGlobals& g = globals();
+    g.spanCount.fetch_sub(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(g.mutex);
+        if (g.spanCache.size() < SPAN_CACHE_LIMIT) {
+            g.spanCache.push_back(span);
+            return;
+        }
+    }
+    osFree(span);
+}
+
+// called by the owner for spans it is not allocating from
+void spanBecameFree(ThreadHeap* heap, Span* span) {
+    if (span == heap->active[span->sizeClass]) {
+        return;
+    }
+    // a queued span still sits on the delayed list and drainDelayed frees it,
+    // a remote writer may still touch the header after handing its block over
+    if (span->used == 0 &&
+        span->remoteWriters.load(std::memory_order_acquire) == 0 &&
+        !span->queued.load(std::memory_order_acquire)) {
+        releaseSpan(heap, span);
+    }
+    else if (!span->inPartial && span->used < span->capacity) {
+        linkPartial(heap, span);
+    }
+}
+
+Span* newSpan(ThreadHeap* heap, uint32_t sizeClass) {
+    PoolGlobals& g = globals();
+    Span* span = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(g.mutex);
+        if (!g.spanCache.empty()) {
+            span = g.spanCache.back();
+            g.spanCache.pop_back();
+        }
+    }
+    if (!span) {
+        span = static_cast<Span*>(osAlloc(POOL_SPAN_SIZE));
+        if (!span) {
+            return nullptr;
+        }
+    }
+    g.spanCount.fetch_add(1, std::memory_order_relaxed);
+
+    span->owner     = heap;
+    span->sizeClass = sizeClass;
+    span->blockSize = s_classSize[sizeClass];
+    span->capacity  = static_cast<uint32_t>(
+        (POOL_SPAN_SIZE - SPAN_HEADER_SIZE) / span->blockSize);
+    span->used      = 0;
+    span->bumped    = 0;
+    span->inPartial = false;
+    span->freeList  = nullptr;
+    span->prev      = span->next = nullptr;
+    span->largeSize = 0;
+    span->remoteFree.store(nullptr, std::memory_order_relaxed);
+    span->queued.store(false, std::memory_order_relaxed);
+    span->remoteWriters.store(0, std::memory_order_relaxed);
+    span->nextDelayed = nullptr;
+    return span;
+}
+
+void* popBlock(Span* span) {
+    void* block = span->freeList;
+    if (block) {
+        span->freeList = *static_cast<void**>(block);
+    }
+    else if (span->bumped < span->capacity) {
+        block = spanData(span) + size_t(span->bumped++) * span->blockSize;
+    }
+    else {
+        return nullptr;
+    }
+    span->used++;
+    return block;
+}
+
+void collectRemote(Span* span) {
+    void* block = span->remoteFree.exchange(nullptr, std::memory_order_acquire);
+    while (block) {
+        void* next = *static_cast<void**>(block);
+        *static_cast<void**>(block) = span->freeList;
+        span->freeList = block;
+        span->used--;
+        block = next;
+    }
+}
+
+void drainDelayed(ThreadHeap* heap) {
+    if (!heap->delayed.load(std::memory_order_relaxed)) {
+        return;
+    }
+    Span* span = heap->delayed.exchange(nullptr, std::memory_order_acquire);
+    while (span) {
+        Span* next = span->nextDelayed;
+        // clear before collecting, a free racing with us queues the span again
+        span->queued.store(false, std::memory_order_release);
+        collectRemote(span);
+        spanBecameFree(heap, span);
+        span = next;
+    }
+}
+
+void* allocSmallSlow(ThreadHeap* heap, uint32_t sizeClass) {
+    drainDelayed(heap);
+
+    Span* span = heap->active[sizeClass];
+    if (span) {
+        if (void* block = popBlock(span)) {
+            return block;
+        }
+    }
+    // the full active span drops out of every list until a block comes back
+    while ((span = heap->partial[sizeClass]) != nullptr) {
+        unlinkPartial(heap, span);
+        heap->active[sizeClass] = span;
+        if (void* block = popBlock(span)) {
+            return block;
+        }
+    }
+
+    span = newSpan(heap, sizeClass);
+    if (!span) {
+        return nullptr;
+    }
+    heap->active[sizeClass] = span;
+    return popBlock(span);
+}
+
+void* allocLarge(size_t size, size_t alignment) {
+    size_t offset = (SPAN_HEADER_SIZE + alignment - 1) & ~(alignment - 1);
+    Span*  span   = static_cast<Span*>(osAlloc(offset + size));
+    if (!span) {
+        return nullptr;
+    }
+    span->owner     = nullptr;
+    span->sizeClass = LARGE_CLASS;
+    span->largeSize = size;
+
+    PoolGlobals& g = globals();
+    g.largeCount.fetch_add(1, std::memory_order_relaxed);
+    g.largeBytes.fetch_add(size, std::memory_order_relaxed);
+    return reinterpret_cast<char*>(span) + offset;
+}
+
+void freeRemote(Span* span, void* block) {
+    // the block keeps the span alive until the owner collects it, the
+    // counter covers the header accesses after that
+    span->remoteWriters.fetch_add(1, std::memory_order_acq_rel);
+
+    void* head = span->remoteFree.load(std::memory_order_relaxed);
+    do {
+        *static_cast<void**>(block) = head;
+    } while (!span->remoteFree.compare_exchange_weak(
+        head, block, std::memory_order_release, std::memory_order_relaxed));
+
+    if (!span->queued.exchange(true, std::memory_order_acq_rel)) {
+        ThreadHeap* owner = span->owner;
+        Span* top = owner->delayed.load(std::memory_order_relaxed);
+        do {
+            span->nextDelayed = top;
+        } while (!owner->delayed.compare_exchange_weak(
+            top, span, std::memory_order_release, std::memory_order_relaxed));
+    }
+    span->remoteWriters.fetch_sub(1, std::memory_order_release);
+}
+
+}
+
+void* poolMalloc(size_t size, size_t alignment) {
+    if ((alignment & (alignment - 1)) || alignment > POOL_SPAN_SIZE / 2) {
+        return nullptr;
+    }
+    if (alignment < 16) {
+        alignment = 16;
+    }
+    countHeapAllocation();
+    if (size > POOL_MAX_SMALL || alignment > POOL_MAX_SMALL_ALIGN) {
+        return allocLarge(size, alignment);
+    }
+
+    // every block starts at a multiple of its class size behind a 128 byte
+    // header, so a class divisible by the alignment gives aligned blocks
+    uint32_t sizeClass = sizeToClass((size + alignment - 1) & ~(alignment - 1));
+    while (s_classSize[sizeClass] % alignment) {
+        sizeClass++;
+    }
+
+    ThreadHeap* heap = localHeap();
+    if (Span* span = heap->active[sizeClass]) {
+        if (void* block = popBlock(span)) {
+            return block;
+        }
+    }
+    return allocSmallSlow(heap, sizeClass);
+}
+
+void poolFree(void* data) {
+    if (!data) {
+        return;
+    }
+    Span* span = spanOf(data);
+    if (span->sizeClass == LARGE_CLASS) {
+        PoolGlobals& g = globals();
+        g.largeCount.fetch_sub(1, std::memory_order_relaxed);
+        g.largeBytes.fetch_sub(span->largeSize, std::memory_order_relaxed);
+        osFree(span);
+        return;
+    }
+
+    ThreadHeap* heap = t_heap;
+    if (span->owner != heap) {
+        freeRemote(span, data);
+        return;
+    }
+    *static_cast<void**>(data) = span->freeList;
+    span->freeList = data;
+    span->used--;
+    spanBecameFree(heap, span);
+}
+
+size_t poolUsableSize(const void* data) {
+    Span* span = spanOf(data);
+    if (span->sizeClass == LARGE_CLASS) {
+        return span->largeSize;
+    }
+    return span->blockSize;
+}
+
+void* poolRealloc(void* data, size_t size, size_t alignment) {
+    if (!data) {
+        return poolMalloc(size, alignment);
+    }
+    size_t usable = poolUsableSize(data);
+    if (size <= usable && size >= usable / 2 &&
+        (reinterpret_cast<uintptr_t>(data) & (alignment - 1)) == 0) {
+        return data;
+    }
+
+    void* moved = poolMalloc(size, alignment);
+    if (moved) {
+        memcpy(moved, data, size < usable ? size : usable);
+        poolFree(data);
+    }
+    return moved;
+}
+
+PoolStats poolStats() {
+    PoolGlobals& g = globals();
+    PoolStats stats;
+    stats.spanCount  = g.spanCount.load(std::memory_order_relaxed);
+    stats.largeCount = g.largeCount.load(std::memory_order_relaxed);
+    stats.largeBytes = g.largeBytes.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(g.mutex);
+        stats.cachedSpanCount = g.spanCache.size();
+    }
+    return stats;
+}
+
+void poolLogStats() {
+    PoolStats stats = poolStats();
+    Log("pool: %zu spans (%.2f MB), %zu cached, %zu large blocks (%.2f MB)",
+        stats.spanCount, stats.spanCount * POOL_SPAN_SIZE / (1024.0 * 1024.0),
+        stats.cachedSpanCount,
+        stats.largeCount, stats.largeBytes / (1024.0 * 1024.0));
+}
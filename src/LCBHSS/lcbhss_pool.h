@@ -0,0 +1,69 @@
+#pragma once
+
+/* Size-class pool allocator, see lcbhss_pool.cpp */
+
+#include <new>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Requests up to POOL_MAX_SMALL bytes with alignment up to
+// POOL_MAX_SMALL_ALIGN are served from 64KB spans split into size classes,
+// each thread allocating from spans its own heap owns. Freeing from another
+// thread pushes the block onto the span's lock-free remote list, the owner
+// takes it back on its next slow-path allocation. Anything bigger goes
+// straight to the OS allocator with a span header in front of it.
+constexpr size_t POOL_SPAN_SIZE       = 64 * 1024;
+constexpr size_t POOL_MAX_SMALL       = 16 * 1024;
+constexpr size_t POOL_MAX_SMALL_ALIGN = 64;
+
+// alignment must be a power of two no larger than POOL_SPAN_SIZE / 2,
+// returns nullptr otherwise or when the system is out of memory
+void*  poolMalloc(
+    size_t size, size_t alignment = 16);
+void   poolFree(
+    void* data);
+// keeps the contents up to the smaller of both sizes
+void*  poolRealloc(
+    void* data, size_t size, size_t alignment = 16);
+size_t poolUsableSize(
+    const void* data);
+
+struct PoolStats {
+    size_t spanCount;          // spans carved into size classes
+    size_t cachedSpanCount;    // empty spans kept for reuse
+    size_t largeCount;
+    size_t largeBytes;
+};
+PoolStats poolStats();
+void      poolLogStats();
+
+template<typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    PoolAllocator() noexcept = default;
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        void* data = poolMalloc(n * sizeof(T),
+            alignof(T) < 16 ? 16 : alignof(T));
+        if (!data) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(data);
+    }
+    void deallocate(T* data, size_t) noexcept {
+        poolFree(data);
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+    template<typename U>
+    bool operator!=(const PoolAllocator<U>&) const noexcept { return false; }
+};
+
+template<typename T>
+using PoolVector = std::vector<T, PoolAllocator<T>>;
@@ -3,51 +3,17 @@
 /*       2020 Feb 3rd      */
 
 #include "lcbhss_space.h"
+#include "lcbhss_pool.h"
+#include "lcbhss_pack.h"
 
+// the hidden back-pointer scheme these used to implement is superseded by
+// the size-class pool, kept as thin wrappers for existing callers
 void* alignedMalloc(size_t size, size_t alignment) {
-    if (alignment & (alignment - 1)) {
-        return nullptr;
-    }
-    //άFreeBlock(void)ָռõڴС-----sizeofȡ
-    const int pointerSize = sizeof(void*);
-    // alignment - 1 + pointerSizeõFreeBlock
-    // ڴҪڴС
-    // egsizeofT=20 __alignof(T)=16,
-    // g_MaxNumberOfObjectsInPool = 1000
-    // ãaligned_malloc(1000*20, 16)
-    // alignment - 1 + pointSize = 19
-    const unsigned requestedSize = size + alignment - 1 + pointerSize;
-    // ĴС
-    void* rawMemory = malloc(requestedSize);
-    // ʵʷڴַָӦƽ̨ʽ
-    uintptr_t start = (uintptr_t)rawMemory + pointerSize;
-
-    // 
-    // ALIGN - 1 ʵڴ
-    // ~(ALIGN - 1)
-    // bytes + (ALIGN-1)ΪȽнλȻض0
-    // ֤ϵ
-    // eg: byte = 100, ALIGN = 8
-    // ~(ALIGN - 1) = (1000)b
-    // bytes + ALIGN-1 = (1101001)b
-
-    // ˴ & ܸλ~λ޹λ1
-    // ((bytes + ALIGN-1)& ~(ALIGN-1)) = (1101000)b = (104)d
-    // 104/8 = 13; ʵϵ
-    // bytesպöʱִС
-    void* aligned = (void*)((start + alignment - 1) & ~(alignment - 1));
-
-    // άһָmalloc()ڴָ
-    *(void**)((uintptr_t)aligned - pointerSize) = rawMemory;
-
-    return aligned;     //Ϊϵ룬ԲҪ
-
-    // ڴ棬λǰάָ룬ٺǶchain
+    return poolMalloc(size, alignment);
 }
 
 void alignedFree(void* aligned) {
-    void* rawMemory = *(void**)((uintptr_t)aligned - sizeof(void*));
-    free(rawMemory);
+    poolFree(aligned);
 }
 
 // ֱһuintptr_t ?
@@ -56,15 +22,7 @@ bool isAligned(void* data, unsigned alignment) {
 }
 
 void* alignedRealloc(void* data, size_t size, size_t alignment) {
-    if (isAligned(data,
-        static_cast<int> (alignment)
-    )) {
-        alignedFree(data);
-        return alignedMalloc(size, alignment);
-    }
-    else {
-        return nullptr;
-    }
+    return poolRealloc(data, size, alignment);
 }
 //-----------------------------------------------------------------------------------------
 
@@ -109,6 +67,16 @@ void Log(const char* fmt, ...) {
 }
 
 std::vector<char> readFile(const std::string& fileName) {
+    const AssetPack* pack  = mountedAssetPack();
+    const PackEntry* entry = pack ? pack->find(fileName) : nullptr;
+    if (entry) {
+        std::vector<char> buffer(static_cast<size_t>(entry->size));
+        if (!pack->read(*entry, buffer.data())) {
+            throw std::runtime_error("failed to unpack " + fileName);
+        }
+        return buffer;
+    }
+
     // ԶƷʽֽļ
     std::ifstream file(fileName, std::ios::ate
         | std::ios::binary);
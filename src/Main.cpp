@@ -4,10 +4,71 @@
 
 #include "LCBHSS/lcbhss_space.h"
 #include "VkApp/VkApp.h"
+#include "VkAppDependence/mesh_file.h"
+#include "VkAppDependence/texture_cook.h"
+#include "LCBHSS/lcbhss_pack.h"
 #include <iostream>
+#include <cstring>
+#include <cctype>
+#include <string>
 #include <exception>
 
 int main(int argc, char* argv[]) {
+	// tool mode: VkForVs --cook-mesh <source.fbx> <output.vkmesh> [packed]
+	if ((argc == 4 || argc == 5) && strcmp(argv[1], "--cook-mesh") == 0) {
+		VertexFormat format = argc == 5 && strcmp(argv[4], "packed") == 0 ?
+			VertexFormat::Packed16 : VertexFormat::Float32;
+		try {
+			cookMesh(argv[2], argv[3], format);
+		}
+		catch (const std::exception & err) {
+			std::cerr << err.what() << std::endl;
+			LOG_AND_RETURN(UNHANDLED_ERROR);
+		}
+		return 0;
+	}
+
+	// tool mode: VkForVs --encode-textures <bc1|bc3|bc4|bc5|bc7|auto> <image>...
+	// writes <image>.dds next to every image
+	if (argc >= 4 && strcmp(argv[1], "--encode-textures") == 0) {
+		TextureCodec codec = TEXTURE_CODEC_AUTO;
+		std::string	 name  = argv[2];
+		for (char& c : name) {
+			c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+		}
+		for (uint32_t i = 0; i < static_cast<uint32_t>(TextureCodec::Count); i++) {
+			const TextureCodecInfo& info = textureCodecInfo(static_cast<TextureCodec>(i));
+			if (info.blockExtent == 4 && name == info.name) {
+				codec = static_cast<TextureCodec>(i);
+			}
+		}
+		if (codec == TEXTURE_CODEC_AUTO && name != "AUTO") {
+			std::cerr << "unknown codec " << argv[2] << std::endl;
+			LOG_AND_RETURN(UNHANDLED_ERROR);
+		}
+		if (!cookTextures(std::vector<std::string>(argv + 3, argv + argc), codec)) {
+			LOG_AND_RETURN(UNHANDLED_ERROR);
+		}
+		return 0;
+	}
+
+	// tool mode: VkForVs --build-pack <output.vkpack> [directory...]
+	// packs textures, shaders and 3dObjects when no directory is given
+	if (argc >= 3 && strcmp(argv[1], "--build-pack") == 0) {
+		std::vector<std::string> directories(argv + 3, argv + argc);
+		if (directories.empty()) {
+			directories = { "textures", "shaders", "3dObjects" };
+		}
+		try {
+			buildAssetPack(argv[2], directories);
+		}
+		catch (const std::exception & err) {
+			std::cerr << err.what() << std::endl;
+			LOG_AND_RETURN(UNHANDLED_ERROR);
+		}
+		return 0;
+	}
+
 	auto vkapp = new VkApp();
 	try {
 		vkapp->Run();
@@ -4,8 +4,13 @@
 
 #include "VkApp.h"
 #include "../LCBHSS/lcbhss_space.h"
+#include "../LCBHSS/lcbhss_pack.h"
+#include "../VkAppDependence/mesh_file.h"
+#include "../VkAppDependence/dds_file.h"
+#include "../VkAppDependence/texture_decode_pool.h"
 
 #include <set>
+#include <memory>
 #include <chrono>
 #include <algorithm>
 #include <exception>
@@ -18,6 +23,41 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+const char* const VkApp::MESH_PATH		 = "3dObjects/Pneuma/Pneuma.FBX";
+const char* const VkApp::MESH_COOKED_PATH = "3dObjects/Pneuma/Pneuma.vkmesh";
+const char* const VkApp::TEXTURE_PATH		 = "textures/texture.png";
+const char* const VkApp::ASSET_PACK_PATH	 = "assets.vkpack";
+const char* const VkApp::PIPELINE_CACHE_PATH = "pipelines.vkcache";
+
+static const char* const SHADER_DIR = "A:/WorkSpace/CppProject/VkForVs/VkForVs/shaders/";
+
+// the packed copy when the mounted asset pack has one
+static std::string shaderPath(const std::string& name) {
+	const AssetPack* pack	= mountedAssetPack();
+	std::string		 packed = "shaders/" + name;
+	return pack && pack->find(packed) ? packed : SHADER_DIR + name;
+}
+
+static const Vertex FALLBACK_VERTICES[] = {
+	// Rectangle 1
+	{{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
+	{{0.5f, -0.5f, 0.0f},  {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
+	{{0.5f, 0.5f, 0.0f},   {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
+	{{-0.5f, 0.5f, 0.0f},  {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}},
+
+	{{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
+	{{0.5f, -0.5f, -0.5f},  {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
+	{{0.5f, 0.5f, -0.5f},   {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
+	{{-0.5f, 0.5f, -0.5f},  {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}}
+};
+// update: ӾеĸΪ
+
+static const uint32_t FALLBACK_INDICES[] = {
+	0, 1, 2, 2, 3, 0,
+
+	4, 5, 6, 6, 7, 4
+};
+
 void VkApp::Run() {
 #ifdef _DEBUG
 	EnableLogging();
@@ -25,6 +65,9 @@ void VkApp::Run() {
 	DisableLogging();
 #endif
 
+	// without a pack (VkForVs --build-pack) the loose files are read
+	mountAssetPack(ASSET_PACK_PATH);
+
 	try {
 		_InitWindow();
 	}
@@ -80,6 +123,8 @@ bool VkApp::isDeviceSuitable(VkPhysicalDevice device) {
 //---------------INIT VULKAN--------------//
 int VkApp::_InitVulkan() {
 
+	auto initBegin = std::chrono::high_resolution_clock::now();
+
 	_CreateInstance();
 	_CreateSurface();
 
@@ -95,29 +140,113 @@ int VkApp::_InitVulkan() {
 	}
 	
 	_CreateLogicalDevice();
+	m_pipelineCache.init(m_gpu, m_device, PIPELINE_CACHE_PATH);
+	m_allocator.init(m_gpu, m_device, m_memoryBudgetExt);
+	m_residency.init(m_allocator, m_device,
+		static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT));
+	m_allocator.setEvictionCallback(
+		[this](uint32_t heapIndex, VkDeviceSize bytesNeeded) {
+			return m_residency.evict(heapIndex, bytesNeeded);
+		});
+	m_residency.setEvictionCallback([this](uint32_t residencyId) {
+		_evictTextureSlot(residencyId);
+	});
+	m_staging.init(m_allocator, m_device);
+	m_attachments.init(m_allocator, m_device);
+	{
+		// the project build compiles the compute fallback, without it or the
+		// device feature it needs, formats that cannot be blitted get one mip
+		std::string		  mipShaderPath = shaderPath(MipGenerator::SHADER_FILE);
+		uint64_t		  size, writeTime;
+		std::vector<char> mipShader;
+		if (!m_storageWriteWithoutFormat) {
+			Log("mips: the device cannot write storage images without a format, "
+				"no compute fallback");
+		}
+		else if (!fileStamp(mipShaderPath, size, writeTime)) {
+			Log("mips: failed to find %s, no compute fallback", mipShaderPath.c_str());
+		}
+		else {
+			mipShader = readFile(mipShaderPath);
+		}
+		m_mipGenerator.init(m_gpu, m_device, m_pipelineCache, mipShader,
+			m_storageWriteWithoutFormat);
+
+		QueueFamilyIndices indices = findQueueFamilies(m_gpu);
+		m_uploader.init(
+			m_device, m_staging,
+			static_cast<uint32_t>(indices.graphicsFamily), m_graphicsQueue,
+			indices.transferFamily, m_transferQueue,
+			&m_mipGenerator
+		);
+		Log("uploads use %s", m_uploader.hasTransferQueue() ?
+			"a dedicated transfer queue" : "the graphics queue");
+		m_streamer.init(m_device, m_allocator, m_uploader,
+			static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT),
+			TEXTURE_STREAM_POOL_SIZE, TEXTURE_STREAM_FRAME_BYTES);
+		m_textureCache.init([this](const TextureHandle& texture) {
+			_removeTextureSlot(texture.slot);
+			if (texture.streamId != UINT32_MAX) {
+				m_streamer.remove(texture.streamId);
+			}
+			else {
+				m_residency.remove(texture.residencyId);
+			}
+		});
+		m_bufferCache.init([this](const MeshBuffer& buffer) {
+			MeshBuffer released = buffer;
+			m_allocator.destroyBuffer(released.buffer, released.alloc);
+		});
+	}
 	_CreateSwapChain();
 	_CreateImageViews();
 
 	_CreateRenderPass();
 	
 	_CreateDescriptorSetLayout();		//
+	_LoadMesh();						// picks the vertex format the pipeline uses
 	_CreateGraphicsPipeline();
 	
 	_CreateCommandPool();				//ҪָĻ
 	_CreateDepthResources();
 	_CreateFramebuffers();
 
+	// every startup upload goes out in one batch
+	m_uploader.beginBatch();
 	_CreateTextureImage();
 	_CreateTextureSampler();
 
 	_CreateVertexBuffers();
 	_CreateIndicesBuffer();
+	_CreateMeshletCuller();
+	m_uploader.endBatch();
+	m_textureCache.logStats("textures");
+	m_bufferCache.logStats("mesh buffers");
+	// the uploads copied the mesh into staging already
+	m_meshFile.close();
+	m_vertexData  = nullptr;
+	m_indexData	  = nullptr;
+	m_meshletData = nullptr;
 	_CreateUniformBuffers();
 	_CreateDescriptorPool();
 	_CreateDescriptorSets();
 	_CreateCommandBuffers();
 	_CreateSyncObjects();
 
+	m_allocator.logStats();
+	{
+		double ms = std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - initBegin).count();
+		uint64_t submits = m_uploader.submitCount();
+		Log("startup: %llu upload submits in %.1f ms, %.1f submits/s",
+			static_cast<unsigned long long>(submits),
+			ms, submits * 1000.0 / std::max(ms, 1e-3));
+	}
+
+#ifdef VKAPP_BENCHMARK
+	_RunBenchmarks();
+#endif
+
 	return 0;
 }
 //----------------------------------------//
@@ -156,7 +285,10 @@ QueueFamilyIndices VkApp::findQueueFamilies(VkPhysicalDevice device) {
 
 	int index = 0;
 	for (const auto& queueFamily : queueFamilies) {
-		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+		// meshlet culling dispatches on the graphics queue; the spec
+		// guarantees a family with both whenever there is a graphics one
+		if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+			(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
 			indices.graphicsFamily = index;
 		}
 
@@ -173,28 +305,24 @@ QueueFamilyIndices VkApp::findQueueFamilies(VkPhysicalDevice device) {
 		index++;
 	}
 
-	return indices;
-}
-
-uint32_t VkApp::findMemoryType(
-	uint32_t typeFilter, VkMemoryPropertyFlags properties
-) {
-
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(
-		m_gpu, &memProperties
-	);
-
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-		if ((typeFilter & (1 << i)) &&
-			((memProperties.memoryTypes[i].propertyFlags & properties) == 
-			properties)
+	// a transfer only family is usually a DMA engine that can copy while the
+	// graphics queue renders; row chunked copies need a 1x1x1 granularity
+	for (uint32_t i = 0; i < queueFamilyCount; i++) {
+		const auto& queueFamily = queueFamilies[i];
+		const auto& granularity = queueFamily.minImageTransferGranularity;
+		if (queueFamily.queueCount > 0 &&
+			(queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+			!(queueFamily.queueFlags &
+				(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+			granularity.width == 1 && granularity.height == 1 &&
+			granularity.depth == 1
 		) {
-			return i;
+			indices.transferFamily = static_cast<int>(i);
+			break;
 		}
 	}
 
-	throw std::runtime_error("failed to find suitable memory type");
+	return indices;
 }
 
 VkFormat VkApp::findSupportedFormat(
@@ -288,6 +416,9 @@ void VkApp::_CreateLogicalDevice() {
 	std::set<int> uniqueQueueFamilies = {
 		indices.graphicsFamily, indices.presentFamily
 	};
+	if (indices.transferFamily >= 0) {
+		uniqueQueueFamilies.insert(indices.transferFamily);
+	}
 
 	float queuePriority = 1.0f;
 	for (int queueFamily : uniqueQueueFamilies) {
@@ -303,6 +434,48 @@ void VkApp::_CreateLogicalDevice() {
 	//----ø
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	//----BCѹ֧ʱDDSCPUϽ
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(m_gpu, &supportedFeatures);
+	deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+	//----ɫmipʱд޸ʽ洢ͼ
+	deviceFeatures.shaderStorageImageWriteWithoutFormat =
+		supportedFeatures.shaderStorageImageWriteWithoutFormat;
+	m_storageWriteWithoutFormat =
+		supportedFeatures.shaderStorageImageWriteWithoutFormat == VK_TRUE;
+	//----鰴͵Ĳλ֧ʱֻһλ
+	deviceFeatures.shaderSampledImageArrayDynamicIndexing =
+		supportedFeatures.shaderSampledImageArrayDynamicIndexing;
+	m_dynamicTextureIndexing =
+		supportedFeatures.shaderSampledImageArrayDynamicIndexing == VK_TRUE;
+	//----鲿ְ󶨣ղλд
+	// queried through vkGetPhysicalDeviceFeatures2, which like the
+	// extension's dependency VK_KHR_maintenance3 is core in Vulkan 1.1
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(m_gpu, &properties);
+	m_descriptorIndexing = m_dynamicTextureIndexing &&
+		properties.apiVersion >= VK_API_VERSION_1_1 &&
+		_CheckOptionalDeviceExtension(m_gpu, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+	indexingFeatures.sType =
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	if (m_descriptorIndexing) {
+		VkPhysicalDeviceFeatures2 features2 = {};
+		features2.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &indexingFeatures;
+		vkGetPhysicalDeviceFeatures2(m_gpu, &features2);
+		m_descriptorIndexing =
+			indexingFeatures.descriptorBindingPartiallyBound == VK_TRUE;
+		// enable only what the texture array uses
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported = indexingFeatures;
+		indexingFeatures = {};
+		indexingFeatures.sType = supported.sType;
+		indexingFeatures.descriptorBindingPartiallyBound = supported.descriptorBindingPartiallyBound;
+	}
+	Log("textures: %s", m_descriptorIndexing ?
+		"bindless array through descriptor indexing" :
+		m_dynamicTextureIndexing ? "fixed texture array" : "one texture");
 	
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType =
@@ -313,11 +486,21 @@ void VkApp::_CreateLogicalDevice() {
 
 	createInfo.pEnabledFeatures = &deviceFeatures;
 
+	std::vector<const char*> extensions = deviceExtensions;
+	m_memoryBudgetExt = _CheckOptionalDeviceExtension(
+		m_gpu, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (m_memoryBudgetExt) {
+		extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	}
+	if (m_descriptorIndexing) {
+		extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		createInfo.pNext = &indexingFeatures;
+	}
 	createInfo.enabledExtensionCount = static_cast<uint32_t>(
-		deviceExtensions.size()
+		extensions.size()
 	);
 	createInfo.ppEnabledExtensionNames =
-		deviceExtensions.data();
+		extensions.data();
 
 #ifdef _DEBUG
 	createInfo.enabledLayerCount = static_cast<uint32_t>(
@@ -333,6 +516,9 @@ void VkApp::_CreateLogicalDevice() {
 
 	vkGetDeviceQueue(m_device, indices.graphicsFamily, 0, &m_graphicsQueue);
 	vkGetDeviceQueue(m_device, indices.presentFamily, 0, &m_presentQueue);
+	if (indices.transferFamily >= 0) {
+		vkGetDeviceQueue(m_device, indices.transferFamily, 0, &m_transferQueue);
+	}
 }
 
 
@@ -404,13 +590,20 @@ void VkApp::_CreateSwapChain() {
 	createInfo.presentMode = presentMode;
 	// VKһŻʩ
 	createInfo.clipped = VK_TRUE;
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	// on a resize the old swap chain is handed over, presentation goes on
+	// from it and its images can be reused
+	createInfo.oldSwapchain = m_swapChain;
 
+	VkSwapchainKHR swapChain;
 	if (vkCreateSwapchainKHR(
-		m_device, &createInfo, nullptr, &m_swapChain) != VK_SUCCESS
+		m_device, &createInfo, nullptr, &swapChain) != VK_SUCCESS
 		) {
 		throw std::runtime_error("failed to create swap chain");
 	}
+	if (m_swapChain != VK_NULL_HANDLE) {
+		vkDestroySwapchainKHR(m_device, m_swapChain, nullptr);
+	}
+	m_swapChain = swapChain;
 
 	
 	vkGetSwapchainImagesKHR(
@@ -520,6 +713,7 @@ void VkApp::_CreateRenderPass() {
 	) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create render pass");
 	}
+	m_renderPassFormat = swapChainImageFormat;
 
 }
 
@@ -560,21 +754,31 @@ void VkApp::_CreateDepthResources() {
 		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
 	);
 
-	createImage(
-		swapChainExtent.width, swapChainExtent.height,
-		format, VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		depthImage, depthImageMemory
-	);
+	VkImageCreateInfo imgInfo = {};
+	imgInfo.sType =
+		VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imgInfo.imageType = VK_IMAGE_TYPE_2D;
+	imgInfo.extent.width = swapChainExtent.width;
+	imgInfo.extent.height = swapChainExtent.height;
+	imgInfo.extent.depth = 1;
+	imgInfo.mipLevels = 1;
+	imgInfo.arrayLayers = 1;
+	imgInfo.format = format;
+	imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imgInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	imgInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+
+	// depth is cleared on load and never stored, so it can be transient and
+	// alias whatever else is in its group; a resize reuses the old memory
+	// when the new extent fits
+	depthImage = m_attachments.addImage(imgInfo, DEPTH_ALIAS_GROUP);
+	m_attachments.bind();
 
 	depthImageView = createImageView(depthImage, format, VK_IMAGE_ASPECT_DEPTH_BIT);
 
-	transitionImageLayout(
-		depthImage, format,
-		VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
-	);
+	// no layout transition: the render pass starts depth from UNDEFINED
 
 }
 
@@ -586,7 +790,8 @@ void VkApp::_CreateCommandPool() {
 	poolInfo.sType =
 		VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
-	poolInfo.flags = 0;
+	// frame command buffers are re-recorded every frame
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
 	if (vkCreateCommandPool(
 		m_device, &poolInfo, nullptr, &m_commandPool
@@ -596,75 +801,415 @@ void VkApp::_CreateCommandPool() {
 
 }
 
+// Startup textures: the one the shader samples and the diffuse map of
+// every material. DDS files are mapped and uploaded on this thread, images
+// go to a decode pool and are uploaded in the order its workers finish
+// them, so the copies overlap with decoding the rest. Logs when each was
+// decoded and uploaded.
 void VkApp::_CreateTextureImage() {
+	TextureDecodePool pool;
+	pool.start();
+
+	struct TimelineEntry {
+		std::string file;
+		bool		decoded;		// by the pool, otherwise mapped
+		uint32_t	worker;
+		double		decodeBeginMs, decodeEndMs;
+		double		uploadBeginMs, uploadEndMs;
+	};
+	std::vector<TimelineEntry> timeline;
+
+	// Every texture goes through m_textureCache, so a file is loaded once
+	// however many materials name it, and files with equal bytes are loaded
+	// once whatever they are called. A cooked .dds next to an image is used
+	// instead of the image, which is the fallback when the .dds is unusable.
+	struct Load {
+		ContentKey	  key;
+		std::string	  file;
+		std::string	  image;			// what the .dds was cooked from
+		TextureHandle texture;
+		uint64_t	  bytes	 = 0;
+		bool		  loaded = false;
+	};
+	struct Use {
+		TextureHandle* target;
+		ContentKey	   key;
+		uint32_t	   load;				// UINT32_MAX when the cache had it
+		bool		   shared;				// another use of the load comes first
+	};
+	std::vector<Load> loads;
+	std::vector<Use>  uses;
+	auto addUse = [&](const std::string& image, TextureHandle* target) {
+		std::string cooked = image.substr(0, image.find_last_of('.')) + ".dds";
+		uint64_t	size, writeTime;
+		std::string file = fileStamp(cooked, size, writeTime) ? cooked : image;
+		Use entry = { target, {}, UINT32_MAX, false };
+		if (!fileContentKey(file, entry.key)) {
+			Log("texture: failed to load %s", file.c_str());
+			return;
+		}
+		for (uint32_t i = 0; i < loads.size() && entry.load == UINT32_MAX; i++) {
+			if (loads[i].key == entry.key) {
+				entry.load	 = i;
+				entry.shared = true;
+			}
+		}
+		if (entry.load == UINT32_MAX && !m_textureCache.acquire(entry.key, *target)) {
+			entry.load = static_cast<uint32_t>(loads.size());
+			Load load;
+			load.key   = entry.key;
+			load.file  = file;
+			load.image = file == image ? std::string() : image;
+			loads.push_back(load);
+		}
+		uses.push_back(entry);
+	};
+	m_materialTextures.assign(m_materialTextureFiles.size(), TextureHandle());
+	addUse(TEXTURE_PATH, &m_texture);
+	for (size_t material = 0; material < m_materialTextureFiles.size(); material++) {
+		if (!m_materialTextureFiles[material].empty()) {
+			addUse(m_materialTextureFiles[material], &m_materialTextures[material]);
+		}
+	}
 
-	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load("textures/texture.png",
-		&texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-	
-	VkDeviceSize imgSize = static_cast<size_t>(texWidth) 
-		* static_cast<size_t>(texHeight) * 4;				//rgba
+	// the pool gets its work before this thread starts on the DDS files
+	auto isDds = [](const std::string& file) {
+		return file.size() >= 4 && file.compare(file.size() - 4, 4, ".dds") == 0;
+	};
+	std::vector<uint32_t> loadOfJob;
+	for (uint32_t i = 0; i < loads.size(); i++) {
+		if (!isDds(loads[i].file)) {
+			pool.submit(loads[i].file);
+			loadOfJob.push_back(i);
+		}
+	}
+	for (uint32_t i = 0; i < loads.size(); i++) {
+		Load& load = loads[i];
+		if (!isDds(load.file)) {
+			continue;
+		}
+		TimelineEntry entry = { load.file, false, 0, 0.0, 0.0, pool.elapsedMs(), 0.0 };
+		if (_CreateCompressedTextureImage(load.file.c_str(), load.texture)) {
+			load.bytes		  = load.key.size;
+			load.loaded		  = true;
+			entry.uploadEndMs = pool.elapsedMs();
+			timeline.push_back(entry);
+		}
+		else if (!load.image.empty()) {
+			pool.submit(load.image);
+			loadOfJob.push_back(i);
+		}
+		else {
+			Log("texture: failed to load %s", load.file.c_str());
+		}
+	}
 
-	if (!pixels) {
+	DecodedImage decoded;
+	while (pool.next(decoded)) {
+		Load& load = loads[loadOfJob[decoded.job]];
+		if (!decoded.pixels) {
+			Log("texture: failed to load %s", decoded.fileName.c_str());
+			continue;
+		}
+		TimelineEntry entry = { decoded.fileName, true, decoded.worker,
+			decoded.beginMs, decoded.endMs, pool.elapsedMs(), 0.0 };
+		load.texture = _CreatePixelTexture(decoded.fileName.c_str(),
+			decoded.pixels.get(), decoded.width, decoded.height, decoded.channels);
+		load.bytes	 = uint64_t(decoded.width) * decoded.height * 4;
+		load.loaded	 = true;
+		decoded.pixels.reset();
+		entry.uploadEndMs = pool.elapsedMs();
+		timeline.push_back(entry);
+	}
+	pool.stop();
+
+	// the first use of a load holds the reference insert() takes, the
+	// others share it; m_textureRefs remembers every reference held
+	for (Load& load : loads) {
+		if (load.loaded) {
+			load.texture.slot = _addTextureSlot(load.texture);
+			m_textureCache.insert(load.key, load.texture, load.bytes);
+		}
+	}
+	for (const Use& entry : uses) {
+		if (entry.load != UINT32_MAX && !loads[entry.load].loaded) {
+			continue;
+		}
+		if (entry.shared) {
+			m_textureCache.acquire(entry.key, *entry.target);
+		}
+		else if (entry.load != UINT32_MAX) {
+			*entry.target = loads[entry.load].texture;
+		}
+		m_textureRefs.push_back(entry.key);
+	}
+	// materials without a texture show m_texture; its load comes first,
+	// so a slot is free for it
+	if (m_texture.slot == UINT32_MAX) {
 		throw std::runtime_error("failed to load texture image");
 	}
+	double decodeWork = 0.0, decodeEnd = 0.0, uploadWork = 0.0, uploadOverlap = 0.0;
+	for (const TimelineEntry& entry : timeline) {
+		if (entry.decoded) {
+			decodeWork += entry.decodeEndMs - entry.decodeBeginMs;
+			decodeEnd	= std::max(decodeEnd, entry.decodeEndMs);
+		}
+	}
+	Log("startup textures, ms since decoding started:");
+	for (const TimelineEntry& entry : timeline) {
+		uploadWork	  += entry.uploadEndMs - entry.uploadBeginMs;
+		uploadOverlap += std::max(0.0,
+			std::min(entry.uploadEndMs, decodeEnd) - entry.uploadBeginMs);
+		if (entry.decoded) {
+			Log("  %-48s decode %7.1f - %7.1f (worker %u), upload %7.1f - %7.1f",
+				entry.file.c_str(), entry.decodeBeginMs, entry.decodeEndMs, entry.worker,
+				entry.uploadBeginMs, entry.uploadEndMs);
+		}
+		else {
+			Log("  %-48s mapped,                              upload %7.1f - %7.1f",
+				entry.file.c_str(), entry.uploadBeginMs, entry.uploadEndMs);
+		}
+	}
+	Log("startup textures: %.1f ms of decoding done in %.1f ms on %u workers, "
+		"%.1f ms recording uploads, %.1f ms of it while decodes were running",
+		decodeWork, decodeEnd, pool.workerCount() ? pool.workerCount() : 1,
+		uploadWork, uploadOverlap);
+}
 
-	VkBuffer	   stagingBuffer;
-	VkDeviceMemory stagingBufferMemoey;
-
-	_createBuffer( imgSize,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stagingBuffer, stagingBufferMemoey
-	);
-
-	void* data;
-	vkMapMemory(
-		m_device, stagingBufferMemoey, 0, imgSize, 0, &data
-	);
-	memcpy(data, pixels, static_cast<size_t>(imgSize));
-	vkUnmapMemory(
-		m_device, stagingBufferMemoey
-	);
-	stbi_image_free(pixels);
+// Uploads 8 bit rows of 1 to 4 channels as an RGBA8 texture with a mip
+// chain generated on the GPU, owned by m_residency from then on. Rows with
+// fewer channels are expanded as they are written into staging.
+VkApp::TextureHandle VkApp::_CreatePixelTexture(
+	const char* name, const void* pixels, uint32_t width, uint32_t height,
+	uint32_t channels
+) {
+	VkImage		image;
+	Allocation	alloc;
+	VkImageView view;
+	VkFormat  format	= VK_FORMAT_R8G8B8A8_UNORM;
+	MipMethod mipMethod = m_mipGenerator.method(format);
+	uint32_t  mipLevels = mipMethod != MipMethod::None ?
+		mipLevelCount(width, height) : 1;
 
 	createImage(
-		texWidth, texHeight,
-		VK_FORMAT_R8G8B8A8_UNORM,
+		width, height,
+		format,
 		VK_IMAGE_TILING_OPTIMAL,
 		VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-		VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_IMAGE_USAGE_SAMPLED_BIT |
+		m_mipGenerator.usage(format),
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		textureImage, textureImageMemory
+		MemoryCategory::Texture,
+		image, alloc,
+		mipLevels
 	);
 	
-	transitionImageLayout(
-		textureImage, VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+	// copy and move to SHADER_READ_ONLY without waiting on the GPU
+	PixelConversion conversion;
+	conversion.srcChannels = channels;
+	m_uploader.uploadImageMipmapped(
+		image, pixels, width, height, 4,
+		format, mipLevels,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		channels != 4 ? &conversion : nullptr
 	);
 
-	copyBufferToImage(stagingBuffer, textureImage,
-		static_cast<uint32_t>(texWidth),
-		static_cast<uint32_t>(texHeight)
-	);
+	view = createImageView(image, format, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
 
-	// ͼתΪɳֵģʽ
-	transitionImageLayout(
-		textureImage,
-		VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	Log("texture: %s %ux%u, %u mips%s, %u channels%s", name, width, height, mipLevels,
+		mipMethod == MipMethod::Blit ? " blitted" :
+		mipMethod == MipMethod::Compute ? " downsampled in a compute shader" : "",
+		channels, channels != 4 ? " expanded into staging" : "");
+	TextureHandle texture;
+	texture.residencyId = m_residency.add(image, view, alloc);
+	return texture;
+}
+
+// Uploads a DDS texture with all of its mips. Block compressed levels go
+// from the mapped file into staging untouched when the device samples the
+// format; otherwise, and for formats Vulkan has no match for, every level
+// is decoded to RGBA8 first. Uncompressed files without mips get a
+// generated chain. Files with a mip chain the device samples as stored are
+// handed to m_streamer instead, which keeps them mapped and starts with
+// the tail. False when there is no usable file.
+bool VkApp::_CreateCompressedTextureImage(const char* fileName, TextureHandle& texture) {
+	std::unique_ptr<DdsFile> file(new DdsFile());
+	if (!file->open(fileName)) {
+		return false;
+	}
+	DdsFile& dds = *file;
+
+	const TextureCodecInfo& info = textureCodecInfo(dds.codec());
+	VkFormat expandedFormat =
+		dds.srgb() ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+	std::vector<VkFormat> candidates;
+	VkFormat storedFormat = dds.srgb() ? info.srgbFormat : info.format;
+	if (storedFormat != VK_FORMAT_UNDEFINED) {
+		candidates.push_back(storedFormat);
+	}
+	candidates.push_back(expandedFormat);
+	VkFormat format = findSupportedFormat(
+		candidates, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+	bool decode = format != storedFormat;
+	bool plain	= decode || info.blockExtent == 1;
+
+	if (dds.mipCount() > 1 && !decode) {
+		Log("texture: %s %ux%u, %u mips, %s, %.2f MB streamed",
+			fileName, dds.width(), dds.height(), dds.mipCount(), info.name,
+			dds.dataSize() / (1024.0 * 1024.0));
+		texture.residencyId = UINT32_MAX;
+		texture.streamId	= m_streamer.add(fileName, std::move(file), format);
+		return true;
+	}
+
+	VkImage		image;
+	Allocation	alloc;
+	VkImageView view;
+
+	// block formats can be neither blitted to nor stored to
+	uint32_t storedLevels = dds.mipCount();
+	bool	 generate	  = storedLevels == 1 && plain &&
+		m_mipGenerator.method(format) != MipMethod::None;
+	uint32_t mipLevels	  = generate ? mipLevelCount(dds.width(), dds.height()) : storedLevels;
+	createImage(
+		dds.width(), dds.height(),
+		format,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+		VK_IMAGE_USAGE_SAMPLED_BIT |
+		(generate ? m_mipGenerator.usage(format) : 0),
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		MemoryCategory::Texture,
+		image, alloc,
+		mipLevels
 	);
-	// 
 
-	vkDestroyBuffer(m_device, stagingBuffer, nullptr);
-	vkFreeMemory(m_device, stagingBufferMemoey, nullptr);
+	std::vector<ImageLevel>	  levels(storedLevels);
+	std::vector<uint8_t>	  decoded;
+	std::vector<VkDeviceSize> decodedOffsets(storedLevels);
+	if (decode) {
+		VkDeviceSize decodedSize = 0;
+		for (uint32_t mip = 0; mip < storedLevels; mip++) {
+			decodedOffsets[mip] = decodedSize;
+			decodedSize += textureLevelSize(TextureCodec::RGBA8,
+				std::max(1u, dds.width() >> mip), std::max(1u, dds.height() >> mip));
+		}
+		decoded.resize(static_cast<size_t>(decodedSize));
+	}
+	for (uint32_t mip = 0; mip < storedLevels; mip++) {
+		ImageLevel& level = levels[mip];
+		level.width	 = std::max(1u, dds.width() >> mip);
+		level.height = std::max(1u, dds.height() >> mip);
+		level.data	 = dds.level(mip);
+		if (decode) {
+			uint8_t* rgba = decoded.data() + decodedOffsets[mip];
+			decodeToRgba8(dds.codec(), level.data, level.width, level.height, rgba);
+			level.data = rgba;
+		}
+	}
+
+	// the staging copies are made here, the mapping can go right after
+	if (generate) {
+		m_uploader.uploadImageMipmapped(
+			image, levels[0].data, levels[0].width, levels[0].height, 4,
+			format, mipLevels,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_SHADER_READ_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+		);
+	}
+	else {
+		m_uploader.uploadImage(
+			image, levels.data(), mipLevels,
+			decode ? 1 : info.blockExtent,
+			decode ? 4 : info.blockSize,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_SHADER_READ_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+		);
+	}
+
+	view				= createImageView(image, format, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+	texture.residencyId = m_residency.add(image, view, alloc);
+	texture.streamId	= UINT32_MAX;
+
+	VkDeviceSize expandedSize = 0;
+	for (uint32_t mip = 0; mip < mipLevels; mip++) {
+		expandedSize += textureLevelSize(TextureCodec::RGBA8,
+			std::max(1u, dds.width() >> mip), std::max(1u, dds.height() >> mip));
+	}
+	Log("texture: %s %ux%u, %u mips%s, %s%s, %.2f MB (RGBA8 %.2f MB)",
+		fileName, dds.width(), dds.height(), mipLevels, generate ? " generated" : "",
+		info.name, decode ? " decoded to RGBA8" : "",
+		(plain ? expandedSize : dds.dataSize()) / (1024.0 * 1024.0),
+		expandedSize / (1024.0 * 1024.0));
+	return true;
+}
+
+VkImageView VkApp::_textureView(const TextureHandle& texture) const {
+	return texture.streamId != UINT32_MAX ?
+		m_streamer.view(texture.streamId) : m_residency.view(texture.residencyId);
+}
 
-	textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_ASPECT_COLOR_BIT);
+// Puts a loaded texture into a free slot of the texture array, the next
+// descriptor write of each frame picks it up. UINT32_MAX when every slot
+// is taken, materials using it then show m_texture.
+uint32_t VkApp::_addTextureSlot(const TextureHandle& texture) {
+	uint32_t slot;
+	if (!m_freeTextureSlots.empty()) {
+		slot = m_freeTextureSlots.back();
+		m_freeTextureSlots.pop_back();
+	}
+	else if (m_textureSlots.size() < m_textureSlotCount) {
+		slot = static_cast<uint32_t>(m_textureSlots.size());
+		m_textureSlots.emplace_back();
+	}
+	else {
+		Log("texture: all %u texture slots are taken", m_textureSlotCount);
+		return UINT32_MAX;
+	}
+	m_textureSlots[slot]	  = texture;
+	m_textureSlots[slot].slot = slot;
+	m_textureSlotVersion++;
+	return slot;
+}
 
+// The texture's owner keeps its view alive for the frames in flight, by
+// then every set has been rewritten without it.
+void VkApp::_removeTextureSlot(uint32_t slot) {
+	if (slot == UINT32_MAX) {
+		return;
+	}
+	m_textureSlots[slot] = TextureHandle();
+	m_freeTextureSlots.push_back(slot);
+	m_textureSlotVersion++;
+}
+
+// The slot stays taken by its texture and shows m_texture from the next
+// descriptor write on. Only textures no frame in flight has drawn get
+// evicted, and with descriptor indexing the array is partially bound, so
+// the sets still holding the destroyed view are never read through it;
+// without it _recordCommandBuffer() keeps every slot resident.
+void VkApp::_evictTextureSlot(uint32_t residencyId) {
+	for (TextureHandle& texture : m_textureSlots) {
+		if (texture.residencyId == residencyId) {
+			texture.residencyId = UINT32_MAX;
+			m_textureSlotVersion++;
+		}
+	}
+}
+
+uint32_t VkApp::_materialTextureSlot(uint32_t material) const {
+	if (material < m_materialTextures.size() &&
+		m_materialTextures[material].slot != UINT32_MAX) {
+		const TextureHandle& texture = m_textureSlots[m_materialTextures[material].slot];
+		if (texture.residencyId != UINT32_MAX || texture.streamId != UINT32_MAX) {
+			return texture.slot;
+		}
+	}
+	return m_texture.slot;
 }
 
 void VkApp::_CreateTextureSampler() {
@@ -697,7 +1242,7 @@ void VkApp::_CreateTextureSampler() {
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod	   = 0.0f;
-	samplerInfo.maxLod	   = 0.0f;
+	samplerInfo.maxLod	   = VK_LOD_CLAMP_NONE;		//ȫmipͬ
 
 	if (vkCreateSampler(
 		m_device, &samplerInfo, nullptr, &textureSampler
@@ -709,7 +1254,8 @@ void VkApp::_CreateTextureSampler() {
 
 VkImageView VkApp::createImageView(
 	VkImage image, VkFormat format,
-	VkImageAspectFlags aspectFlags
+	VkImageAspectFlags aspectFlags,
+	uint32_t mipLevels
 ) {
 
 	VkImageViewCreateInfo createInfo = {};
@@ -737,7 +1283,7 @@ VkImageView VkApp::createImageView(
 	// ֻһͼ
 	createInfo.subresourceRange.aspectMask = aspectFlags;
 	createInfo.subresourceRange.baseMipLevel = 0;
-	createInfo.subresourceRange.levelCount = 1;
+	createInfo.subresourceRange.levelCount = mipLevels;
 	createInfo.subresourceRange.baseArrayLayer = 0;
 	createInfo.subresourceRange.layerCount = 1;
 	// дVRӦó򣬿ܻʹֶ֧εĽ
@@ -756,84 +1302,103 @@ VkImageView VkApp::createImageView(
 
 void VkApp::_CreateDescriptorSets() {
 
-	std::vector<VkDescriptorSetLayout>
-		layouts(swapChainImages.size(), m_descripSetLayout);
+	// every frame reads the same ring buffer through a dynamic offset, the
+	// sets only differ while a streamed texture's view moves
+	std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> layouts;
+	layouts.fill(m_descripSetLayout);
 	VkDescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.sType =
 		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = m_descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());
+	allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
 	allocInfo.pSetLayouts = layouts.data();
 
-	m_descriptorSets.resize(swapChainImages.size());
 	if (vkAllocateDescriptorSets(
-		m_device, &allocInfo, m_descriptorSets.data()
+		m_device, &allocInfo, m_descriptorSets
 	) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate descriptor sets");
 	}
 
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
+	for (size_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
 		VkDescriptorBufferInfo bufferInfo = {};
 		{
-			bufferInfo.buffer = m_uniformBuffers[i];
+			bufferInfo.buffer = m_uniformRing.buffer();
 			bufferInfo.offset = 0;
 			bufferInfo.range = sizeof(UniformBufferObject);
 		}
-		VkDescriptorImageInfo imgInfo = {};
-		{
-			imgInfo.imageLayout =
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imgInfo.imageView = textureImageView;
-			imgInfo.sampler = textureSampler;
-		}
-		std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+		VkWriteDescriptorSet descriptorWrite = {};
 		{
-			
-			descriptorWrites[0].sType =
+			descriptorWrite.sType =
 				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[0].dstSet = m_descriptorSets[i];
-			descriptorWrites[0].dstBinding = 0;				//Binding Ҳindex
-			descriptorWrites[0].dstArrayElement = 0;
-			descriptorWrites[0].descriptorType =
-				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			descriptorWrites[0].descriptorCount = 1;
+			descriptorWrite.dstSet = m_descriptorSets[frame];
+			descriptorWrite.dstBinding = 0;				//Binding Ҳindex
+			descriptorWrite.dstArrayElement = 0;
+			descriptorWrite.descriptorType =
+				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			descriptorWrite.descriptorCount = 1;
+			descriptorWrite.pBufferInfo = &bufferInfo;
 		}
-		{
-			descriptorWrites[0].pBufferInfo = &bufferInfo;
-			descriptorWrites[0].pImageInfo = nullptr;
-			descriptorWrites[0].pTexelBufferView = nullptr;
+		vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
 
-			descriptorWrites[1].sType =
-				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[1].dstSet =
-				m_descriptorSets[i];
-			descriptorWrites[1].dstBinding = 1;
-			descriptorWrites[1].dstArrayElement = 0;
-			descriptorWrites[1].descriptorType =
-				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[1].descriptorCount = 1;
-			descriptorWrites[1].pImageInfo = &imgInfo;
-		}
+		_writeTextureDescriptors(frame);
+	}
 
-		vkUpdateDescriptorSets(
-			m_device, 
-			static_cast<uint32_t>(descriptorWrites.size()),
-			descriptorWrites.data(),
-			0, nullptr
-		);
+}
+
+// Points the frame's texture array at the slots' current views; empty
+// slots are left as they are when partially bound, else show m_texture.
+// Called once the frame's fence has signalled, no pending command buffer
+// uses the set then.
+void VkApp::_writeTextureDescriptors(size_t frame) {
+	uint32_t slotCount = m_descriptorIndexing ?
+		static_cast<uint32_t>(m_textureSlots.size()) : m_textureSlotCount;
+	VkDescriptorImageInfo* imgInfos =
+		m_frameArenas[frame].allocArray<VkDescriptorImageInfo>(slotCount);
+	VkWriteDescriptorSet* descriptorWrites =
+		m_frameArenas[frame].allocArray<VkWriteDescriptorSet>(slotCount);
+	uint32_t writeCount = 0;
+	for (uint32_t slot = 0; slot < slotCount; slot++) {
+		const TextureHandle* texture =
+			slot < m_textureSlots.size() ? &m_textureSlots[slot] : nullptr;
+		if (!texture ||
+			(texture->residencyId == UINT32_MAX && texture->streamId == UINT32_MAX)) {
+			if (m_descriptorIndexing) {
+				continue;
+			}
+			texture = &m_texture;
+		}
+		VkDescriptorImageInfo& imgInfo = imgInfos[writeCount];
+		imgInfo.imageLayout =
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imgInfo.imageView = _textureView(*texture);
+		imgInfo.sampler = textureSampler;
+
+		VkWriteDescriptorSet& descriptorWrite = descriptorWrites[writeCount++];
+		descriptorWrite.sType =
+			VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = m_descriptorSets[frame];
+		descriptorWrite.dstBinding = 1;
+		descriptorWrite.dstArrayElement = slot;
+		descriptorWrite.descriptorType =
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pImageInfo = &imgInfo;
 	}
+	vkUpdateDescriptorSets(m_device, writeCount, descriptorWrites, 0, nullptr);
 
+	m_descriptorViews[frame] = _textureDescriptorVersion();
 }
 
 void VkApp::_CreateDescriptorPool() {
 	
 	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(
-		swapChainImages.size());
+	poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 	poolSizes[0].type =
-		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	
-	poolSizes[1].descriptorCount = poolSizes[0].descriptorCount;
+	// a full texture array per set, see _CreateDescriptorSetLayout()
+	poolSizes[1].descriptorCount =
+		static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * m_textureSlotCount;
 	poolSizes[1].type =
 		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 
@@ -842,8 +1407,7 @@ void VkApp::_CreateDescriptorPool() {
 		VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	createInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	createInfo.pPoolSizes = poolSizes.data();
-	createInfo.maxSets = static_cast<uint32_t>(
-		swapChainImages.size());
+	createInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 
 	if (vkCreateDescriptorPool(
 		m_device, &createInfo, nullptr, &m_descriptorPool
@@ -853,103 +1417,175 @@ void VkApp::_CreateDescriptorPool() {
 
 }
 
-void VkApp::_CreateVertexBuffers() {
+void VkApp::_LoadMesh() {
+	// the project build compiles vert_packed.spv, a missing one fails
+	// pipeline creation instead of quietly doubling the vertex bandwidth
+	m_vertexFormat = VertexFormat::Packed16;
+
+	// cook on first launch and whenever the FBX changes, map afterwards
+	bool ready = m_meshFile.open(MESH_COOKED_PATH, m_vertexFormat) &&
+		!m_meshFile.isStale(MESH_PATH);
+	if (!ready) {
+		m_meshFile.close();
+		try {
+			cookMesh(MESH_PATH, MESH_COOKED_PATH, m_vertexFormat);
+			ready = m_meshFile.open(MESH_COOKED_PATH, m_vertexFormat);
+		}
+		catch (const std::exception& e) {
+			Log("mesh: %s", e.what());
+		}
+	}
 
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+	if (!ready || m_meshFile.header().indexCount == 0) {
+		// the built-in quads are Float32 vertices
+		Log("mesh: %s %s, drawing the built-in quads with float32 vertices",
+			MESH_PATH, ready ? "has no triangles" : "could not be loaded");
+		m_meshFile.close();
+		m_vertexFormat	= VertexFormat::Float32;
+		m_vertexData	= FALLBACK_VERTICES;
+		m_vertexCount	= static_cast<uint32_t>(sizeof(FALLBACK_VERTICES) / sizeof(Vertex));
+		m_indexData		= FALLBACK_INDICES;
+		m_indexCount	= static_cast<uint32_t>(sizeof(FALLBACK_INDICES) / sizeof(uint32_t));
+		m_meshRanges	= { { 0, 0, m_indexCount } };
+		m_materialTextureFiles.clear();
+		m_meshletData	= nullptr;		// too small to be worth culling
+		m_meshletCount	= 0;
+		m_meshBounds	= glm::vec4(0.0f, 0.0f, -0.25f, 0.75f);
+		m_meshFit		= glm::mat4(1.0f);
+		m_vertexDequant = glm::mat4(1.0f);
+		return;
+	}
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+	const MeshFileHeader& header = m_meshFile.header();
+	m_vertexData  = m_meshFile.vertices();
+	m_vertexCount = header.vertexCount;
+	m_indexData	  = m_meshFile.indices();
+	m_indexCount  = header.indexCount;
+	m_meshRanges.assign(m_meshFile.ranges(), m_meshFile.ranges() + header.rangeCount);
+	m_meshletData  = m_meshFile.meshlets();
+
+	// diffuse maps are named relative to the FBX
+	std::string meshDirectory(MESH_PATH);
+	meshDirectory.erase(meshDirectory.find_last_of('/') + 1);
+	m_materialTextureFiles.clear();
+	for (uint32_t i = 0; i < header.materialCount; i++) {
+		const char* texture = m_meshFile.materialTexture(i);
+		m_materialTextureFiles.push_back(*texture ? meshDirectory + texture : std::string());
+	}
+	m_meshletCount = header.meshletCount;
+
+	// the camera looks at the origin from (2, 2, 2) with Z up
+	glm::vec3 boundsMin(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+	glm::vec3 boundsMax(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+	glm::vec3 extent  = boundsMax - boundsMin;
+	float	  largest = std::max(extent.x, std::max(extent.y, extent.z));
+	m_meshBounds = glm::vec4((boundsMin + boundsMax) * 0.5f, glm::length(extent) * 0.5f);
+	m_meshFit = glm::scale(glm::mat4(1.0f),
+		glm::vec3(largest > 0.0f ? 1.5f / largest : 1.0f));
+	if (header.upAxis == 0) {
+		m_meshFit = glm::rotate(m_meshFit, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	}
+	else if (header.upAxis == 1) {
+		m_meshFit = glm::rotate(m_meshFit, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	}
+	m_meshFit		= glm::translate(m_meshFit, (boundsMin + boundsMax) * -0.5f);
+	m_vertexDequant = vertexDequantization(m_vertexFormat, boundsMin, boundsMax);
+	Log("mesh: %u vertices, %s layout, %u bytes each",
+		m_vertexCount, vertexLayout(m_vertexFormat).name, header.vertexStride);
+}
 
-	_createBuffer(
-		bufferSize,
-		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+void VkApp::_CreateVertexBuffers() {
 
-		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-		stagingBuffer,
-		stagingBufferMemory
-	);
+	VkDeviceSize bufferSize =
+		VkDeviceSize(vertexLayout(m_vertexFormat).stride) * m_vertexCount;
 
-	//˴offsetҪmemRequirements.alignment
-	void* data;
-	vkMapMemory(
-		m_device, stagingBufferMemory, 0, bufferSize, 0, &data
-	);
-	memcpy(data, vertices.data(), (size_t)bufferSize);
-	vkUnmapMemory(
-		m_device, stagingBufferMemory
-	);
+	// a mesh with the same vertices already resident shares its buffer
+	m_vertexBufferKey = contentKey(m_vertexData, static_cast<size_t>(bufferSize),
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	MeshBuffer shared;
+	if (m_bufferCache.acquire(m_vertexBufferKey, shared)) {
+		m_vertexBuffer		= shared.buffer;
+		m_vertexBufferAlloc = shared.alloc;
+		return;
+	}
 
 	_createBuffer(bufferSize,
 		VK_BUFFER_USAGE_TRANSFER_DST_BIT |
 		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		MemoryCategory::Mesh,
 		m_vertexBuffer,
-		m_vertexBufferMemory
+		m_vertexBufferAlloc
 	);
 
-	_copyBuffer(stagingBuffer, m_vertexBuffer, bufferSize);
-
-	vkDestroyBuffer(m_device, stagingBuffer, nullptr);
-	vkFreeMemory(m_device, stagingBufferMemory, nullptr);
+	m_uploader.uploadBuffer(
+		m_vertexBuffer, 0, m_vertexData, bufferSize,
+		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
+	);
+	m_bufferCache.insert(m_vertexBufferKey, { m_vertexBuffer, m_vertexBufferAlloc }, bufferSize);
 
 }
 
 void VkApp::_CreateIndicesBuffer() {
 	
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-
-	_createBuffer(
-		bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stagingBuffer, stagingBufferMemory
-	);
-
-	void* data;
-	vkMapMemory(
-		m_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(
-		m_device, stagingBufferMemory
-	);
+	VkDeviceSize bufferSize = sizeof(uint32_t) * m_indexCount;
+
+	m_indicesBufferKey = contentKey(m_indexData, static_cast<size_t>(bufferSize),
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	MeshBuffer shared;
+	if (m_bufferCache.acquire(m_indicesBufferKey, shared)) {
+		m_indicesBuffer		 = shared.buffer;
+		m_indicesBufferAlloc = shared.alloc;
+		return;
+	}
 
+	// also the source the meshlet culling compacts from
 	_createBuffer(
 		bufferSize,
 		VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-		VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		MemoryCategory::Mesh,
 		m_indicesBuffer,
-		m_indicesBufferMemory
+		m_indicesBufferAlloc
 	);
 
-	_copyBuffer(stagingBuffer, m_indicesBuffer, bufferSize);
-
-	vkDestroyBuffer(m_device, stagingBuffer, nullptr);
-	vkFreeMemory(m_device, stagingBufferMemory, nullptr);
+	m_uploader.uploadBuffer(
+		m_indicesBuffer, 0, m_indexData, bufferSize,
+		VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+	);
+	m_bufferCache.insert(m_indicesBufferKey, { m_indicesBuffer, m_indicesBufferAlloc }, bufferSize);
 
 }
 
-void VkApp::_CreateUniformBuffers() {
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+void VkApp::_CreateMeshletCuller() {
+	// the project build compiles the compute shader, a missing one throws
+	m_meshletCulling = m_meshletCount > 0;
+	if (!m_meshletCulling) {
+		Log("mesh: drawn without meshlet culling");
+		return;
+	}
 
-	m_uniformBuffers.resize(swapChainImages.size());
-	m_uniformBuffersMemory.resize(swapChainImages.size());
+	std::string cullShaderPath = shaderPath(MeshletCuller::SHADER_FILE);
+	m_meshletCuller.init(
+		m_allocator, m_device, m_uploader, m_pipelineCache, readFile(cullShaderPath),
+		m_meshletData, m_meshletCount,
+		m_meshRanges.data(), static_cast<uint32_t>(m_meshRanges.size()),
+		m_indicesBuffer, m_indexCount,
+		static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT)
+	);
+	Log("mesh: %u meshlets culled on the GPU", m_meshletCount);
+}
 
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		_createBuffer(
-			bufferSize,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			m_uniformBuffers[i],
-			m_uniformBuffersMemory[i]
-		);
-	}
+void VkApp::_CreateUniformBuffers() {
+	m_uniformRing.init(
+		m_allocator, m_gpu,
+		static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT),
+		UNIFORM_RING_FRAME_SIZE
+	);
 }
 
 void VkApp::_CreateDescriptorSetLayout() {
@@ -958,7 +1594,7 @@ void VkApp::_CreateDescriptorSetLayout() {
 	{
 		uboLayoutBingding.binding = 0; //ӦĶɫеĲ
 		uboLayoutBingding.descriptorType =
-			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		uboLayoutBingding.descriptorCount = 1;
 
 		uboLayoutBingding.stageFlags =
@@ -967,10 +1603,24 @@ void VkApp::_CreateDescriptorSetLayout() {
 
 	}
 	
+	// the texture array, as large as the device allows; the fragment
+	// shader indexes it with the slot pushed per draw
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(m_gpu, &properties);
+	const VkPhysicalDeviceLimits& limits = properties.limits;
+	uint32_t slotCount = m_descriptorIndexing ? TEXTURE_SLOT_LIMIT : TEXTURE_SLOT_FIXED_COUNT;
+	m_textureSlotCount = !m_dynamicTextureIndexing ? 1 : std::min({
+		slotCount,
+		limits.maxPerStageDescriptorSamplers,
+		limits.maxPerStageDescriptorSampledImages,
+		limits.maxDescriptorSetSamplers,
+		limits.maxDescriptorSetSampledImages
+	});
+
 	VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
 	{
 		samplerLayoutBinding.binding = 1;
-		samplerLayoutBinding.descriptorCount = 1;
+		samplerLayoutBinding.descriptorCount = m_textureSlotCount;
 		samplerLayoutBinding.descriptorType =
 			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		samplerLayoutBinding.pImmutableSamplers = nullptr;
@@ -987,6 +1637,21 @@ void VkApp::_CreateDescriptorSetLayout() {
 	createInfo.bindingCount = static_cast<uint32_t>(bindings.size());
 	createInfo.pBindings = bindings.data();
 
+	// empty slots need no valid descriptor; every set holds the whole
+	// array, so textures loaded after startup still find a slot
+	std::array<VkDescriptorBindingFlagsEXT, 2> bindingFlags = {
+		0,
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+	};
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo = {};
+	flagsInfo.sType =
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	flagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+	flagsInfo.pBindingFlags = bindingFlags.data();
+	if (m_descriptorIndexing) {
+		createInfo.pNext = &flagsInfo;
+	}
+
 	if (vkCreateDescriptorSetLayout(
 		m_device, &createInfo, nullptr, &m_descripSetLayout
 	) != VK_SUCCESS) {
@@ -997,10 +1662,10 @@ void VkApp::_CreateDescriptorSetLayout() {
 
 void VkApp::_CreateGraphicsPipeline() {
 
-	auto vertShaderCode = readFile(
-		"A:/WorkSpace/CppProject/VkForVs/VkForVs/shaders/vert.spv");
-	auto fragShaderCode = readFile(
-		"A:/WorkSpace/CppProject/VkForVs/VkForVs/shaders/frag.spv");
+	const VertexLayout& vertexLayout = ::vertexLayout(m_vertexFormat);
+
+	auto vertShaderCode = readFile(shaderPath(vertexLayout.vertexShader));
+	auto fragShaderCode = readFile(shaderPath("frag.spv"));
 
 	VkShaderModule vertShaderModule =
 		_CreateShaderModule(vertShaderCode);
@@ -1028,6 +1693,14 @@ void VkApp::_CreateGraphicsPipeline() {
 		VK_SHADER_STAGE_FRAGMENT_BIT;
 	fragShaderStageInfo.module = fragShaderModule;
 	fragShaderStageInfo.pName = "main";
+	// constant_id 0 of shader.frag sizes the texture array
+	VkSpecializationMapEntry slotCountEntry = { 0, 0, sizeof(uint32_t) };
+	VkSpecializationInfo fragSpecialization = {};
+	fragSpecialization.mapEntryCount = 1;
+	fragSpecialization.pMapEntries = &slotCountEntry;
+	fragSpecialization.dataSize = sizeof(m_textureSlotCount);
+	fragSpecialization.pData = &m_textureSlotCount;
+	fragShaderStageInfo.pSpecializationInfo = &fragSpecialization;
 
 	VkPipelineShaderStageCreateInfo shaderStages[] = {
 		vertShaderStageInfo, fragShaderStageInfo
@@ -1038,8 +1711,8 @@ void VkApp::_CreateGraphicsPipeline() {
 	vertexInputInfo.sType =
 		VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 //--------------------------Set bind description--------------------------//
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
+	auto bindingDescription = vertexLayout.bindingDescription();
+	auto attributeDescriptions = vertexLayout.attributeDescriptions();
 
 	vertexInputInfo.vertexBindingDescriptionCount = 1;
 	vertexInputInfo.vertexAttributeDescriptionCount =
@@ -1057,25 +1730,15 @@ void VkApp::_CreateGraphicsPipeline() {
 		VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST; //㹹һͼԪ
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width  = (float)swapChainExtent.width;
-	viewport.height = (float)swapChainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.offset = { 0, 0 };
-	scissor.extent = swapChainExtent;
-
+	// viewport and scissor are dynamic, set from the swap chain extent
+	// when recording, so a resize keeps the pipeline
 	VkPipelineViewportStateCreateInfo viewportState = {};
 	viewportState.sType =
 		VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
+	viewportState.pViewports = nullptr;
 	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
+	viewportState.pScissors = nullptr;
 
 	VkPipelineRasterizationStateCreateInfo rasterizer = {};
 	rasterizer.sType =
@@ -1132,7 +1795,7 @@ void VkApp::_CreateGraphicsPipeline() {
 
 	VkDynamicState dynamicStates[] = {
 		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_LINE_WIDTH
+		VK_DYNAMIC_STATE_SCISSOR
 	};
 
 	VkPipelineDynamicStateCreateInfo dynamicState = {};
@@ -1146,8 +1809,13 @@ void VkApp::_CreateGraphicsPipeline() {
 		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutInfo.setLayoutCount = 1;
 	pipelineLayoutInfo.pSetLayouts = &m_descripSetLayout;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = nullptr;
+	// the texture slot of the drawn material
+	VkPushConstantRange materialRange = {};
+	materialRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	materialRange.offset = 0;
+	materialRange.size = sizeof(uint32_t);
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &materialRange;
 
 	if (vkCreatePipelineLayout(
 		m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout
@@ -1178,7 +1846,7 @@ void VkApp::_CreateGraphicsPipeline() {
 	pipelineInfo.pMultisampleState		= &multisamping;
 	pipelineInfo.pDepthStencilState		= &depthInfo;
 	pipelineInfo.pColorBlendState		= &colorBlending;
-	pipelineInfo.pDynamicState			= nullptr;
+	pipelineInfo.pDynamicState			= &dynamicState;
 
 	pipelineInfo.layout					= m_pipelineLayout;
 	pipelineInfo.renderPass				= m_renderPass;
@@ -1187,8 +1855,10 @@ void VkApp::_CreateGraphicsPipeline() {
 	pipelineInfo.basePipelineHandle		= VK_NULL_HANDLE;
 	pipelineInfo.basePipelineIndex		= -1;
 
-	if (vkCreateGraphicsPipelines(
-		m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicsPipeline
+	// re-run when the surface format changes, the cache saves the driver
+	// compiling again
+	if (m_pipelineCache.createGraphicsPipeline(
+		"graphics", pipelineInfo, m_graphicsPipeline
 	) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create graphics pipeline");
 	}
@@ -1200,7 +1870,7 @@ void VkApp::_CreateGraphicsPipeline() {
 
 void VkApp::_CreateCommandBuffers() {
 
-	m_commandBuffers.resize(swapChainFrameBuffers.size());
+	m_commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
 	VkCommandBufferAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfo.commandPool = m_commandPool;
@@ -1213,73 +1883,131 @@ void VkApp::_CreateCommandBuffers() {
 		throw std::runtime_error("failed to allocate command buffers");
 	}
 
-	for (size_t i = 0; i < m_commandBuffers.size(); i++) {
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType =
-			VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags =
-			VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		beginInfo.pInheritanceInfo = nullptr;
+}
 
-		if (vkBeginCommandBuffer(
-			m_commandBuffers[i], &beginInfo
-		) != VK_SUCCESS) {
-			throw std::runtime_error("failed to begin recording command buffer");
-		}
+void VkApp::_recordCommandBuffer(
+	VkCommandBuffer commandBuffer, uint32_t imageIndex
+) {
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType =
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags =
+		VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = nullptr;
 
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType =
-			VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = m_renderPass;
-		renderPassInfo.framebuffer = swapChainFrameBuffers[i];
-
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = swapChainExtent;
-
-		std::array<VkClearValue, 2> clearValues = {};
-		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-		clearValues[1].depthStencil = { 1.0f, 0 };			//׶Զƽ/ƽ
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		renderPassInfo.pClearValues = clearValues.data();
-
-		vkCmdBeginRenderPass(
-			m_commandBuffers[i],
-			&renderPassInfo,
-			VK_SUBPASS_CONTENTS_INLINE); //Ҫ
-	//-------------------- buffers---------------------------//
-		vkCmdBindPipeline(m_commandBuffers[i],
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			m_graphicsPipeline
-		);
-		VkBuffer vertexBuffers[] = { m_vertexBuffer };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(
-			m_commandBuffers[i], 0, 1, vertexBuffers, offsets
-		);
-		vkCmdBindIndexBuffer(m_commandBuffers[i], m_indicesBuffer,
-			0, VK_INDEX_TYPE_UINT16);
-	//----------------------------------------------------------//
-		//	size()  һȾʵΪ1ʾʵȾ firstVertex firstInstance
-		//											     	|||        |||
-		//                                          gl_VertexIndex gl_InstanceIndex
-		vkCmdBindDescriptorSets(m_commandBuffers[i],
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			m_pipelineLayout,
-			0, 1, &m_descriptorSets[i], 0, nullptr);
-		vkCmdDrawIndexed(
-			m_commandBuffers[i], static_cast<uint32_t>(
-				indices.size())
-			, 1, 0, 0, 0
-		);
+	if (vkBeginCommandBuffer(
+		commandBuffer, &beginInfo
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to begin recording command buffer");
+	}
 
-		vkCmdEndRenderPass(m_commandBuffers[i]);
-		if (vkEndCommandBuffer(
-			m_commandBuffers[i]
-		) != VK_SUCCESS) {
-			throw std::runtime_error("failed to record command buffer");
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType =
+		VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = m_renderPass;
+	renderPassInfo.framebuffer = swapChainFrameBuffers[imageIndex];
+
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = swapChainExtent;
+
+	// culling runs before the pass and needs this frame's matrices
+	MeshletCullParams cullParams;
+	uint32_t dynamicOffset = _updateUniformBuffer(cullParams);
+	if (m_meshletCulling) {
+		m_meshletCuller.record(commandBuffer,
+			static_cast<uint32_t>(m_curFrame), cullParams);
+	}
+
+	const uint32_t clearValueCount = 2;
+	VkClearValue* clearValues =
+		m_frameArenas[m_curFrame].allocArray<VkClearValue>(clearValueCount);
+	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+	clearValues[1].depthStencil = { 1.0f, 0 };			//׶Զƽ/ƽ
+	renderPassInfo.clearValueCount = clearValueCount;
+	renderPassInfo.pClearValues = clearValues;
+
+	vkCmdBeginRenderPass(
+		commandBuffer,
+		&renderPassInfo,
+		VK_SUBPASS_CONTENTS_INLINE); //Ҫ
+//-------------------- buffers---------------------------//
+	vkCmdBindPipeline(commandBuffer,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		m_graphicsPipeline
+	);
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width  = (float)swapChainExtent.width;
+	viewport.height = (float)swapChainExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	VkBuffer vertexBuffers[] = { m_vertexBuffer };
+	VkDeviceSize offsets[] = { 0 };
+	vkCmdBindVertexBuffers(
+		commandBuffer, 0, 1, vertexBuffers, offsets
+	);
+//----------------------------------------------------------//
+	//	size()  һȾʵΪ1ʾʵȾ firstVertex firstInstance
+	//											     	|||        |||
+	//                                          gl_VertexIndex gl_InstanceIndex
+	// one set holds every texture, materials only push their slot
+	vkCmdBindDescriptorSets(commandBuffer,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		m_pipelineLayout,
+		0, 1, &m_descriptorSets[m_curFrame], 1, &dynamicOffset);
+	if (m_meshletCulling) {
+		m_meshletCuller.bindIndices(commandBuffer, static_cast<uint32_t>(m_curFrame));
+	}
+	else {
+		vkCmdBindIndexBuffer(commandBuffer, m_indicesBuffer,
+			0, VK_INDEX_TYPE_UINT32);
+	}
+	// m_texture stands in for evicted textures and has to stay; without
+	// descriptor indexing every slot is in the bound set, so all of them do
+	if (m_descriptorIndexing) {
+		if (m_texture.residencyId != UINT32_MAX) {
+			m_residency.touch(m_texture.residencyId);
+		}
+	}
+	else {
+		for (const TextureHandle& texture : m_textureSlots) {
+			if (texture.residencyId != UINT32_MAX) {
+				m_residency.touch(texture.residencyId);
+			}
+		}
+	}
+	for (const MaterialRange& range : m_meshRanges) {
+		uint32_t textureSlot = _materialTextureSlot(range.material);
+		if (m_textureSlots[textureSlot].residencyId != UINT32_MAX) {
+			m_residency.touch(m_textureSlots[textureSlot].residencyId);
+		}
+		vkCmdPushConstants(commandBuffer, m_pipelineLayout,
+			VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(textureSlot), &textureSlot);
+		if (m_meshletCulling) {
+			m_meshletCuller.draw(commandBuffer,
+				static_cast<uint32_t>(m_curFrame), range.material);
+		}
+		else {
+			vkCmdDrawIndexed(
+				commandBuffer, range.indexCount, 1, range.firstIndex, 0, 0
+			);
 		}
 	}
 
+	vkCmdEndRenderPass(commandBuffer);
+	if (vkEndCommandBuffer(
+		commandBuffer
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record command buffer");
+	}
+
 }
 
 void VkApp::_CreateSyncObjects() {
@@ -1346,8 +2074,10 @@ void VkApp::createImage(
 	VkFormat format, VkImageTiling  tiling,
 	VkImageUsageFlags				usage,
 	VkMemoryPropertyFlags			properties,
+	MemoryCategory					category,
 	VkImage&						image,
-	VkDeviceMemory&					imageMemory
+	Allocation&						imageAlloc,
+	uint32_t						mipLevels
 ) {
 	VkImageCreateInfo imgInfo = {};
 	imgInfo.sType =
@@ -1357,7 +2087,7 @@ void VkApp::createImage(
 	imgInfo.extent.width = width;
 	imgInfo.extent.height = height;
 	imgInfo.extent.depth = 1;
-	imgInfo.mipLevels = 1;
+	imgInfo.mipLevels = mipLevels;
 	imgInfo.arrayLayers = 1;
 
 	imgInfo.initialLayout =
@@ -1377,236 +2107,17 @@ void VkApp::createImage(
 	imgInfo.samples =
 		VK_SAMPLE_COUNT_1_BIT;			//һ
 
-	if (vkCreateImage(
-		m_device, &imgInfo, nullptr, &image
-	) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create image");
-	}
-
-	VkMemoryRequirements memRequirements;
-	vkGetImageMemoryRequirements(m_device, image, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(
-		memRequirements.memoryTypeBits,
-		properties
-	);
-
-	if (vkAllocateMemory(
-		m_device, &allocInfo, nullptr, &imageMemory
-	) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate image memory");
-	}
-
-	vkBindImageMemory(m_device, image, imageMemory, 0);
-}
-
-void VkApp::transitionImageLayout(
-	VkImage image, VkFormat	format, 
-	VkImageLayout oldLayout,
-	VkImageLayout newLayout
-) {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-	VkImageMemoryBarrier barrier = {};
-	barrier.sType =
-		VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-
-	barrier.oldLayout = oldLayout;
-	barrier.newLayout = newLayout;
-
-	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		barrier.subresourceRange.aspectMask =
-			VK_IMAGE_ASPECT_DEPTH_BIT;
-	}
-	else {
-		barrier.subresourceRange.aspectMask =
-			VK_IMAGE_ASPECT_COLOR_BIT;
-	}
-
-	VkPipelineStageFlags srcStage;		// δ -> 
-	VkPipelineStageFlags dstStage;		//    -> ɫȡ
-	{
-		
-		if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
-			newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-		) {
-			barrier.srcAccessMask = 0;
-			barrier.dstAccessMask =
-				VK_ACCESS_TRANSFER_WRITE_BIT;
-			srcStage =
-				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			dstStage =
-				VK_PIPELINE_STAGE_TRANSFER_BIT;
-		}
-		else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
-				 (newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL||
-				  newLayout == VK_IMAGE_LAYOUT_SHARED_PRESENT_KHR)
-		) {
-			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			srcStage =
-				VK_PIPELINE_STAGE_TRANSFER_BIT;
-			dstStage =
-				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		}
-		else if(oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
-				newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
-		){
-			barrier.srcAccessMask = 0;
-			barrier.dstAccessMask =
-				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
-				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-			srcStage =
-				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			dstStage =
-				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;	 //ڽȲʱɱȡ
-		}
-		else throw std::runtime_error("unsupported layout transition");
-	}
-
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;		//ڴݶȨ
-	barrier.image = image;
-
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.levelCount		= 1;
-	barrier.subresourceRange.baseMipLevel	= 0;
-	barrier.subresourceRange.layerCount		= 1;
-
-
-	vkCmdPipelineBarrier(
-		commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier
-	);	//ύ϶
-
-	endSingleTimeCommands(commandBuffer);
-}
-
-void VkApp::copyBufferToImage(
-	VkBuffer			buffer, 
-	VkImage				image, 
-	uint32_t			width, 
-	uint32_t			height
-){
-	VkCommandBuffer commandBuffer =
-		beginSingleTimeCommands();
-
-	VkBufferImageCopy region = {};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;			//-+
-	region.bufferImageHeight = 0;		//--ŷʽ
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-
-	region.imageOffset = { 0,0,0 };
-	region.imageExtent = { width, height, 1 };
-
-	vkCmdCopyBufferToImage(
-		commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1, &region
-	);
-
-	endSingleTimeCommands(commandBuffer);
-}
-
-VkCommandBuffer VkApp::beginSingleTimeCommands() {
-
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType =
-		VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level =
-		VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = m_commandPool;
-	allocInfo.commandBufferCount = 1;
-
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(
-		m_device, &allocInfo, &commandBuffer
-	);
-
-	VkCommandBufferBeginInfo beginInfo = {};
-	beginInfo.sType =
-		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags =
-		VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-	return commandBuffer;
-}
-
-void VkApp::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
-	vkEndCommandBuffer(commandBuffer);
-
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType =
-		VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-
-	vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(m_graphicsQueue);
-
-	vkFreeCommandBuffers(m_device, m_commandPool, 1, &commandBuffer);
-	
+	m_allocator.createImage(imgInfo, properties, category, image, imageAlloc);
 }
 
 void VkApp::_createBuffer(
 	VkDeviceSize size, VkBufferUsageFlags usage,
 	VkMemoryPropertyFlags properties,
+	MemoryCategory category,
 	VkBuffer& buffer,
-	VkDeviceMemory& bufferMemory
+	Allocation& bufferAlloc
 ) {
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType =
-		VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = size;
-	bufferInfo.usage = usage;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	
-	if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer)
-		!= VK_SUCCESS
-	) {
-		throw std::runtime_error("failed to create buffer");
-	}
-
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(
-		m_device, buffer, &memRequirements
-	);
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType =
-		VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(
-		memRequirements.memoryTypeBits, properties
-	);
-
-	if (vkAllocateMemory(
-		m_device, &allocInfo, nullptr, &bufferMemory
-	) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate buffer memory");
-	}
-
-	vkBindBufferMemory(m_device, buffer, bufferMemory, 0);
-}
-
-void VkApp::_copyBuffer(
-	VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size
-) {
-	VkCommandBuffer commandBuffer =
-		beginSingleTimeCommands();
-
-	VkBufferCopy copyRegion = {};
-	copyRegion.srcOffset = 0;
-	copyRegion.dstOffset = 0;
-	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-	endSingleTimeCommands(commandBuffer);
+	m_allocator.createBuffer(size, usage, properties, category, buffer, bufferAlloc);
 }
 
 VkShaderModule VkApp::_CreateShaderModule(
@@ -1754,6 +2265,27 @@ bool VkApp::_CheckDeviceExtensionSupport(VkPhysicalDevice device) {
 	return requiredExtensions.empty();
 }
 
+bool VkApp::_CheckOptionalDeviceExtension(VkPhysicalDevice device, const char* name) {
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(
+		device, nullptr, &extensionCount, nullptr
+	);
+
+	std::vector<VkExtensionProperties> availableExtensions(
+		extensionCount
+	);
+	vkEnumerateDeviceExtensionProperties(
+		device, nullptr, &extensionCount, availableExtensions.data()
+	);
+
+	for (const auto& extension : availableExtensions) {
+		if (strcmp(extension.extensionName, name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
 void VkApp::framebufferResizeCallback(GLFWwindow* window,
 	int width, int height) {
 	auto app = reinterpret_cast<VkApp*> (
@@ -1805,6 +2337,16 @@ void VkApp::_drawFrame() {
 		m_device, 1, &inFlightFences[m_curFrame],
 		VK_TRUE, std::numeric_limits<uint64_t>::max()
 	);
+	m_uniformRing.beginFrame(static_cast<uint32_t>(m_curFrame));
+	m_frameArenas[m_curFrame].reset();
+	uint64_t heapAllocations = heapAllocationCount();
+	m_uploader.collect();
+	m_residency.nextFrame();
+	// streamed uploads go out ahead of this frame's submit
+	m_streamer.update();
+	if (m_descriptorViews[m_curFrame] != _textureDescriptorVersion()) {
+		_writeTextureDescriptors(m_curFrame);
+	}
 
 	// ȡ֡ͼ
 	uint32_t imageIndex;
@@ -1818,7 +2360,21 @@ void VkApp::_drawFrame() {
 		frameBufferResized
 	) {
 		std::cerr << "window size changed, reset swap chain\n";
-		{
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			// nothing was acquired, so nothing will signal the semaphore;
+			// a new one leaves no doubt it is unsignaled for the next frame
+			vkDestroySemaphore(m_device, imageAvailableSemaphores[m_curFrame], nullptr);
+			VkSemaphoreCreateInfo semaphoreInfo = {};
+			semaphoreInfo.sType =
+				VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			if (vkCreateSemaphore(
+				m_device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[m_curFrame]
+			) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create semaphores for a frame");
+			}
+		}
+		else {
+			// the image was acquired, wait on its semaphore to unsignal it
 			VkSubmitInfo submitInfo = {};
 			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
@@ -1849,13 +2405,14 @@ void VkApp::_drawFrame() {
 		throw std::runtime_error("failed to acquire swap chain image");
 	}
 
-	_updateUniformBuffer(imageIndex);
-
 	if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
 		vkWaitForFences(m_device, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
 	}
 	imagesInFlight[imageIndex] = inFlightFences[m_curFrame];
 
+	vkResetCommandBuffer(m_commandBuffers[m_curFrame], 0);
+	_recordCommandBuffer(m_commandBuffers[m_curFrame], imageIndex);
+
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
@@ -1870,7 +2427,7 @@ void VkApp::_drawFrame() {
 	submitInfo.pWaitDstStageMask = waitStages;
 
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &m_commandBuffers[imageIndex];
+	submitInfo.pCommandBuffers = &m_commandBuffers[m_curFrame];
 
 	VkSemaphore signalSemaphores[] = {
 		renderFinishedSemaphores[m_curFrame]
@@ -1906,7 +2463,19 @@ void VkApp::_drawFrame() {
 		&presentInfo
 	);
 
-	m_curFrame = (m_curFrame + 1) & MAX_FRAMES_IN_FLIGHT;
+	// steady state frames are expected to stay off the heap entirely,
+	// the first round of frames may still warm up lazily grown containers
+	heapAllocations = heapAllocationCount() - heapAllocations;
+	if (heapAllocations != 0 && m_frameNumber >= 2 * MAX_FRAMES_IN_FLIGHT) {
+		if (m_allocatingFrames++ == 0) {
+			Log("frame %llu made %llu heap allocations",
+				static_cast<unsigned long long>(m_frameNumber),
+				static_cast<unsigned long long>(heapAllocations));
+		}
+	}
+	m_frameNumber++;
+
+	m_curFrame = (m_curFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 
 }
 void VkApp::_cleanUpSwapChain() {
@@ -1916,19 +2485,7 @@ void VkApp::_cleanUpSwapChain() {
 	}
 
 	vkDestroyImageView(m_device, depthImageView, nullptr);
-	vkDestroyImage(m_device, depthImage, nullptr);
-	vkFreeMemory(m_device, depthImageMemory, nullptr);
-
-	vkFreeCommandBuffers(
-		m_device, m_commandPool,
-		static_cast<uint32_t>(m_commandBuffers.size()),
-		m_commandBuffers.data()
-	);
-
-	vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
-
-	vkDestroyRenderPass(m_device, m_renderPass, nullptr);
+	m_attachments.releaseImages();
 
 	for (auto imageView : swapChainImageViews) {
 		vkDestroyImageView(
@@ -1936,7 +2493,14 @@ void VkApp::_cleanUpSwapChain() {
 		);
 	}
 
-	vkDestroySwapchainKHR(m_device, m_swapChain, nullptr);
+}
+
+void VkApp::_cleanUpRenderPass() {
+
+	vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+
+	vkDestroyRenderPass(m_device, m_renderPass, nullptr);
 
 }
 
@@ -1953,19 +2517,36 @@ void VkApp::_resetSwapChain() {
 
 	_cleanUpSwapChain();
 
+	// the render pass and pipeline only depend on the formats, the command
+	// buffers are recorded every frame anyway
 	_CreateSwapChain();
 	_CreateImageViews();
-	_CreateRenderPass();
-	_CreateGraphicsPipeline();
+	if (swapChainImageFormat != m_renderPassFormat) {
+		_cleanUpRenderPass();
+		_CreateRenderPass();
+		_CreateGraphicsPipeline();
+	}
 	_CreateDepthResources();
 	_CreateFramebuffers();
-	_CreateCommandBuffers();
+	imagesInFlight.assign(swapChainImages.size(), VK_NULL_HANDLE);
 
 	frameBufferResized = false;
 }
 
 int VkApp::_CleanUp() {
 
+	Log("%llu of %llu frames made heap allocations, frame arena high water %zu bytes",
+		static_cast<unsigned long long>(m_allocatingFrames),
+		static_cast<unsigned long long>(m_frameNumber),
+		m_frameArenas[0].highWater());
+	if (m_meshletCulling) {
+		Log("meshlet culling drew %llu of %llu triangles (%.1f%%)",
+			static_cast<unsigned long long>(m_meshletCuller.drawnTriangles()),
+			static_cast<unsigned long long>(m_meshletCuller.offeredTriangles()),
+			m_meshletCuller.drawnTriangles() * 100.0 /
+			std::max<uint64_t>(m_meshletCuller.offeredTriangles(), 1));
+	}
+
 #ifdef _DEBUG
 	try {
 		_DestroyDebugUtilsMessengerEXT(
@@ -1987,30 +2568,37 @@ int VkApp::_CleanUp() {
 	}
 	
 	_cleanUpSwapChain();
+	vkDestroySwapchainKHR(m_device, m_swapChain, nullptr);
+	_cleanUpRenderPass();
 
 	vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
 	vkDestroyDescriptorSetLayout(m_device, m_descripSetLayout, nullptr);
 
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		vkDestroyBuffer(
-			m_device, m_uniformBuffers[i], nullptr
-		);
-		vkFreeMemory(
-			m_device, m_uniformBuffersMemory[i], nullptr
-		);
-	}
+	m_uniformRing.destroy();
 
-	vkDestroyImageView(m_device, textureImageView, nullptr);
-	vkDestroyImage(m_device, textureImage, nullptr);
-	vkFreeMemory(m_device, textureImageMemory, nullptr);
+	for (const ContentKey& key : m_textureRefs) {
+		m_textureCache.release(key);
+	}
+	m_textureRefs.clear();
+	m_streamer.logStats();
+	m_streamer.destroy();
+	m_residency.destroy();
 	vkDestroySampler(m_device, textureSampler, nullptr);
 
-	vkDestroyBuffer(m_device, m_vertexBuffer, nullptr);
-	vkDestroyBuffer(m_device, m_indicesBuffer, nullptr);
-	vkFreeMemory(m_device, m_vertexBufferMemory, nullptr);
-	vkFreeMemory(m_device, m_indicesBufferMemory, nullptr);
+	m_bufferCache.release(m_vertexBufferKey);
+	m_bufferCache.release(m_indicesBufferKey);
+	if (m_meshletCulling) {
+		m_meshletCuller.destroy();
+	}
 	vkDestroyCommandPool(m_device, m_commandPool, nullptr);
 
+	m_attachments.destroy();
+	m_uploader.destroy();
+	m_mipGenerator.destroy();
+	m_pipelineCache.destroy();
+	m_staging.destroy();
+	m_allocator.destroy();
+
 	vkDestroyDevice(m_device, nullptr);
 	vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
 
@@ -2032,11 +2620,12 @@ int VkApp::_CleanUp() {
 		LOG_AND_EXIT(UNHANDLED_ERROR);
 	}
 
+	unmountAssetPack();
 	return 0;
 }
 
 
-void VkApp::_updateUniformBuffer(uint32_t currentImage) {
+uint32_t VkApp::_updateUniformBuffer(MeshletCullParams& cullParams) {
 	
 	static auto startTime = std::chrono::high_resolution_clock
 		::now();
@@ -2048,10 +2637,11 @@ void VkApp::_updateUniformBuffer(uint32_t currentImage) {
 	UniformBufferObject ubo = {};
 	// ZתTime
 	// rotate  תǶ ת glm::mat4(1.0f) => λ
-	ubo.model = glm::rotate(glm::mat4(1.0f),
+	glm::mat4 meshModel = glm::rotate(glm::mat4(1.0f),
 		time * glm::radians(90.0f),
 		glm::vec3(0.0f, 0.0f, 1.0f)
-	);
+	) * m_meshFit;
+	ubo.model = meshModel * m_vertexDequant;
 	// lookAt ۲λ ӵ Ϊ ͼ任
 	ubo.view = glm::lookAt(
 		glm::vec3(2.0f, 2.0f, 2.0f),
@@ -2068,17 +2658,24 @@ void VkApp::_updateUniformBuffer(uint32_t currentImage) {
 	// עĻʹ֮ǰpipelineʱõıƴʱ˳ʱ룬±汻޳
 	ubo.proj[1][1] *= -1;
 
-	void* data;
-	vkMapMemory(
-		m_device, m_uniformBuffersMemory[currentImage],
-		0, sizeof(ubo), 0, &data
-	);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(
-		m_device,
-		m_uniformBuffersMemory[currentImage]
-	);
+	// meshlet bounds are in mesh space, before the dequantization
+	cullParams = meshletCullParams(
+		ubo.proj * ubo.view * meshModel, ubo.view * meshModel);
+
+	// each texture is spread over the mesh, it covers about as many pixels
+	// as the mesh's bounding sphere spans at its centre's depth
+	glm::mat4 viewFromMesh = ubo.view * meshModel;
+	glm::vec4 center = viewFromMesh * glm::vec4(glm::vec3(m_meshBounds), 1.0f);
+	float	  radius = m_meshBounds.w * glm::length(glm::vec3(viewFromMesh[0]));
+	float	  depth	 = std::max(-center.z, 0.1f);
+	float	  pixels = radius / depth * std::abs(ubo.proj[1][1]) * swapChainExtent.height;
+	for (const TextureHandle& texture : m_textureSlots) {
+		if (texture.streamId != UINT32_MAX) {
+			m_streamer.requestScreenSize(texture.streamId, pixels);
+		}
+	}
 
+	return m_uniformRing.push(ubo);
 }
 
 std::vector<const char*> VkApp::_GetRequiredExtensions() {
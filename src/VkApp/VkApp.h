@@ -10,6 +10,18 @@
 #include <array>
 
 #include "../VkAppDependence/vk_depend.h"
+#include "../VkAppDependence/vk_allocator.h"
+#include "../VkAppDependence/vk_uniform_ring.h"
+#include "../VkAppDependence/vk_staging.h"
+#include "../VkAppDependence/vk_upload.h"
+#include "../VkAppDependence/vk_residency.h"
+#include "../VkAppDependence/vk_texture_stream.h"
+#include "../VkAppDependence/vk_resource_cache.h"
+#include "../VkAppDependence/vk_attachments.h"
+#include "../VkAppDependence/vk_pipeline_cache.h"
+#include "../VkAppDependence/vk_meshlet_cull.h"
+#include "../VkAppDependence/mesh_file.h"
+#include "../LCBHSS/lcbhss_arena.h"
 
 class VkApp {
 public:
@@ -21,28 +33,55 @@ public:
 	static void  getBindingDescription();
 
 	static const size_t MAX_FRAMES_IN_FLIGHT = 2;
+	static const char* const MESH_PATH;
+	static const char* const MESH_COOKED_PATH;
+	static const char* const TEXTURE_PATH;
+	static const char* const ASSET_PACK_PATH;
+	static const char* const PIPELINE_CACHE_PATH;
+	static const VkDeviceSize UNIFORM_RING_FRAME_SIZE = 256 * 1024;
+	// device memory streamed mips live in, and what a frame uploads of them
+	static const VkDeviceSize TEXTURE_STREAM_POOL_SIZE	 = 256ull * 1024 * 1024;
+	static const VkDeviceSize TEXTURE_STREAM_FRAME_BYTES = 8ull * 1024 * 1024;
+	// attachments whose uses within a frame never overlap share a group
+	static const uint32_t DEPTH_ALIAS_GROUP = 0;
+	// size of the bindless texture array with descriptor indexing, and
+	// without it, where every slot is allocated and written; both are
+	// clamped to the device's sampler limits
+	static const uint32_t TEXTURE_SLOT_LIMIT	   = 1024;
+	static const uint32_t TEXTURE_SLOT_FIXED_COUNT = 16;
 
 private:
+	// A loaded texture: owned by m_residency when it was loaded whole, by
+	// m_streamer when its mips stream in; the other id is UINT32_MAX.
+	// `slot` is its element of the texture array draws index.
+	struct TextureHandle {
+		uint32_t residencyId = UINT32_MAX;
+		uint32_t streamId	 = UINT32_MAX;
+		uint32_t slot		 = UINT32_MAX;
+	};
+	struct MeshBuffer {
+		VkBuffer   buffer = VK_NULL_HANDLE;
+		Allocation alloc  {};
+	};
+
 	int  _exec();
 	int  _InitVulkan();
 	int  _InitWindow();
 	void _drawFrame();
 	int  _CleanUp();
 
-	void _cleanUpSwapChain();
+	void _cleanUpSwapChain();			// what depends on the extent
+	void _cleanUpRenderPass();			// what depends on the formats
 	void _resetSwapChain();
-	void _updateUniformBuffer(uint32_t currentImage);
+	uint32_t _updateUniformBuffer(MeshletCullParams& cullParams);
+	void _recordCommandBuffer(VkCommandBuffer, uint32_t imageIndex);
 	
 	void _createBuffer(
 		VkDeviceSize size, VkBufferUsageFlags usage,
 		VkMemoryPropertyFlags properties,
+		MemoryCategory category,
 		VkBuffer& buffer,
-		VkDeviceMemory& bufferMemory
-	);
-	void _copyBuffer (
-		VkBuffer srcBuffer,
-		VkBuffer dstBuffer,
-		VkDeviceSize size
+		Allocation& bufferAlloc
 	);
 
     int  _CreateInstance();
@@ -58,13 +97,28 @@ private:
 
 	void _CreateCommandPool();
 	void _CreateTextureImage();
+	TextureHandle _CreatePixelTexture(
+		const char* name, const void* pixels, uint32_t width, uint32_t height,
+		uint32_t channels = 4);
+	bool _CreateCompressedTextureImage(const char* fileName, TextureHandle& texture);
+	VkImageView _textureView(const TextureHandle& texture) const;
+	uint32_t _addTextureSlot(const TextureHandle& texture);
+	void	 _removeTextureSlot(uint32_t slot);
+	void	 _evictTextureSlot(uint32_t residencyId);
+	uint32_t _materialTextureSlot(uint32_t material) const;
 	void _CreateTextureSampler();
+	void _LoadMesh();
 
 	void _CreateDescriptorSets();		// 
+	void _writeTextureDescriptors(size_t frame);
+	uint64_t _textureDescriptorVersion() const {
+		return m_streamer.viewVersion() + m_textureSlotVersion;
+	}
 	void _CreateDescriptorPool();
 	
 	void _CreateVertexBuffers();
 	void _CreateIndicesBuffer();
+	void _CreateMeshletCuller();
 	void _CreateUniformBuffers();
 
 	void _CreateDescriptorSetLayout();
@@ -73,34 +127,20 @@ private:
 	void _CreateSyncObjects();
 	void _CreateSemaphores();			//,SyncObjCreateFunc
 	
-	VkCommandBuffer
-		 beginSingleTimeCommands();
-	void endSingleTimeCommands(VkCommandBuffer);
 
 	void createImage(
 		uint32_t width, uint32_t height,
 		VkFormat format, VkImageTiling		tiling,
 		VkImageUsageFlags					usage,
 		VkMemoryPropertyFlags				properties,
+		MemoryCategory						category,
 		VkImage&							image,
-		VkDeviceMemory&						imageMemory
-	);
-
-	void transitionImageLayout(
-		VkImage, VkFormat,
-		VkImageLayout						oldLayout,
-		VkImageLayout						newLayout
-	);
-
-	void copyBufferToImage(
-		VkBuffer							buffer,
-		VkImage								image,
-		uint32_t							width,
-		uint32_t							height
+		Allocation&							imageAlloc,
+		uint32_t							mipLevels = 1
 	);
 
 	VkImageView
-		createImageView(VkImage, VkFormat, VkImageAspectFlags);
+		createImageView(VkImage, VkFormat, VkImageAspectFlags, uint32_t mipLevels = 1);
 	
 	VkShaderModule
 		_CreateShaderModule(const std::vector<char>&);
@@ -108,6 +148,7 @@ private:
 	bool _CheckValidationLayersSupport(
 		const std::vector<const char*>& validationLayers);
 	bool _CheckDeviceExtensionSupport(VkPhysicalDevice device);
+	bool _CheckOptionalDeviceExtension(VkPhysicalDevice device, const char* name);
 
 	std::vector<const char*>
 		_GetRequiredExtensions();
@@ -115,10 +156,6 @@ private:
 	QueueFamilyIndices
 		findQueueFamilies(VkPhysicalDevice device);
 
-	uint32_t
-		findMemoryType(uint32_t typeFilter,
-		VkMemoryPropertyFlags properties);
-
 	VkFormat
 		findSupportedFormat(const std::vector<VkFormat>&,
 			VkImageTiling, VkFormatFeatureFlags);
@@ -149,9 +186,27 @@ private:
 	VkInstance				 m_instance			 {};
 	VkPhysicalDevice		 m_gpu				 {};
 	VkDevice				 m_device			 {};
+	DeviceAllocator			 m_allocator		 {};
+	StagingArena			 m_staging			 {};
+	PipelineCache			 m_pipelineCache		 {};
+	MipGenerator			 m_mipGenerator		 {};
+	UploadEngine			 m_uploader			 {};
+	TextureResidency		 m_residency		 {};
+	TextureStreamer			 m_streamer			 {};
+	// textures and mesh buffers by content, what the caches release goes
+	// back to m_residency, m_streamer or m_allocator
+	ResourceCache<TextureHandle> m_textureCache;
+	ResourceCache<MeshBuffer>	 m_bufferCache;
+	std::vector<ContentKey>		 m_textureRefs;		// one per m_texture and material texture
+	AttachmentPool			 m_attachments		 {};
+	bool					 m_memoryBudgetExt = false;
+	bool					 m_storageWriteWithoutFormat = false;
+	bool					 m_dynamicTextureIndexing	 = false;
+	bool					 m_descriptorIndexing		 = false;
 	// ڴ˴queueʽָΪƺд빲õĶ
 	VkQueue					 m_graphicsQueue	 {};
 	VkQueue					 m_presentQueue		 {};
+	VkQueue					 m_transferQueue	 {};
 	VkSurfaceKHR			 m_surface	  = VK_NULL_HANDLE;
 	VkSwapchainKHR			 m_swapChain		 {};
 	VkFormat				 swapChainImageFormat{};
@@ -159,24 +214,34 @@ private:
 
 	VkDescriptorSetLayout    m_descripSetLayout  {};
 	VkDescriptorPool		 m_descriptorPool{};
-	std::vector<VkDescriptorSet>
-							 m_descriptorSets    {};
+	// one set per frame in flight, so a streamed view can change in the
+	// set of a frame whose fence has signalled while the others still draw
+	VkDescriptorSet			 m_descriptorSets[MAX_FRAMES_IN_FLIGHT] {};
+	uint64_t				 m_descriptorViews[MAX_FRAMES_IN_FLIGHT] = {};	// _textureDescriptorVersion() written
+	// Binding 1 is an array of every loaded texture, one slot each, so the
+	// whole mesh draws with one set bind and a pushed slot per material.
+	// The sets hold m_textureSlotCount slots. With descriptor indexing the
+	// array is partially bound and empty slots are left unwritten; without
+	// it empty ones show m_texture.
+	std::vector<TextureHandle> m_textureSlots;			// residencyId and streamId unset when empty or evicted
+	std::vector<uint32_t>	 m_freeTextureSlots;
+	uint32_t				 m_textureSlotCount	  = 1;	// descriptors in the layout and sets
+	uint64_t				 m_textureSlotVersion = 0;	// bumped when a slot changes
 
 	VkPipelineLayout         m_pipelineLayout	 {};
 	VkRenderPass             m_renderPass        {};
+	VkFormat				 m_renderPassFormat	 {};	// swap chain format it was made for
 	VkPipeline               m_graphicsPipeline  {};
 
 	VkBuffer				 m_vertexBuffer      {};
-	VkDeviceMemory           m_vertexBufferMemory{};
+	Allocation				 m_vertexBufferAlloc {};
+	ContentKey				 m_vertexBufferKey	 {};
 	VkCommandPool			 m_commandPool       {};
 	
-	VkImage					 textureImage;
-	VkDeviceMemory			 textureImageMemory;
-	VkImageView				 textureImageView;
+	TextureHandle			 m_texture;
 	VkSampler				 textureSampler;
 
 	VkImage					 depthImage;
-	VkDeviceMemory			 depthImageMemory;
 	VkImageView				 depthImageView;
 
 	std::vector<VkImage> swapChainImages;
@@ -191,6 +256,10 @@ private:
 	std::vector<VkFence>     inFlightFences;
 	std::vector<VkFence>	 imagesInFlight;
 	size_t					 m_curFrame = 0;
+	uint64_t				 m_frameNumber = 0;
+	uint64_t				 m_allocatingFrames = 0;	// frames that touched the heap
+	// transient CPU data of a frame, reset once its inFlightFences entry signals
+	LinearArena				 m_frameArenas[MAX_FRAMES_IN_FLIGHT];
 	//--------------------------------------------------
 	//--------------------------------------------------
 
@@ -203,33 +272,39 @@ private:
 	}; 
 
 	//--------------Vertex data-------------------//
-	const std::vector<Vertex> vertices = {
-		// Rectangle 1
-		{{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
-		{{0.5f, -0.5f, 0.0f},  {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
-		{{0.5f, 0.5f, 0.0f},   {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
-		{{-0.5f, 0.5f, 0.0f},  {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}},
-
-		{{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
-		{{0.5f, -0.5f, -0.5f},  {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
-		{{0.5f, 0.5f, -0.5f},   {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
-		{{-0.5f, 0.5f, -0.5f},  {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}}
-	};
-	// update: ӾеĸΪ
-
-	const std::vector<uint16_t> indices = {
-		0, 1, 2, 2, 3, 0,
-
-		4, 5, 6, 6, 7, 4
-	};
+	// set by _LoadMesh(), point into m_meshFile or at the built-in quads;
+	// the mapping is closed once the startup uploads have copied it
+	MeshFile				   m_meshFile;
+	VertexFormat			   m_vertexFormat = VertexFormat::Float32;
+	const void*				   m_vertexData	 = nullptr;
+	uint32_t				   m_vertexCount = 0;
+	const uint32_t*			   m_indexData	 = nullptr;
+	uint32_t				   m_indexCount	 = 0;
+	std::vector<MaterialRange> m_meshRanges;
+	// diffuse map per material, set by _LoadMesh(); empty without one
+	std::vector<std::string>   m_materialTextureFiles;
+	// texture per material, neither id set without a diffuse map
+	std::vector<TextureHandle> m_materialTextures;
+	const Meshlet*			   m_meshletData  = nullptr;
+	uint32_t				   m_meshletCount = 0;
+	glm::vec4				   m_meshBounds;	// bounding sphere in mesh space
+	glm::mat4				   m_meshFit;		// centres and scales, Z up
+	glm::mat4				   m_vertexDequant;	// vertex positions to mesh space
 	VkBuffer	   m_indicesBuffer;
-	VkDeviceMemory m_indicesBufferMemory;
+	Allocation	   m_indicesBufferAlloc;
+	ContentKey	   m_indicesBufferKey;
+	// draws the mesh whenever it has meshlets, the built-in quads have none
+	MeshletCuller  m_meshletCuller;
+	bool		   m_meshletCulling = false;
 
-	std::vector<VkBuffer> m_uniformBuffers;
-	std::vector<VkDeviceMemory> m_uniformBuffersMemory;
+	UniformRing	   m_uniformRing;
 	//--------------------------------------------//
 
 
+#ifdef VKAPP_BENCHMARK
+	void _RunBenchmarks();
+#endif
+
 #ifdef _DEBUG
 	VkDebugUtilsMessengerEXT m_callback{};
 
@@ -0,0 +1,476 @@
+/* Micro benchmarks, only compiled in with VKAPP_BENCHMARK defined */
+
+#ifdef VKAPP_BENCHMARK
+
+#include "VkApp.h"
+#include "../LCBHSS/lcbhss_space.h"
+#include "../LCBHSS/lcbhss_pool.h"
+#include "../VkAppDependence/fbx_import.h"
+#include "../VkAppDependence/mesh_file.h"
+#include "../VkAppDependence/pixel_convert.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+using BenchClock = std::chrono::high_resolution_clock;
+
+double elapsedMs(BenchClock::time_point begin) {
+	return std::chrono::duration<double, std::milli>(
+		BenchClock::now() - begin).count();
+}
+
+// old _updateUniformBuffer path: one VkDeviceMemory per object,
+// vkMapMemory + memcpy + vkUnmapMemory for every write
+double benchMapUnmap(
+	VkDevice device, const DeviceAllocator& allocator,
+	uint32_t objectCount, uint32_t frames
+) {
+	// stay far below maxMemoryAllocationCount, objects share them round robin
+	const uint32_t memoryCount = std::min<uint32_t>(objectCount, 1024);
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType =
+		VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = sizeof(UniformBufferObject);
+	allocInfo.memoryTypeIndex = allocator.findMemoryType(
+		~0u,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+	);
+
+	std::vector<VkDeviceMemory> memories(memoryCount);
+	for (auto& memory : memories) {
+		if (vkAllocateMemory(
+			device, &allocInfo, nullptr, &memory
+		) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate benchmark memory");
+		}
+	}
+
+	UniformBufferObject ubo = {};
+	auto begin = BenchClock::now();
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		for (uint32_t i = 0; i < objectCount; i++) {
+			ubo.model[3][0] = static_cast<float>(i);
+
+			void* data;
+			vkMapMemory(
+				device, memories[i % memoryCount],
+				0, sizeof(ubo), 0, &data
+			);
+			memcpy(data, &ubo, sizeof(ubo));
+			vkUnmapMemory(device, memories[i % memoryCount]);
+		}
+	}
+	double ms = elapsedMs(begin) / frames;
+
+	for (auto memory : memories) {
+		vkFreeMemory(device, memory, nullptr);
+	}
+	return ms;
+}
+
+double benchUniformRing(
+	DeviceAllocator& allocator, VkPhysicalDevice gpu,
+	uint32_t objectCount, uint32_t frames
+) {
+	UniformRing ring;
+	// worst case padding: every push rounds up to the offset alignment
+	ring.init(allocator, gpu,
+		static_cast<uint32_t>(VkApp::MAX_FRAMES_IN_FLIGHT),
+		static_cast<VkDeviceSize>(objectCount) *
+		std::max<VkDeviceSize>(sizeof(UniformBufferObject), 256));
+
+	UniformBufferObject ubo = {};
+	auto begin = BenchClock::now();
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		ring.beginFrame(frame);
+		for (uint32_t i = 0; i < objectCount; i++) {
+			ubo.model[3][0] = static_cast<float>(i);
+			ring.push(ubo);
+		}
+	}
+	double ms = elapsedMs(begin) / frames;
+
+	ring.destroy();
+	return ms;
+}
+
+struct HeapFuncs {
+	const char* name;
+	void*		(*alloc)(size_t);
+	void		(*release)(void*);
+};
+
+const HeapFuncs s_mallocHeap = {
+	"malloc", [](size_t size) { return malloc(size); }, [](void* data) { free(data); }
+};
+const HeapFuncs s_poolHeap = {
+	"pool", [](size_t size) { return poolMalloc(size); }, [](void* data) { poolFree(data); }
+};
+
+// per-frame lists: barrier and descriptor write arrays grown by doubling,
+// freed in reverse order at the end of the frame
+double benchFrameLists(const HeapFuncs& heap, uint32_t frames) {
+	const uint32_t listCount = 64;
+	void* lists[listCount];
+
+	auto begin = BenchClock::now();
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		for (uint32_t i = 0; i < listCount; i++) {
+			size_t capacity = 4 * sizeof(VkImageMemoryBarrier);
+			void*  data		= heap.alloc(capacity);
+			// 4 .. 128 elements
+			for (uint32_t grow = 0; grow < i % 6; grow++) {
+				void* bigger = heap.alloc(capacity * 2);
+				memcpy(bigger, data, capacity);
+				heap.release(data);
+				data	  = bigger;
+				capacity *= 2;
+			}
+			lists[i] = data;
+		}
+		for (uint32_t i = listCount; i-- > 0;) {
+			heap.release(lists[i]);
+		}
+	}
+	return elapsedMs(begin) / frames;
+}
+
+// asset loading: mixed sizes from vertex attributes up to texture mips,
+// freed in random order
+double benchMixedLifetimes(const HeapFuncs& heap, uint32_t rounds) {
+	const uint32_t liveCount = 4096;
+	std::vector<void*>	live(liveCount, nullptr);
+	std::mt19937		rng(7);
+
+	auto begin = BenchClock::now();
+	for (uint32_t round = 0; round < rounds; round++) {
+		for (uint32_t i = 0; i < liveCount; i++) {
+			uint32_t slot = rng() % liveCount;
+			heap.release(live[slot]);
+			// mostly small, one in 64 between 16KB and 1MB
+			size_t size = (rng() % 64) ? 16 + rng() % 2048 : 16384 + rng() % (1 << 20);
+			live[slot] = heap.alloc(size);
+			memset(live[slot], 0, 16);
+		}
+	}
+	double ms = elapsedMs(begin) / rounds;
+
+	for (void* data : live) {
+		heap.release(data);
+	}
+	return ms;
+}
+
+// loader thread allocates, render thread frees
+double benchCrossThread(const HeapFuncs& heap, uint32_t count) {
+	std::mutex			mutex;
+	std::vector<void*>	queue;
+	queue.reserve(count);
+
+	auto begin = BenchClock::now();
+	std::thread producer([&]() {
+		for (uint32_t i = 0; i < count; i++) {
+			void* data = heap.alloc(32 + (i % 32) * 16);
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(data);
+		}
+	});
+
+	uint32_t freed = 0;
+	std::vector<void*> batch;
+	batch.reserve(count);
+	while (freed < count) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			batch.swap(queue);
+		}
+		for (void* data : batch) {
+			heap.release(data);
+		}
+		freed += static_cast<uint32_t>(batch.size());
+		batch.clear();
+		std::this_thread::yield();
+	}
+	producer.join();
+	return elapsedMs(begin);
+}
+
+struct MeshLoadTimes {
+	double importMs;		// FBX parse + vertex packing, every launch before cooking
+	double cookMs;			// import + write, paid once per source change
+	double coldMapMs;		// map + copy, file dropped from the OS cache
+	double warmMapMs;		// map + copy, file in the OS cache
+	bool   coldDropped;		// false when the cache could not be dropped
+	size_t payloadBytes;
+};
+
+// Writes the file's dirty pages out and drops it from the OS file cache,
+// so the next read comes from the disk. Windows purges a file's cached
+// pages when it is opened unbuffered and no other handle is open.
+bool dropFromOsCache(const char* fileName) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName, GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+		OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	bool flushed = FlushFileBuffers(file) != 0;
+	CloseHandle(file);
+	return flushed;
+#else
+	int file = open(fileName, O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+	bool dropped = fdatasync(file) == 0 &&
+		posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED) == 0;
+	close(file);
+	return dropped;
+#endif
+}
+
+// map a .vkmesh and copy its payloads the way uploadBuffer() copies them
+// into the staging arena
+size_t mapAndCopy(const char* fileName, VertexFormat format, std::vector<char>& staging) {
+	MeshFile file;
+	if (!file.open(fileName, format)) {
+		throw std::runtime_error("failed to map benchmark mesh");
+	}
+	size_t vertexBytes = size_t(file.header().vertexCount) * file.header().vertexStride;
+	size_t indexBytes  = file.header().indexCount * sizeof(uint32_t);
+	staging.resize(vertexBytes + indexBytes);
+	memcpy(staging.data(), file.vertices(), vertexBytes);
+	memcpy(staging.data() + vertexBytes, file.indices(), indexBytes);
+	return vertexBytes + indexBytes;
+}
+
+MeshLoadTimes benchMeshLoad(
+	const char* source, const char* scratch, VertexFormat format, uint32_t runs
+) {
+	MeshLoadTimes		 times = {};
+	std::vector<uint8_t> vertices;
+	std::vector<char>	 staging;
+
+	auto begin = BenchClock::now();
+	for (uint32_t i = 0; i < runs; i++) {
+		MeshData mesh = loadFbxMesh(source);
+		encodeVertices(mesh.vertices, format, mesh.boundsMin, mesh.boundsMax, vertices);
+	}
+	times.importMs = elapsedMs(begin) / runs;
+
+	begin = BenchClock::now();
+	cookMesh(source, scratch, format);
+	times.cookMs = elapsedMs(begin);
+
+	times.coldDropped  = dropFromOsCache(scratch);
+	begin = BenchClock::now();
+	times.payloadBytes = mapAndCopy(scratch, format, staging);
+	times.coldMapMs	   = elapsedMs(begin);
+
+	begin = BenchClock::now();
+	for (uint32_t i = 0; i < runs; i++) {
+		mapAndCopy(scratch, format, staging);
+	}
+	times.warmMapMs = elapsedMs(begin) / runs;
+
+	std::remove(scratch);
+	return times;
+}
+
+// ms per run of `kernel` over the benchmark image
+template<typename Kernel>
+double timePixelKernel(uint32_t runs, Kernel kernel) {
+	kernel();
+	auto begin = BenchClock::now();
+	for (uint32_t i = 0; i < runs; i++) {
+		kernel();
+	}
+	return elapsedMs(begin) / runs;
+}
+
+// Every pixel kernel at every level the CPU has, writing into mapped
+// staging memory the way uploads do. The old loader path widened RGB to
+// RGBA in a heap buffer (stb's scalar loop) and then copied it into
+// staging; the new one expands straight into staging.
+void benchPixelKernels(DeviceAllocator& allocator, uint32_t runs) {
+	const size_t		 pixels = 2048 * 2048;
+	std::vector<uint8_t> rgb(pixels * 3), rgba(pixels * 4), widened(pixels * 4);
+	std::mt19937		 rng(11);
+	for (uint8_t& byte : rgb) {
+		byte = static_cast<uint8_t>(rng());
+	}
+	for (uint8_t& byte : rgba) {
+		byte = static_cast<uint8_t>(rng());
+	}
+
+	VkBuffer   staging;
+	Allocation stagingAlloc;
+	allocator.createBuffer(
+		pixels * 4,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		MemoryCategory::Staging,
+		staging, stagingAlloc
+	);
+	uint8_t* mapped = static_cast<uint8_t*>(stagingAlloc.mapped);
+
+	const uint8_t	bgra[4] = { 2, 1, 0, 3 };
+	PixelConversion srgbPremultiply;
+	srgbPremultiply.srcChannels = 3;
+	srgbPremultiply.decodeSrgb	= true;
+	srgbPremultiply.premultiply = true;
+	srgbPremultiply.encodeSrgb	= true;
+
+	PixelKernelLevel detected = detectPixelKernelLevel();
+	double			 scalarMs[4] = {};
+	Log("benchmark: pixel kernels, %ux%u into staging, %u runs", 2048, 2048, runs);
+	for (uint32_t level = 0; level <= static_cast<uint32_t>(detected); level++) {
+		setPixelKernelLevel(static_cast<PixelKernelLevel>(level));
+		double ms[4] = {
+			timePixelKernel(runs, [&]() { expandToRgba8(rgb.data(), 3, mapped, pixels); }),
+			timePixelKernel(runs, [&]() { premultiplyAlpha8(rgba.data(), mapped, pixels); }),
+			timePixelKernel(runs, [&]() { swizzleRgba8(rgba.data(), mapped, pixels, bgra); }),
+			timePixelKernel(runs, [&]() { convertPixels(rgb.data(), mapped, pixels, srgbPremultiply); })
+		};
+		if (level == 0) {
+			std::copy(ms, ms + 4, scalarMs);
+		}
+		Log("  %-6s RGB->RGBA %6.2f ms (%.1fx), premultiply %6.2f ms (%.1fx), "
+			"RGBA->BGRA %6.2f ms (%.1fx), RGB sRGB premultiplied %6.2f ms (%.1fx)",
+			pixelKernelLevelName(static_cast<PixelKernelLevel>(level)),
+			ms[0], scalarMs[0] / std::max(ms[0], 1e-6),
+			ms[1], scalarMs[1] / std::max(ms[1], 1e-6),
+			ms[2], scalarMs[2] / std::max(ms[2], 1e-6),
+			ms[3], scalarMs[3] / std::max(ms[3], 1e-6));
+	}
+	setPixelKernelLevel(detected);
+
+	double toLinearMs = timePixelKernel(runs, [&]() { srgbToLinear8(rgba.data(), mapped, pixels); });
+	double toSrgbMs	  = timePixelKernel(runs, [&]() { linearToSrgb8(rgba.data(), mapped, pixels); });
+	Log("  tables sRGB->linear %6.2f ms, linear->sRGB %6.2f ms", toLinearMs, toSrgbMs);
+
+	double oldMs = timePixelKernel(runs, [&]() {
+		for (size_t i = 0; i < pixels; i++) {
+			widened[i * 4]	   = rgb[i * 3];
+			widened[i * 4 + 1] = rgb[i * 3 + 1];
+			widened[i * 4 + 2] = rgb[i * 3 + 2];
+			widened[i * 4 + 3] = 255;
+		}
+		memcpy(mapped, widened.data(), pixels * 4);
+	});
+	double newMs = timePixelKernel(runs, [&]() { expandToRgba8(rgb.data(), 3, mapped, pixels); });
+	Log("  RGB upload: widen + copy %6.2f ms, %s expand into staging %6.2f ms, %.1fx, "
+		"no %.0f MB RGBA buffer", oldMs, pixelKernelLevelName(detected), newMs,
+		oldMs / std::max(newMs, 1e-6), pixels * 4 / (1024.0 * 1024.0));
+
+	allocator.destroyBuffer(staging, stagingAlloc);
+}
+
+// Share of the triangles meshlet culling keeps over a full turn of the
+// demo camera of _updateUniformBuffer(), one step per degree, with
+// meshletVisible(), the test meshlet_cull.comp runs per workgroup.
+double benchMeshletCulling(
+	const MeshFile& file, const glm::mat4& meshFit, float aspect, uint64_t& offered
+) {
+	glm::mat4 view = glm::lookAt(
+		glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	glm::mat4 proj = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 10.0f);
+	proj[1][1] *= -1;
+
+	const Meshlet* meshlets = file.meshlets();
+	uint64_t	   kept		= 0;
+	offered = 0;
+	for (uint32_t degree = 0; degree < 360; degree++) {
+		glm::mat4 model = glm::rotate(glm::mat4(1.0f),
+			glm::radians(static_cast<float>(degree)), glm::vec3(0.0f, 0.0f, 1.0f)) * meshFit;
+		MeshletCullParams params = meshletCullParams(proj * view * model, view * model);
+		for (uint32_t i = 0; i < file.header().meshletCount; i++) {
+			offered += meshlets[i].triangleCount;
+			if (meshletVisible(meshlets[i], params)) {
+				kept += meshlets[i].triangleCount;
+			}
+		}
+	}
+	return kept * 100.0 / std::max<uint64_t>(offered, 1);
+}
+
+}
+
+void VkApp::_RunBenchmarks() {
+	const uint32_t frames = 16;
+	const uint32_t objectCounts[] = { 1000, 4000, 16000 };
+
+	Log("benchmark: uniform updates, %u frames per run", frames);
+	for (uint32_t count : objectCounts) {
+		double mapMs  = benchMapUnmap(m_device, m_allocator, count, frames);
+		double ringMs = benchUniformRing(m_allocator, m_gpu, count, frames);
+
+		Log("  %6u objects: map/unmap %8.3f ms/frame (%6.1f ns/obj), "
+			"ring %8.3f ms/frame (%6.1f ns/obj), %.1fx",
+			count,
+			mapMs, mapMs * 1e6 / count,
+			ringMs, ringMs * 1e6 / count,
+			mapMs / std::max(ringMs, 1e-6));
+	}
+
+	Log("benchmark: pool allocator vs malloc");
+	const HeapFuncs* heaps[] = { &s_mallocHeap, &s_poolHeap };
+	for (const HeapFuncs* heap : heaps) {
+		double listsMs = benchFrameLists(*heap, 1000);
+		double mixedMs = benchMixedLifetimes(*heap, 64);
+		double crossMs = benchCrossThread(*heap, 200000);
+
+		Log("  %-6s frame lists %7.3f ms/frame, mixed %7.3f ms/round, "
+			"cross-thread %7.2f ms / 200k", heap->name, listsMs, mixedMs, crossMs);
+	}
+	poolLogStats();
+
+	Log("benchmark: mesh startup, %s", MESH_PATH);
+	std::string scratch = std::string(MESH_COOKED_PATH) + ".bench";
+	const VertexFormat formats[] = { VertexFormat::Float32, VertexFormat::Packed16 };
+	for (VertexFormat format : formats) {
+		MeshLoadTimes mesh = benchMeshLoad(MESH_PATH, scratch.c_str(), format, 8);
+		Log("  %-8s fbx import %7.2f ms, cook %7.2f ms, .vkmesh %s map %6.2f ms, "
+			"warm map %6.2f ms (%.2f MB vertex+index, %.1fx faster than import)",
+			vertexLayout(format).name, mesh.importMs, mesh.cookMs,
+			mesh.coldDropped ? "cold" : "first (OS cache not dropped)",
+			mesh.coldMapMs, mesh.warmMapMs,
+			mesh.payloadBytes / (1024.0 * 1024.0),
+			mesh.importMs / std::max(mesh.warmMapMs, 1e-6));
+	}
+
+	MeshFile cooked;
+	if (cooked.open(MESH_COOKED_PATH, m_vertexFormat) && cooked.header().meshletCount > 0) {
+		uint64_t offered;
+		double	 keptPercent = benchMeshletCulling(cooked, m_meshFit,
+			swapChainExtent.width / (float)swapChainExtent.height, offered);
+		Log("benchmark: meshlet culling keeps %.1f%% of %llu triangles over a camera turn "
+			"(%u meshlets)", keptPercent, static_cast<unsigned long long>(offered / 360),
+			cooked.header().meshletCount);
+	}
+
+	benchPixelKernels(m_allocator, 8);
+}
+
+#endif // VKAPP_BENCHMARK
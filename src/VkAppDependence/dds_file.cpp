@@ -0,0 +1,283 @@
+#include "dds_file.h"
+#include "../LCBHSS/lcbhss_space.h"
+
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// layouts from the DirectX documentation, after the "DDS " magic
+struct DdsPixelFormat {
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t rgbBitCount;
+	uint32_t rBitMask;
+	uint32_t gBitMask;
+	uint32_t bBitMask;
+	uint32_t aBitMask;
+};
+
+struct DdsHeader {
+	uint32_t	   size;
+	uint32_t	   flags;
+	uint32_t	   height;
+	uint32_t	   width;
+	uint32_t	   pitchOrLinearSize;
+	uint32_t	   depth;
+	uint32_t	   mipMapCount;
+	uint32_t	   reserved1[11];
+	DdsPixelFormat pixelFormat;
+	uint32_t	   caps;
+	uint32_t	   caps2;
+	uint32_t	   caps3;
+	uint32_t	   caps4;
+	uint32_t	   reserved2;
+};
+static_assert(sizeof(DdsHeader) == 124, "DdsHeader layout changed");
+
+struct DdsHeaderDx10 {
+	uint32_t dxgiFormat;
+	uint32_t resourceDimension;
+	uint32_t miscFlag;
+	uint32_t arraySize;
+	uint32_t miscFlags2;
+};
+
+const uint32_t DDS_MAGIC			  = 0x20534444;		// "DDS "
+const uint32_t DDSD_CAPS			  = 0x1;
+const uint32_t DDSD_HEIGHT			  = 0x2;
+const uint32_t DDSD_WIDTH			  = 0x4;
+const uint32_t DDSD_PIXELFORMAT		  = 0x1000;
+const uint32_t DDSD_MIPMAPCOUNT		  = 0x20000;
+const uint32_t DDSD_LINEARSIZE		  = 0x80000;
+const uint32_t DDPF_ALPHAPIXELS		  = 0x1;
+const uint32_t DDPF_FOURCC			  = 0x4;
+const uint32_t DDPF_RGB				  = 0x40;
+const uint32_t DDSCAPS_COMPLEX		  = 0x8;
+const uint32_t DDSCAPS_TEXTURE		  = 0x1000;
+const uint32_t DDSCAPS_MIPMAP		  = 0x400000;
+const uint32_t DDSCAPS2_CUBEMAP		  = 0x200;
+const uint32_t DDSCAPS2_VOLUME		  = 0x200000;
+const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+const uint32_t DDS_RESOURCE_MISC_CUBE  = 0x4;
+
+constexpr uint32_t fourCC(char a, char b, char c, char d) {
+	return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) |
+		(static_cast<uint32_t>(c) << 16) | (static_cast<uint32_t>(d) << 24);
+}
+
+struct DxgiFormat { uint32_t dxgi; TextureCodec codec; bool srgb; };
+const DxgiFormat DXGI_FORMATS[] = {
+	{ 28, TextureCodec::RGBA8, false }, { 29, TextureCodec::RGBA8, true },
+	{ 71, TextureCodec::BC1,   false }, { 72, TextureCodec::BC1,   true },
+	{ 77, TextureCodec::BC3,   false }, { 78, TextureCodec::BC3,   true },
+	{ 80, TextureCodec::BC4,   false },
+	{ 83, TextureCodec::BC5,   false },
+	{ 87, TextureCodec::BGRA8, false }, { 91, TextureCodec::BGRA8, true },
+	{ 88, TextureCodec::BGRX8, false }, { 93, TextureCodec::BGRX8, true },
+	{ 98, TextureCodec::BC7,   false }, { 99, TextureCodec::BC7,   true },
+};
+
+bool fromDxgi(uint32_t dxgiFormat, TextureCodec& codec, bool& srgb) {
+	for (const DxgiFormat& entry : DXGI_FORMATS) {
+		if (entry.dxgi == dxgiFormat) {
+			codec = entry.codec;
+			srgb  = entry.srgb;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool toDxgi(TextureCodec codec, bool srgb, uint32_t& dxgiFormat) {
+	for (const DxgiFormat& entry : DXGI_FORMATS) {
+		if (entry.codec == codec && entry.srgb == srgb) {
+			dxgiFormat = entry.dxgi;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool fromPixelFormat(const DdsPixelFormat& pf, TextureCodec& codec) {
+	if (pf.flags & DDPF_FOURCC) {
+		switch (pf.fourCC) {
+		case fourCC('D', 'X', 'T', '1'):
+			codec = TextureCodec::BC1;
+			return true;
+		case fourCC('D', 'X', 'T', '5'):
+			codec = TextureCodec::BC3;
+			return true;
+		case fourCC('A', 'T', 'I', '1'):
+		case fourCC('B', 'C', '4', 'U'):
+			codec = TextureCodec::BC4;
+			return true;
+		case fourCC('A', 'T', 'I', '2'):
+		case fourCC('B', 'C', '5', 'U'):
+			codec = TextureCodec::BC5;
+			return true;
+		default:
+			return false;
+		}
+	}
+	if (!(pf.flags & DDPF_RGB) || pf.rgbBitCount != 32 || pf.gBitMask != 0x0000FF00) {
+		return false;
+	}
+	bool alpha = (pf.flags & DDPF_ALPHAPIXELS) && pf.aBitMask == 0xFF000000;
+	if (pf.rBitMask == 0x000000FF && pf.bBitMask == 0x00FF0000) {
+		codec = alpha ? TextureCodec::RGBA8 : TextureCodec::RGBX8;
+		return true;
+	}
+	if (pf.rBitMask == 0x00FF0000 && pf.bBitMask == 0x000000FF) {
+		codec = alpha ? TextureCodec::BGRA8 : TextureCodec::BGRX8;
+		return true;
+	}
+	return false;
+}
+
+uint32_t mipExtent(uint32_t extent, uint32_t mip) {
+	return std::max(1u, extent >> mip);
+}
+
+}
+
+bool DdsFile::open(const std::string& fileName) {
+	close();
+	if (!m_file.open(fileName)) {
+		return false;
+	}
+
+	const uint8_t* data = m_file.data();
+	uint64_t	   size = m_file.size();
+	uint64_t	   offset = sizeof(uint32_t) + sizeof(DdsHeader);
+	if (size < offset || *reinterpret_cast<const uint32_t*>(data) != DDS_MAGIC) {
+		Log("texture: %s is not a DDS file", fileName.c_str());
+		close();
+		return false;
+	}
+
+	const DdsHeader& h = *reinterpret_cast<const DdsHeader*>(data + sizeof(uint32_t));
+	bool supported = h.size == sizeof(DdsHeader) && h.width && h.height &&
+		!(h.caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME));
+	if (supported && (h.pixelFormat.flags & DDPF_FOURCC) &&
+		h.pixelFormat.fourCC == fourCC('D', 'X', '1', '0')) {
+		const DdsHeaderDx10* dx10 = reinterpret_cast<const DdsHeaderDx10*>(data + offset);
+		offset += sizeof(DdsHeaderDx10);
+		supported = size >= offset &&
+			dx10->resourceDimension == DDS_DIMENSION_TEXTURE2D &&
+			!(dx10->miscFlag & DDS_RESOURCE_MISC_CUBE) && dx10->arraySize <= 1 &&
+			fromDxgi(dx10->dxgiFormat, m_codec, m_srgb);
+	}
+	else if (supported) {
+		supported = fromPixelFormat(h.pixelFormat, m_codec);
+	}
+	if (!supported) {
+		Log("texture: %s is not a supported 2D DDS texture", fileName.c_str());
+		close();
+		return false;
+	}
+
+	m_width	 = h.width;
+	m_height = h.height;
+
+	// a full chain ends at 1x1, longer chains are cut
+	uint32_t fullChain = 1;
+	while ((std::max(m_width, m_height) >> fullChain) != 0) {
+		fullChain++;
+	}
+	uint32_t mips = (h.flags & DDSD_MIPMAPCOUNT) ? std::max(1u, h.mipMapCount) : 1;
+	mips = std::min(mips, fullChain);
+
+	for (uint32_t mip = 0; mip < mips; mip++) {
+		uint64_t bytes = textureLevelSize(m_codec, mipExtent(m_width, mip), mipExtent(m_height, mip));
+		if (bytes > size - offset) {
+			Log("texture: %s is truncated at mip %u", fileName.c_str(), mip);
+			close();
+			return false;
+		}
+		m_levels.push_back(offset);
+		offset += bytes;
+	}
+	return true;
+}
+
+void DdsFile::close() {
+	m_file.close();
+	m_levels.clear();
+	m_codec	 = TextureCodec::RGBA8;
+	m_srgb	 = false;
+	m_width	 = 0;
+	m_height = 0;
+}
+
+uint64_t DdsFile::levelSize(uint32_t mip) const {
+	return textureLevelSize(m_codec, mipExtent(m_width, mip), mipExtent(m_height, mip));
+}
+
+uint64_t DdsFile::dataSize() const {
+	uint64_t bytes = 0;
+	for (uint32_t mip = 0; mip < mipCount(); mip++) {
+		bytes += levelSize(mip);
+	}
+	return bytes;
+}
+
+void writeDds(
+	const std::string& fileName, TextureCodec codec, bool srgb,
+	uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels
+) {
+	DdsHeaderDx10 dx10 = {};
+	if (!toDxgi(codec, srgb, dx10.dxgiFormat)) {
+		throw std::runtime_error("failed to write " + fileName + ": no DXGI format for " +
+			textureCodecInfo(codec).name + (srgb ? " sRGB" : ""));
+	}
+	dx10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	dx10.arraySize		   = 1;
+
+	uint32_t  mips	 = static_cast<uint32_t>(levels.size());
+	DdsHeader header = {};
+	header.size				 = sizeof(DdsHeader);
+	header.flags			 = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT |
+		DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height			 = height;
+	header.width			 = width;
+	header.pitchOrLinearSize = static_cast<uint32_t>(textureLevelSize(codec, width, height));
+	header.mipMapCount		 = mips;
+	header.pixelFormat.size	  = sizeof(DdsPixelFormat);
+	header.pixelFormat.flags  = DDPF_FOURCC;
+	header.pixelFormat.fourCC = fourCC('D', 'X', '1', '0');
+	header.caps = DDSCAPS_TEXTURE | (mips > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+	for (uint32_t mip = 0; mip < mips; mip++) {
+		if (levels[mip].size() != textureLevelSize(codec, mipExtent(width, mip), mipExtent(height, mip))) {
+			throw std::runtime_error("failed to write " + fileName + ": mip size mismatch");
+		}
+	}
+
+	std::string tempName = fileName + ".tmp";
+	{
+		std::ofstream file(tempName, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			throw std::runtime_error("failed to create " + tempName);
+		}
+		file.write(reinterpret_cast<const char*>(&DDS_MAGIC), sizeof(DDS_MAGIC));
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(&dx10), sizeof(dx10));
+		for (const std::vector<uint8_t>& level : levels) {
+			file.write(reinterpret_cast<const char*>(level.data()), static_cast<std::streamsize>(level.size()));
+		}
+		if (!file.flush()) {
+			throw std::runtime_error("failed to write " + tempName);
+		}
+	}
+
+	// rename does not replace an existing file on Windows
+	std::remove(fileName.c_str());
+	if (std::rename(tempName.c_str(), fileName.c_str()) != 0) {
+		std::remove(tempName.c_str());
+		throw std::runtime_error("failed to replace " + fileName);
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "texture_codec.h"
+#include "../LCBHSS/lcbhss_mapped_file.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// A mapped DirectDraw Surface holding a single 2D texture with its mip
+// chain. Accepted are the legacy DXT1/DXT5/ATI1/ATI2 FourCCs, 32 bit RGB
+// masks, and DX10 headers with one of the DXGI formats TextureCodec covers.
+// Cube maps, volumes and arrays are rejected. Levels are mapped, not read:
+// they go straight from the file into staging.
+class DdsFile {
+public:
+	// false when the file is missing or not a supported DDS
+	bool open(const std::string& fileName);
+	void close();
+
+	TextureCodec codec()	const { return m_codec; }
+	bool		 srgb()		const { return m_srgb; }		// DXGI _SRGB format
+	uint32_t	 width()	const { return m_width; }
+	uint32_t	 height()	const { return m_height; }
+	uint32_t	 mipCount() const { return static_cast<uint32_t>(m_levels.size()); }
+
+	// size of mip `mip` is max(1, width >> mip) x max(1, height >> mip)
+	const void*	 level(uint32_t mip)	 const { return m_file.data() + m_levels[mip]; }
+	uint64_t	 levelSize(uint32_t mip) const;
+	uint64_t	 dataSize()				 const;		// all levels
+
+private:
+	MappedFile			  m_file;
+	TextureCodec		  m_codec  = TextureCodec::RGBA8;
+	bool				  m_srgb   = false;
+	uint32_t			  m_width  = 0;
+	uint32_t			  m_height = 0;
+	std::vector<uint64_t> m_levels;		// file offset of every mip
+};
+
+// Writes a 2D texture with its mips, mip 0 first, as a DX10 DDS that
+// DdsFile reads back. Goes through a temporary file like cookMesh().
+void writeDds(
+	const std::string& fileName, TextureCodec codec, bool srgb,
+	uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels);
@@ -0,0 +1,829 @@
+#include "fbx_import.h"
+#include "../LCBHSS/lcbhss_space.h"
+
+#include <stb_image.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// Binary FBX: a 27 byte header, then a tree of node records. Each record is
+// end offset, property count, property byte length, name, properties and
+// the child records closed by an all zero record. Offsets and counts are
+// 32 bit before version 7500 and 64 bit from then on.
+const char	   FBX_MAGIC[]		= "Kaydara FBX Binary  ";
+const size_t   FBX_HEADER_SIZE	= 27;
+
+struct FbxNode {
+	const char*	   name			 = nullptr;
+	uint32_t	   nameLength	 = 0;
+	const uint8_t* properties	 = nullptr;
+	uint32_t	   propertyCount = 0;
+	const uint8_t* children		 = nullptr;
+	const uint8_t* end			 = nullptr;
+
+	bool is(const char* other) const {
+		return strlen(other) == nameLength && memcmp(name, other, nameLength) == 0;
+	}
+};
+
+struct FbxProperty {
+	char		   type = 0;
+	const uint8_t* data = nullptr;		// behind the type code
+};
+
+template<typename T>
+T readRaw(const uint8_t* data) {
+	T value;
+	memcpy(&value, data, sizeof(T));
+	return value;
+}
+
+[[noreturn]] void parseError(const char* what) {
+	throw std::runtime_error(std::string("failed to parse FBX: ") + what);
+}
+
+class FbxReader {
+public:
+	FbxReader(const uint8_t* data, size_t size) : m_data(data), m_end(data + size) {
+		if (size < FBX_HEADER_SIZE || memcmp(data, FBX_MAGIC, sizeof(FBX_MAGIC) - 1) != 0) {
+			parseError("not a binary FBX file");
+		}
+		m_version = readRaw<uint32_t>(data + 23);
+		m_wide	  = m_version >= 7500;
+		if (m_version < 7000) {
+			parseError("FBX versions before 7.0 are not supported");
+		}
+	}
+
+	template<typename F>
+	void forEachTopLevel(F fn) const {
+		const uint8_t* cursor = m_data + FBX_HEADER_SIZE;
+		FbxNode node;
+		while (cursor < m_end && _readNode(cursor, m_end, node)) {
+			fn(node);
+		}
+	}
+
+	template<typename F>
+	void forEachChild(const FbxNode& parent, F fn) const {
+		const uint8_t* cursor = parent.children;
+		FbxNode child;
+		while (cursor < parent.end && _readNode(cursor, parent.end, child)) {
+			fn(child);
+		}
+	}
+
+	bool findChild(const FbxNode& parent, const char* name, FbxNode& result) const {
+		bool found = false;
+		forEachChild(parent, [&](const FbxNode& child) {
+			if (!found && child.is(name)) {
+				result = child;
+				found  = true;
+			}
+		});
+		return found;
+	}
+
+	FbxProperty property(const FbxNode& node, uint32_t index) const {
+		if (index >= node.propertyCount) {
+			parseError("missing property");
+		}
+		const uint8_t* cursor = node.properties;
+		for (uint32_t i = 0; i < index; i++) {
+			cursor = _skipProperty(cursor, node.children);
+		}
+		if (cursor >= node.children) {
+			parseError("truncated property list");
+		}
+		FbxProperty result;
+		result.type = static_cast<char>(*cursor);
+		result.data = cursor + 1;
+		return result;
+	}
+
+	int64_t integer(const FbxProperty& prop) const {
+		switch (prop.type) {
+		case 'C': return prop.data[0];
+		case 'Y': return readRaw<int16_t>(prop.data);
+		case 'I': return readRaw<int32_t>(prop.data);
+		case 'L': return readRaw<int64_t>(prop.data);
+		default:  parseError("expected an integer property");
+		}
+	}
+
+	double number(const FbxProperty& prop) const {
+		switch (prop.type) {
+		case 'F': return readRaw<float>(prop.data);
+		case 'D': return readRaw<double>(prop.data);
+		default:  return static_cast<double>(integer(prop));
+		}
+	}
+
+	// FBX writes "Name\0\1Class" for object names, the class part is cut off
+	std::string string(const FbxProperty& prop) const {
+		if (prop.type != 'S' && prop.type != 'R') {
+			parseError("expected a string property");
+		}
+		uint32_t	length = readRaw<uint32_t>(prop.data);
+		const char* text   = reinterpret_cast<const char*>(prop.data + 4);
+		return std::string(text, strnlen(text, length));
+	}
+
+	bool stringIs(const FbxProperty& prop, const char* value) const {
+		if (prop.type != 'S') {
+			return false;
+		}
+		uint32_t length = readRaw<uint32_t>(prop.data);
+		return strlen(value) == length && memcmp(prop.data + 4, value, length) == 0;
+	}
+
+	void doubles(const FbxProperty& prop, std::vector<double>& out) {
+		uint32_t	   count;
+		const uint8_t* data = _arrayData(prop, count);
+		out.resize(count);
+		if (prop.type == 'd') {
+			memcpy(out.data(), data, count * sizeof(double));
+		}
+		else if (prop.type == 'f') {
+			for (uint32_t i = 0; i < count; i++) {
+				out[i] = readRaw<float>(data + i * sizeof(float));
+			}
+		}
+		else {
+			parseError("expected a floating point array");
+		}
+	}
+
+	void ints(const FbxProperty& prop, std::vector<int32_t>& out) {
+		uint32_t	   count;
+		const uint8_t* data = _arrayData(prop, count);
+		out.resize(count);
+		if (prop.type == 'i') {
+			memcpy(out.data(), data, count * sizeof(int32_t));
+		}
+		else if (prop.type == 'l') {
+			for (uint32_t i = 0; i < count; i++) {
+				out[i] = static_cast<int32_t>(readRaw<int64_t>(data + i * sizeof(int64_t)));
+			}
+		}
+		else {
+			parseError("expected an integer array");
+		}
+	}
+
+	uint32_t version() const { return m_version; }
+
+private:
+	bool _readNode(const uint8_t*& cursor, const uint8_t* limit, FbxNode& node) const {
+		const size_t headerSize = m_wide ? 25 : 13;
+		if (static_cast<size_t>(limit - cursor) < headerSize) {
+			parseError("truncated node record");
+		}
+
+		uint64_t endOffset, propertyCount, propertyBytes;
+		if (m_wide) {
+			endOffset	  = readRaw<uint64_t>(cursor);
+			propertyCount = readRaw<uint64_t>(cursor + 8);
+			propertyBytes = readRaw<uint64_t>(cursor + 16);
+		}
+		else {
+			endOffset	  = readRaw<uint32_t>(cursor);
+			propertyCount = readRaw<uint32_t>(cursor + 4);
+			propertyBytes = readRaw<uint32_t>(cursor + 8);
+		}
+		if (endOffset == 0) {
+			cursor += headerSize;
+			return false;
+		}
+
+		node.nameLength	   = cursor[headerSize - 1];
+		node.name		   = reinterpret_cast<const char*>(cursor + headerSize);
+		node.properties	   = cursor + headerSize + node.nameLength;
+		node.propertyCount = static_cast<uint32_t>(propertyCount);
+		node.end		   = m_data + endOffset;
+		if (node.end > limit || node.end <= cursor ||
+			propertyBytes > static_cast<uint64_t>(node.end - node.properties)) {
+			parseError("node record out of bounds");
+		}
+		node.children = node.properties + propertyBytes;
+
+		cursor = node.end;
+		return true;
+	}
+
+	const uint8_t* _skipProperty(const uint8_t* cursor, const uint8_t* limit) const {
+		const uint8_t* data = cursor + 1;
+		const uint8_t* next = nullptr;
+		switch (*cursor) {
+		case 'C': case 'B':			  next = data + 1; break;
+		case 'Y':					  next = data + 2; break;
+		case 'I': case 'F':			  next = data + 4; break;
+		case 'D': case 'L':			  next = data + 8; break;
+		case 'S': case 'R':
+			next = data + 4 + readRaw<uint32_t>(data);
+			break;
+		case 'f': case 'd': case 'l': case 'i': case 'b':
+			next = data + 12 + readRaw<uint32_t>(data + 8);
+			break;
+		default:
+			parseError("unknown property type");
+		}
+		if (next > limit) {
+			parseError("property out of bounds");
+		}
+		return next;
+	}
+
+	// raw or inflated array contents, inflated ones live in m_inflated
+	// until the next call
+	const uint8_t* _arrayData(const FbxProperty& prop, uint32_t& count) {
+		uint32_t elementSize;
+		switch (prop.type) {
+		case 'b':			elementSize = 1; break;
+		case 'i': case 'f': elementSize = 4; break;
+		case 'l': case 'd': elementSize = 8; break;
+		default:
+			parseError("expected an array property");
+		}
+
+		count = readRaw<uint32_t>(prop.data);
+		uint32_t encoding  = readRaw<uint32_t>(prop.data + 4);
+		uint32_t byteCount = readRaw<uint32_t>(prop.data + 8);
+		const uint8_t* stored = prop.data + 12;
+		size_t rawSize = static_cast<size_t>(count) * elementSize;
+
+		if (encoding == 0) {
+			if (byteCount != rawSize) {
+				parseError("array size mismatch");
+			}
+			return stored;
+		}
+		if (encoding != 1) {
+			parseError("unknown array encoding");
+		}
+		if (m_inflated.size() < rawSize) {
+			m_inflated.resize(rawSize);
+		}
+		int inflated = stbi_zlib_decode_buffer(
+			reinterpret_cast<char*>(m_inflated.data()), static_cast<int>(rawSize),
+			reinterpret_cast<const char*>(stored), static_cast<int>(byteCount));
+		if (inflated != static_cast<int>(rawSize)) {
+			parseError("corrupt compressed array");
+		}
+		return m_inflated.data();
+	}
+
+	const uint8_t*		 m_data;
+	const uint8_t*		 m_end;
+	uint32_t			 m_version = 0;
+	bool				 m_wide	   = false;
+	std::vector<uint8_t> m_inflated;
+};
+
+//-----------------------------------------------------------------------------
+
+enum class Mapping {
+	None,
+	ByPolygonVertex,
+	ByControlPoint,
+	ByPolygon,
+	AllSame
+};
+
+// one LayerElementNormal / UV / Material, values are read into scratch
+// vectors owned by the element and reused for every geometry
+struct LayerElement {
+	Mapping				 mapping  = Mapping::None;
+	bool				 indirect = false;
+	std::vector<double>	 values;
+	std::vector<int32_t> indices;		// IndexToDirect indices or material slots
+
+	void clear() {
+		mapping	 = Mapping::None;
+		indirect = false;
+		values.clear();
+		indices.clear();
+	}
+
+	void read(FbxReader& reader, const FbxNode& element,
+		const char* valueName, const char* indexName) {
+		clear();
+		reader.forEachChild(element, [&](const FbxNode& child) {
+			if (child.is("MappingInformationType")) {
+				FbxProperty prop = reader.property(child, 0);
+				if (reader.stringIs(prop, "ByPolygonVertex")) {
+					mapping = Mapping::ByPolygonVertex;
+				}
+				else if (reader.stringIs(prop, "ByVertex") ||
+					reader.stringIs(prop, "ByVertice") ||
+					reader.stringIs(prop, "ByControlPoint")) {
+					mapping = Mapping::ByControlPoint;
+				}
+				else if (reader.stringIs(prop, "ByPolygon")) {
+					mapping = Mapping::ByPolygon;
+				}
+				else if (reader.stringIs(prop, "AllSame")) {
+					mapping = Mapping::AllSame;
+				}
+			}
+			else if (child.is("ReferenceInformationType")) {
+				FbxProperty prop = reader.property(child, 0);
+				indirect = reader.stringIs(prop, "IndexToDirect") ||
+					reader.stringIs(prop, "Index");
+			}
+			else if (valueName && child.is(valueName)) {
+				reader.doubles(reader.property(child, 0), values);
+			}
+			else if (child.is(indexName)) {
+				reader.ints(reader.property(child, 0), indices);
+			}
+		});
+	}
+
+	// element index for a corner, -1 when the layer has nothing for it
+	int32_t lookup(uint32_t corner, uint32_t controlPoint, uint32_t polygon) const {
+		uint32_t slot;
+		switch (mapping) {
+		case Mapping::ByPolygonVertex: slot = corner;		break;
+		case Mapping::ByControlPoint:  slot = controlPoint; break;
+		case Mapping::ByPolygon:	   slot = polygon;		break;
+		case Mapping::AllSame:		   slot = 0;			break;
+		default:					   return -1;
+		}
+		if (!indirect) {
+			return static_cast<int32_t>(slot);
+		}
+		return slot < indices.size() ? indices[slot] : -1;
+	}
+};
+
+struct IdIndex {
+	int64_t	 id;
+	uint32_t index;
+
+	bool operator<(const IdIndex& other) const { return id < other.id; }
+};
+
+int32_t findId(const std::vector<IdIndex>& sorted, int64_t id) {
+	auto it = std::lower_bound(sorted.begin(), sorted.end(), IdIndex{ id, 0 });
+	return it != sorted.end() && it->id == id ? static_cast<int32_t>(it->index) : -1;
+}
+
+struct FbxModel {
+	int64_t	  id		= 0;
+	int64_t	  parentId	= 0;
+	glm::mat4 local		= glm::mat4(1.0f);
+	glm::mat4 geometric = glm::mat4(1.0f);
+};
+
+glm::mat4 eulerXYZ(const glm::vec3& degrees) {
+	glm::mat4 identity(1.0f);
+	return glm::rotate(identity, glm::radians(degrees.z), glm::vec3(0, 0, 1)) *
+		   glm::rotate(identity, glm::radians(degrees.y), glm::vec3(0, 1, 0)) *
+		   glm::rotate(identity, glm::radians(degrees.x), glm::vec3(1, 0, 0));
+}
+
+// pivots and offsets are ignored, exporters rarely set them for meshes
+void readModelTransform(const FbxReader& reader, const FbxNode& model, FbxModel& result) {
+	glm::vec3 translation(0.0f), rotation(0.0f), preRotation(0.0f), scaling(1.0f);
+	glm::vec3 geoTranslation(0.0f), geoRotation(0.0f), geoScaling(1.0f);
+
+	FbxNode properties;
+	if (reader.findChild(model, "Properties70", properties)) {
+		reader.forEachChild(properties, [&](const FbxNode& p) {
+			if (p.propertyCount < 7) {
+				return;
+			}
+			FbxProperty name = reader.property(p, 0);
+			glm::vec3* target =
+				reader.stringIs(name, "Lcl Translation")	  ? &translation :
+				reader.stringIs(name, "Lcl Rotation")		  ? &rotation :
+				reader.stringIs(name, "Lcl Scaling")		  ? &scaling :
+				reader.stringIs(name, "PreRotation")		  ? &preRotation :
+				reader.stringIs(name, "GeometricTranslation") ? &geoTranslation :
+				reader.stringIs(name, "GeometricRotation")	  ? &geoRotation :
+				reader.stringIs(name, "GeometricScaling")	  ? &geoScaling : nullptr;
+			if (target) {
+				for (uint32_t i = 0; i < 3; i++) {
+					(*target)[i] = static_cast<float>(reader.number(reader.property(p, 4 + i)));
+				}
+			}
+		});
+	}
+
+	glm::mat4 identity(1.0f);
+	result.local =
+		glm::translate(identity, translation) *
+		eulerXYZ(preRotation) * eulerXYZ(rotation) *
+		glm::scale(identity, scaling);
+	result.geometric =
+		glm::translate(identity, geoTranslation) *
+		eulerXYZ(geoRotation) *
+		glm::scale(identity, geoScaling);
+}
+
+// open addressing table merging corners whose position, normal and UV are
+// bit identical; exporters write normals and UVs per corner, so equal
+// values, not equal element indices, are what makes corners shareable
+class CornerTable {
+public:
+	void reset(size_t corners) {
+		size_t capacity = 16;
+		while (capacity < corners * 2) {
+			capacity *= 2;
+		}
+		m_slots.assign(capacity, UINT32_MAX);
+		m_mask = capacity - 1;
+	}
+
+	// index of an equal vertex, appends `vertex` when there is none
+	uint32_t findOrInsert(const MeshVertex& vertex, std::vector<MeshVertex>& vertices) {
+		uint32_t words[sizeof(MeshVertex) / 4];
+		memcpy(words, &vertex, sizeof(words));
+		uint32_t hash = 2166136261u;
+		for (uint32_t word : words) {
+			hash = (hash ^ word) * 16777619u;
+		}
+
+		for (size_t i = hash & m_mask;; i = (i + 1) & m_mask) {
+			uint32_t& slot = m_slots[i];
+			if (slot == UINT32_MAX) {
+				slot = static_cast<uint32_t>(vertices.size());
+				vertices.push_back(vertex);
+				return slot;
+			}
+			if (memcmp(&vertices[slot], &vertex, sizeof(MeshVertex)) == 0) {
+				return slot;
+			}
+		}
+	}
+
+private:
+	std::vector<uint32_t> m_slots;		// vertex index or UINT32_MAX
+	size_t				  m_mask = 0;
+};
+
+}
+
+MeshData loadFbxMesh(const std::string& fileName) {
+	auto begin = std::chrono::high_resolution_clock::now();
+
+	std::vector<char> file = readFile(fileName);
+	FbxReader reader(reinterpret_cast<const uint8_t*>(file.data()), file.size());
+
+	MeshData mesh;
+
+	// pass 1: collect objects and connections, nothing is decoded yet
+	std::vector<FbxNode>  geometries;
+	std::vector<FbxModel> models;
+	std::vector<IdIndex>  geometryIds, modelIds, materialIds, textureIds;
+	std::vector<std::string> textureFiles;
+	struct Link {
+		int64_t child;
+		int64_t parent;
+	};
+	std::vector<Link> links, diffuseLinks;		// diffuse: texture -> material
+
+	reader.forEachTopLevel([&](const FbxNode& top) {
+		if (top.is("GlobalSettings")) {
+			FbxNode properties;
+			if (reader.findChild(top, "Properties70", properties)) {
+				reader.forEachChild(properties, [&](const FbxNode& p) {
+					if (p.propertyCount >= 5 &&
+						reader.stringIs(reader.property(p, 0), "UpAxis")) {
+						mesh.upAxis = static_cast<uint32_t>(
+							reader.integer(reader.property(p, 4)));
+					}
+				});
+			}
+		}
+		else if (top.is("Objects")) {
+			reader.forEachChild(top, [&](const FbxNode& object) {
+				if (object.propertyCount < 3) {
+					return;
+				}
+				int64_t id = reader.integer(reader.property(object, 0));
+				if (object.is("Geometry") &&
+					reader.stringIs(reader.property(object, 2), "Mesh")) {
+					geometryIds.push_back({ id, static_cast<uint32_t>(geometries.size()) });
+					geometries.push_back(object);
+				}
+				else if (object.is("Model")) {
+					FbxModel model;
+					model.id = id;
+					readModelTransform(reader, object, model);
+					modelIds.push_back({ id, static_cast<uint32_t>(models.size()) });
+					models.push_back(model);
+				}
+				else if (object.is("Material")) {
+					materialIds.push_back({ id, static_cast<uint32_t>(mesh.materials.size()) });
+					mesh.materials.push_back(reader.string(reader.property(object, 1)));
+				}
+				else if (object.is("Texture")) {
+					// the relative name survives moving the asset folder
+					FbxNode file;
+					if ((reader.findChild(object, "RelativeFilename", file) ||
+						reader.findChild(object, "FileName", file)) && file.propertyCount >= 1) {
+						textureIds.push_back({ id, static_cast<uint32_t>(textureFiles.size()) });
+						textureFiles.push_back(reader.string(reader.property(file, 0)));
+					}
+				}
+			});
+		}
+		else if (top.is("Connections")) {
+			reader.forEachChild(top, [&](const FbxNode& c) {
+				if (c.propertyCount >= 3 && reader.stringIs(reader.property(c, 0), "OO")) {
+					links.push_back({
+						reader.integer(reader.property(c, 1)),
+						reader.integer(reader.property(c, 2))
+					});
+				}
+				else if (c.propertyCount >= 4 && reader.stringIs(reader.property(c, 0), "OP") &&
+					reader.stringIs(reader.property(c, 3), "DiffuseColor")) {
+					diffuseLinks.push_back({
+						reader.integer(reader.property(c, 1)),
+						reader.integer(reader.property(c, 2))
+					});
+				}
+			});
+		}
+	});
+
+	std::sort(geometryIds.begin(), geometryIds.end());
+	std::sort(modelIds.begin(), modelIds.end());
+	std::sort(materialIds.begin(), materialIds.end());
+	std::sort(textureIds.begin(), textureIds.end());
+
+	// first diffuse texture of every material, with forward slashes
+	mesh.materialTextures.resize(mesh.materials.size());
+	for (const Link& link : diffuseLinks) {
+		int32_t texture	 = findId(textureIds, link.child);
+		int32_t material = findId(materialIds, link.parent);
+		if (texture >= 0 && material >= 0 && mesh.materialTextures[material].empty()) {
+			std::string file = textureFiles[texture];
+			std::replace(file.begin(), file.end(), '\\', '/');
+			mesh.materialTextures[material] = file;
+		}
+	}
+
+	// geometry instances and per-model material slots, in connection order
+	struct Instance {
+		uint32_t geometry;
+		int32_t	 model;
+	};
+	std::vector<Instance> instances;
+	std::vector<IdIndex>  modelMaterials;		// id = model index
+	std::vector<bool>	  geometryUsed(geometries.size(), false);
+
+	for (const Link& link : links) {
+		int32_t parentModel = findId(modelIds, link.parent);
+		if (parentModel < 0) {
+			continue;
+		}
+		int32_t index;
+		if ((index = findId(modelIds, link.child)) >= 0) {
+			models[index].parentId = link.parent;
+		}
+		else if ((index = findId(geometryIds, link.child)) >= 0) {
+			instances.push_back({ static_cast<uint32_t>(index), parentModel });
+			geometryUsed[index] = true;
+		}
+		else if ((index = findId(materialIds, link.child)) >= 0) {
+			modelMaterials.push_back({ parentModel, static_cast<uint32_t>(index) });
+		}
+	}
+	for (uint32_t i = 0; i < geometries.size(); i++) {
+		if (!geometryUsed[i]) {
+			instances.push_back({ i, -1 });
+		}
+	}
+	std::stable_sort(modelMaterials.begin(), modelMaterials.end());
+
+	// world transforms, parents resolved on demand
+	std::vector<glm::mat4> world(models.size());
+	std::vector<uint8_t>   worldState(models.size(), 0);		// 0 todo, 1 busy, 2 done
+	auto worldOf = [&](int32_t model) {
+		std::vector<int32_t> chain;
+		for (int32_t m = model; m >= 0 && worldState[m] != 2; m = findId(modelIds, models[m].parentId)) {
+			if (worldState[m] == 1) {
+				break;		// cycle, treat as root
+			}
+			worldState[m] = 1;
+			chain.push_back(m);
+		}
+		for (size_t i = chain.size(); i-- > 0;) {
+			int32_t m	   = chain[i];
+			int32_t parent = findId(modelIds, models[m].parentId);
+			world[m]	   = parent >= 0 && worldState[parent] == 2 ?
+				world[parent] * models[m].local : models[m].local;
+			worldState[m]  = 2;
+		}
+		return world[model];
+	};
+
+	// pass 2: decode and emit every instance
+	std::vector<double>	  positions;
+	std::vector<int32_t>  polygons;
+	std::vector<glm::vec3> points;			// transformed control points
+	LayerElement		  normals, uvs, materials;
+	CornerTable			  corners;
+	std::vector<uint32_t> triangles;		// 3 indices per triangle
+	std::vector<uint32_t> triangleMaterials;
+	std::vector<uint32_t> polygonCorners;
+	uint32_t			  defaultMaterial = UINT32_MAX;
+
+	for (const Instance& instance : instances) {
+		const FbxNode& geometry = geometries[instance.geometry];
+
+		positions.clear();
+		polygons.clear();
+		normals.clear();
+		uvs.clear();
+		materials.clear();
+		bool hasNormals = false, hasUVs = false, hasMaterials = false;
+
+		reader.forEachChild(geometry, [&](const FbxNode& child) {
+			if (child.is("Vertices")) {
+				reader.doubles(reader.property(child, 0), positions);
+			}
+			else if (child.is("PolygonVertexIndex")) {
+				reader.ints(reader.property(child, 0), polygons);
+			}
+			else if (child.is("LayerElementNormal") && !hasNormals) {
+				normals.read(reader, child, "Normals", "NormalsIndex");
+				hasNormals = !normals.values.empty();
+			}
+			else if (child.is("LayerElementUV") && !hasUVs) {
+				uvs.read(reader, child, "UV", "UVIndex");
+				hasUVs = !uvs.values.empty();
+			}
+			else if (child.is("LayerElementMaterial") && !hasMaterials) {
+				// Materials holds the model's slot per polygon, whatever the
+				// reference type says
+				materials.read(reader, child, nullptr, "Materials");
+				materials.indirect = true;
+				hasMaterials	   = !materials.indices.empty();
+			}
+		});
+		if (!hasNormals) {
+			normals.mapping = Mapping::None;
+		}
+		if (!hasUVs) {
+			uvs.mapping = Mapping::None;
+		}
+
+		glm::mat4 transform(1.0f);
+		uint32_t  firstMaterial = 0, materialCount = 0;
+		if (instance.model >= 0) {
+			transform = worldOf(instance.model) * models[instance.model].geometric;
+
+			auto range = std::equal_range(modelMaterials.begin(), modelMaterials.end(),
+				IdIndex{ instance.model, 0 });
+			firstMaterial = static_cast<uint32_t>(range.first - modelMaterials.begin());
+			materialCount = static_cast<uint32_t>(range.second - range.first);
+		}
+		glm::mat3 normalTransform = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+		uint32_t controlPointCount = static_cast<uint32_t>(positions.size() / 3);
+		uint32_t vertexBase		   = static_cast<uint32_t>(mesh.vertices.size());
+		size_t	 triangleBase	   = triangles.size();
+		corners.reset(polygons.size());
+
+		points.resize(controlPointCount);
+		for (uint32_t i = 0; i < controlPointCount; i++) {
+			const double* p = &positions[i * 3];
+			points[i] = glm::vec3(transform * glm::vec4(
+				static_cast<float>(p[0]), static_cast<float>(p[1]), static_cast<float>(p[2]), 1.0f));
+		}
+
+		uint32_t polygon = 0;
+		polygonCorners.clear();
+		for (uint32_t corner = 0; corner < polygons.size(); corner++) {
+			int32_t	 raw		  = polygons[corner];
+			bool	 last		  = raw < 0;
+			uint32_t controlPoint = static_cast<uint32_t>(last ? ~raw : raw);
+			if (controlPoint >= controlPointCount) {
+				parseError("polygon index out of range");
+			}
+
+			int32_t normal = normals.lookup(corner, controlPoint, polygon);
+			int32_t uv	   = uvs.lookup(corner, controlPoint, polygon);
+			if (normal >= 0 && static_cast<size_t>(normal) * 3 + 2 >= normals.values.size()) {
+				normal = -1;
+			}
+			if (uv >= 0 && static_cast<size_t>(uv) * 2 + 1 >= uvs.values.size()) {
+				uv = -1;
+			}
+
+			MeshVertex v;
+			v.position = points[controlPoint];
+			v.normal   = glm::vec3(0.0f);
+			if (normal >= 0) {
+				const double* n = &normals.values[normal * 3];
+				v.normal = glm::normalize(normalTransform * glm::vec3(
+					static_cast<float>(n[0]), static_cast<float>(n[1]), static_cast<float>(n[2])));
+			}
+			v.uv = glm::vec2(0.0f);
+			if (uv >= 0) {
+				const double* t = &uvs.values[uv * 2];
+				v.uv = glm::vec2(static_cast<float>(t[0]), 1.0f - static_cast<float>(t[1]));
+			}
+			polygonCorners.push_back(corners.findOrInsert(v, mesh.vertices));
+
+			if (!last) {
+				continue;
+			}
+
+			// material slot of the model, then the global material
+			uint32_t material = UINT32_MAX;
+			if (hasMaterials) {
+				int32_t slot = materials.lookup(corner, controlPoint, polygon);
+				if (slot >= 0 && static_cast<uint32_t>(slot) < materialCount) {
+					material = modelMaterials[firstMaterial + slot].index;
+				}
+			}
+			if (material == UINT32_MAX) {
+				if (defaultMaterial == UINT32_MAX) {
+					defaultMaterial = static_cast<uint32_t>(mesh.materials.size());
+					mesh.materials.push_back("default");
+					mesh.materialTextures.push_back(std::string());
+				}
+				material = defaultMaterial;
+			}
+
+			for (size_t i = 1; i + 1 < polygonCorners.size(); i++) {
+				triangles.push_back(polygonCorners[0]);
+				triangles.push_back(polygonCorners[i]);
+				triangles.push_back(polygonCorners[i + 1]);
+				triangleMaterials.push_back(material);
+			}
+			polygonCorners.clear();
+			polygon++;
+		}
+
+		if (!hasNormals) {
+			// smooth normals over the merged corners of this instance
+			for (size_t t = triangleBase; t < triangles.size(); t += 3) {
+				MeshVertex& a = mesh.vertices[triangles[t]];
+				MeshVertex& b = mesh.vertices[triangles[t + 1]];
+				MeshVertex& c = mesh.vertices[triangles[t + 2]];
+				glm::vec3 face = glm::cross(b.position - a.position, c.position - a.position);
+				a.normal += face;
+				b.normal += face;
+				c.normal += face;
+			}
+			for (size_t v = vertexBase; v < mesh.vertices.size(); v++) {
+				float length = glm::length(mesh.vertices[v].normal);
+				mesh.vertices[v].normal = length > 0.0f ?
+					mesh.vertices[v].normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+			}
+		}
+	}
+
+	// counting sort of the triangles by material
+	std::vector<uint32_t> materialStart(mesh.materials.size() + 1, 0);
+	for (uint32_t material : triangleMaterials) {
+		materialStart[material + 1]++;
+	}
+	for (size_t i = 1; i < materialStart.size(); i++) {
+		materialStart[i] += materialStart[i - 1];
+	}
+	for (size_t i = 0; i + 1 < materialStart.size(); i++) {
+		if (materialStart[i + 1] > materialStart[i]) {
+			mesh.ranges.push_back({
+				static_cast<uint32_t>(i), materialStart[i] * 3,
+				(materialStart[i + 1] - materialStart[i]) * 3
+			});
+		}
+	}
+	mesh.indices.resize(triangles.size());
+	for (size_t t = 0; t < triangleMaterials.size(); t++) {
+		uint32_t dst = materialStart[triangleMaterials[t]]++ * 3;
+		mesh.indices[dst]	  = triangles[t * 3];
+		mesh.indices[dst + 1] = triangles[t * 3 + 1];
+		mesh.indices[dst + 2] = triangles[t * 3 + 2];
+	}
+
+	if (!mesh.vertices.empty()) {
+		mesh.boundsMin = mesh.boundsMax = mesh.vertices[0].position;
+		for (const MeshVertex& v : mesh.vertices) {
+			mesh.boundsMin = glm::min(mesh.boundsMin, v.position);
+			mesh.boundsMax = glm::max(mesh.boundsMax, v.position);
+		}
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - begin).count();
+	Log("fbx: %s (v%u): %u meshes, %u vertices, %u triangles, %u materials in %.1f ms",
+		fileName.c_str(), reader.version(),
+		static_cast<uint32_t>(instances.size()),
+		static_cast<uint32_t>(mesh.vertices.size()),
+		static_cast<uint32_t>(mesh.indices.size() / 3),
+		static_cast<uint32_t>(mesh.ranges.size()), ms);
+	return mesh;
+}
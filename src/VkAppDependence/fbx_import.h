@@ -0,0 +1,18 @@
+#pragma once
+
+#include "mesh_data.h"
+
+#include <string>
+
+// Loads every "Mesh" geometry of a binary FBX 7.x file into one triangle
+// list. Polygons are fan triangulated, corners sharing position, normal and
+// UV are merged, and each instance is baked with its model's world
+// transform (translation, pre-rotation, XYZ euler rotation, scaling and the
+// geometric offset). Missing normals are generated smooth. Positions stay
+// in the file's axes and units, see MeshData::upAxis.
+//
+// The file is read in one piece and walked in place; compressed arrays are
+// inflated into scratch buffers that are reused across geometries, so the
+// import allocates little beyond the output itself. Throws on malformed or
+// ASCII files.
+MeshData loadFbxMesh(const std::string& fileName);
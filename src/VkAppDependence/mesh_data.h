@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct MeshVertex {
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 uv;			// top left origin, as Vulkan samples
+};
+
+// Triangles [firstIndex, firstIndex + indexCount) all use one material.
+struct MaterialRange {
+	uint32_t material;		// index into MeshData::materials
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
+// One triangle list, ranges sorted by material and covering every index.
+struct MeshData {
+	std::vector<MeshVertex>	   vertices;
+	std::vector<uint32_t>	   indices;
+	std::vector<MaterialRange> ranges;
+	std::vector<std::string>   materials;
+	// diffuse texture per material as the source names it, relative to the
+	// source file with forward slashes; empty when it has none
+	std::vector<std::string>   materialTextures;
+
+	glm::vec3				   boundsMin = glm::vec3(0.0f);
+	glm::vec3				   boundsMax = glm::vec3(0.0f);
+	uint32_t				   upAxis	 = 1;		// 0 = X, 1 = Y, 2 = Z
+};
@@ -0,0 +1,173 @@
+#include "mesh_file.h"
+#include "fbx_import.h"
+#include "mesh_optimize.h"
+#include "mesh_meshlet.h"
+#include "../LCBHSS/lcbhss_space.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+static uint64_t alignOffset(uint64_t offset) {
+	return (offset + MESH_FILE_ALIGNMENT - 1) & ~static_cast<uint64_t>(MESH_FILE_ALIGNMENT - 1);
+}
+
+void cookMesh(
+	const std::string& sourceName, const std::string& fileName, VertexFormat format
+) {
+	auto begin = std::chrono::high_resolution_clock::now();
+
+	MeshData mesh = loadFbxMesh(sourceName);
+	optimizeMesh(mesh);
+	std::vector<Meshlet> meshlets;
+	buildMeshlets(mesh, meshlets);
+	std::vector<uint8_t> vertices;
+	encodeVertices(mesh.vertices, format, mesh.boundsMin, mesh.boundsMax, vertices);
+
+	MeshFileHeader header = {};
+	header.magic		 = MESH_FILE_MAGIC;
+	header.version		 = MESH_FILE_VERSION;
+	header.vertexStride	 = vertexLayout(format).stride;
+	header.vertexCount	 = static_cast<uint32_t>(mesh.vertices.size());
+	header.indexCount	 = static_cast<uint32_t>(mesh.indices.size());
+	header.rangeCount	 = static_cast<uint32_t>(mesh.ranges.size());
+	header.materialCount = static_cast<uint32_t>(mesh.materials.size());
+	header.upAxis		 = mesh.upAxis;
+	header.vertexFormat	 = static_cast<uint32_t>(format);
+	header.meshletCount	 = static_cast<uint32_t>(meshlets.size());
+	for (int i = 0; i < 3; i++) {
+		header.boundsMin[i] = mesh.boundsMin[i];
+		header.boundsMax[i] = mesh.boundsMax[i];
+	}
+	if (!fileStamp(sourceName, header.sourceSize, header.sourceTime)) {
+		throw std::runtime_error("failed to stat " + sourceName);
+	}
+
+	uint64_t materialBytes = 0;
+	for (size_t i = 0; i < mesh.materials.size(); i++) {
+		materialBytes += mesh.materials[i].size() + 1 + mesh.materialTextures[i].size() + 1;
+	}
+	header.vertexOffset	  = alignOffset(sizeof(MeshFileHeader));
+	header.indexOffset	  = alignOffset(header.vertexOffset + vertices.size());
+	header.rangeOffset	  = alignOffset(header.indexOffset + mesh.indices.size() * sizeof(uint32_t));
+	header.meshletOffset  = alignOffset(header.rangeOffset + mesh.ranges.size() * sizeof(MaterialRange));
+	header.materialOffset = alignOffset(header.meshletOffset + meshlets.size() * sizeof(Meshlet));
+	header.fileSize		  = header.materialOffset + materialBytes;
+
+	std::string tempName = fileName + ".tmp";
+	{
+		std::ofstream file(tempName, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			throw std::runtime_error("failed to create " + tempName);
+		}
+
+		uint64_t written = 0;
+		auto put = [&](uint64_t offset, const void* data, uint64_t size) {
+			static const char zeros[MESH_FILE_ALIGNMENT] = {};
+			file.write(zeros, static_cast<std::streamsize>(offset - written));
+			file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+			written = offset + size;
+		};
+		put(0, &header, sizeof(header));
+		put(header.vertexOffset, vertices.data(), vertices.size());
+		put(header.indexOffset, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+		put(header.rangeOffset, mesh.ranges.data(), mesh.ranges.size() * sizeof(MaterialRange));
+		put(header.meshletOffset, meshlets.data(), meshlets.size() * sizeof(Meshlet));
+		uint64_t nameOffset = header.materialOffset;
+		for (size_t i = 0; i < mesh.materials.size(); i++) {
+			for (const std::string* name : { &mesh.materials[i], &mesh.materialTextures[i] }) {
+				put(nameOffset, name->c_str(), name->size() + 1);
+				nameOffset += name->size() + 1;
+			}
+		}
+
+		if (!file.flush()) {
+			throw std::runtime_error("failed to write " + tempName);
+		}
+	}
+
+	// rename does not replace an existing file on Windows
+	std::remove(fileName.c_str());
+	if (std::rename(tempName.c_str(), fileName.c_str()) != 0) {
+		std::remove(tempName.c_str());
+		throw std::runtime_error("failed to replace " + fileName);
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - begin).count();
+	Log("mesh: cooked %s (%s vertices), %.2f MB in %.1f ms",
+		fileName.c_str(), vertexLayout(format).name,
+		header.fileSize / (1024.0 * 1024.0), ms);
+}
+
+bool MeshFile::open(const std::string& fileName, VertexFormat format) {
+	close();
+	if (!m_file.open(fileName) || m_file.size() < sizeof(MeshFileHeader)) {
+		m_file.close();
+		return false;
+	}
+
+	const MeshFileHeader& h = *reinterpret_cast<const MeshFileHeader*>(m_file.data());
+	auto fits = [&](uint64_t offset, uint64_t count, uint64_t size) {
+		return offset % MESH_FILE_ALIGNMENT == 0 &&
+			offset <= h.fileSize && count <= (h.fileSize - offset) / size;
+	};
+	bool valid =
+		h.magic == MESH_FILE_MAGIC &&
+		h.version == MESH_FILE_VERSION &&
+		h.vertexFormat == static_cast<uint32_t>(format) &&
+		h.vertexStride == vertexLayout(format).stride &&
+		h.fileSize == m_file.size() &&
+		fits(h.vertexOffset, h.vertexCount, h.vertexStride) &&
+		fits(h.indexOffset, h.indexCount, sizeof(uint32_t)) &&
+		fits(h.rangeOffset, h.rangeCount, sizeof(MaterialRange)) &&
+		fits(h.meshletOffset, h.meshletCount, sizeof(Meshlet)) &&
+		h.materialOffset <= h.fileSize &&
+		(h.materialCount == 0 || m_file.data()[h.fileSize - 1] == '\0');
+	if (!valid) {
+		Log("mesh: %s is not a current %s .vkmesh",
+			fileName.c_str(), vertexLayout(format).name);
+		m_file.close();
+		return false;
+	}
+
+	m_header = &h;
+	return true;
+}
+
+bool MeshFile::isStale(const std::string& sourceName) const {
+	uint64_t size, writeTime;
+	return fileStamp(sourceName, size, writeTime) &&
+		(size != m_header->sourceSize || writeTime != m_header->sourceTime);
+}
+
+const void* MeshFile::vertices() const {
+	return m_file.data() + m_header->vertexOffset;
+}
+
+const uint32_t* MeshFile::indices() const {
+	return reinterpret_cast<const uint32_t*>(m_file.data() + m_header->indexOffset);
+}
+
+const MaterialRange* MeshFile::ranges() const {
+	return reinterpret_cast<const MaterialRange*>(m_file.data() + m_header->rangeOffset);
+}
+
+const Meshlet* MeshFile::meshlets() const {
+	return reinterpret_cast<const Meshlet*>(m_file.data() + m_header->meshletOffset);
+}
+
+const char* MeshFile::material(uint32_t index) const {
+	const char* name = reinterpret_cast<const char*>(m_file.data() + m_header->materialOffset);
+	for (uint32_t i = 0; i < index * 2; i++) {
+		name += strlen(name) + 1;
+	}
+	return name;
+}
+
+const char* MeshFile::materialTexture(uint32_t index) const {
+	const char* name = material(index);
+	return name + strlen(name) + 1;
+}
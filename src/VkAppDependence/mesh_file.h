@@ -0,0 +1,83 @@
+#pragma once
+
+#include "vertex_format.h"
+#include "mesh_meshlet.h"
+#include "../LCBHSS/lcbhss_mapped_file.h"
+
+#include <string>
+#include <cstdint>
+
+// .vkmesh: a cooked mesh whose payloads are stored exactly as the GPU
+// buffers want them, so loading is a map and a copy into staging.
+//
+//   MeshFileHeader
+//   vertices[vertexCount]        layout of vertexFormat
+//   uint32_t[indexCount]
+//   MaterialRange[rangeCount]
+//   Meshlet[meshletCount]        covering the indices in order
+//   per material its name, then its diffuse texture path relative to
+//   the source file (empty without one), each null terminated
+//
+// Every payload starts on a MESH_FILE_ALIGNMENT boundary. A file is only
+// accepted with the current version and the requested vertex format,
+// anything else is cooked again. Little endian, like every platform the
+// demo runs on.
+const uint32_t MESH_FILE_MAGIC	   = 0x534D4B56;		// "VKMS"
+const uint32_t MESH_FILE_VERSION   = 5;		// 2: cache optimized, 3: vertex formats, 4: meshlets, 5: textures
+const uint32_t MESH_FILE_ALIGNMENT = 64;
+
+struct MeshFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexStride;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t rangeCount;
+	uint32_t materialCount;
+	uint32_t upAxis;
+	uint32_t vertexFormat;		// VertexFormat
+	uint32_t meshletCount;
+	float	 boundsMin[3];
+	float	 boundsMax[3];
+	uint64_t sourceSize;		// stamp of the file it was cooked from
+	uint64_t sourceTime;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t rangeOffset;
+	uint64_t materialOffset;
+	uint64_t meshletOffset;
+	uint64_t fileSize;
+};
+static_assert(sizeof(MeshFileHeader) == 128, "MeshFileHeader layout changed");
+
+// Imports `sourceName` (FBX), optimizes it for the vertex cache, splits it
+// into meshlets and writes it to `fileName`, via a temporary file so a
+// crash never leaves a half written mesh behind.
+void cookMesh(
+	const std::string& sourceName, const std::string& fileName, VertexFormat format);
+
+// A mapped .vkmesh. All pointers stay valid until close().
+class MeshFile {
+public:
+	// false when the file is missing or not a valid current .vkmesh
+	// in `format`
+	bool open(const std::string& fileName, VertexFormat format);
+	void close() { m_file.close(); m_header = nullptr; }
+
+	// true when `sourceName` exists and differs from the stamp it was
+	// cooked from; without the source the cooked file is all there is
+	bool isStale(const std::string& sourceName) const;
+
+	const MeshFileHeader& header()	  const { return *m_header; }
+	const void*			  vertices()  const;
+	const uint32_t*		  indices()	  const;
+	const MaterialRange*  ranges()	  const;
+	const Meshlet*		  meshlets()  const;
+	// name and diffuse texture of material i, walk the name table
+	const char*			  material(uint32_t index) const;
+	const char*			  materialTexture(uint32_t index) const;
+
+private:
+	MappedFile			  m_file;
+	const MeshFileHeader* m_header = nullptr;
+};
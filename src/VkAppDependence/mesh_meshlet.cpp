@@ -0,0 +1,274 @@
+#include "mesh_meshlet.h"
+#include "mesh_optimize.h"
+#include "../LCBHSS/lcbhss_space.h"
+
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <algorithm>
+
+namespace {
+
+// cones wider than this (cosine of the half angle) cull too rarely to test
+const float CONE_MIN_DOT = 0.1f;
+// a meshlet stops growing rather than take a triangle facing further than
+// this (cosine) from its average; smaller meshlets but cones that cull,
+// Pneuma keeps ~84% of its triangles from the demo's camera instead of ~98%
+const float CONE_LIMIT	 = 0.5f;
+// how many added vertices it is worth to keep a triangle facing like the
+// rest of its meshlet, per unit of (1 - cosine)
+const float CONE_WEIGHT	 = 1.0f;
+
+// Ritter's sphere: start from the two points furthest apart along a sweep
+// from the first vertex and grow the sphere over whatever lies outside
+void boundingSphere(const std::vector<glm::vec3>& points, glm::vec3& center, float& radius) {
+	auto furthest = [&](const glm::vec3& from) {
+		size_t best		= 0;
+		float  bestDist = -1.0f;
+		for (size_t i = 0; i < points.size(); i++) {
+			glm::vec3 d	   = points[i] - from;
+			float	  dist = glm::dot(d, d);
+			if (dist > bestDist) {
+				bestDist = dist;
+				best	 = i;
+			}
+		}
+		return points[best];
+	};
+	glm::vec3 a = furthest(points[0]);
+	glm::vec3 b = furthest(a);
+	center = (a + b) * 0.5f;
+	radius = glm::length(b - a) * 0.5f;
+
+	for (const glm::vec3& p : points) {
+		float dist = glm::length(p - center);
+		if (dist > radius) {
+			float grown = (radius + dist) * 0.5f;
+			center += (p - center) * ((grown - radius) / dist);
+			radius	= grown;
+		}
+	}
+}
+
+void finishMeshlet(
+	const std::vector<glm::vec3>& normals, Meshlet& meshlet, std::vector<glm::vec3>& points
+) {
+	glm::vec3 center;
+	float	  radius;
+	boundingSphere(points, center, radius);
+
+	uint32_t  firstTriangle = meshlet.firstIndex / 3;
+	glm::vec3 axis(0.0f);
+	for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+		axis += normals[firstTriangle + t];
+	}
+	float axisLength = glm::length(axis);
+	axis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+
+	// degenerate triangles have a zero normal and widen the cone to 90
+	// degrees, which disables it; they are never rasterized, but can not
+	// be told apart from slivers here
+	float minDot = 1.0f;
+	for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+		minDot = std::min(minDot, glm::dot(normals[firstTriangle + t], axis));
+	}
+
+	for (int i = 0; i < 3; i++) {
+		meshlet.center[i]	= center[i];
+		meshlet.coneAxis[i] = axis[i];
+	}
+	meshlet.radius		= radius;
+	meshlet.coneCutoff	= minDot <= CONE_MIN_DOT ?
+		1.0f : std::sqrt(1.0f - minDot * minDot);
+	meshlet.vertexCount = static_cast<uint32_t>(points.size());
+}
+
+}
+
+void buildMeshlets(MeshData& mesh, std::vector<Meshlet>& meshlets) {
+	meshlets.clear();
+	size_t triangleCount = mesh.indices.size() / 3;
+
+	std::vector<glm::vec3> normals(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++) {
+		const glm::vec3& a = mesh.vertices[mesh.indices[t * 3]].position;
+		const glm::vec3& b = mesh.vertices[mesh.indices[t * 3 + 1]].position;
+		const glm::vec3& c = mesh.vertices[mesh.indices[t * 3 + 2]].position;
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		float	  length = glm::length(normal);
+		normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+	}
+
+	// triangles around each position; attribute seams split vertices but
+	// should not stop a meshlet from growing across them
+	std::vector<uint32_t> positionOf(mesh.vertices.size());
+	{
+		std::unordered_map<uint64_t, uint32_t> first;
+		first.reserve(mesh.vertices.size());
+		for (size_t v = 0; v < mesh.vertices.size(); v++) {
+			uint32_t bits[3];
+			memcpy(bits, &mesh.vertices[v].position, sizeof(bits));
+			uint64_t key = (static_cast<uint64_t>(bits[0]) * 0x9E3779B1u) ^
+				(static_cast<uint64_t>(bits[1]) << 21) ^ (static_cast<uint64_t>(bits[2]) << 42) ^ bits[2];
+			auto inserted = first.emplace(key, static_cast<uint32_t>(v));
+			const glm::vec3& p = mesh.vertices[inserted.first->second].position;
+			// keep a colliding key unwelded rather than merging the wrong points
+			bool same = p.x == mesh.vertices[v].position.x &&
+				p.y == mesh.vertices[v].position.y && p.z == mesh.vertices[v].position.z;
+			positionOf[v] = same ? inserted.first->second : static_cast<uint32_t>(v);
+		}
+	}
+	std::vector<uint32_t> offsets(mesh.vertices.size() + 1, 0);
+	for (uint32_t index : mesh.indices) {
+		offsets[positionOf[index] + 1]++;
+	}
+	for (size_t v = 0; v < mesh.vertices.size(); v++) {
+		offsets[v + 1] += offsets[v];
+	}
+	std::vector<uint32_t> adjacency(mesh.indices.size());
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < mesh.indices.size(); i++) {
+			adjacency[fill[positionOf[mesh.indices[i]]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	std::vector<uint8_t>   emitted(triangleCount, 0);
+	std::vector<uint32_t>  owner(mesh.vertices.size(), UINT32_MAX);	// meshlet a vertex is in
+	std::vector<uint32_t>  members;		// vertices of the open meshlet
+	std::vector<glm::vec3> points;
+	std::vector<uint32_t>  reordered;
+	std::vector<glm::vec3> reorderedNormals;
+	reordered.reserve(mesh.indices.size());
+	reorderedNormals.reserve(triangleCount);
+
+	for (const MaterialRange& range : mesh.ranges) {
+		uint32_t firstTriangle = range.firstIndex / 3;
+		uint32_t endTriangle   = firstTriangle + range.indexCount / 3;
+
+		// seeds follow the input order, which optimizeMesh() left spatially
+		// coherent, so a new meshlet starts next to where the last one ended
+		for (uint32_t seed = firstTriangle; seed < endTriangle; seed++) {
+			if (emitted[seed]) {
+				continue;
+			}
+
+			uint32_t id = static_cast<uint32_t>(meshlets.size());
+			Meshlet	 meshlet = {};
+			meshlet.firstIndex = static_cast<uint32_t>(reordered.size());
+			meshlet.material   = range.material;
+			members.clear();
+			glm::vec3 normalSum(0.0f);
+
+			int64_t next = seed;
+			while (next >= 0) {
+				uint32_t triangle = static_cast<uint32_t>(next);
+				for (uint32_t c = 0; c < 3; c++) {
+					uint32_t v = mesh.indices[triangle * 3 + c];
+					reordered.push_back(v);
+					if (owner[v] != id) {
+						owner[v] = id;
+						members.push_back(v);
+					}
+				}
+				reorderedNormals.push_back(normals[triangle]);
+				normalSum += normals[triangle];
+				emitted[triangle] = 1;
+				if (++meshlet.triangleCount == MESHLET_MAX_TRIANGLES) {
+					break;
+				}
+
+				// the neighbour that adds the fewest vertices, ties go to
+				// the one facing most like the meshlet so far
+				float	  sumLength = glm::length(normalSum);
+				glm::vec3 axis		= sumLength > 0.0f ? normalSum / sumLength : glm::vec3(0.0f);
+				float	  bestScore = 0.0f;
+				next = -1;
+				for (uint32_t v : members) {
+					uint32_t position = positionOf[v];
+					for (uint32_t k = offsets[position]; k < offsets[position + 1]; k++) {
+						uint32_t candidate = adjacency[k];
+						if (emitted[candidate] ||
+							candidate < firstTriangle || candidate >= endTriangle) {
+							continue;
+						}
+						const uint32_t* corners = mesh.indices.data() + candidate * 3;
+						uint32_t		added	= (owner[corners[0]] != id) +
+							(owner[corners[1]] != id && corners[1] != corners[0]) +
+							(owner[corners[2]] != id && corners[2] != corners[0] &&
+								corners[2] != corners[1]);
+						float facing = glm::dot(normals[candidate], axis);
+						if (members.size() + added > MESHLET_MAX_VERTICES || facing < CONE_LIMIT) {
+							continue;
+						}
+						float score = added + CONE_WEIGHT * (1.0f - facing);
+						if (next < 0 || score < bestScore) {
+							bestScore = score;
+							next	  = candidate;
+						}
+					}
+				}
+			}
+
+			points.clear();
+			for (uint32_t v : members) {
+				points.push_back(mesh.vertices[v].position);
+			}
+			meshlets.push_back(meshlet);
+			finishMeshlet(reorderedNormals, meshlets.back(), points);
+		}
+	}
+	mesh.indices.swap(reordered);
+	optimizeVertexFetch(mesh);
+
+	uint32_t coned	   = 0;
+	uint64_t vertexSum = 0;
+	for (const Meshlet& meshlet : meshlets) {
+		coned	  += meshlet.coneCutoff < 1.0f;
+		vertexSum += meshlet.vertexCount;
+	}
+	size_t count = std::max<size_t>(meshlets.size(), 1);
+	VertexCacheStats cache = analyzeVertexCache(
+		mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+	Log("mesh: %zu meshlets, %.1f triangles and %.1f vertices on average, "
+		"%.0f%% can be cone culled, ACMR %.3f",
+		meshlets.size(), triangleCount / static_cast<double>(count),
+		static_cast<double>(vertexSum) / count, coned * 100.0 / count, cache.acmr);
+}
+
+MeshletCullParams meshletCullParams(const glm::mat4& clipFromMesh, const glm::mat4& viewFromMesh) {
+	// Gribb/Hartmann: the planes are sums of rows of the clip matrix
+	glm::vec4 rows[4];
+	for (int r = 0; r < 4; r++) {
+		rows[r] = glm::vec4(clipFromMesh[0][r], clipFromMesh[1][r],
+			clipFromMesh[2][r], clipFromMesh[3][r]);
+	}
+
+	MeshletCullParams params;
+	params.planes[0] = rows[3] + rows[0];		// left
+	params.planes[1] = rows[3] - rows[0];		// right
+	params.planes[2] = rows[3] + rows[1];
+	params.planes[3] = rows[3] - rows[1];
+	params.planes[4] = rows[2];					// near, depth is 0..1
+	params.planes[5] = rows[3] - rows[2];		// far
+	for (glm::vec4& plane : params.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+
+	params.camera = glm::inverse(viewFromMesh)[3];
+	return params;
+}
+
+bool meshletVisible(const Meshlet& meshlet, const MeshletCullParams& params) {
+	glm::vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+	for (const glm::vec4& plane : params.planes) {
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -meshlet.radius) {
+			return false;
+		}
+	}
+
+	glm::vec3 axis(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+	glm::vec3 toCenter = center - glm::vec3(params.camera);
+	return glm::dot(toCenter, axis) <
+		meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
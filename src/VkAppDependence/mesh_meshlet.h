@@ -0,0 +1,55 @@
+#pragma once
+
+#include "mesh_data.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+// limits of one cluster, the usual mesh shader sizes
+const uint32_t MESHLET_MAX_VERTICES	 = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// A run of triangles [firstIndex, firstIndex + triangleCount * 3) of the
+// mesh's index buffer, with bounds in mesh space. Laid out as std430 for
+// shaders/meshlet_cull.comp.
+struct Meshlet {
+	float	 center[3];			// bounding sphere
+	float	 radius;
+	float	 coneAxis[3];		// average facing of the triangles
+	float	 coneCutoff;		// sine of the cone's half angle, 1 when it can not cull
+	uint32_t firstIndex;
+	uint32_t triangleCount;
+	uint32_t vertexCount;
+	uint32_t material;
+};
+static_assert(sizeof(Meshlet) == 48, "Meshlet layout is shared with meshlet_cull.comp");
+
+// Splits every material range into meshlets of at most
+// MESHLET_MAX_VERTICES distinct vertices and MESHLET_MAX_TRIANGLES
+// triangles and rewrites the range's indices in meshlet order. A meshlet
+// grows over neighbouring triangles, preferring the ones that add no
+// vertices and face the same way as the rest, so its normal cone stays
+// narrow enough to cull. Meant to run after optimizeMesh(): seeds follow
+// its order and meshlets are small enough to keep most of its vertex cache
+// locality, while its overdraw order is given up, culling compacts meshlets
+// in whatever order they pass. Vertices are renumbered again for fetch
+// locality. Logs the cluster statistics.
+void buildMeshlets(MeshData& mesh, std::vector<Meshlet>& meshlets);
+
+// Frustum planes and camera position in the space the meshlet bounds are
+// in, pushed to meshlet_cull.comp as they are.
+struct MeshletCullParams {
+	glm::vec4 planes[6];		// xyz points inside, normalized
+	glm::vec4 camera;
+};
+static_assert(sizeof(MeshletCullParams) == 112, "MeshletCullParams is a push constant block");
+
+// `clipFromMesh` is proj * view * model with a 0..1 depth range,
+// `viewFromMesh` is view * model. Both may only scale uniformly.
+MeshletCullParams meshletCullParams(const glm::mat4& clipFromMesh, const glm::mat4& viewFromMesh);
+
+// the test meshlet_cull.comp runs: the sphere touches the frustum and the
+// camera is not behind every triangle's plane
+bool meshletVisible(const Meshlet& meshlet, const MeshletCullParams& params);
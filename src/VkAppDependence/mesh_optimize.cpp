@@ -0,0 +1,320 @@
+#include "mesh_optimize.h"
+#include "../LCBHSS/lcbhss_space.h"
+
+#include <algorithm>
+
+namespace {
+
+// clusters may cost this much more ACMR than their cache optimal order
+const float OVERDRAW_THRESHOLD = 1.05f;
+
+// FIFO cache simulated with time stamps; a vertex is cached while fewer
+// than `size` misses happened since it was loaded
+class CacheModel {
+public:
+	CacheModel(size_t vertexCount, uint32_t size) :
+		m_stamps(vertexCount, 0), m_time(size + 1), m_size(size) {
+	}
+
+	// 1 on a miss
+	uint32_t access(uint32_t vertex) {
+		if (m_time - m_stamps[vertex] > m_size) {
+			m_stamps[vertex] = m_time++;
+			return 1;
+		}
+		return 0;
+	}
+
+	void flush() { m_time += m_size + 1; }
+
+private:
+	std::vector<uint32_t> m_stamps;
+	uint32_t			  m_time;
+	uint32_t			  m_size;
+};
+
+// triangles around each vertex, CSR layout
+struct Adjacency {
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> triangles;
+
+	void build(const uint32_t* indices, size_t indexCount, size_t vertexCount) {
+		offsets.assign(vertexCount + 1, 0);
+		for (size_t i = 0; i < indexCount; i++) {
+			offsets[indices[i] + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++) {
+			offsets[v + 1] += offsets[v];
+		}
+		triangles.resize(indexCount);
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indexCount; i++) {
+			triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+};
+
+// Tipsify: fan around the vertex that stays cached longest, fall back to
+// recently emitted vertices, then to input order. `clusters` receives the
+// first triangle of every run restarted from input order, where the cache
+// holds nothing useful anyway.
+void tipsify(
+	const uint32_t* indices, size_t indexCount, size_t vertexCount,
+	uint32_t cacheSize, uint32_t* out, std::vector<uint32_t>& clusters
+) {
+	size_t triangleCount = indexCount / 3;
+	clusters.assign(1, 0);
+	if (triangleCount == 0) {
+		return;
+	}
+
+	Adjacency adjacency;
+	adjacency.build(indices, indexCount, vertexCount);
+
+	std::vector<uint32_t> live(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+	}
+	std::vector<uint32_t> stamps(vertexCount, 0);
+	std::vector<uint8_t>  emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnds;
+	std::vector<uint32_t> candidates;
+	deadEnds.reserve(indexCount);
+
+	uint32_t time	 = cacheSize + 1;
+	size_t	 cursor	 = 0;
+	size_t	 written = 0;
+	int64_t	 fan	 = indices[0];
+
+	while (fan >= 0) {
+		candidates.clear();
+		for (uint32_t k = adjacency.offsets[fan]; k < adjacency.offsets[fan + 1]; k++) {
+			uint32_t triangle = adjacency.triangles[k];
+			if (emitted[triangle]) {
+				continue;
+			}
+			for (uint32_t c = 0; c < 3; c++) {
+				uint32_t v = indices[triangle * 3 + c];
+				out[written++] = v;
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - stamps[v] > cacheSize) {
+					stamps[v] = time++;
+				}
+			}
+			emitted[triangle] = 1;
+		}
+
+		// the candidate that is oldest in the cache but will still be there
+		// after emitting all of its remaining triangles
+		int64_t next = -1;
+		int64_t best = -1;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0) {
+				continue;
+			}
+			int64_t priority = 0;
+			if (time - stamps[v] + 2 * live[v] <= cacheSize) {
+				priority = time - stamps[v];
+			}
+			if (priority > best) {
+				best = priority;
+				next = v;
+			}
+		}
+
+		if (next < 0) {
+			while (!deadEnds.empty()) {
+				uint32_t v = deadEnds.back();
+				deadEnds.pop_back();
+				if (live[v] > 0) {
+					next = v;
+					break;
+				}
+			}
+			bool restart = next < 0;
+			for (; next < 0 && cursor < vertexCount; cursor++) {
+				if (live[cursor] > 0) {
+					next = static_cast<int64_t>(cursor);
+				}
+			}
+			if (restart && next >= 0) {
+				clusters.push_back(static_cast<uint32_t>(written / 3));
+			}
+		}
+		fan = next;
+	}
+}
+
+// Splits the tipsify clusters further wherever the part so far is already
+// within OVERDRAW_THRESHOLD of the cluster's ACMR, then sorts the clusters
+// by how much they face away from the range's centre (Sander et al. 2007,
+// "fast overdraw" ordering).
+void optimizeOverdraw(
+	uint32_t* indices, size_t indexCount, const std::vector<MeshVertex>& vertices,
+	const std::vector<uint32_t>& hardClusters, uint32_t cacheSize
+) {
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	std::vector<uint32_t> clusters;
+	CacheModel cache(vertices.size(), cacheSize);
+	for (size_t h = 0; h < hardClusters.size(); h++) {
+		uint32_t start = hardClusters[h];
+		uint32_t end   = h + 1 < hardClusters.size() ?
+			hardClusters[h + 1] : static_cast<uint32_t>(triangleCount);
+
+		cache.flush();
+		uint32_t misses = 0;
+		for (uint32_t t = start * 3; t < end * 3; t++) {
+			misses += cache.access(indices[t]);
+		}
+		float limit = OVERDRAW_THRESHOLD * misses / (end - start);
+
+		clusters.push_back(start);
+		cache.flush();
+		uint32_t first = start;
+		misses = 0;
+		for (uint32_t t = start; t < end; t++) {
+			for (uint32_t c = 0; c < 3; c++) {
+				misses += cache.access(indices[t * 3 + c]);
+			}
+			if (t + 1 < end && static_cast<float>(misses) / (t + 1 - first) <= limit) {
+				clusters.push_back(t + 1);
+				cache.flush();
+				first  = t + 1;
+				misses = 0;
+			}
+		}
+		// a tail that never got down to the limit joins the cluster before
+		if (first != start && first < end) {
+			clusters.pop_back();
+		}
+	}
+
+	// area weighted centroid and normal per cluster
+	struct Cluster {
+		uint32_t  start;
+		uint32_t  end;
+		glm::vec3 centroid;
+		glm::vec3 normal;
+		float	  area;
+		float	  sortKey;
+	};
+	std::vector<Cluster> sorted(clusters.size());
+	glm::vec3 rangeCentroid(0.0f);
+	float	  rangeArea = 0.0f;
+	for (size_t i = 0; i < clusters.size(); i++) {
+		Cluster& cluster = sorted[i];
+		cluster.start	 = clusters[i];
+		cluster.end		 = i + 1 < clusters.size() ?
+			clusters[i + 1] : static_cast<uint32_t>(triangleCount);
+		cluster.centroid = glm::vec3(0.0f);
+		cluster.normal	 = glm::vec3(0.0f);
+		cluster.area	 = 0.0f;
+		for (uint32_t t = cluster.start; t < cluster.end; t++) {
+			const glm::vec3& a = vertices[indices[t * 3]].position;
+			const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3& c = vertices[indices[t * 3 + 2]].position;
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float	  area	 = glm::length(normal);
+			cluster.centroid += (a + b + c) * (area / 3.0f);
+			cluster.normal	 += normal;
+			cluster.area	 += area;
+		}
+		rangeCentroid += cluster.centroid;
+		rangeArea	  += cluster.area;
+		if (cluster.area > 0.0f) {
+			cluster.centroid /= cluster.area;
+		}
+	}
+	if (rangeArea > 0.0f) {
+		rangeCentroid /= rangeArea;
+	}
+	for (Cluster& cluster : sorted) {
+		float length	= glm::length(cluster.normal);
+		cluster.sortKey = length > 0.0f ?
+			glm::dot(cluster.centroid - rangeCentroid, cluster.normal / length) : 0.0f;
+	}
+	std::stable_sort(sorted.begin(), sorted.end(),
+		[](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<uint32_t> reordered;
+	reordered.reserve(indexCount);
+	for (const Cluster& cluster : sorted) {
+		reordered.insert(reordered.end(),
+			indices + cluster.start * 3, indices + cluster.end * 3);
+	}
+	std::copy(reordered.begin(), reordered.end(), indices);
+}
+
+}
+
+VertexCacheStats analyzeVertexCache(
+	const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize
+) {
+	CacheModel			 cache(vertexCount, cacheSize);
+	std::vector<uint8_t> referenced(vertexCount, 0);
+	uint32_t			 misses = 0, unique = 0;
+	for (size_t i = 0; i < indexCount; i++) {
+		misses += cache.access(indices[i]);
+		if (!referenced[indices[i]]) {
+			referenced[indices[i]] = 1;
+			unique++;
+		}
+	}
+
+	VertexCacheStats stats;
+	stats.misses = misses;
+	stats.acmr	 = indexCount ? misses * 3.0f / indexCount : 0.0f;
+	stats.atvr	 = unique ? static_cast<float>(misses) / unique : 0.0f;
+	return stats;
+}
+
+void optimizeVertexFetch(MeshData& mesh) {
+	std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+	uint32_t			  used = 0;
+	for (uint32_t& index : mesh.indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = used++;
+		}
+		index = remap[index];
+	}
+
+	std::vector<MeshVertex> vertices(used);
+	for (size_t v = 0; v < mesh.vertices.size(); v++) {
+		if (remap[v] != UINT32_MAX) {
+			vertices[remap[v]] = mesh.vertices[v];
+		}
+	}
+	mesh.vertices.swap(vertices);
+}
+
+void optimizeMesh(MeshData& mesh) {
+	VertexCacheStats before = analyzeVertexCache(
+		mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+
+	std::vector<uint32_t> reordered;
+	std::vector<uint32_t> clusters;
+	for (const MaterialRange& range : mesh.ranges) {
+		uint32_t* indices = mesh.indices.data() + range.firstIndex;
+		reordered.resize(range.indexCount);
+		tipsify(indices, range.indexCount, mesh.vertices.size(),
+			VERTEX_CACHE_SIZE, reordered.data(), clusters);
+		std::copy(reordered.begin(), reordered.end(), indices);
+
+		optimizeOverdraw(indices, range.indexCount, mesh.vertices,
+			clusters, VERTEX_CACHE_SIZE);
+	}
+	optimizeVertexFetch(mesh);
+
+	VertexCacheStats after = analyzeVertexCache(
+		mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+	Log("mesh: %u-entry cache ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, "
+		"%u -> %u vertex shader invocations",
+		VERTEX_CACHE_SIZE, before.acmr, after.acmr, before.atvr, after.atvr,
+		before.misses, after.misses);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "mesh_data.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// FIFO size the orderings are tuned for and the statistics simulate;
+// desktop GPUs reuse somewhat more, mobile parts about this many
+const uint32_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats {
+	float	 acmr;			// cache misses per triangle, 0.5 at best, 3 at worst
+	float	 atvr;			// cache misses per referenced vertex, 1 at best
+	uint32_t misses;		// vertex shader invocations
+};
+
+VertexCacheStats analyzeVertexCache(
+	const uint32_t* indices, size_t indexCount, size_t vertexCount,
+	uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Renumbers the vertices in first-use order for fetch locality and drops
+// the ones no index refers to.
+void optimizeVertexFetch(MeshData& mesh);
+
+// Reorders every material range for the post-transform cache (Tipsify,
+// Sander et al. 2007), then reorders the clusters of each range from
+// outward to inward facing so near surfaces tend to be drawn first while
+// keeping ACMR within a few percent, and finally renumbers the vertices
+// with optimizeVertexFetch(). Ranges keep their place and size. Logs
+// ACMR/ATVR before and after.
+void optimizeMesh(MeshData& mesh);
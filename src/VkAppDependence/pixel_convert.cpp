@@ -0,0 +1,355 @@
+#include "pixel_convert.h"
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+const size_t BLOCK_PIXELS = 1024;		// convertPixels()'s scratch, 4 KB
+
+struct SrgbTables {
+	uint8_t toLinear[256];
+	uint8_t toSrgb[256];
+
+	SrgbTables() {
+		for (int i = 0; i < 256; i++) {
+			double v	   = i / 255.0;
+			double linear  = v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+			double srgb	   = v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+			toLinear[i]	   = static_cast<uint8_t>(linear * 255.0 + 0.5);
+			toSrgb[i]	   = static_cast<uint8_t>(srgb * 255.0 + 0.5);
+		}
+	}
+};
+
+const SrgbTables& srgbTables() {
+	static const SrgbTables tables;
+	return tables;
+}
+
+// x * y / 255 rounded, exact for x, y in 0..255
+inline uint32_t mulDiv255(uint32_t x, uint32_t y) {
+	uint32_t t = x * y + 128;
+	return (t + (t >> 8)) >> 8;
+}
+
+//------------------------------- scalar --------------------------------//
+
+void expandRgbScalar(const uint8_t* src, uint8_t* dst, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		dst[i * 4]	   = src[i * 3];
+		dst[i * 4 + 1] = src[i * 3 + 1];
+		dst[i * 4 + 2] = src[i * 3 + 2];
+		dst[i * 4 + 3] = 255;
+	}
+}
+
+void premultiplyScalar(const uint8_t* src, uint8_t* dst, size_t count) {
+	for (size_t i = 0; i < count * 4; i += 4) {
+		uint32_t alpha = src[i + 3];
+		dst[i]	   = static_cast<uint8_t>(mulDiv255(src[i], alpha));
+		dst[i + 1] = static_cast<uint8_t>(mulDiv255(src[i + 1], alpha));
+		dst[i + 2] = static_cast<uint8_t>(mulDiv255(src[i + 2], alpha));
+		dst[i + 3] = static_cast<uint8_t>(alpha);
+	}
+}
+
+void swizzleScalar(const uint8_t* src, uint8_t* dst, size_t count, const uint8_t order[4]) {
+	for (size_t i = 0; i < count * 4; i += 4) {
+		uint8_t pixel[4] = { src[i], src[i + 1], src[i + 2], src[i + 3] };
+		dst[i]	   = pixel[order[0]];
+		dst[i + 1] = pixel[order[1]];
+		dst[i + 2] = pixel[order[2]];
+		dst[i + 3] = pixel[order[3]];
+	}
+}
+
+//-------------------------------- SSSE3 --------------------------------//
+
+PIXEL_TARGET("ssse3")
+void expandRgbSsse3(const uint8_t* src, uint8_t* dst, size_t count) {
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha	  = _mm_set1_epi32(static_cast<int>(0xFF000000));
+	size_t i = 0;
+	// 16 bytes are loaded for the 12 of 4 pixels, the loads stop in time
+	for (; i + 6 <= count; i += 4) {
+		__m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4),
+			_mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha));
+	}
+	expandRgbScalar(src + i * 3, dst + i * 4, count - i);
+}
+
+// 2 pixels widened to 16 bits, times their alpha / 255
+PIXEL_TARGET("ssse3")
+inline __m128i premultiplyHalfSsse3(__m128i pixels, __m128i alphas) {
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(pixels, alphas), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+PIXEL_TARGET("ssse3")
+void premultiplySsse3(const uint8_t* src, uint8_t* dst, size_t count) {
+	// alpha into the colour lanes, 255 into the alpha lane keeps it
+	const __m128i broadcast = _mm_setr_epi8(3, 3, 3, -1, 7, 7, 7, -1, 11, 11, 11, -1, 15, 15, 15, -1);
+	const __m128i keep		= _mm_set1_epi32(static_cast<int>(0xFF000000));
+	const __m128i zero		= _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+		__m128i alphas = _mm_or_si128(_mm_shuffle_epi8(pixels, broadcast), keep);
+		__m128i low	   = premultiplyHalfSsse3(
+			_mm_unpacklo_epi8(pixels, zero), _mm_unpacklo_epi8(alphas, zero));
+		__m128i high   = premultiplyHalfSsse3(
+			_mm_unpackhi_epi8(pixels, zero), _mm_unpackhi_epi8(alphas, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi16(low, high));
+	}
+	premultiplyScalar(src + i * 4, dst + i * 4, count - i);
+}
+
+PIXEL_TARGET("ssse3")
+void swizzleSsse3(const uint8_t* src, uint8_t* dst, size_t count, const uint8_t order[4]) {
+	alignas(16) int8_t lanes[16];
+	for (int i = 0; i < 16; i++) {
+		lanes[i] = static_cast<int8_t>((i & ~3) + order[i & 3]);
+	}
+	const __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes));
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_shuffle_epi8(pixels, shuffle));
+	}
+	swizzleScalar(src + i * 4, dst + i * 4, count - i, order);
+}
+
+//--------------------------------- AVX2 --------------------------------//
+
+PIXEL_TARGET("avx2")
+void expandRgbAvx2(const uint8_t* src, uint8_t* dst, size_t count) {
+	// vpshufb stays within 128 bit lanes, each lane gets 4 pixels
+	const __m256i shuffle = _mm256_setr_epi8(
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m256i alpha	  = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+	size_t i = 0;
+	// the second load ends 4 bytes past the 24 of 8 pixels
+	for (; i + 10 <= count; i += 8) {
+		__m128i low	 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+		__m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 12));
+		__m256i rgb	 = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4),
+			_mm256_or_si256(_mm256_shuffle_epi8(rgb, shuffle), alpha));
+	}
+	expandRgbSsse3(src + i * 3, dst + i * 4, count - i);
+}
+
+PIXEL_TARGET("avx2")
+inline __m256i premultiplyHalfAvx2(__m256i pixels, __m256i alphas) {
+	__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(pixels, alphas), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+PIXEL_TARGET("avx2")
+void premultiplyAvx2(const uint8_t* src, uint8_t* dst, size_t count) {
+	const __m256i broadcast = _mm256_setr_epi8(
+		3, 3, 3, -1, 7, 7, 7, -1, 11, 11, 11, -1, 15, 15, 15, -1,
+		3, 3, 3, -1, 7, 7, 7, -1, 11, 11, 11, -1, 15, 15, 15, -1);
+	const __m256i keep		= _mm256_set1_epi32(static_cast<int>(0xFF000000));
+	const __m256i zero		= _mm256_setzero_si256();
+	size_t i = 0;
+	// unpacking and packing both work per lane, so the pixel order holds
+	for (; i + 8 <= count; i += 8) {
+		__m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+		__m256i alphas = _mm256_or_si256(_mm256_shuffle_epi8(pixels, broadcast), keep);
+		__m256i low	   = premultiplyHalfAvx2(
+			_mm256_unpacklo_epi8(pixels, zero), _mm256_unpacklo_epi8(alphas, zero));
+		__m256i high   = premultiplyHalfAvx2(
+			_mm256_unpackhi_epi8(pixels, zero), _mm256_unpackhi_epi8(alphas, zero));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_packus_epi16(low, high));
+	}
+	premultiplySsse3(src + i * 4, dst + i * 4, count - i);
+}
+
+PIXEL_TARGET("avx2")
+void swizzleAvx2(const uint8_t* src, uint8_t* dst, size_t count, const uint8_t order[4]) {
+	alignas(32) int8_t lanes[32];
+	for (int i = 0; i < 32; i++) {
+		lanes[i] = static_cast<int8_t>((i & 12) + order[i & 3]);
+	}
+	const __m256i shuffle = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes));
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4),
+			_mm256_shuffle_epi8(pixels, shuffle));
+	}
+	swizzleSsse3(src + i * 4, dst + i * 4, count - i, order);
+}
+
+//-----------------------------------------------------------------------//
+
+struct Kernels {
+	void (*expandRgb)(const uint8_t* src, uint8_t* dst, size_t count);
+	void (*premultiply)(const uint8_t* src, uint8_t* dst, size_t count);
+	void (*swizzle)(const uint8_t* src, uint8_t* dst, size_t count, const uint8_t order[4]);
+};
+
+// by PixelKernelLevel
+const Kernels s_kernels[] = {
+	{ expandRgbScalar, premultiplyScalar, swizzleScalar },
+	{ expandRgbSsse3,  premultiplySsse3,  swizzleSsse3 },
+	{ expandRgbAvx2,   premultiplyAvx2,   swizzleAvx2 },
+};
+
+PixelKernelLevel& currentLevel() {
+	static PixelKernelLevel level = detectPixelKernelLevel();
+	return level;
+}
+
+const Kernels& kernels() {
+	return s_kernels[static_cast<uint32_t>(currentLevel())];
+}
+
+void applyTable(const uint8_t* table, const uint8_t* src, uint8_t* dst, size_t count) {
+	for (size_t i = 0; i < count * 4; i += 4) {
+		dst[i]	   = table[src[i]];
+		dst[i + 1] = table[src[i + 1]];
+		dst[i + 2] = table[src[i + 2]];
+		dst[i + 3] = src[i + 3];
+	}
+}
+
+}
+
+PixelKernelLevel detectPixelKernelLevel() {
+	// leaf 1: ECX bit 9 SSSE3, bit 27 OSXSAVE; leaf 7: EBX bit 5 AVX2
+	uint32_t leaf1[4] = {}, leaf7[4] = {};
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 0);
+	uint32_t maxLeaf = static_cast<uint32_t>(regs[0]);
+	__cpuid(regs, 1);
+	std::memcpy(leaf1, regs, sizeof(leaf1));
+	if (maxLeaf >= 7) {
+		__cpuidex(regs, 7, 0);
+		std::memcpy(leaf7, regs, sizeof(leaf7));
+	}
+#else
+	uint32_t maxLeaf = __get_cpuid_max(0, nullptr);
+	__cpuid(1, leaf1[0], leaf1[1], leaf1[2], leaf1[3]);
+	if (maxLeaf >= 7) {
+		__cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+	}
+#endif
+	if (!(leaf1[2] & (1u << 9))) {
+		return PixelKernelLevel::Scalar;
+	}
+	// AVX2 also needs the OS to save the YMM registers
+	bool ymmSaved = false;
+	if (leaf1[2] & (1u << 27)) {
+#ifdef _MSC_VER
+		ymmSaved = (_xgetbv(0) & 6) == 6;
+#else
+		uint32_t xcr0Low, xcr0High;
+		__asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+		ymmSaved = (xcr0Low & 6) == 6;
+#endif
+	}
+	return ymmSaved && (leaf7[1] & (1u << 5)) ?
+		PixelKernelLevel::Avx2 : PixelKernelLevel::Ssse3;
+}
+
+PixelKernelLevel pixelKernelLevel() {
+	return currentLevel();
+}
+
+void setPixelKernelLevel(PixelKernelLevel level) {
+	currentLevel() = std::min(level, detectPixelKernelLevel());
+}
+
+const char* pixelKernelLevelName(PixelKernelLevel level) {
+	switch (level) {
+	case PixelKernelLevel::Scalar: return "scalar";
+	case PixelKernelLevel::Ssse3:  return "SSSE3";
+	case PixelKernelLevel::Avx2:   return "AVX2";
+	}
+	return "unknown";
+}
+
+void expandToRgba8(const uint8_t* src, uint32_t channels, uint8_t* dst, size_t count) {
+	switch (channels) {
+	case 1:
+		for (size_t i = 0; i < count; i++) {
+			dst[i * 4] = dst[i * 4 + 1] = dst[i * 4 + 2] = src[i];
+			dst[i * 4 + 3] = 255;
+		}
+		break;
+	case 2:
+		for (size_t i = 0; i < count; i++) {
+			dst[i * 4] = dst[i * 4 + 1] = dst[i * 4 + 2] = src[i * 2];
+			dst[i * 4 + 3] = src[i * 2 + 1];
+		}
+		break;
+	case 3:
+		kernels().expandRgb(src, dst, count);
+		break;
+	default:
+		if (dst != src) {
+			std::memcpy(dst, src, count * 4);
+		}
+		break;
+	}
+}
+
+void premultiplyAlpha8(const uint8_t* src, uint8_t* dst, size_t count) {
+	kernels().premultiply(src, dst, count);
+}
+
+void swizzleRgba8(const uint8_t* src, uint8_t* dst, size_t count, const uint8_t order[4]) {
+	kernels().swizzle(src, dst, count, order);
+}
+
+void srgbToLinear8(const uint8_t* src, uint8_t* dst, size_t count) {
+	applyTable(srgbTables().toLinear, src, dst, count);
+}
+
+void linearToSrgb8(const uint8_t* src, uint8_t* dst, size_t count) {
+	applyTable(srgbTables().toSrgb, src, dst, count);
+}
+
+void convertPixels(
+	const uint8_t* src, uint8_t* dst, size_t count, const PixelConversion& conversion
+) {
+	const uint8_t* order   = conversion.swizzle;
+	bool		   swizzle = order[0] != 0 || order[1] != 1 || order[2] != 2 || order[3] != 3;
+	if (!swizzle && !conversion.decodeSrgb && !conversion.premultiply && !conversion.encodeSrgb) {
+		expandToRgba8(src, conversion.srcChannels, dst, count);
+		return;
+	}
+
+	alignas(32) uint8_t block[BLOCK_PIXELS * 4];
+	for (size_t done = 0; done < count; done += BLOCK_PIXELS) {
+		size_t pixels = std::min(count - done, BLOCK_PIXELS);
+		expandToRgba8(src + done * conversion.srcChannels, conversion.srcChannels, block, pixels);
+		if (swizzle) {
+			swizzleRgba8(block, block, pixels, order);
+		}
+		if (conversion.decodeSrgb) {
+			srgbToLinear8(block, block, pixels);
+		}
+		if (conversion.premultiply) {
+			premultiplyAlpha8(block, block, pixels);
+		}
+		if (conversion.encodeSrgb) {
+			linearToSrgb8(block, block, pixels);
+		}
+		std::memcpy(dst + done * 4, block, pixels * 4);
+	}
+}
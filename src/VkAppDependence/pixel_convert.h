@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// MSVC compiles any intrinsic as it is, GCC and Clang only inside
+// functions built for its instruction set
+#ifdef _MSC_VER
+#define PIXEL_TARGET(isa)
+#else
+#define PIXEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// Conversions of 8 bit pixels on their way into staging memory. RGB
+// expansion, premultiplying and swizzling have a scalar, an SSSE3 and an
+// AVX2 version with identical results; the widest one the CPU runs is
+// used. The sRGB curves are 256 entry tables at every level, a lookup per
+// byte beats computing them in vectors, and grey images are rare enough to
+// stay scalar. Kernels whose source and destination pixels have the same
+// size may convert in place.
+
+enum class PixelKernelLevel : uint32_t {
+	Scalar,
+	Ssse3,
+	Avx2
+};
+
+// widest level the CPU and OS support
+PixelKernelLevel detectPixelKernelLevel();
+PixelKernelLevel pixelKernelLevel();
+// clamped to detectPixelKernelLevel(); not while conversions run, for
+// benchmarks to compare the levels
+void			 setPixelKernelLevel(PixelKernelLevel level);
+const char*		 pixelKernelLevelName(PixelKernelLevel level);
+
+// 1 (grey), 2 (grey, alpha), 3 (RGB) or 4 channels to RGBA, alpha 255
+// when the source has none; `dst` must not overlap `src` but for 4
+void expandToRgba8(const uint8_t* src, uint32_t channels, uint8_t* dst, size_t count);
+// colour times alpha, rounded
+void premultiplyAlpha8(const uint8_t* src, uint8_t* dst, size_t count);
+// dst channel c is src channel order[c], each 0..3
+void swizzleRgba8(const uint8_t* src, uint8_t* dst, size_t count, const uint8_t order[4]);
+// colour channels between the sRGB curve and linear, alpha kept
+void srgbToLinear8(const uint8_t* src, uint8_t* dst, size_t count);
+void linearToSrgb8(const uint8_t* src, uint8_t* dst, size_t count);
+
+// What convertPixels() does on the way to RGBA8, in member order.
+// Premultiplying an sRGB image correctly decodes it first and encodes the
+// result again.
+struct PixelConversion {
+	uint32_t srcChannels = 4;
+	uint8_t	 swizzle[4]	 = { 0, 1, 2, 3 };
+	bool	 decodeSrgb	 = false;
+	bool	 premultiply = false;
+	bool	 encodeSrgb	 = false;
+};
+
+// `count` pixels of `conversion.srcChannels` bytes to RGBA8. `dst` is only
+// written, in order: a chain of passes runs in a block on the stack, since
+// mapped staging memory may be write combined and slow to read back.
+void convertPixels(
+	const uint8_t* src, uint8_t* dst, size_t count, const PixelConversion& conversion);
@@ -0,0 +1,293 @@
+#include "texture_codec.h"
+#include "texture_bc7.h"
+
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+const TextureCodecInfo CODECS[] = {
+	{ "RGBA8", 1, 4,  VK_FORMAT_R8G8B8A8_UNORM,		  VK_FORMAT_R8G8B8A8_SRGB },
+	{ "BGRA8", 1, 4,  VK_FORMAT_B8G8R8A8_UNORM,		  VK_FORMAT_B8G8R8A8_SRGB },
+	{ "RGBX8", 1, 4,  VK_FORMAT_UNDEFINED,			  VK_FORMAT_UNDEFINED },
+	{ "BGRX8", 1, 4,  VK_FORMAT_UNDEFINED,			  VK_FORMAT_UNDEFINED },
+	{ "BC1",   4, 8,  VK_FORMAT_BC1_RGBA_UNORM_BLOCK, VK_FORMAT_BC1_RGBA_SRGB_BLOCK },
+	{ "BC3",   4, 16, VK_FORMAT_BC3_UNORM_BLOCK,	  VK_FORMAT_BC3_SRGB_BLOCK },
+	{ "BC4",   4, 8,  VK_FORMAT_BC4_UNORM_BLOCK,	  VK_FORMAT_BC4_UNORM_BLOCK },
+	{ "BC5",   4, 16, VK_FORMAT_BC5_UNORM_BLOCK,	  VK_FORMAT_BC5_UNORM_BLOCK },
+	{ "BC7",   4, 16, VK_FORMAT_BC7_UNORM_BLOCK,	  VK_FORMAT_BC7_SRGB_BLOCK },
+};
+static_assert(sizeof(CODECS) / sizeof(CODECS[0]) == static_cast<size_t>(TextureCodec::Count),
+	"every TextureCodec needs an entry");
+
+uint8_t expand5(uint32_t v) { return static_cast<uint8_t>((v << 3) | (v >> 2)); }
+uint8_t expand6(uint32_t v) { return static_cast<uint8_t>((v << 2) | (v >> 4)); }
+
+// 4x4 RGBA8 texels of a BC1 color block; `opaque` forces the four color
+// mode, as BC3 does
+void decodeColorBlock(const uint8_t* block, bool opaque, uint8_t out[16][4]) {
+	uint32_t c0 = block[0] | (block[1] << 8);
+	uint32_t c1 = block[2] | (block[3] << 8);
+
+	uint8_t palette[4][4] = {
+		{ expand5(c0 >> 11), expand6((c0 >> 5) & 63), expand5(c0 & 31), 255 },
+		{ expand5(c1 >> 11), expand6((c1 >> 5) & 63), expand5(c1 & 31), 255 },
+	};
+	for (int c = 0; c < 3; c++) {
+		if (c0 > c1 || opaque) {
+			palette[2][c] = static_cast<uint8_t>((2 * palette[0][c] + palette[1][c]) / 3);
+			palette[3][c] = static_cast<uint8_t>((palette[0][c] + 2 * palette[1][c]) / 3);
+		}
+		else {
+			palette[2][c] = static_cast<uint8_t>((palette[0][c] + palette[1][c]) / 2);
+			palette[3][c] = 0;
+		}
+	}
+	palette[2][3] = 255;
+	palette[3][3] = c0 > c1 || opaque ? 255 : 0;
+
+	uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) |
+		(static_cast<uint32_t>(block[7]) << 24);
+	for (int i = 0; i < 16; i++) {
+		memcpy(out[i], palette[(indices >> (2 * i)) & 3], 4);
+	}
+}
+
+// one channel of a BC4 block into out[i][channel]
+void decodeChannelBlock(const uint8_t* block, int channel, uint8_t out[16][4]) {
+	uint32_t a0 = block[0], a1 = block[1];
+	uint8_t	 palette[8] = { static_cast<uint8_t>(a0), static_cast<uint8_t>(a1) };
+	if (a0 > a1) {
+		for (uint32_t k = 2; k < 8; k++) {
+			palette[k] = static_cast<uint8_t>(((8 - k) * a0 + (k - 1) * a1) / 7);
+		}
+	}
+	else {
+		for (uint32_t k = 2; k < 6; k++) {
+			palette[k] = static_cast<uint8_t>(((6 - k) * a0 + (k - 1) * a1) / 5);
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++) {
+		indices |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+	}
+	for (int i = 0; i < 16; i++) {
+		out[i][channel] = palette[(indices >> (3 * i)) & 7];
+	}
+}
+
+class BlockBits {
+public:
+	explicit BlockBits(const uint8_t* block) {
+		memcpy(&m_low, block, 8);
+		memcpy(&m_high, block + 8, 8);
+	}
+
+	uint32_t read(uint32_t count) {
+		if (count == 0) {
+			return 0;
+		}
+		uint64_t bits = m_position < 64 ? m_low >> m_position : m_high >> (m_position - 64);
+		if (m_position < 64 && m_position + count > 64) {
+			bits |= m_high << (64 - m_position);
+		}
+		m_position += count;
+		return static_cast<uint32_t>(bits & ((1ull << count) - 1));
+	}
+
+private:
+	uint64_t m_low;
+	uint64_t m_high;
+	uint32_t m_position = 0;
+};
+
+void decodeBc7Block(const uint8_t* block, uint8_t out[16][4]) {
+	uint32_t modeIndex = 0;
+	while (modeIndex < 8 && !(block[0] & (1 << modeIndex))) {
+		modeIndex++;
+	}
+	if (modeIndex == 8) {
+		// reserved mode
+		memset(out, 0, 16 * 4);
+		return;
+	}
+	const Bc7Mode& mode = BC7_MODES[modeIndex];
+
+	BlockBits bits(block);
+	bits.read(modeIndex + 1);
+	uint32_t partition		= bits.read(mode.partitionBits);
+	uint32_t rotation		= bits.read(mode.rotationBits);
+	uint32_t indexSelection = bits.read(mode.indexSelectionBits);
+
+	// [subset * 2 + endpoint][channel]
+	uint32_t endpoints[6][4] = {};
+	uint32_t endpointCount	 = mode.subsets * 2;
+	for (uint32_t c = 0; c < 3; c++) {
+		for (uint32_t e = 0; e < endpointCount; e++) {
+			endpoints[e][c] = bits.read(mode.colorBits);
+		}
+	}
+	for (uint32_t e = 0; e < endpointCount; e++) {
+		endpoints[e][3] = bits.read(mode.alphaBits);
+	}
+
+	uint32_t pBits[6] = {};
+	bool	 hasPBit  = mode.endpointPBits || mode.sharedPBits;
+	if (mode.endpointPBits) {
+		for (uint32_t e = 0; e < endpointCount; e++) {
+			pBits[e] = bits.read(1);
+		}
+	}
+	else if (mode.sharedPBits) {
+		for (uint32_t s = 0; s < mode.subsets; s++) {
+			pBits[s * 2] = pBits[s * 2 + 1] = bits.read(1);
+		}
+	}
+
+	uint32_t colorBits = mode.colorBits + hasPBit;
+	uint32_t alphaBits = mode.alphaBits ? mode.alphaBits + hasPBit : 0;
+	for (uint32_t e = 0; e < endpointCount; e++) {
+		for (uint32_t c = 0; c < 4; c++) {
+			uint32_t precision = c < 3 ? colorBits : alphaBits;
+			if (precision == 0) {
+				endpoints[e][c] = 255;
+				continue;
+			}
+			uint32_t value = hasPBit ? (endpoints[e][c] << 1) | pBits[e] : endpoints[e][c];
+			value <<= 8 - precision;
+			endpoints[e][c] = value | (value >> precision);
+		}
+	}
+
+	uint32_t subsetOf[16];
+	for (uint32_t i = 0; i < 16; i++) {
+		subsetOf[i] = mode.subsets == 1 ? 0 :
+			mode.subsets == 2 ? (BC7_PARTITIONS2[partition] >> i) & 1 :
+			(BC7_PARTITIONS3[partition] >> (2 * i)) & 3;
+	}
+	auto isAnchor = [&](uint32_t i) {
+		return i == 0 ||
+			(mode.subsets == 2 && i == BC7_ANCHORS2[partition]) ||
+			(mode.subsets == 3 &&
+				(i == BC7_ANCHORS3_SECOND[partition] || i == BC7_ANCHORS3_THIRD[partition]));
+	};
+
+	uint32_t indices[16], secondary[16] = {};
+	for (uint32_t i = 0; i < 16; i++) {
+		indices[i] = bits.read(mode.indexBits - isAnchor(i));
+	}
+	if (mode.secondaryIndexBits) {
+		for (uint32_t i = 0; i < 16; i++) {
+			secondary[i] = bits.read(mode.secondaryIndexBits - (i == 0));
+		}
+	}
+
+	const uint8_t* colorWeights = bc7Weights(mode.indexBits);
+	const uint8_t* alphaWeights = colorWeights;
+	const uint32_t* colorIndices = indices;
+	const uint32_t* alphaIndices = indices;
+	if (mode.secondaryIndexBits) {
+		alphaWeights = bc7Weights(mode.secondaryIndexBits);
+		alphaIndices = secondary;
+		if (indexSelection) {
+			std::swap(colorWeights, alphaWeights);
+			std::swap(colorIndices, alphaIndices);
+		}
+	}
+
+	for (uint32_t i = 0; i < 16; i++) {
+		const uint32_t* e0 = endpoints[subsetOf[i] * 2];
+		const uint32_t* e1 = endpoints[subsetOf[i] * 2 + 1];
+		for (uint32_t c = 0; c < 3; c++) {
+			out[i][c] = bc7Interpolate(e0[c], e1[c], colorWeights[colorIndices[i]]);
+		}
+		out[i][3] = bc7Interpolate(e0[3], e1[3], alphaWeights[alphaIndices[i]]);
+		if (rotation) {
+			std::swap(out[i][3], out[i][rotation - 1]);
+		}
+	}
+}
+
+}
+
+const TextureCodecInfo& textureCodecInfo(TextureCodec codec) {
+	return CODECS[static_cast<uint32_t>(codec)];
+}
+
+uint64_t textureLevelSize(TextureCodec codec, uint32_t width, uint32_t height) {
+	const TextureCodecInfo& info = textureCodecInfo(codec);
+	uint64_t columns = (width + info.blockExtent - 1) / info.blockExtent;
+	uint64_t rows	 = (height + info.blockExtent - 1) / info.blockExtent;
+	return columns * rows * info.blockSize;
+}
+
+void decodeToRgba8(
+	TextureCodec codec, const void* data, uint32_t width, uint32_t height, uint8_t* rgba
+) {
+	const uint8_t* src = static_cast<const uint8_t*>(data);
+	size_t		   texelCount = static_cast<size_t>(width) * height;
+	switch (codec) {
+	case TextureCodec::RGBA8:
+		memcpy(rgba, src, texelCount * 4);
+		return;
+	case TextureCodec::BGRA8:
+	case TextureCodec::RGBX8:
+	case TextureCodec::BGRX8: {
+		bool swap  = codec != TextureCodec::RGBX8;
+		bool alpha = codec == TextureCodec::BGRA8;
+		for (size_t i = 0; i < texelCount; i++) {
+			rgba[i * 4]		= src[i * 4 + (swap ? 2 : 0)];
+			rgba[i * 4 + 1] = src[i * 4 + 1];
+			rgba[i * 4 + 2] = src[i * 4 + (swap ? 0 : 2)];
+			rgba[i * 4 + 3] = alpha ? src[i * 4 + 3] : 255;
+		}
+		return;
+	}
+	default:
+		break;
+	}
+
+	uint32_t blockSize = textureCodecInfo(codec).blockSize;
+	uint32_t columns   = (width + 3) / 4;
+	uint32_t rows	   = (height + 3) / 4;
+	uint8_t	 texels[16][4];
+	for (uint32_t by = 0; by < rows; by++) {
+		for (uint32_t bx = 0; bx < columns; bx++) {
+			const uint8_t* block = src + (static_cast<size_t>(by) * columns + bx) * blockSize;
+			switch (codec) {
+			case TextureCodec::BC1:
+				decodeColorBlock(block, false, texels);
+				break;
+			case TextureCodec::BC3:
+				decodeColorBlock(block + 8, true, texels);
+				decodeChannelBlock(block, 3, texels);
+				break;
+			case TextureCodec::BC4:
+			case TextureCodec::BC5:
+				for (int i = 0; i < 16; i++) {
+					texels[i][0] = texels[i][1] = texels[i][2] = 0;
+					texels[i][3] = 255;
+				}
+				decodeChannelBlock(block, 0, texels);
+				if (codec == TextureCodec::BC5) {
+					decodeChannelBlock(block + 8, 1, texels);
+				}
+				break;
+			default:
+				decodeBc7Block(block, texels);
+				break;
+			}
+
+			// partial blocks at the edges
+			uint32_t w = std::min(4u, width - bx * 4);
+			uint32_t h = std::min(4u, height - by * 4);
+			for (uint32_t y = 0; y < h; y++) {
+				uint8_t* dst = rgba + ((static_cast<size_t>(by) * 4 + y) * width + bx * 4) * 4;
+				memcpy(dst, texels[y * 4], w * 4);
+			}
+		}
+	}
+}
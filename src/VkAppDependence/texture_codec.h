@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+// How the texels of a texture level are stored. Block codecs store 4x4
+// texel blocks in rows, partial blocks at the right and bottom edges are
+// padded; plain codecs store rows of texels. Every level is tightly packed.
+enum class TextureCodec : uint32_t {
+	RGBA8 = 0,
+	BGRA8,
+	RGBX8,			// fourth byte ignored, alpha is 255
+	BGRX8,
+	BC1,			// 8 byte blocks, RGB + 1 bit alpha
+	BC3,			// 16 byte blocks, BC1 color + BC4 alpha
+	BC4,			// 8 byte blocks, one channel
+	BC5,			// 16 byte blocks, two BC4 channels
+	BC7,			// 16 byte blocks, RGBA
+	Count
+};
+
+struct TextureCodecInfo {
+	const char* name;
+	uint32_t	blockExtent;		// 4 for block codecs, 1 otherwise
+	uint32_t	blockSize;			// bytes per block or texel
+	VkFormat	format;				// to sample it as stored, UNDEFINED when
+	VkFormat	srgbFormat;			// the codec has to be decoded first
+};
+
+const TextureCodecInfo& textureCodecInfo(TextureCodec codec);
+
+// bytes of one level, rows of blocks rounded up
+uint64_t textureLevelSize(TextureCodec codec, uint32_t width, uint32_t height);
+
+// Decodes a level into tightly packed RGBA8 rows, the way the GPU samples
+// the codec's UNORM format: BC4 gives (r, 0, 0, 255), BC5 (r, g, 0, 255).
+// `rgba` holds width * height * 4 bytes.
+void decodeToRgba8(
+	TextureCodec codec, const void* data, uint32_t width, uint32_t height, uint8_t* rgba);
+
+// Encodes block rows [firstRow, firstRow + rowCount) of a tightly packed
+// RGBA8 level into `data`, the start of the level in block codec `codec`.
+// Rows are independent, disjoint ranges can be encoded on separate threads.
+// See texture_encode.cpp.
+void encodeFromRgba8(
+	TextureCodec codec, const uint8_t* rgba, uint32_t width, uint32_t height,
+	uint32_t firstRow, uint32_t rowCount, void* data);
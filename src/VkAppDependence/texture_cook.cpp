@@ -0,0 +1,240 @@
+#include "texture_cook.h"
+#include "dds_file.h"
+#include "../LCBHSS/lcbhss_space.h"
+
+#include <stb_image.h>
+
+#include <cmath>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+bool nameContains(const std::string& name, const char* tag) {
+	return name.find(tag) != std::string::npos;
+}
+
+bool dataMap(const std::string& name) {
+	return nameContains(name, "_NRM") || nameContains(name, "_MTL") || nameContains(name, "_MSK");
+}
+
+// channels the codec keeps, the ones PSNR is measured over
+uint32_t storedChannels(TextureCodec codec) {
+	switch (codec) {
+	case TextureCodec::BC4:
+		return 1;
+	case TextureCodec::BC5:
+		return 2;
+	case TextureCodec::BC1:
+		return 3;
+	default:
+		return 4;
+	}
+}
+
+float srgbToLinear(float v) {
+	v /= 255.0f;
+	return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+}
+
+uint8_t linearToSrgb(float v) {
+	v = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+	return static_cast<uint8_t>(std::min(std::max(v * 255.0f + 0.5f, 0.0f), 255.0f));
+}
+
+// next mip, 2x2 box filter; odd edges repeat their last row or column
+void downsample(
+	const std::vector<uint8_t>& src, uint32_t width, uint32_t height, bool srgb,
+	std::vector<uint8_t>& dst
+) {
+	static float toLinear[256];
+	static std::once_flag tableBuilt;
+	std::call_once(tableBuilt, [] {
+		for (uint32_t v = 0; v < 256; v++) {
+			toLinear[v] = srgbToLinear(static_cast<float>(v));
+		}
+	});
+
+	uint32_t dstWidth  = std::max(1u, width / 2);
+	uint32_t dstHeight = std::max(1u, height / 2);
+	dst.resize(static_cast<size_t>(dstWidth) * dstHeight * 4);
+	for (uint32_t y = 0; y < dstHeight; y++) {
+		uint32_t y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+		for (uint32_t x = 0; x < dstWidth; x++) {
+			uint32_t x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+			const uint8_t* texels[4] = {
+				&src[(static_cast<size_t>(y0) * width + x0) * 4], &src[(static_cast<size_t>(y0) * width + x1) * 4],
+				&src[(static_cast<size_t>(y1) * width + x0) * 4], &src[(static_cast<size_t>(y1) * width + x1) * 4],
+			};
+			uint8_t* out = &dst[(static_cast<size_t>(y) * dstWidth + x) * 4];
+			for (uint32_t c = 0; c < 4; c++) {
+				if (srgb && c < 3) {
+					float sum = 0.0f;
+					for (const uint8_t* texel : texels) {
+						sum += toLinear[texel[c]];
+					}
+					out[c] = linearToSrgb(sum / 4.0f);
+				}
+				else {
+					uint32_t sum = 2;
+					for (const uint8_t* texel : texels) {
+						sum += texel[c];
+					}
+					out[c] = static_cast<uint8_t>(sum / 4);
+				}
+			}
+		}
+	}
+}
+
+// block rows handed out in small runs so uneven rows even out
+void encodeLevel(
+	TextureCodec codec, const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height,
+	uint32_t threads, std::vector<uint8_t>& level
+) {
+	const uint32_t RUN = 4;
+	uint32_t rows = (height + 3) / 4;
+	level.resize(textureLevelSize(codec, width, height));
+
+	std::atomic<uint32_t> nextRow(0);
+	auto worker = [&] {
+		for (uint32_t row = nextRow.fetch_add(RUN); row < rows; row = nextRow.fetch_add(RUN)) {
+			encodeFromRgba8(codec, rgba.data(), width, height, row, std::min(RUN, rows - row), level.data());
+		}
+	};
+	std::vector<std::thread> workers;
+	for (uint32_t i = 1; i < std::min(threads, (rows + RUN - 1) / RUN); i++) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : workers) {
+		thread.join();
+	}
+}
+
+double measurePsnr(
+	TextureCodec codec, const std::vector<uint8_t>& source, const std::vector<uint8_t>& level,
+	uint32_t width, uint32_t height
+) {
+	std::vector<uint8_t> decoded(source.size());
+	decodeToRgba8(codec, level.data(), width, height, decoded.data());
+
+	uint32_t channels = storedChannels(codec);
+	double	 squared  = 0.0;
+	for (size_t texel = 0; texel < source.size(); texel += 4) {
+		for (uint32_t c = 0; c < channels; c++) {
+			double d = static_cast<double>(source[texel + c]) - decoded[texel + c];
+			squared += d * d;
+		}
+	}
+	if (squared == 0.0) {
+		return INFINITY;
+	}
+	double mse = squared / (static_cast<double>(width) * height * channels);
+	return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+}
+
+TextureCookStats cookTexture(
+	const std::string& sourceName, const std::string& fileName,
+	TextureCodec codec, uint32_t threads
+) {
+	if (codec == TEXTURE_CODEC_AUTO) {
+		codec = nameContains(sourceName, "_NRM") ? TextureCodec::BC5 : TextureCodec::BC7;
+	}
+	if (textureCodecInfo(codec).blockExtent != 4) {
+		throw std::runtime_error(std::string("failed to cook texture: ") +
+			textureCodecInfo(codec).name + " is not a block codec");
+	}
+	bool srgb = storedChannels(codec) >= 3 && !dataMap(sourceName);
+
+	int		 width = 0, height = 0, channels = 0;
+	stbi_uc* pixels = stbi_load(sourceName.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels) {
+		throw std::runtime_error("failed to load texture image " + sourceName);
+	}
+	std::vector<uint8_t> source(pixels, pixels + static_cast<size_t>(width) * height * 4);
+	stbi_image_free(pixels);
+
+	TextureCookStats stats = {};
+	auto			 begin = std::chrono::high_resolution_clock::now();
+
+	uint32_t mipWidth = width, mipHeight = height;
+	std::vector<uint8_t>			  mip = source, next;
+	std::vector<std::vector<uint8_t>> levels;
+	for (;;) {
+		levels.emplace_back();
+		encodeLevel(codec, mip, mipWidth, mipHeight, std::max(1u, threads), levels.back());
+		stats.pixels += static_cast<uint64_t>(mipWidth) * mipHeight;
+		if (mipWidth == 1 && mipHeight == 1) {
+			break;
+		}
+		downsample(mip, mipWidth, mipHeight, srgb, next);
+		mip.swap(next);
+		mipWidth  = std::max(1u, mipWidth / 2);
+		mipHeight = std::max(1u, mipHeight / 2);
+	}
+	stats.seconds = std::chrono::duration<double>(
+		std::chrono::high_resolution_clock::now() - begin).count();
+	stats.psnr = measurePsnr(codec, source, levels[0], width, height);
+
+	writeDds(fileName, codec, srgb, width, height, levels);
+	return stats;
+}
+
+bool cookTextures(const std::vector<std::string>& sourceNames, TextureCodec codec) {
+	uint32_t cores		 = std::max(1u, std::thread::hardware_concurrency());
+	uint32_t fileWorkers = std::max(1u, std::min(cores, static_cast<uint32_t>(sourceNames.size())));
+	uint32_t blockThreads = std::max(1u, cores / fileWorkers);
+
+	std::atomic<uint32_t> nextFile(0);
+	std::atomic<bool>	  failed(false);
+	std::mutex			  totalsMutex;
+	uint64_t			  totalPixels = 0;
+	double				  totalPsnr	  = 0.0;
+	uint32_t			  cooked	  = 0;
+
+	auto begin	= std::chrono::high_resolution_clock::now();
+	auto worker = [&] {
+		for (uint32_t i = nextFile++; i < sourceNames.size(); i = nextFile++) {
+			const std::string& sourceName = sourceNames[i];
+			std::string fileName = sourceName.substr(0, sourceName.find_last_of('.')) + ".dds";
+			try {
+				TextureCookStats stats = cookTexture(sourceName, fileName, codec, blockThreads);
+				Log("texture: cooked %s, %.2f MPix/s, PSNR %.2f dB",
+					fileName.c_str(), stats.pixels / stats.seconds / 1e6, stats.psnr);
+
+				std::lock_guard<std::mutex> lock(totalsMutex);
+				totalPixels += stats.pixels;
+				if (std::isfinite(stats.psnr)) {
+					totalPsnr += stats.psnr;
+					cooked++;
+				}
+			}
+			catch (const std::exception& err) {
+				Log("texture: %s", err.what());
+				failed = true;
+			}
+		}
+	};
+	std::vector<std::thread> workers;
+	for (uint32_t i = 1; i < fileWorkers; i++) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : workers) {
+		thread.join();
+	}
+
+	double seconds = std::chrono::duration<double>(
+		std::chrono::high_resolution_clock::now() - begin).count();
+	Log("texture: %zu files, %.1f MPix in %.2f s, %.2f MPix/s on %u threads, mean PSNR %.2f dB",
+		sourceNames.size(), totalPixels / 1e6, seconds, totalPixels / seconds / 1e6,
+		fileWorkers * blockThreads, cooked ? totalPsnr / cooked : 0.0);
+	return !failed;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "texture_codec.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Offline texture compression: source images in, DDS files with full mip
+// chains out, in the layout DdsFile and the upload path consume.
+
+// BC5 for tangent space normal maps (_NRM in the name), BC7 for the rest
+const TextureCodec TEXTURE_CODEC_AUTO = TextureCodec::Count;
+
+struct TextureCookStats {
+	uint64_t pixels;		// every mip
+	double	 seconds;		// encoding only
+	double	 psnr;			// mip 0, over the channels the codec stores, in dB
+};
+
+// Loads `sourceName` as RGBA8, builds its mip chain with a 2x2 box filter
+// (in linear space for color maps), encodes every level in `codec` with the
+// block rows split over `threads` threads and writes the DDS to `fileName`.
+// Color maps in BC1/BC3/BC7 are tagged sRGB, data maps (_NRM, _MTL, _MSK)
+// and BC4/BC5 are not.
+TextureCookStats cookTexture(
+	const std::string& sourceName, const std::string& fileName,
+	TextureCodec codec, uint32_t threads);
+
+// Cooks every source to a .dds next to it. Files are spread over the cores,
+// what a file does not get of them goes to its block rows. Logs MPix/s and
+// PSNR per file and in total; false when any file failed.
+bool cookTextures(const std::vector<std::string>& sourceNames, TextureCodec codec);
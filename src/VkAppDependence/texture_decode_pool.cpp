@@ -0,0 +1,104 @@
+#include "texture_decode_pool.h"
+#include "../LCBHSS/lcbhss_mapped_file.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+
+void DecodedPixelsDeleter::operator()(uint8_t* pixels) const {
+	stbi_image_free(pixels);
+}
+
+void TextureDecodePool::start(uint32_t workers) {
+	stop();
+	if (workers == 0) {
+		workers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	}
+	m_start		= std::chrono::high_resolution_clock::now();
+	m_stopping	= false;
+	m_submitted = 0;
+	m_handedOut = 0;
+	for (uint32_t i = 0; i < workers; i++) {
+		m_workers.emplace_back(&TextureDecodePool::_work, this, i);
+	}
+}
+
+void TextureDecodePool::stop() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+		m_jobs.clear();
+	}
+	m_jobReady.notify_all();
+	for (std::thread& worker : m_workers) {
+		worker.join();
+	}
+	m_workers.clear();
+	m_done.clear();
+}
+
+uint32_t TextureDecodePool::submit(const std::string& fileName) {
+	uint32_t id;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		id = m_submitted++;
+		m_jobs.push_back({ id, fileName });
+	}
+	m_jobReady.notify_one();
+	return id;
+}
+
+bool TextureDecodePool::next(DecodedImage& image) {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_handedOut == m_submitted) {
+		return false;
+	}
+	m_imageReady.wait(lock, [this] { return !m_done.empty(); });
+	image = std::move(m_done.front());
+	m_done.pop_front();
+	m_handedOut++;
+	return true;
+}
+
+double TextureDecodePool::elapsedMs() const {
+	return std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - m_start).count();
+}
+
+void TextureDecodePool::_work(uint32_t worker) {
+	for (;;) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobReady.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+			if (m_stopping) {
+				return;
+			}
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+
+		DecodedImage image;
+		image.job	   = job.id;
+		image.fileName = std::move(job.fileName);
+		image.worker   = worker;
+		image.beginMs  = elapsedMs();
+		// mapped rather than stbi_load()ed, so images in the asset pack decode too
+		int width = 0, height = 0, channels = 0;
+		MappedFile file;
+		if (file.open(image.fileName)) {
+			image.pixels.reset(stbi_load_from_memory(file.data(), static_cast<int>(file.size()),
+				&width, &height, &channels, 0));
+		}
+		image.width	   = static_cast<uint32_t>(width);
+		image.height   = static_cast<uint32_t>(height);
+		image.channels = static_cast<uint32_t>(channels);
+		image.endMs	   = elapsedMs();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_done.push_back(std::move(image));
+		}
+		m_imageReady.notify_one();
+	}
+}
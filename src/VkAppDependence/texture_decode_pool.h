@@ -0,0 +1,75 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+
+struct DecodedPixelsDeleter {
+	void operator()(uint8_t* pixels) const;		// stbi_image_free
+};
+
+// An image decoded by a TextureDecodePool worker, with when and where.
+struct DecodedImage {
+	uint32_t	job = 0;			// what submit() returned
+	std::string fileName;
+	// 8 bit rows of `channels` (1 to 4, see expandToRgba8()), null when the
+	// file could not be decoded
+	std::unique_ptr<uint8_t, DecodedPixelsDeleter> pixels;
+	uint32_t	width	 = 0;
+	uint32_t	height	 = 0;
+	uint32_t	channels = 0;
+
+	uint32_t	worker	  = 0;
+	double		beginMs	  = 0.0;	// since the pool started
+	double		endMs	  = 0.0;
+};
+
+// Decodes image files (anything stb_image reads, 8 bits per channel) on
+// worker threads. Images keep the channels they were stored with, the
+// upload expands them into staging, so RGB images are never widened into
+// a buffer of their own. The thread that submits takes finished images
+// back with next() in completion order and records their uploads while
+// the workers go on with the rest, so only the copies stay on that thread.
+class TextureDecodePool {
+public:
+	~TextureDecodePool() { stop(); }
+
+	// `workers` 0 leaves one core to the caller
+	void start(uint32_t workers = 0);
+	// images not handed out yet are dropped
+	void stop();
+
+	uint32_t submit(const std::string& fileName);
+	// Blocks until an image submitted and not handed out yet is decoded.
+	// False once every submitted image has been handed out.
+	bool next(DecodedImage& image);
+
+	uint32_t workerCount() const { return static_cast<uint32_t>(m_workers.size()); }
+	double	 elapsedMs() const;		// since start()
+
+private:
+	struct Job {
+		uint32_t	id;
+		std::string fileName;
+	};
+
+	void _work(uint32_t worker);
+
+	std::vector<std::thread>	m_workers;
+	std::chrono::high_resolution_clock::time_point m_start;
+
+	std::mutex					m_mutex;
+	std::condition_variable		m_jobReady;
+	std::condition_variable		m_imageReady;
+	std::deque<Job>				m_jobs;
+	std::deque<DecodedImage>	m_done;
+	uint32_t					m_submitted = 0;
+	uint32_t					m_handedOut = 0;
+	bool						m_stopping	= false;
+};
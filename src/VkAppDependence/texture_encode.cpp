@@ -0,0 +1,838 @@
+#include "texture_codec.h"
+#include "texture_bc7.h"
+#include "pixel_convert.h"
+
+#include <immintrin.h>
+
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+// Block encoders. Endpoints start on the principal axis of the texels and
+// are refined by least squares against the indices they produced, every
+// candidate is scored by decoding it exactly the way decodeToRgba8() does.
+// Index selection, the inner loop of every encoder, compares eight texels
+// per instruction with AVX2 when pixelKernelLevel() allows it, else four
+// with SSE2, which both the Win32 and the x64 build have. Both pick the
+// same indices and sum the same errors in the same order.
+
+namespace {
+
+// the 16 texels of a block, edge texels repeated for partial blocks
+struct BlockTexels {
+	float  texels[16][4];
+	__m128 lanes[4][4];			// [channel][texels 4g..4g+3]
+};
+
+const uint32_t ALL_TEXELS = 0xFFFF;
+
+void loadBlock(
+	const uint8_t* rgba, uint32_t width, uint32_t height,
+	uint32_t blockX, uint32_t blockY, BlockTexels& block
+) {
+	for (uint32_t i = 0; i < 16; i++) {
+		uint32_t x = std::min(blockX * 4 + i % 4, width - 1);
+		uint32_t y = std::min(blockY * 4 + i / 4, height - 1);
+		const uint8_t* texel = rgba + (static_cast<size_t>(y) * width + x) * 4;
+		for (uint32_t c = 0; c < 4; c++) {
+			block.texels[i][c] = texel[c];
+		}
+	}
+	for (uint32_t c = 0; c < 4; c++) {
+		for (uint32_t g = 0; g < 4; g++) {
+			block.lanes[c][g] = _mm_setr_ps(
+				block.texels[g * 4][c], block.texels[g * 4 + 1][c],
+				block.texels[g * 4 + 2][c], block.texels[g * 4 + 3][c]);
+		}
+	}
+}
+
+__m128 laneMask(uint32_t members, uint32_t group) {
+	return _mm_castsi128_ps(_mm_setr_epi32(
+		(members >> (group * 4)) & 1 ? -1 : 0, (members >> (group * 4 + 1)) & 1 ? -1 : 0,
+		(members >> (group * 4 + 2)) & 1 ? -1 : 0, (members >> (group * 4 + 3)) & 1 ? -1 : 0));
+}
+
+// selectIndices() two texel groups at a time
+PIXEL_TARGET("avx2")
+float selectIndicesAvx2(
+	const BlockTexels& block, uint32_t firstChannel, uint32_t channelCount,
+	const float (*palette)[4], uint32_t count, uint32_t members, uint8_t indices[16]
+) {
+	const __m256i bits	= _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	__m128		  total = _mm_setzero_ps();
+	for (uint32_t g = 0; g < 4; g += 2) {
+		__m256 lanes[4];
+		for (uint32_t c = firstChannel; c < firstChannel + channelCount; c++) {
+			lanes[c] = _mm256_insertf128_ps(
+				_mm256_castps128_ps256(block.lanes[c][g]), block.lanes[c][g + 1], 1);
+		}
+		__m256	best	  = _mm256_set1_ps(FLT_MAX);
+		__m256i bestIndex = _mm256_setzero_si256();
+		for (uint32_t p = 0; p < count; p++) {
+			__m256 error = _mm256_setzero_ps();
+			for (uint32_t c = firstChannel; c < firstChannel + channelCount; c++) {
+				__m256 d = _mm256_sub_ps(lanes[c], _mm256_set1_ps(palette[p][c]));
+				error = _mm256_add_ps(error, _mm256_mul_ps(d, d));
+			}
+			__m256i closer = _mm256_castps_si256(_mm256_cmp_ps(error, best, _CMP_LT_OQ));
+			best	  = _mm256_min_ps(error, best);
+			bestIndex = _mm256_blendv_epi8(
+				bestIndex, _mm256_set1_epi32(static_cast<int>(p)), closer);
+		}
+		// the groups go into the total one by one, as in the SSE2 version
+		__m256i member = _mm256_and_si256(
+			_mm256_set1_epi32(static_cast<int>(members >> (g * 4))), bits);
+		best = _mm256_and_ps(best,
+			_mm256_castsi256_ps(_mm256_cmpeq_epi32(member, bits)));
+		total = _mm_add_ps(total, _mm256_castps256_ps128(best));
+		total = _mm_add_ps(total, _mm256_extractf128_ps(best, 1));
+
+		alignas(32) int32_t indexLanes[8];
+		_mm256_store_si256(reinterpret_cast<__m256i*>(indexLanes), bestIndex);
+		for (uint32_t l = 0; l < 8; l++) {
+			indices[g * 4 + l] = static_cast<uint8_t>(indexLanes[l]);
+		}
+	}
+	alignas(16) float sums[4];
+	_mm_store_ps(sums, total);
+	return sums[0] + sums[1] + sums[2] + sums[3];
+}
+
+// Nearest of `count` palette entries for every texel, over channels
+// [firstChannel, firstChannel + channelCount). Returns the squared error
+// summed over the texels in `members`.
+float selectIndices(
+	const BlockTexels& block, uint32_t firstChannel, uint32_t channelCount,
+	const float (*palette)[4], uint32_t count, uint32_t members, uint8_t indices[16]
+) {
+	if (pixelKernelLevel() == PixelKernelLevel::Avx2) {
+		return selectIndicesAvx2(
+			block, firstChannel, channelCount, palette, count, members, indices);
+	}
+	__m128 total = _mm_setzero_ps();
+	for (uint32_t g = 0; g < 4; g++) {
+		__m128	best	  = _mm_set1_ps(FLT_MAX);
+		__m128i bestIndex = _mm_setzero_si128();
+		for (uint32_t p = 0; p < count; p++) {
+			__m128 error = _mm_setzero_ps();
+			for (uint32_t c = firstChannel; c < firstChannel + channelCount; c++) {
+				__m128 d = _mm_sub_ps(block.lanes[c][g], _mm_set1_ps(palette[p][c]));
+				error = _mm_add_ps(error, _mm_mul_ps(d, d));
+			}
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(error, best));
+			best	  = _mm_min_ps(error, best);
+			bestIndex = _mm_or_si128(
+				_mm_and_si128(closer, _mm_set1_epi32(static_cast<int>(p))),
+				_mm_andnot_si128(closer, bestIndex));
+		}
+		total = _mm_add_ps(total, _mm_and_ps(best, laneMask(members, g)));
+
+		alignas(16) int32_t lanes[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), bestIndex);
+		for (uint32_t l = 0; l < 4; l++) {
+			indices[g * 4 + l] = static_cast<uint8_t>(lanes[l]);
+		}
+	}
+	alignas(16) float sums[4];
+	_mm_store_ps(sums, total);
+	return sums[0] + sums[1] + sums[2] + sums[3];
+}
+
+// Mean and principal axis of the texels in `members`. Returns what the
+// axis leaves unexplained, the squared distance of the texels from the line.
+float principalAxis(
+	const BlockTexels& block, uint32_t channels, uint32_t members,
+	float mean[4], float axis[4]
+) {
+	std::fill(mean, mean + 4, 0.0f);
+	std::fill(axis, axis + 4, 0.0f);
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < 16; i++) {
+		if (members & (1u << i)) {
+			for (uint32_t c = 0; c < channels; c++) {
+				mean[c] += block.texels[i][c];
+			}
+			count++;
+		}
+	}
+	if (count == 0) {
+		return 0.0f;
+	}
+	for (uint32_t c = 0; c < channels; c++) {
+		mean[c] /= count;
+	}
+
+	float covariance[4][4] = {};
+	float spread = 0.0f;
+	for (uint32_t i = 0; i < 16; i++) {
+		if (!(members & (1u << i))) {
+			continue;
+		}
+		for (uint32_t a = 0; a < channels; a++) {
+			float da = block.texels[i][a] - mean[a];
+			spread += da * da;
+			for (uint32_t b = a; b < channels; b++) {
+				covariance[a][b] += da * (block.texels[i][b] - mean[b]);
+			}
+		}
+	}
+	for (uint32_t a = 0; a < channels; a++) {
+		for (uint32_t b = 0; b < a; b++) {
+			covariance[a][b] = covariance[b][a];
+		}
+	}
+
+	// power iteration, started on the widest channel
+	uint32_t widest = 0;
+	for (uint32_t c = 1; c < channels; c++) {
+		if (covariance[c][c] > covariance[widest][widest]) {
+			widest = c;
+		}
+	}
+	axis[widest] = 1.0f;
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = {};
+		float length  = 0.0f;
+		for (uint32_t a = 0; a < channels; a++) {
+			for (uint32_t b = 0; b < channels; b++) {
+				next[a] += covariance[a][b] * axis[b];
+			}
+			length += next[a] * next[a];
+		}
+		if (length < 1e-12f) {
+			break;
+		}
+		length = 1.0f / std::sqrt(length);
+		for (uint32_t c = 0; c < channels; c++) {
+			axis[c] = next[c] * length;
+		}
+	}
+
+	float along = 0.0f;
+	for (uint32_t a = 0; a < channels; a++) {
+		for (uint32_t b = 0; b < channels; b++) {
+			along += axis[a] * covariance[a][b] * axis[b];
+		}
+	}
+	return std::max(0.0f, spread - along);
+}
+
+// endpoints spanning the texels in `members` along their principal axis
+void fitLine(
+	const BlockTexels& block, uint32_t channels, uint32_t members,
+	float e0[4], float e1[4]
+) {
+	float mean[4], axis[4];
+	principalAxis(block, channels, members, mean, axis);
+
+	float minT = 0.0f, maxT = 0.0f;
+	bool  first = true;
+	for (uint32_t i = 0; i < 16; i++) {
+		if (!(members & (1u << i))) {
+			continue;
+		}
+		float t = 0.0f;
+		for (uint32_t c = 0; c < channels; c++) {
+			t += (block.texels[i][c] - mean[c]) * axis[c];
+		}
+		minT  = first ? t : std::min(minT, t);
+		maxT  = first ? t : std::max(maxT, t);
+		first = false;
+	}
+	for (uint32_t c = 0; c < 4; c++) {
+		e0[c] = c < channels ? std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * minT)) : 255.0f;
+		e1[c] = c < channels ? std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * maxT)) : 255.0f;
+	}
+}
+
+// Least squares endpoints for fixed indices, texel i weighted weights[indices[i]]
+// towards e1. Leaves the endpoints alone when the indices do not pin them.
+void refineEndpoints(
+	const BlockTexels& block, uint32_t channels, uint32_t members,
+	const uint8_t indices[16], const float* weights, float e0[4], float e1[4]
+) {
+	float a = 0.0f, b = 0.0f, c = 0.0f;
+	float x0[4] = {}, x1[4] = {};
+	for (uint32_t i = 0; i < 16; i++) {
+		if (!(members & (1u << i))) {
+			continue;
+		}
+		float t = weights[indices[i]], s = 1.0f - t;
+		a += s * s;
+		b += s * t;
+		c += t * t;
+		for (uint32_t ch = 0; ch < channels; ch++) {
+			x0[ch] += s * block.texels[i][ch];
+			x1[ch] += t * block.texels[i][ch];
+		}
+	}
+	float det = a * c - b * b;
+	if (std::fabs(det) < 1e-6f) {
+		return;
+	}
+	for (uint32_t ch = 0; ch < channels; ch++) {
+		e0[ch] = std::min(255.0f, std::max(0.0f, (c * x0[ch] - b * x1[ch]) / det));
+		e1[ch] = std::min(255.0f, std::max(0.0f, (a * x1[ch] - b * x0[ch]) / det));
+	}
+}
+
+// BC1 / BC3 color ------------------------------------------------------
+
+uint32_t quantize565(const float color[4]) {
+	uint32_t r = static_cast<uint32_t>(color[0] * 31.0f / 255.0f + 0.5f);
+	uint32_t g = static_cast<uint32_t>(color[1] * 63.0f / 255.0f + 0.5f);
+	uint32_t b = static_cast<uint32_t>(color[2] * 31.0f / 255.0f + 0.5f);
+	return (r << 11) | (g << 5) | b;
+}
+
+void expand565(uint32_t c, float out[4]) {
+	uint32_t r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+	out[0] = static_cast<float>((r << 3) | (r >> 2));
+	out[1] = static_cast<float>((g << 2) | (g >> 4));
+	out[2] = static_cast<float>((b << 3) | (b >> 2));
+	out[3] = 255.0f;
+}
+
+// `opaque` is the BC3 color block, always four colors; BC1 blocks with
+// texels below alpha 128 use the three color mode with transparent black
+void encodeColorBlock(const BlockTexels& block, bool opaque, uint8_t out[8]) {
+	uint32_t visible = 0;
+	for (uint32_t i = 0; i < 16; i++) {
+		if (opaque || block.texels[i][3] >= 128.0f) {
+			visible |= 1u << i;
+		}
+	}
+	bool threeColor = visible != ALL_TEXELS;
+
+	float e0[4], e1[4];
+	fitLine(block, 3, visible, e0, e1);
+
+	static const float FOUR_WEIGHTS[4]	= { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+	static const float THREE_WEIGHTS[4] = { 0.0f, 1.0f, 0.5f, 0.0f };
+
+	float	 bestError = FLT_MAX;
+	uint32_t bestC0 = 0, bestC1 = 0;
+	uint8_t	 bestIndices[16] = {};
+	for (int iteration = 0; iteration < 3 && visible != 0; iteration++) {
+		uint32_t c0 = quantize565(e0), c1 = quantize565(e1);
+		// the decoder picks the mode from the endpoint order
+		if (threeColor ? c0 > c1 : c0 < c1) {
+			std::swap(c0, c1);
+			std::swap(e0, e1);
+		}
+
+		float palette[4][4];
+		expand565(c0, palette[0]);
+		expand565(c1, palette[1]);
+		bool four = !threeColor && (opaque || c0 > c1);
+		for (uint32_t ch = 0; ch < 3; ch++) {
+			uint32_t a = static_cast<uint32_t>(palette[0][ch]);
+			uint32_t b = static_cast<uint32_t>(palette[1][ch]);
+			palette[2][ch] = static_cast<float>(four ? (2 * a + b) / 3 : (a + b) / 2);
+			palette[3][ch] = static_cast<float>(four ? (a + 2 * b) / 3 : 0);
+		}
+
+		uint8_t indices[16];
+		float	error = selectIndices(block, 0, 3, palette, four ? 4 : 3, visible, indices);
+		if (error < bestError) {
+			bestError = error;
+			bestC0	  = c0;
+			bestC1	  = c1;
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+		if (error == 0.0f) {
+			break;
+		}
+		refineEndpoints(block, 3, visible, indices,
+			four ? FOUR_WEIGHTS : THREE_WEIGHTS, e0, e1);
+	}
+
+	uint32_t bits = 0;
+	for (uint32_t i = 0; i < 16; i++) {
+		uint32_t index = visible & (1u << i) ? bestIndices[i] : 3;
+		bits |= index << (2 * i);
+	}
+	out[0] = static_cast<uint8_t>(bestC0);
+	out[1] = static_cast<uint8_t>(bestC0 >> 8);
+	out[2] = static_cast<uint8_t>(bestC1);
+	out[3] = static_cast<uint8_t>(bestC1 >> 8);
+	memcpy(out + 4, &bits, 4);
+}
+
+// BC4, one channel -----------------------------------------------------
+
+void channelPalette(uint32_t a0, uint32_t a1, uint32_t channel, float palette[8][4]) {
+	uint32_t values[8] = { a0, a1 };
+	if (a0 > a1) {
+		for (uint32_t k = 2; k < 8; k++) {
+			values[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+		}
+	}
+	else {
+		for (uint32_t k = 2; k < 6; k++) {
+			values[k] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+		}
+		values[6] = 0;
+		values[7] = 255;
+	}
+	for (uint32_t k = 0; k < 8; k++) {
+		palette[k][channel] = static_cast<float>(values[k]);
+	}
+}
+
+void encodeChannelBlock(const BlockTexels& block, uint32_t channel, uint8_t out[8]) {
+	float low = 255.0f, high = 0.0f, innerLow = 255.0f, innerHigh = 0.0f;
+	for (uint32_t i = 0; i < 16; i++) {
+		float v = block.texels[i][channel];
+		low	 = std::min(low, v);
+		high = std::max(high, v);
+		if (v > 0.0f && v < 255.0f) {
+			innerLow  = std::min(innerLow, v);
+			innerHigh = std::max(innerHigh, v);
+		}
+	}
+
+	// eight interpolated values between the extremes, or six between the
+	// inner extremes when exact 0 and 255 are left to the two fixed ones
+	bool	 inner = innerLow <= innerHigh;
+	uint32_t candidates[2][2] = {
+		{ static_cast<uint32_t>(high), static_cast<uint32_t>(low) },
+		{ inner ? static_cast<uint32_t>(innerLow) : 0, inner ? static_cast<uint32_t>(innerHigh) : 0 },
+	};
+	uint32_t candidateCount = (low == 0.0f || high == 255.0f) ? 2 : 1;
+
+	float	 bestError = FLT_MAX;
+	uint32_t best	   = 0;
+	uint8_t	 bestIndices[16] = {};
+	for (uint32_t k = 0; k < candidateCount; k++) {
+		float palette[8][4] = {};
+		channelPalette(candidates[k][0], candidates[k][1], channel, palette);
+		uint8_t indices[16];
+		float	error = selectIndices(block, channel, 1, palette, 8, ALL_TEXELS, indices);
+		if (error < bestError) {
+			bestError = error;
+			best	  = k;
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+	}
+
+	uint64_t bits = 0;
+	for (uint32_t i = 0; i < 16; i++) {
+		bits |= static_cast<uint64_t>(bestIndices[i]) << (3 * i);
+	}
+	out[0] = static_cast<uint8_t>(candidates[best][0]);
+	out[1] = static_cast<uint8_t>(candidates[best][1]);
+	for (uint32_t i = 0; i < 6; i++) {
+		out[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+	}
+}
+
+// BC7, modes 6, 5 and 1 ------------------------------------------------
+
+class BlockWriter {
+public:
+	void write(uint32_t value, uint32_t count) {
+		for (uint32_t bit = 0; bit < count; bit++, m_position++) {
+			if ((value >> bit) & 1) {
+				m_bytes[m_position / 8] |= static_cast<uint8_t>(1u << (m_position % 8));
+			}
+		}
+	}
+	const uint8_t* bytes() const { return m_bytes; }
+
+private:
+	uint8_t	 m_bytes[16] = {};
+	uint32_t m_position	 = 0;
+};
+
+// how a mode extends its stored endpoint bits
+enum class PBit : uint32_t {
+	None = 0,
+	Shared,			// one for both endpoints of a subset
+	Unique,			// one per endpoint
+};
+
+// the part of a BC7 mode the fit of one subset depends on
+struct Bc7Subset {
+	uint32_t channels;		// 4 fits alpha along with the color
+	uint32_t bits;			// stored per channel
+	PBit	 pBit;
+	uint32_t indexBits;
+};
+
+const Bc7Subset MODE6_SUBSET = { 4, 7, PBit::Unique, 4 };
+const Bc7Subset MODE5_COLOR	 = { 3, 7, PBit::None,	 2 };
+const Bc7Subset MODE1_SUBSET = { 3, 6, PBit::Shared, 3 };
+
+struct Bc7Endpoints {
+	uint32_t stored[2][4] = {};		// [endpoint][channel]
+	uint32_t pBits[2]	  = {};
+};
+
+struct Bc7Candidate {
+	float		 error	   = FLT_MAX;
+	uint32_t	 partition = 0;
+	Bc7Endpoints endpoints[2];		// per subset
+	uint8_t		 indices[16] = {};
+};
+
+uint32_t expandBc7(const Bc7Subset& mode, uint32_t stored, uint32_t pBit) {
+	uint32_t precision = mode.bits + (mode.pBit != PBit::None);
+	uint32_t value	   = mode.pBit != PBit::None ? (stored << 1) | pBit : stored;
+	value <<= 8 - precision;
+	return value | (value >> precision);
+}
+
+bool opaqueTexels(const BlockTexels& block, uint32_t members) {
+	for (uint32_t i = 0; i < 16; i++) {
+		if ((members & (1u << i)) && block.texels[i][3] != 255.0f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void copyIndices(const uint8_t from[16], uint32_t members, uint8_t to[16]) {
+	for (uint32_t i = 0; i < 16; i++) {
+		if (members & (1u << i)) {
+			to[i] = from[i];
+		}
+	}
+}
+
+// endpoint pair quantized channel by channel, the p-bits that land
+// closest win; full alpha survives 7 bit endpoints only with p-bit 1
+void quantizeBc7(const Bc7Subset& mode, const float e0[4], const float e1[4], bool opaque, Bc7Endpoints& out) {
+	const float* ends[2]   = { e0, e1 };
+	uint32_t	 pCount	   = mode.pBit != PBit::None ? 2 : 1;
+	uint32_t	 precision = mode.bits + pCount - 1;
+	int			 top	   = (1 << mode.bits) - 1;
+
+	uint32_t levels[2][2][4] = {};		// [endpoint][p-bit][channel]
+	float	 errors[2][2]	 = { { 0.0f, FLT_MAX }, { 0.0f, FLT_MAX } };
+	for (uint32_t e = 0; e < 2; e++) {
+		for (uint32_t p = 0; p < pCount; p++) {
+			errors[e][p] = 0.0f;
+			for (uint32_t c = 0; c < mode.channels; c++) {
+				float target = ends[e][c] * ((1u << precision) - 1) / 255.0f;
+				int	  level	 = static_cast<int>(pCount == 2 ? (target - p) / 2.0f + 0.5f : target + 0.5f);
+				levels[e][p][c] = static_cast<uint32_t>(std::min(std::max(level, 0), top));
+				float d = static_cast<float>(expandBc7(mode, levels[e][p][c], p)) - ends[e][c];
+				errors[e][p] += d * d;
+			}
+		}
+	}
+
+	bool sharedOne = errors[0][1] + errors[1][1] < errors[0][0] + errors[1][0];
+	for (uint32_t e = 0; e < 2; e++) {
+		uint32_t p =
+			mode.pBit == PBit::None	  ? 0 :
+			opaque					  ? 1 :
+			mode.pBit == PBit::Shared ? sharedOne : errors[e][1] < errors[e][0];
+		out.pBits[e] = p;
+		for (uint32_t c = 0; c < 4; c++) {
+			out.stored[e][c] = c < mode.channels ? levels[e][p][c] : 0;
+		}
+	}
+}
+
+// squared error of `endpoints` over the texels in `members`, with the
+// indices they pick
+float evaluateBc7(
+	const BlockTexels& block, uint32_t members, const Bc7Subset& mode,
+	const Bc7Endpoints& endpoints, uint8_t indices[16]
+) {
+	uint32_t ends[2][4];
+	for (uint32_t e = 0; e < 2; e++) {
+		for (uint32_t c = 0; c < 4; c++) {
+			ends[e][c] = c < mode.channels ? expandBc7(mode, endpoints.stored[e][c], endpoints.pBits[e]) : 255;
+		}
+	}
+	const uint8_t* weights = bc7Weights(mode.indexBits);
+	uint32_t	   count   = 1u << mode.indexBits;
+	float		   palette[16][4];
+	for (uint32_t k = 0; k < count; k++) {
+		for (uint32_t c = 0; c < 4; c++) {
+			palette[k][c] = bc7Interpolate(ends[0][c], ends[1][c], weights[k]);
+		}
+	}
+	return selectIndices(block, 0, mode.channels, palette, count, members, indices);
+}
+
+float fitBc7Subset(
+	const BlockTexels& block, uint32_t members, const Bc7Subset& mode,
+	Bc7Endpoints& endpoints, uint8_t indices[16]
+) {
+	const uint8_t* weights = bc7Weights(mode.indexBits);
+	float		   scaled[16];
+	for (uint32_t k = 0; k < (1u << mode.indexBits); k++) {
+		scaled[k] = weights[k] / 64.0f;
+	}
+	bool opaque = mode.channels == 4 && opaqueTexels(block, members);
+
+	float e0[4], e1[4];
+	fitLine(block, mode.channels, members, e0, e1);
+
+	float bestError = FLT_MAX;
+	for (int iteration = 0; iteration < 3; iteration++) {
+		if (opaque) {
+			e0[3] = e1[3] = 255.0f;
+		}
+		Bc7Endpoints quantized;
+		quantizeBc7(mode, e0, e1, opaque, quantized);
+
+		uint8_t candidate[16];
+		float	error = evaluateBc7(block, members, mode, quantized, candidate);
+		if (error < bestError) {
+			bestError = error;
+			endpoints = quantized;
+			copyIndices(candidate, members, indices);
+		}
+		if (error == 0.0f) {
+			break;
+		}
+		refineEndpoints(block, mode.channels, members, candidate, scaled, e0, e1);
+	}
+	return bestError;
+}
+
+// Rounding each endpoint on its own misses pairs that interpolate closer.
+// Walks every stored channel one level either way while that helps,
+// starting from the fitted endpoints and from them with the p-bits flipped.
+// Returns the new error.
+float walkBc7Endpoints(
+	const BlockTexels& block, uint32_t members, const Bc7Subset& mode,
+	Bc7Endpoints& endpoints, uint8_t indices[16]
+) {
+	const Bc7Endpoints origin = endpoints;
+	uint8_t			   candidate[16];
+	float			   bestError = evaluateBc7(block, members, mode, origin, candidate);
+
+	bool	 opaque = mode.channels == 4 && opaqueTexels(block, members);
+	uint32_t top	= (1u << mode.bits) - 1;
+	uint32_t starts = mode.pBit == PBit::Unique ? 4 : mode.pBit == PBit::Shared ? 2 : 1;
+	for (uint32_t start = 0; start < starts && bestError > 0.0f; start++) {
+		Bc7Endpoints walk = origin;
+		walk.pBits[0] ^= start & 1;
+		walk.pBits[1] ^= mode.pBit == PBit::Shared ? start & 1 : start >> 1;
+		if (opaque && (walk.pBits[0] == 0 || walk.pBits[1] == 0)) {
+			continue;
+		}
+
+		float error = evaluateBc7(block, members, mode, walk, candidate);
+		for (bool improved = true; improved && error > 0.0f;) {
+			improved = false;
+			for (uint32_t e = 0; e < 2; e++) {
+				for (uint32_t c = 0; c < mode.channels; c++) {
+					for (int step = -1; step <= 1; step += 2) {
+						uint32_t original = walk.stored[e][c];
+						if ((step < 0 && original == 0) || (step > 0 && original == top)) {
+							continue;
+						}
+						walk.stored[e][c] = original + step;
+						uint8_t stepped[16];
+						float	steppedError = evaluateBc7(block, members, mode, walk, stepped);
+						if (steppedError < error) {
+							error	 = steppedError;
+							improved = true;
+							memcpy(candidate, stepped, sizeof(stepped));
+						}
+						else {
+							walk.stored[e][c] = original;
+						}
+					}
+				}
+			}
+		}
+		if (error < bestError) {
+			bestError = error;
+			endpoints = walk;
+			copyIndices(candidate, members, indices);
+		}
+	}
+	return bestError;
+}
+
+void encodeBc7Block(const BlockTexels& block, uint8_t out[16]) {
+	bool opaque = opaqueTexels(block, ALL_TEXELS);
+
+	// mode 6: one subset, RGBA 7.7.7.7 + p-bit per endpoint, 4 bit indices
+	Bc7Candidate mode6;
+	mode6.error = fitBc7Subset(block, ALL_TEXELS, MODE6_SUBSET, mode6.endpoints[0], mode6.indices);
+	if (mode6.error > 0.0f) {
+		mode6.error = walkBc7Endpoints(block, ALL_TEXELS, MODE6_SUBSET, mode6.endpoints[0], mode6.indices);
+	}
+
+	// mode 5: one subset, RGB 7.7.7 and separate 8 bit alpha, 2 bit indices;
+	// opaque blocks keep alpha 255 in mode 6 only with both p-bits set, which
+	// leaves their colors odd, mode 5 reaches the even ones
+	Bc7Candidate mode5;
+	if (opaque && mode6.error > 0.0f) {
+		mode5.error = fitBc7Subset(block, ALL_TEXELS, MODE5_COLOR, mode5.endpoints[0], mode5.indices);
+		if (mode5.error > 0.0f) {
+			mode5.error = walkBc7Endpoints(block, ALL_TEXELS, MODE5_COLOR, mode5.endpoints[0], mode5.indices);
+		}
+	}
+	float singleError = std::min(mode6.error, mode5.error);
+
+	// mode 1: two subsets, RGB 6.6.6 + shared p-bit, 3 bit indices, for
+	// opaque blocks one subset leaves visibly off; partitions are ranked by
+	// how well a line fits each subset, the best few are fitted
+	const float VISIBLE_ERROR = 16 * 4.0f;
+	Bc7Candidate mode1;
+	if (opaque && singleError > VISIBLE_ERROR) {
+		const uint32_t TRIED = 4;
+		uint32_t	   ranked[TRIED];
+		float		   rankedError[TRIED];
+		std::fill(rankedError, rankedError + TRIED, FLT_MAX);
+		for (uint32_t partition = 0; partition < 64; partition++) {
+			uint32_t second = BC7_PARTITIONS2[partition];
+			float	 mean[4], axis[4];
+			float	 residual = principalAxis(block, 3, ~second & ALL_TEXELS, mean, axis) +
+				principalAxis(block, 3, second, mean, axis);
+			for (uint32_t slot = 0; slot < TRIED; slot++) {
+				if (residual < rankedError[slot]) {
+					for (uint32_t move = TRIED - 1; move > slot; move--) {
+						ranked[move]	  = ranked[move - 1];
+						rankedError[move] = rankedError[move - 1];
+					}
+					ranked[slot]	  = partition;
+					rankedError[slot] = residual;
+					break;
+				}
+			}
+		}
+
+		for (uint32_t slot = 0; slot < TRIED; slot++) {
+			Bc7Candidate candidate;
+			candidate.partition = ranked[slot];
+			uint32_t second = BC7_PARTITIONS2[candidate.partition];
+			candidate.error =
+				fitBc7Subset(block, ~second & ALL_TEXELS, MODE1_SUBSET, candidate.endpoints[0], candidate.indices) +
+				fitBc7Subset(block, second, MODE1_SUBSET, candidate.endpoints[1], candidate.indices);
+			if (candidate.error < mode1.error) {
+				mode1 = candidate;
+			}
+		}
+		uint32_t second = BC7_PARTITIONS2[mode1.partition];
+		mode1.error =
+			walkBc7Endpoints(block, ~second & ALL_TEXELS, MODE1_SUBSET, mode1.endpoints[0], mode1.indices) +
+			walkBc7Endpoints(block, second, MODE1_SUBSET, mode1.endpoints[1], mode1.indices);
+	}
+
+	BlockWriter writer;
+	if (mode1.error < singleError) {
+		uint32_t second = BC7_PARTITIONS2[mode1.partition];
+		uint32_t anchors[2] = { 0, BC7_ANCHORS2[mode1.partition] };
+		// the anchor's index top bit is implied zero, flip the subset if not
+		for (uint32_t s = 0; s < 2; s++) {
+			if (mode1.indices[anchors[s]] >= 4) {
+				std::swap(mode1.endpoints[s].stored[0], mode1.endpoints[s].stored[1]);
+				for (uint32_t i = 0; i < 16; i++) {
+					if (((second >> i) & 1) == s) {
+						mode1.indices[i] = static_cast<uint8_t>(7 - mode1.indices[i]);
+					}
+				}
+			}
+		}
+		writer.write(1u << 1, 2);
+		writer.write(mode1.partition, 6);
+		for (uint32_t c = 0; c < 3; c++) {
+			for (uint32_t s = 0; s < 2; s++) {
+				writer.write(mode1.endpoints[s].stored[0][c], 6);
+				writer.write(mode1.endpoints[s].stored[1][c], 6);
+			}
+		}
+		writer.write(mode1.endpoints[0].pBits[0], 1);
+		writer.write(mode1.endpoints[1].pBits[0], 1);
+		for (uint32_t i = 0; i < 16; i++) {
+			writer.write(mode1.indices[i], i == anchors[0] || i == anchors[1] ? 2 : 3);
+		}
+	}
+	else if (mode5.error < mode6.error) {
+		Bc7Endpoints& ends = mode5.endpoints[0];
+		if (mode5.indices[0] >= 2) {
+			std::swap(ends.stored[0], ends.stored[1]);
+			for (uint32_t i = 0; i < 16; i++) {
+				mode5.indices[i] = static_cast<uint8_t>(3 - mode5.indices[i]);
+			}
+		}
+		writer.write(1u << 5, 6);
+		writer.write(0, 2);			// no rotation
+		for (uint32_t c = 0; c < 3; c++) {
+			writer.write(ends.stored[0][c], 7);
+			writer.write(ends.stored[1][c], 7);
+		}
+		writer.write(255, 8);
+		writer.write(255, 8);
+		for (uint32_t i = 0; i < 16; i++) {
+			writer.write(mode5.indices[i], i == 0 ? 1 : 2);
+		}
+		writer.write(0, 31);		// alpha indices
+	}
+	else {
+		Bc7Endpoints& ends = mode6.endpoints[0];
+		if (mode6.indices[0] >= 8) {
+			std::swap(ends.stored[0], ends.stored[1]);
+			std::swap(ends.pBits[0], ends.pBits[1]);
+			for (uint32_t i = 0; i < 16; i++) {
+				mode6.indices[i] = static_cast<uint8_t>(15 - mode6.indices[i]);
+			}
+		}
+		writer.write(1u << 6, 7);
+		for (uint32_t c = 0; c < 4; c++) {
+			writer.write(ends.stored[0][c], 7);
+			writer.write(ends.stored[1][c], 7);
+		}
+		writer.write(ends.pBits[0], 1);
+		writer.write(ends.pBits[1], 1);
+		for (uint32_t i = 0; i < 16; i++) {
+			writer.write(mode6.indices[i], i == 0 ? 3 : 4);
+		}
+	}
+	memcpy(out, writer.bytes(), 16);
+}
+
+}
+
+void encodeFromRgba8(
+	TextureCodec codec, const uint8_t* rgba, uint32_t width, uint32_t height,
+	uint32_t firstRow, uint32_t rowCount, void* data
+) {
+	const TextureCodecInfo& info = textureCodecInfo(codec);
+	if (info.blockExtent != 4) {
+		throw std::runtime_error("failed to encode: not a block codec");
+	}
+
+	uint32_t columns = (width + 3) / 4;
+	uint8_t* blocks	 = static_cast<uint8_t*>(data);
+	BlockTexels block;
+	for (uint32_t by = firstRow; by < firstRow + rowCount; by++) {
+		for (uint32_t bx = 0; bx < columns; bx++) {
+			loadBlock(rgba, width, height, bx, by, block);
+			uint8_t* out = blocks + (static_cast<size_t>(by) * columns + bx) * info.blockSize;
+			switch (codec) {
+			case TextureCodec::BC1:
+				encodeColorBlock(block, false, out);
+				break;
+			case TextureCodec::BC3:
+				encodeChannelBlock(block, 3, out);
+				encodeColorBlock(block, true, out + 8);
+				break;
+			case TextureCodec::BC4:
+				encodeChannelBlock(block, 0, out);
+				break;
+			case TextureCodec::BC5:
+				encodeChannelBlock(block, 0, out);
+				encodeChannelBlock(block, 1, out + 8);
+				break;
+			default:
+				encodeBc7Block(block, out);
+				break;
+			}
+		}
+	}
+}
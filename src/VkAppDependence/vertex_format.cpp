@@ -0,0 +1,182 @@
+#include "vertex_format.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+#define VERTEX_ATTRIBUTE(TYPE, MEMBER, SEMANTIC, FORMAT) \
+	{ VertexSemantic::SEMANTIC, FORMAT, static_cast<uint32_t>(offsetof(TYPE, MEMBER)) }
+
+static const VertexAttribute FLOAT32_ATTRIBUTES[] = {
+	VERTEX_ATTRIBUTE(Vertex, pos,	   Position, VK_FORMAT_R32G32B32_SFLOAT),
+	VERTEX_ATTRIBUTE(Vertex, color,	   Color,	 VK_FORMAT_R32G32B32_SFLOAT),
+	VERTEX_ATTRIBUTE(Vertex, texCoord, TexCoord, VK_FORMAT_R32G32_SFLOAT)
+};
+
+static const VertexAttribute PACKED16_ATTRIBUTES[] = {
+	VERTEX_ATTRIBUTE(PackedVertex, position, Position, VK_FORMAT_R16G16B16A16_SNORM),
+	VERTEX_ATTRIBUTE(PackedVertex, normal,	 Normal,   VK_FORMAT_R8G8_SNORM),
+	VERTEX_ATTRIBUTE(PackedVertex, texCoord, TexCoord, VK_FORMAT_R16G16_SFLOAT),
+	VERTEX_ATTRIBUTE(PackedVertex, color,	 Color,	   VK_FORMAT_R8G8B8A8_UNORM)
+};
+
+#undef VERTEX_ATTRIBUTE
+
+static const VertexLayout LAYOUTS[] = {
+	{
+		VertexFormat::Float32, "float32", sizeof(Vertex),
+		FLOAT32_ATTRIBUTES, sizeof(FLOAT32_ATTRIBUTES) / sizeof(VertexAttribute),
+		"vert.spv"
+	},
+	{
+		VertexFormat::Packed16, "packed16", sizeof(PackedVertex),
+		PACKED16_ATTRIBUTES, sizeof(PACKED16_ATTRIBUTES) / sizeof(VertexAttribute),
+		"vert_packed.spv"
+	}
+};
+
+const VertexLayout& vertexLayout(VertexFormat format) {
+	return LAYOUTS[static_cast<uint32_t>(format)];
+}
+
+VkVertexInputBindingDescription VertexLayout::bindingDescription(uint32_t binding) const {
+	VkVertexInputBindingDescription description = {};
+	description.binding	  = binding;
+	description.stride	  = stride;
+	description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	return description;
+}
+
+std::vector<VkVertexInputAttributeDescription>
+	VertexLayout::attributeDescriptions(uint32_t binding) const {
+	std::vector<VkVertexInputAttributeDescription> descriptions(attributeCount);
+	for (uint32_t i = 0; i < attributeCount; i++) {
+		descriptions[i].binding	 = binding;
+		descriptions[i].location = static_cast<uint32_t>(attributes[i].semantic);
+		descriptions[i].format	 = attributes[i].format;
+		descriptions[i].offset	 = attributes[i].offset;
+	}
+	return descriptions;
+}
+
+//-----------------------------------------------------------------------------
+
+static int16_t toSnorm16(float value) {
+	return static_cast<int16_t>(std::lround(std::max(-1.0f, std::min(1.0f, value)) * 32767.0f));
+}
+
+static int8_t toSnorm8(float value) {
+	return static_cast<int8_t>(std::lround(std::max(-1.0f, std::min(1.0f, value)) * 127.0f));
+}
+
+// IEEE half, round to nearest even, overflow to infinity
+static uint16_t toHalf(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign	  = (bits >> 16) & 0x8000u;
+	uint32_t exponent = (bits >> 23) & 0xFFu;
+	uint32_t mantissa = bits & 0x7FFFFFu;
+
+	if (exponent == 0xFF) {
+		return static_cast<uint16_t>(sign | 0x7C00u | (mantissa ? 0x200u : 0u));
+	}
+	int32_t halfExponent = static_cast<int32_t>(exponent) - 127 + 15;
+	if (halfExponent >= 31) {
+		return static_cast<uint16_t>(sign | 0x7C00u);
+	}
+	if (halfExponent <= 0) {
+		if (halfExponent < -10) {
+			return static_cast<uint16_t>(sign);
+		}
+		// subnormal: shift the mantissa with its implicit bit into place
+		mantissa |= 0x800000u;
+		uint32_t shift	  = static_cast<uint32_t>(14 - halfExponent);
+		uint32_t half	  = mantissa >> shift;
+		uint32_t rest	  = mantissa & ((1u << shift) - 1);
+		uint32_t halfway  = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1u))) {
+			half++;
+		}
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	uint32_t half = sign | (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1FFFu;
+	if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) {
+		half++;		// may carry into the exponent, which is still correct
+	}
+	return static_cast<uint16_t>(half);
+}
+
+// unit vector onto the octahedron, lower half folded over the diagonals
+static void toOctahedral(const glm::vec3& n, int8_t out[2]) {
+	float	  l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+	glm::vec2 p	 = l1 > 0.0f ? glm::vec2(n.x / l1, n.y / l1) : glm::vec2(0.0f);
+	if (n.z < 0.0f) {
+		glm::vec2 folded(
+			(1.0f - std::fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+		p = folded;
+	}
+	out[0] = toSnorm8(p.x);
+	out[1] = toSnorm8(p.y);
+}
+
+static void quantizationBox(
+	const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+	glm::vec3& center, glm::vec3& halfExtent
+) {
+	center	   = (boundsMin + boundsMax) * 0.5f;
+	halfExtent = (boundsMax - boundsMin) * 0.5f;
+	for (int i = 0; i < 3; i++) {
+		halfExtent[i] = std::max(halfExtent[i], 1e-6f);
+	}
+}
+
+void encodeVertices(
+	const std::vector<MeshVertex>& vertices, VertexFormat format,
+	const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+	std::vector<uint8_t>& out
+) {
+	out.resize(vertices.size() * vertexLayout(format).stride);
+
+	if (format == VertexFormat::Float32) {
+		Vertex* dst = reinterpret_cast<Vertex*>(out.data());
+		for (size_t i = 0; i < vertices.size(); i++) {
+			dst[i].pos		= vertices[i].position;
+			dst[i].color	= vertices[i].normal * 0.5f + glm::vec3(0.5f);
+			dst[i].texCoord = vertices[i].uv;
+		}
+		return;
+	}
+
+	glm::vec3 center, halfExtent;
+	quantizationBox(boundsMin, boundsMax, center, halfExtent);
+
+	PackedVertex* dst = reinterpret_cast<PackedVertex*>(out.data());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		const MeshVertex& src  = vertices[i];
+		glm::vec3		  unit = (src.position - center) / halfExtent;
+		for (int c = 0; c < 3; c++) {
+			dst[i].position[c] = toSnorm16(unit[c]);
+		}
+		toOctahedral(src.normal, dst[i].normal);
+		dst[i].texCoord[0] = toHalf(src.uv.x);
+		dst[i].texCoord[1] = toHalf(src.uv.y);
+		memset(dst[i].color, 0xFF, sizeof(dst[i].color));
+	}
+}
+
+glm::mat4 vertexDequantization(
+	VertexFormat format, const glm::vec3& boundsMin, const glm::vec3& boundsMax
+) {
+	if (format == VertexFormat::Float32) {
+		return glm::mat4(1.0f);
+	}
+	glm::vec3 center, halfExtent;
+	quantizationBox(boundsMin, boundsMax, center, halfExtent);
+	return glm::scale(glm::translate(glm::mat4(1.0f), center), halfExtent);
+}
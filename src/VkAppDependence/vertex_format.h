@@ -0,0 +1,67 @@
+#pragma once
+
+#include "vk_depend.h"
+#include "mesh_data.h"
+
+#include <vector>
+#include <cstdint>
+
+// Vertex buffer layouts a mesh can be stored and drawn in. Each layout
+// is described once by a table of (semantic, format, offset) and the
+// Vulkan binding and attribute descriptions are generated from it.
+enum class VertexFormat : uint32_t {
+	Float32 = 0,		// Vertex, 32 bytes, shaders/vert.spv
+	Packed16			// PackedVertex, 16 bytes, shaders/vert_packed.spv
+};
+
+// values are the shader input locations
+enum class VertexSemantic : uint32_t {
+	Position = 0,
+	Color	 = 1,
+	TexCoord = 2,
+	Normal	 = 3
+};
+
+// Positions are snorm16 inside the mesh bounds, the model matrix applies
+// vertexDequantization(). The position attribute is read as four snorm16
+// components so it can use a format every device supports for vertex
+// input; its fourth component overlaps the normal and is ignored.
+struct PackedVertex {
+	int16_t	 position[3];
+	int8_t	 normal[2];			// octahedral, snorm8
+	uint16_t texCoord[2];		// half floats
+	uint8_t	 color[4];			// unorm8
+};
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must stay 16 bytes");
+
+struct VertexAttribute {
+	VertexSemantic semantic;
+	VkFormat	   format;
+	uint32_t	   offset;
+};
+
+struct VertexLayout {
+	VertexFormat		   format;
+	const char*			   name;
+	uint32_t			   stride;
+	const VertexAttribute* attributes;
+	uint32_t			   attributeCount;
+	const char*			   vertexShader;		// file in the shader directory
+
+	VkVertexInputBindingDescription bindingDescription(uint32_t binding = 0) const;
+	std::vector<VkVertexInputAttributeDescription>
+		attributeDescriptions(uint32_t binding = 0) const;
+};
+
+const VertexLayout& vertexLayout(VertexFormat format);
+
+// Writes the vertices in `format`, layout.stride bytes each. Float32 shows
+// the normal as the color, Packed16 keeps the normal and a white color.
+void encodeVertices(
+	const std::vector<MeshVertex>& vertices, VertexFormat format,
+	const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+	std::vector<uint8_t>& out);
+
+// maps encoded positions back to mesh space, identity for Float32
+glm::mat4 vertexDequantization(
+	VertexFormat format, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
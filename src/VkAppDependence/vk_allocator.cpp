@@ -0,0 +1,514 @@
+#include "vk_allocator.h"
+#include "../LCBHSS/lcbhss_space.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+const char* memoryCategoryName(MemoryCategory category) {
+	switch (category) {
+	case MemoryCategory::Texture:	 return "texture";
+	case MemoryCategory::Mesh:		 return "mesh";
+	case MemoryCategory::Uniform:	 return "uniform";
+	case MemoryCategory::Staging:	 return "staging";
+	case MemoryCategory::Attachment: return "attachment";
+	default:						 return "unknown";
+	}
+}
+
+void DeviceAllocator::init(
+	VkPhysicalDevice gpu, VkDevice device, bool memoryBudgetExt,
+	VkDeviceSize preferredBlockSize
+) {
+	m_gpu		= gpu;
+	m_device	= device;
+	m_blockSize = preferredBlockSize;
+	m_budgetExt = memoryBudgetExt;
+
+	vkGetPhysicalDeviceMemoryProperties(m_gpu, &m_memProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(m_gpu, &properties);
+	m_granularity = std::max<VkDeviceSize>(
+		properties.limits.bufferImageGranularity, 1);
+}
+
+void DeviceAllocator::destroy() {
+	for (uint32_t i = 0; i < m_blocks.size(); i++) {
+		if (m_blocks[i].memory != VK_NULL_HANDLE) {
+			if (m_blocks[i].allocationCount != 0) {
+				Log("allocator: block %u destroyed with %u live allocations",
+					i, m_blocks[i].allocationCount);
+			}
+			_releaseBlock(i);
+		}
+	}
+	m_blocks.clear();
+
+	if (m_dedicatedCount != 0) {
+		Log("allocator: %u dedicated allocations leaked", m_dedicatedCount);
+	}
+}
+
+uint32_t DeviceAllocator::findMemoryType(
+	uint32_t typeFilter, VkMemoryPropertyFlags properties
+) const {
+	for (uint32_t i = 0; i < m_memProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) &&
+			((m_memProperties.memoryTypes[i].propertyFlags & properties) ==
+			properties)
+		) {
+			return i;
+		}
+	}
+
+	throw std::runtime_error("failed to find suitable memory type");
+}
+
+bool DeviceAllocator::hasMemoryType(
+	uint32_t typeFilter, VkMemoryPropertyFlags properties
+) const {
+	for (uint32_t i = 0; i < m_memProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) &&
+			((m_memProperties.memoryTypes[i].propertyFlags & properties) ==
+			properties)
+		) {
+			return true;
+		}
+	}
+	return false;
+}
+
+VkDeviceSize DeviceAllocator::_blockSizeFor(uint32_t memoryType) const {
+	uint32_t heapIndex = m_memProperties.memoryTypes[memoryType].heapIndex;
+	VkDeviceSize heapSize = m_memProperties.memoryHeaps[heapIndex].size;
+
+	// small heaps (e.g. the 256 MB host visible device local window)
+	// should not be eaten by a handful of blocks
+	if (heapSize <= 1024ull * 1024 * 1024) {
+		return alignUp(heapSize / 8, 1024 * 1024);
+	}
+	return m_blockSize;
+}
+
+VkDeviceMemory DeviceAllocator::_allocateMemory(
+	uint32_t memoryType, VkDeviceSize size, void** mapped
+) {
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType =
+		VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize  = size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	while (!_fitsBudget(memoryType, size) && _makeRoom(memoryType, size)) {
+	}
+
+	VkDeviceMemory memory;
+	VkResult	   result;
+	while ((result = vkAllocateMemory(m_device, &allocInfo, nullptr, &memory)) ==
+		VK_ERROR_OUT_OF_DEVICE_MEMORY && _makeRoom(memoryType, size)) {
+	}
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate device memory");
+	}
+
+	*mapped = nullptr;
+	if (m_memProperties.memoryTypes[memoryType].propertyFlags &
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		if (vkMapMemory(
+			m_device, memory, 0, VK_WHOLE_SIZE, 0, mapped
+		) != VK_SUCCESS) {
+			vkFreeMemory(m_device, memory, nullptr);
+			throw std::runtime_error("failed to map device memory");
+		}
+	}
+	m_heapBytes[m_memProperties.memoryTypes[memoryType].heapIndex] += size;
+	return memory;
+}
+
+uint32_t DeviceAllocator::_createBlock(
+	uint32_t memoryType, bool linear, VkDeviceSize size
+) {
+	Block block;
+	block.memory	 = _allocateMemory(memoryType, size, &block.mapped);
+	block.size		 = size;
+	block.memoryType = memoryType;
+	block.linear	 = linear;
+	block.freeList.push_back({ 0, size });
+
+	for (uint32_t i = 0; i < m_blocks.size(); i++) {
+		if (m_blocks[i].memory == VK_NULL_HANDLE) {
+			m_blocks[i] = std::move(block);
+			return i;
+		}
+	}
+	m_blocks.push_back(std::move(block));
+	return static_cast<uint32_t>(m_blocks.size() - 1);
+}
+
+void DeviceAllocator::_releaseBlock(uint32_t blockIndex) {
+	Block& block = m_blocks[blockIndex];
+	if (block.mapped) {
+		vkUnmapMemory(m_device, block.memory);
+	}
+	vkFreeMemory(m_device, block.memory, nullptr);
+	m_heapBytes[m_memProperties.memoryTypes[block.memoryType].heapIndex] -= block.size;
+	block = Block();
+}
+
+HeapBudget DeviceAllocator::heapBudget(uint32_t heapIndex) const {
+	HeapBudget result;
+	result.allocated = m_heapBytes[heapIndex];
+
+	if (m_budgetExt) {
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+		budget.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2 properties = {};
+		properties.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		properties.pNext = &budget;
+		vkGetPhysicalDeviceMemoryProperties2(m_gpu, &properties);
+
+		result.budget = budget.heapBudget[heapIndex];
+		result.usage  = budget.heapUsage[heapIndex];
+	}
+	else {
+		// no driver numbers: leave a fifth of the heap to everyone else
+		result.budget = m_memProperties.memoryHeaps[heapIndex].size / 5 * 4;
+		result.usage  = m_heapBytes[heapIndex];
+	}
+	return result;
+}
+
+bool DeviceAllocator::_fitsBudget(uint32_t memoryType, VkDeviceSize size) const {
+	HeapBudget budget = heapBudget(m_memProperties.memoryTypes[memoryType].heapIndex);
+	return budget.usage + size <= budget.budget;
+}
+
+bool DeviceAllocator::_trimEmptyBlocks(uint32_t heapIndex) {
+	bool released = false;
+	for (uint32_t i = 0; i < m_blocks.size(); i++) {
+		const Block& block = m_blocks[i];
+		if (block.memory != VK_NULL_HANDLE && block.allocationCount == 0 &&
+			m_memProperties.memoryTypes[block.memoryType].heapIndex == heapIndex) {
+			_releaseBlock(i);
+			released = true;
+		}
+	}
+	return released;
+}
+
+bool DeviceAllocator::_makeRoom(uint32_t memoryType, VkDeviceSize size) {
+	uint32_t heapIndex = m_memProperties.memoryTypes[memoryType].heapIndex;
+	if (_trimEmptyBlocks(heapIndex)) {
+		return true;
+	}
+	return m_evict && m_evict(heapIndex, size);
+}
+
+bool DeviceAllocator::_allocateFromBlock(
+	Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset
+) {
+	// best fit: the smallest free range that still holds the aligned request
+	size_t		 best	  = block.freeList.size();
+	VkDeviceSize bestSize = ~0ull;
+
+	for (size_t i = 0; i < block.freeList.size(); i++) {
+		const Range& range	 = block.freeList[i];
+		VkDeviceSize aligned = alignUp(range.offset, alignment);
+		if (aligned + size <= range.offset + range.size &&
+			range.size < bestSize) {
+			best	 = i;
+			bestSize = range.size;
+		}
+	}
+	if (best == block.freeList.size()) {
+		return false;
+	}
+
+	Range		 range	 = block.freeList[best];
+	VkDeviceSize aligned = alignUp(range.offset, alignment);
+	VkDeviceSize tail	 = range.offset + range.size - (aligned + size);
+
+	block.freeList.erase(block.freeList.begin() + best);
+	if (tail > 0) {
+		block.freeList.insert(block.freeList.begin() + best,
+			Range{ aligned + size, tail });
+	}
+	if (aligned > range.offset) {
+		block.freeList.insert(block.freeList.begin() + best,
+			Range{ range.offset, aligned - range.offset });
+	}
+
+	offset = aligned;
+	return true;
+}
+
+void DeviceAllocator::_freeToBlock(
+	Block& block, VkDeviceSize offset, VkDeviceSize size
+) {
+	auto it = std::lower_bound(block.freeList.begin(), block.freeList.end(), offset,
+		[](const Range& r, VkDeviceSize o) { return r.offset < o; });
+	it = block.freeList.insert(it, Range{ offset, size });
+
+	// merge with the following range
+	auto next = it + 1;
+	if (next != block.freeList.end() &&
+		it->offset + it->size == next->offset) {
+		it->size += next->size;
+		block.freeList.erase(next);
+	}
+	// merge with the preceding range
+	if (it != block.freeList.begin()) {
+		auto prev = it - 1;
+		if (prev->offset + prev->size == it->offset) {
+			prev->size += it->size;
+			block.freeList.erase(it);
+		}
+	}
+}
+
+Allocation DeviceAllocator::allocate(
+	const VkMemoryRequirements& requirements,
+	VkMemoryPropertyFlags		properties,
+	MemoryCategory				category,
+	bool						linear
+) {
+	Allocation allocation;
+	allocation.memoryType = findMemoryType(
+		requirements.memoryTypeBits, properties);
+	allocation.size		= requirements.size;
+	allocation.category = category;
+
+	// with granularity 1 buffers and images may share blocks freely
+	if (m_granularity <= 1) {
+		linear = true;
+	}
+
+	// lazily allocated memory is only committed on use, sharing a block
+	// would just pin pages for nothing
+	VkDeviceSize blockSize = _blockSizeFor(allocation.memoryType);
+	if (requirements.size > blockSize / 2 ||
+		(m_memProperties.memoryTypes[allocation.memoryType].propertyFlags &
+		VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+		void* mapped;
+		allocation.memory	  = _allocateMemory(
+			allocation.memoryType, requirements.size, &mapped);
+		allocation.offset	  = 0;
+		allocation.blockIndex = Allocation::DEDICATED;
+		allocation.mapped	  = mapped;
+
+		m_dedicatedCount++;
+		m_dedicatedBytes += requirements.size;
+		m_liveCount++;
+		m_usedBytes += requirements.size;
+		m_categoryCount[static_cast<uint32_t>(category)]++;
+		m_categoryBytes[static_cast<uint32_t>(category)] += requirements.size;
+		return allocation;
+	}
+
+	VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+	VkDeviceSize offset	   = 0;
+	uint32_t	 blockIndex = UINT32_MAX;
+
+	for (;;) {
+		for (uint32_t i = 0; i < m_blocks.size(); i++) {
+			Block& block = m_blocks[i];
+			if (block.memory == VK_NULL_HANDLE ||
+				block.memoryType != allocation.memoryType ||
+				block.linear != linear) {
+				continue;
+			}
+			if (_allocateFromBlock(block, requirements.size, alignment, offset)) {
+				blockIndex = i;
+				break;
+			}
+		}
+		// evicting may free a range in an existing block, so look again
+		// before a new block is pushed over the budget
+		if (blockIndex != UINT32_MAX ||
+			_fitsBudget(allocation.memoryType, blockSize) ||
+			!_makeRoom(allocation.memoryType, blockSize)) {
+			break;
+		}
+	}
+
+	if (blockIndex == UINT32_MAX) {
+		blockIndex = _createBlock(allocation.memoryType, linear, blockSize);
+		if (!_allocateFromBlock(
+			m_blocks[blockIndex], requirements.size, alignment, offset)) {
+			throw std::runtime_error("failed to sub-allocate from a fresh block");
+		}
+	}
+
+	Block& block = m_blocks[blockIndex];
+	block.allocationCount++;
+
+	allocation.memory	  = block.memory;
+	allocation.offset	  = offset;
+	allocation.blockIndex = blockIndex;
+	allocation.mapped	  = block.mapped ?
+		static_cast<char*>(block.mapped) + offset : nullptr;
+
+	m_liveCount++;
+	m_usedBytes += requirements.size;
+	m_categoryCount[static_cast<uint32_t>(category)]++;
+	m_categoryBytes[static_cast<uint32_t>(category)] += requirements.size;
+	return allocation;
+}
+
+void DeviceAllocator::free(Allocation& allocation) {
+	if (allocation.memory == VK_NULL_HANDLE) {
+		return;
+	}
+
+	m_liveCount--;
+	m_usedBytes -= allocation.size;
+	m_categoryCount[static_cast<uint32_t>(allocation.category)]--;
+	m_categoryBytes[static_cast<uint32_t>(allocation.category)] -= allocation.size;
+
+	if (allocation.blockIndex == Allocation::DEDICATED) {
+		if (allocation.mapped) {
+			vkUnmapMemory(m_device, allocation.memory);
+		}
+		vkFreeMemory(m_device, allocation.memory, nullptr);
+		m_heapBytes[m_memProperties.memoryTypes[allocation.memoryType].heapIndex] -=
+			allocation.size;
+		m_dedicatedCount--;
+		m_dedicatedBytes -= allocation.size;
+		allocation = Allocation();
+		return;
+	}
+
+	Block& block = m_blocks[allocation.blockIndex];
+	_freeToBlock(block, allocation.offset, allocation.size);
+	block.allocationCount--;
+
+	// keep one empty block per (type, linear) pair around so that
+	// create/destroy cycles like swap chain resizes do not hit the driver
+	if (block.allocationCount == 0) {
+		for (uint32_t i = 0; i < m_blocks.size(); i++) {
+			if (i != allocation.blockIndex &&
+				m_blocks[i].memory != VK_NULL_HANDLE &&
+				m_blocks[i].memoryType == block.memoryType &&
+				m_blocks[i].linear == block.linear) {
+				_releaseBlock(allocation.blockIndex);
+				break;
+			}
+		}
+	}
+
+	allocation = Allocation();
+}
+
+void DeviceAllocator::createBuffer(
+	VkDeviceSize size, VkBufferUsageFlags usage,
+	VkMemoryPropertyFlags properties, MemoryCategory category,
+	VkBuffer& buffer, Allocation& allocation
+) {
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType =
+		VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer)
+		!= VK_SUCCESS
+	) {
+		throw std::runtime_error("failed to create buffer");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(
+		m_device, buffer, &memRequirements
+	);
+
+	allocation = allocate(memRequirements, properties, category, true);
+	vkBindBufferMemory(m_device, buffer, allocation.memory, allocation.offset);
+}
+
+void DeviceAllocator::createImage(
+	const VkImageCreateInfo& imageInfo,
+	VkMemoryPropertyFlags properties, MemoryCategory category,
+	VkImage& image, Allocation& allocation
+) {
+	if (vkCreateImage(
+		m_device, &imageInfo, nullptr, &image
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create image");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(m_device, image, &memRequirements);
+
+	allocation = allocate(memRequirements, properties, category,
+		imageInfo.tiling == VK_IMAGE_TILING_LINEAR);
+	vkBindImageMemory(m_device, image, allocation.memory, allocation.offset);
+}
+
+void DeviceAllocator::destroyBuffer(VkBuffer& buffer, Allocation& allocation) {
+	vkDestroyBuffer(m_device, buffer, nullptr);
+	buffer = VK_NULL_HANDLE;
+	free(allocation);
+}
+
+void DeviceAllocator::destroyImage(VkImage& image, Allocation& allocation) {
+	vkDestroyImage(m_device, image, nullptr);
+	image = VK_NULL_HANDLE;
+	free(allocation);
+}
+
+AllocatorStats DeviceAllocator::stats() const {
+	AllocatorStats result;
+	for (const Block& block : m_blocks) {
+		if (block.memory == VK_NULL_HANDLE) {
+			continue;
+		}
+		result.blockCount++;
+		result.reservedBytes += block.size;
+		result.freeRangeCount += static_cast<uint32_t>(block.freeList.size());
+		for (const Range& range : block.freeList) {
+			result.largestFreeRange = std::max(result.largestFreeRange, range.size);
+		}
+	}
+	result.dedicatedCount  = m_dedicatedCount;
+	result.reservedBytes  += m_dedicatedBytes;
+	result.allocationCount = m_liveCount;
+	result.usedBytes	   = m_usedBytes;
+	for (uint32_t i = 0; i < static_cast<uint32_t>(MemoryCategory::Count); i++) {
+		result.categoryCount[i] = m_categoryCount[i];
+		result.categoryBytes[i] = m_categoryBytes[i];
+	}
+	return result;
+}
+
+void DeviceAllocator::logStats() const {
+	AllocatorStats s = stats();
+	Log("allocator: %u blocks + %u dedicated, %u allocations, "
+		"%.2f / %.2f MB used, %u free ranges (largest %.2f MB)",
+		s.blockCount, s.dedicatedCount, s.allocationCount,
+		s.usedBytes / (1024.0 * 1024.0), s.reservedBytes / (1024.0 * 1024.0),
+		s.freeRangeCount, s.largestFreeRange / (1024.0 * 1024.0));
+
+	for (uint32_t i = 0; i < static_cast<uint32_t>(MemoryCategory::Count); i++) {
+		if (s.categoryCount[i] != 0) {
+			Log("  %-10s %5u allocations %10.2f MB",
+				memoryCategoryName(static_cast<MemoryCategory>(i)),
+				s.categoryCount[i], s.categoryBytes[i] / (1024.0 * 1024.0));
+		}
+	}
+	for (uint32_t i = 0; i < m_memProperties.memoryHeapCount; i++) {
+		HeapBudget budget = heapBudget(i);
+		Log("  heap %u: %.2f MB ours, %.2f / %.2f MB of budget%s", i,
+			budget.allocated / (1024.0 * 1024.0),
+			budget.usage / (1024.0 * 1024.0),
+			budget.budget / (1024.0 * 1024.0),
+			m_budgetExt ? "" : " (estimated)");
+	}
+}
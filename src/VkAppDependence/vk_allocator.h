@@ -0,0 +1,157 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+// What a piece of device memory is used for, only used for accounting.
+enum class MemoryCategory : uint32_t {
+	Texture,
+	Mesh,
+	Uniform,
+	Staging,
+	Attachment,
+	Count
+};
+
+const char* memoryCategoryName(MemoryCategory category);
+
+// A range carved out of a DeviceAllocator block (or a dedicated VkDeviceMemory).
+// offset is what has to be passed to vkBind*Memory.
+struct Allocation {
+	VkDeviceMemory	memory		= VK_NULL_HANDLE;
+	VkDeviceSize	offset		= 0;
+	VkDeviceSize	size		= 0;
+	uint32_t		memoryType	= 0;
+	uint32_t		blockIndex	= 0;
+	void*			mapped		= nullptr;	// persistent host pointer, HOST_VISIBLE only
+	MemoryCategory	category	= MemoryCategory::Texture;
+
+	static const uint32_t DEDICATED = UINT32_MAX;
+};
+
+struct AllocatorStats {
+	uint32_t		blockCount		= 0;
+	uint32_t		dedicatedCount	= 0;
+	uint32_t		allocationCount = 0;
+	uint32_t		freeRangeCount	= 0;
+	VkDeviceSize	reservedBytes	= 0;		// sum of vkAllocateMemory sizes
+	VkDeviceSize	usedBytes		= 0;		// sum of live sub-allocations
+	VkDeviceSize	largestFreeRange = 0;
+
+	uint32_t		categoryCount[static_cast<uint32_t>(MemoryCategory::Count)] = {};
+	VkDeviceSize	categoryBytes[static_cast<uint32_t>(MemoryCategory::Count)] = {};
+};
+
+struct HeapBudget {
+	VkDeviceSize	budget	  = 0;		// what the process may use on this heap
+	VkDeviceSize	usage	  = 0;		// what it uses right now
+	VkDeviceSize	allocated = 0;		// the part of usage owned by the allocator
+};
+
+// Block based sub-allocator. Every memory type gets its own list of large
+// VkDeviceMemory blocks which are handed out through an offset sorted
+// free list (best fit, neighbours coalesce on free). Buffers and optimal
+// tiled images never share a block when bufferImageGranularity > 1, so
+// granularity conflicts can not happen. Requests bigger than half a block
+// and LAZILY_ALLOCATED memory get a dedicated allocation.
+//
+// Every new VkDeviceMemory is checked against the heap budget, taken from
+// VK_EXT_memory_budget when the device has it enabled or estimated from the
+// heap size otherwise. When it would go over budget, or the driver reports
+// out of memory, cached empty blocks are released first and then the
+// eviction callback is asked to free something on that heap, until the
+// request fits or nothing is left to evict.
+class DeviceAllocator {
+public:
+	// return true when something was freed on heapIndex
+	using EvictionCallback =
+		std::function<bool(uint32_t heapIndex, VkDeviceSize bytesNeeded)>;
+
+	void init(VkPhysicalDevice gpu, VkDevice device, bool memoryBudgetExt,
+		VkDeviceSize preferredBlockSize = 64ull * 1024 * 1024);
+	void destroy();
+
+	void setEvictionCallback(EvictionCallback callback) { m_evict = callback; }
+
+	Allocation allocate(
+		const VkMemoryRequirements& requirements,
+		VkMemoryPropertyFlags		properties,
+		MemoryCategory				category,
+		bool						linear
+	);
+	void free(Allocation& allocation);
+
+	void createBuffer(
+		VkDeviceSize size, VkBufferUsageFlags usage,
+		VkMemoryPropertyFlags properties, MemoryCategory category,
+		VkBuffer& buffer, Allocation& allocation
+	);
+	void createImage(
+		const VkImageCreateInfo& imageInfo,
+		VkMemoryPropertyFlags properties, MemoryCategory category,
+		VkImage& image, Allocation& allocation
+	);
+	void destroyBuffer(VkBuffer& buffer, Allocation& allocation);
+	void destroyImage(VkImage& image, Allocation& allocation);
+
+	uint32_t findMemoryType(uint32_t typeFilter,
+		VkMemoryPropertyFlags properties) const;
+	bool	 hasMemoryType(uint32_t typeFilter,
+		VkMemoryPropertyFlags properties) const;
+
+	AllocatorStats stats() const;
+	void		   logStats() const;
+	HeapBudget	   heapBudget(uint32_t heapIndex) const;
+
+	const VkPhysicalDeviceMemoryProperties&
+		memoryProperties() const { return m_memProperties; }
+
+private:
+	struct Range {
+		VkDeviceSize offset;
+		VkDeviceSize size;
+	};
+
+	struct Block {
+		VkDeviceMemory	   memory		   = VK_NULL_HANDLE;
+		VkDeviceSize	   size			   = 0;
+		void*			   mapped		   = nullptr;
+		uint32_t		   memoryType	   = 0;
+		bool			   linear		   = true;
+		uint32_t		   allocationCount = 0;
+		std::vector<Range> freeList;		// sorted by offset
+	};
+
+	VkDeviceSize _blockSizeFor(uint32_t memoryType) const;
+	uint32_t	 _createBlock(uint32_t memoryType, bool linear, VkDeviceSize size);
+	void		 _releaseBlock(uint32_t blockIndex);
+	bool		 _allocateFromBlock(Block& block, VkDeviceSize size,
+					VkDeviceSize alignment, VkDeviceSize& offset);
+	void		 _freeToBlock(Block& block, VkDeviceSize offset, VkDeviceSize size);
+	VkDeviceMemory
+				 _allocateMemory(uint32_t memoryType, VkDeviceSize size, void** mapped);
+	bool		 _fitsBudget(uint32_t memoryType, VkDeviceSize size) const;
+	bool		 _makeRoom(uint32_t memoryType, VkDeviceSize size);
+	bool		 _trimEmptyBlocks(uint32_t heapIndex);
+
+	VkPhysicalDevice				 m_gpu			  = VK_NULL_HANDLE;
+	VkDevice						 m_device		  = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties m_memProperties  {};
+	VkDeviceSize					 m_blockSize	  = 0;
+	VkDeviceSize					 m_granularity	  = 1;
+	bool							 m_budgetExt	  = false;
+	EvictionCallback				 m_evict;
+
+	std::vector<Block>				 m_blocks;		// released blocks keep their slot
+	uint32_t						 m_dedicatedCount = 0;
+	VkDeviceSize					 m_dedicatedBytes = 0;
+	uint32_t						 m_liveCount	  = 0;
+	VkDeviceSize					 m_usedBytes	  = 0;
+
+	VkDeviceSize					 m_heapBytes[VK_MAX_MEMORY_HEAPS] = {};
+	uint32_t						 m_categoryCount[static_cast<uint32_t>(MemoryCategory::Count)] = {};
+	VkDeviceSize					 m_categoryBytes[static_cast<uint32_t>(MemoryCategory::Count)] = {};
+};
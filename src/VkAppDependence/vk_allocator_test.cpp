@@ -0,0 +1,387 @@
+/* DeviceAllocator test, no GPU needed: the Vulkan entry points the
+ * allocator calls and Log() are defined below, so this builds as its own
+ * program without the Vulkan loader or the rest of the project, e.g.
+ *
+ *   cl /EHsc /std:c++17 /DVK_ALLOCATOR_TEST /I"%VULKAN_SDK%\Include"
+ *      src\VkAppDependence\vk_allocator_test.cpp src\VkAppDependence\vk_allocator.cpp
+ *
+ * Exits with the number of failed checks. */
+
+#ifdef VK_ALLOCATOR_TEST
+
+#include "vk_allocator.h"
+#include "../LCBHSS/lcbhss_space.h"
+
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstdarg>
+
+namespace {
+
+// two heaps: a large device local one (64 MB blocks) and a 256 MB host
+// visible one (32 MB blocks, see _blockSizeFor())
+const VkDeviceSize DEVICE_HEAP = 4096ull * 1024 * 1024;
+const VkDeviceSize HOST_HEAP   = 256ull * 1024 * 1024;
+const VkDeviceSize MB		   = 1024 * 1024;
+
+struct FakeMemory {
+	VkDeviceSize	  size;
+	std::vector<char> bytes;		// only for host visible types
+};
+
+struct FakeDevice {
+	VkDeviceSize granularity	= 1024;
+	uint32_t	 allocateCalls	= 0;
+	uint32_t	 liveMemories	= 0;
+	uint32_t	 mappedMemories = 0;
+	// next vkGet*MemoryRequirements result
+	VkMemoryRequirements requirements = {};
+};
+
+FakeDevice s_device;
+
+VkDeviceMemory toHandle(FakeMemory* memory) {
+	return (VkDeviceMemory)(uintptr_t)memory;
+}
+
+FakeMemory* fromHandle(VkDeviceMemory memory) {
+	return (FakeMemory*)(uintptr_t)memory;
+}
+
+uint32_t s_failures = 0;
+
+#define CHECK(X) \
+	do { if (!(X)) { s_failures++; Log("  FAILED line %d: %s", __LINE__, #X); } } while (0)
+
+VkMemoryRequirements requirements(VkDeviceSize size, VkDeviceSize alignment) {
+	VkMemoryRequirements result = {};
+	result.size			  = size;
+	result.alignment	  = alignment;
+	result.memoryTypeBits = ~0u;
+	return result;
+}
+
+bool overlaps(const Allocation& a, const Allocation& b) {
+	return a.memory == b.memory &&
+		a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+}
+
+void testSubAllocation() {
+	Log("allocator test: sub-allocation");
+	DeviceAllocator allocator;
+	allocator.init(VK_NULL_HANDLE, VK_NULL_HANDLE, false);
+	uint32_t calls = s_device.allocateCalls;
+
+	const VkDeviceSize sizes[]		= { 100, 4096, 3 * MB, 17, 256 * 1024 };
+	const VkDeviceSize alignments[] = { 16, 4096, 65536, 1, 256 };
+
+	std::vector<Allocation> allocations;
+	for (uint32_t i = 0; i < 5; i++) {
+		allocations.push_back(allocator.allocate(
+			requirements(sizes[i], alignments[i]),
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Mesh, true));
+		CHECK(allocations[i].offset % alignments[i] == 0);
+	}
+	// everything fits one 64 MB block
+	CHECK(s_device.allocateCalls == calls + 1);
+	for (uint32_t i = 0; i < 5; i++) {
+		CHECK(allocations[i].memory == allocations[0].memory);
+		CHECK(allocations[i].blockIndex != Allocation::DEDICATED);
+		for (uint32_t j = i + 1; j < 5; j++) {
+			CHECK(!overlaps(allocations[i], allocations[j]));
+		}
+	}
+
+	// persistent mapping hands out block pointer + offset
+	Allocation a = allocator.allocate(requirements(1000, 64),
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, MemoryCategory::Staging, true);
+	Allocation b = allocator.allocate(requirements(1000, 64),
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, MemoryCategory::Staging, true);
+	CHECK(a.mapped && b.mapped);
+	CHECK(static_cast<char*>(b.mapped) - static_cast<char*>(a.mapped) ==
+		static_cast<ptrdiff_t>(b.offset - a.offset));
+	CHECK(a.mapped == fromHandle(a.memory)->bytes.data() + a.offset);
+
+	// more than half a block goes dedicated
+	Allocation big = allocator.allocate(requirements(40 * MB, 4096),
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Texture, false);
+	CHECK(big.blockIndex == Allocation::DEDICATED && big.offset == 0);
+
+	AllocatorStats s = allocator.stats();
+	CHECK(s.blockCount == 2 && s.dedicatedCount == 1 && s.allocationCount == 8);
+	CHECK(s.categoryCount[static_cast<uint32_t>(MemoryCategory::Mesh)] == 5);
+
+	allocator.free(big);
+	allocator.free(a);
+	allocator.free(b);
+	for (Allocation& allocation : allocations) {
+		allocator.free(allocation);
+	}
+	CHECK(allocator.stats().usedBytes == 0);
+	allocator.destroy();
+	CHECK(s_device.liveMemories == 0 && s_device.mappedMemories == 0);
+}
+
+void testCoalescing() {
+	Log("allocator test: coalescing");
+	DeviceAllocator allocator;
+	allocator.init(VK_NULL_HANDLE, VK_NULL_HANDLE, false);
+
+	std::vector<Allocation> allocations;
+	for (uint32_t i = 0; i < 8; i++) {
+		allocations.push_back(allocator.allocate(requirements(MB, 256),
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Mesh, true));
+	}
+	VkDeviceSize blockSize = allocator.stats().reservedBytes;
+
+	// free every other one: no neighbours, one range each plus the tail
+	for (uint32_t i = 0; i < 8; i += 2) {
+		allocator.free(allocations[i]);
+	}
+	CHECK(allocator.stats().freeRangeCount == 5);
+
+	// a hole of exactly the right size is the best fit
+	Allocation refill = allocator.allocate(requirements(MB, 256),
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Mesh, true);
+	CHECK(refill.offset < 8 * MB);
+	CHECK(allocator.stats().freeRangeCount == 4);
+	allocator.free(refill);
+
+	// the rest joins both neighbours until a single range is left
+	for (uint32_t i = 1; i < 8; i += 2) {
+		allocator.free(allocations[i]);
+	}
+	AllocatorStats s = allocator.stats();
+	CHECK(s.freeRangeCount == 1);
+	CHECK(s.largestFreeRange == blockSize);
+	CHECK(s.blockCount == 1);		// the empty block is kept for reuse
+
+	uint32_t calls = s_device.allocateCalls;
+	Allocation again = allocator.allocate(requirements(MB, 256),
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Mesh, true);
+	CHECK(s_device.allocateCalls == calls && again.offset == 0);
+	allocator.free(again);
+	allocator.destroy();
+	CHECK(s_device.liveMemories == 0);
+}
+
+void testGranularity() {
+	Log("allocator test: buffer/image granularity");
+	DeviceAllocator allocator;
+	allocator.init(VK_NULL_HANDLE, VK_NULL_HANDLE, false);
+
+	Allocation buffer = allocator.allocate(requirements(100, 16),
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Mesh, true);
+	Allocation image = allocator.allocate(requirements(100, 16),
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Texture, false);
+	Allocation image2 = allocator.allocate(requirements(100, 16),
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Texture, false);
+	// linear and optimal never share a block, optimal ones do among themselves
+	CHECK(buffer.memory != image.memory);
+	CHECK(image.memory == image2.memory);
+	CHECK(allocator.stats().blockCount == 2);
+
+	// createBuffer/createImage pick the kind from the usage
+	s_device.requirements = requirements(4096, 256);
+	VkBuffer   vkBuffer;
+	Allocation bufferAlloc;
+	allocator.createBuffer(4096, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Mesh, vkBuffer, bufferAlloc);
+	CHECK(bufferAlloc.memory == buffer.memory);
+
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	VkImage	   vkImage;
+	Allocation imageAlloc;
+	allocator.createImage(imageInfo,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Texture, vkImage, imageAlloc);
+	CHECK(imageAlloc.memory == image.memory);
+
+	allocator.destroyImage(vkImage, imageAlloc);
+	allocator.destroyBuffer(vkBuffer, bufferAlloc);
+	allocator.free(image2);
+	allocator.free(image);
+	allocator.free(buffer);
+	allocator.destroy();
+
+	// with granularity 1 there is nothing to separate
+	s_device.granularity = 1;
+	allocator.init(VK_NULL_HANDLE, VK_NULL_HANDLE, false);
+	buffer = allocator.allocate(requirements(100, 16),
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Mesh, true);
+	image = allocator.allocate(requirements(100, 16),
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Texture, false);
+	CHECK(buffer.memory == image.memory && !overlaps(buffer, image));
+	allocator.free(image);
+	allocator.free(buffer);
+	allocator.destroy();
+	s_device.granularity = 1024;
+	CHECK(s_device.liveMemories == 0);
+}
+
+void testBudget() {
+	Log("allocator test: heap budget and eviction");
+	DeviceAllocator allocator;
+	allocator.init(VK_NULL_HANDLE, VK_NULL_HANDLE, false);
+
+	// the estimated budget is 4/5 of 256 MB: six 32 MB blocks of two
+	// allocations each fit, the seventh block has to ask the callback
+	std::vector<Allocation> allocations;
+	uint32_t evictCalls = 0;
+	allocator.setEvictionCallback([&](uint32_t heapIndex, VkDeviceSize bytes) {
+		evictCalls++;
+		CHECK(heapIndex == 1 && bytes == 32 * MB);
+		if (allocations.empty()) {
+			return false;
+		}
+		allocator.free(allocations.front());
+		allocations.erase(allocations.begin());
+		return true;
+	});
+
+	for (uint32_t i = 0; i < 12; i++) {
+		allocations.push_back(allocator.allocate(requirements(16 * MB, 256),
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, MemoryCategory::Staging, true));
+	}
+	CHECK(evictCalls == 0);
+	CHECK(allocator.heapBudget(1).allocated == 6 * 32 * MB);
+
+	// the evicted allocation left a hole in a block, which is used in place
+	uint32_t calls = s_device.allocateCalls;
+	allocations.push_back(allocator.allocate(requirements(16 * MB, 256),
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, MemoryCategory::Staging, true));
+	CHECK(evictCalls == 1);
+	CHECK(s_device.allocateCalls == calls);
+	CHECK(allocator.heapBudget(1).allocated == 6 * 32 * MB);
+
+	for (Allocation& allocation : allocations) {
+		allocator.free(allocation);
+	}
+	allocator.destroy();
+	CHECK(s_device.liveMemories == 0);
+}
+
+}
+
+void Log(const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+	printf("\n");
+}
+
+//----the Vulkan entry points DeviceAllocator uses, faked
+
+void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(
+	VkPhysicalDevice, VkPhysicalDeviceMemoryProperties* properties
+) {
+	*properties = {};
+	properties->memoryHeapCount = 2;
+	properties->memoryHeaps[0].size	 = DEVICE_HEAP;
+	properties->memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+	properties->memoryHeaps[1].size	 = HOST_HEAP;
+
+	properties->memoryTypeCount = 2;
+	properties->memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	properties->memoryTypes[0].heapIndex	 = 0;
+	properties->memoryTypes[1].propertyFlags =
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	properties->memoryTypes[1].heapIndex	 = 1;
+}
+
+void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties2(
+	VkPhysicalDevice gpu, VkPhysicalDeviceMemoryProperties2* properties
+) {
+	vkGetPhysicalDeviceMemoryProperties(gpu, &properties->memoryProperties);
+}
+
+void VKAPI_CALL vkGetPhysicalDeviceProperties(
+	VkPhysicalDevice, VkPhysicalDeviceProperties* properties
+) {
+	*properties = {};
+	properties->limits.bufferImageGranularity = s_device.granularity;
+}
+
+VkResult VKAPI_CALL vkAllocateMemory(
+	VkDevice, const VkMemoryAllocateInfo* info,
+	const VkAllocationCallbacks*, VkDeviceMemory* memory
+) {
+	s_device.allocateCalls++;
+	s_device.liveMemories++;
+	*memory = toHandle(new FakeMemory{ info->allocationSize, {} });
+	return VK_SUCCESS;
+}
+
+void VKAPI_CALL vkFreeMemory(
+	VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*
+) {
+	s_device.liveMemories--;
+	delete fromHandle(memory);
+}
+
+VkResult VKAPI_CALL vkMapMemory(
+	VkDevice, VkDeviceMemory memory, VkDeviceSize, VkDeviceSize,
+	VkMemoryMapFlags, void** data
+) {
+	FakeMemory* fake = fromHandle(memory);
+	fake->bytes.resize(static_cast<size_t>(fake->size));
+	s_device.mappedMemories++;
+	*data = fake->bytes.data();
+	return VK_SUCCESS;
+}
+
+void VKAPI_CALL vkUnmapMemory(VkDevice, VkDeviceMemory memory) {
+	s_device.mappedMemories--;
+	fromHandle(memory)->bytes.clear();
+}
+
+VkResult VKAPI_CALL vkCreateBuffer(
+	VkDevice, const VkBufferCreateInfo*, const VkAllocationCallbacks*, VkBuffer* buffer
+) {
+	*buffer = (VkBuffer)(uintptr_t)1;
+	return VK_SUCCESS;
+}
+
+VkResult VKAPI_CALL vkCreateImage(
+	VkDevice, const VkImageCreateInfo*, const VkAllocationCallbacks*, VkImage* image
+) {
+	*image = (VkImage)(uintptr_t)1;
+	return VK_SUCCESS;
+}
+
+void VKAPI_CALL vkDestroyBuffer(VkDevice, VkBuffer, const VkAllocationCallbacks*) {}
+void VKAPI_CALL vkDestroyImage(VkDevice, VkImage, const VkAllocationCallbacks*) {}
+
+void VKAPI_CALL vkGetBufferMemoryRequirements(
+	VkDevice, VkBuffer, VkMemoryRequirements* requirements
+) {
+	*requirements = s_device.requirements;
+}
+
+void VKAPI_CALL vkGetImageMemoryRequirements(
+	VkDevice, VkImage, VkMemoryRequirements* requirements
+) {
+	*requirements = s_device.requirements;
+}
+
+VkResult VKAPI_CALL vkBindBufferMemory(VkDevice, VkBuffer, VkDeviceMemory, VkDeviceSize) {
+	return VK_SUCCESS;
+}
+
+VkResult VKAPI_CALL vkBindImageMemory(VkDevice, VkImage, VkDeviceMemory, VkDeviceSize) {
+	return VK_SUCCESS;
+}
+
+int main() {
+	testSubAllocation();
+	testCoalescing();
+	testGranularity();
+	testBudget();
+
+	Log("allocator test: %u failed checks", s_failures);
+	return static_cast<int>(s_failures);
+}
+
+#endif // VK_ALLOCATOR_TEST
@@ -0,0 +1,123 @@
+#include "vk_attachments.h"
+#include "../LCBHSS/lcbhss_space.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static const VkImageUsageFlags ATTACHMENT_USAGE =
+	VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+	VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+	VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+void AttachmentPool::init(DeviceAllocator& allocator, VkDevice device) {
+	m_allocator = &allocator;
+	m_device	= device;
+}
+
+void AttachmentPool::destroy() {
+	releaseImages();
+	for (auto& group : m_groups) {
+		if (group.alloc.memory != VK_NULL_HANDLE) {
+			m_allocator->free(group.alloc);
+		}
+	}
+	m_groups.clear();
+}
+
+VkImage AttachmentPool::addImage(VkImageCreateInfo imageInfo, uint32_t aliasGroup) {
+	if ((imageInfo.usage & ~ATTACHMENT_USAGE) == 0) {
+		imageInfo.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	}
+
+	VkImage image;
+	if (vkCreateImage(m_device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create attachment image");
+	}
+
+	if (aliasGroup >= m_groups.size()) {
+		m_groups.resize(aliasGroup + 1);
+	}
+	m_groups[aliasGroup].images.push_back(image);
+	return image;
+}
+
+void AttachmentPool::bind() {
+	for (auto& group : m_groups) {
+		if (group.images.empty()) {
+			continue;
+		}
+
+		// one range that satisfies every image of the group
+		VkMemoryRequirements requirements = {};
+		requirements.memoryTypeBits = ~0u;
+		requirements.alignment		= 1;
+		for (auto image : group.images) {
+			VkMemoryRequirements imageRequirements;
+			vkGetImageMemoryRequirements(m_device, image, &imageRequirements);
+
+			requirements.size = std::max(requirements.size, imageRequirements.size);
+			requirements.alignment =
+				std::max(requirements.alignment, imageRequirements.alignment);
+			requirements.memoryTypeBits &= imageRequirements.memoryTypeBits;
+		}
+		if (requirements.memoryTypeBits == 0) {
+			throw std::runtime_error("aliased attachments share no memory type");
+		}
+
+		// memoryTypeBits of a transient image only include lazy types when
+		// every image of the group was created transient
+		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		bool lazy = m_allocator->hasMemoryType(requirements.memoryTypeBits,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+			VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+		if (lazy) {
+			properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+		}
+
+		Allocation& alloc = group.alloc;
+		bool reuse = alloc.memory != VK_NULL_HANDLE &&
+			group.lazy == lazy &&
+			alloc.size >= requirements.size &&
+			alloc.offset % requirements.alignment == 0 &&
+			(requirements.memoryTypeBits & (1u << alloc.memoryType));
+
+		if (!reuse) {
+			if (alloc.memory != VK_NULL_HANDLE) {
+				m_allocator->free(alloc);
+			}
+			alloc = m_allocator->allocate(requirements, properties,
+				MemoryCategory::Attachment, false);
+			group.lazy = lazy;
+		}
+
+		for (auto image : group.images) {
+			if (vkBindImageMemory(
+				m_device, image, alloc.memory, alloc.offset
+			) != VK_SUCCESS) {
+				throw std::runtime_error("failed to bind attachment memory");
+			}
+		}
+		Log("attachments: group with %u images, %.2f MB %s%s",
+			static_cast<uint32_t>(group.images.size()),
+			alloc.size / (1024.0 * 1024.0),
+			lazy ? "lazily allocated" : "device local",
+			reuse ? ", reused" : "");
+	}
+}
+
+void AttachmentPool::releaseImages() {
+	for (auto& group : m_groups) {
+		for (auto image : group.images) {
+			vkDestroyImage(m_device, image, nullptr);
+		}
+		group.images.clear();
+	}
+}
+
+VkDeviceSize AttachmentPool::reservedBytes() const {
+	VkDeviceSize bytes = 0;
+	for (const auto& group : m_groups) {
+		bytes += group.alloc.size;
+	}
+	return bytes;
+}
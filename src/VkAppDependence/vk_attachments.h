@@ -0,0 +1,43 @@
+#pragma once
+
+#include "vk_allocator.h"
+
+#include <vector>
+#include <cstdint>
+
+// Owns the memory behind render targets that live only inside a frame
+// (depth, MSAA color, intermediate targets). Images added to the same alias
+// group are bound to the same memory, so their uses within a frame must not
+// overlap and every render pass has to start them from UNDEFINED. Images
+// created with TRANSIENT_ATTACHMENT usage get LAZILY_ALLOCATED memory when
+// the device has it, which tile based GPUs never actually back.
+//
+// releaseImages() destroys the images but keeps the memory, the next bind()
+// reuses it when it is still large enough, so resizing the swap chain to an
+// equal or smaller size does not allocate.
+class AttachmentPool {
+public:
+	void init(DeviceAllocator& allocator, VkDevice device);
+	void destroy();
+
+	// TRANSIENT_ATTACHMENT is added when usage only has attachment bits
+	VkImage addImage(VkImageCreateInfo imageInfo, uint32_t aliasGroup);
+	// allocates or reuses group memory and binds every image added since
+	// the last releaseImages()
+	void	bind();
+	void	releaseImages();
+
+	VkDeviceSize reservedBytes() const;
+	bool		 isLazy(uint32_t aliasGroup) const { return m_groups[aliasGroup].lazy; }
+
+private:
+	struct Group {
+		Allocation			 alloc	{};
+		bool				 lazy	= false;
+		std::vector<VkImage> images;
+	};
+
+	DeviceAllocator*   m_allocator = nullptr;
+	VkDevice		   m_device	   = VK_NULL_HANDLE;
+	std::vector<Group> m_groups;
+};
@@ -11,45 +11,13 @@ struct Vertex {
 	glm::vec3 color;
 	glm::vec2 texCoord;	//
 
-	//-------------------ע-----------------------------
-	static VkVertexInputBindingDescription getBindingDescription() {
-		VkVertexInputBindingDescription bindingDescription = {};
-		bindingDescription.binding = 0;
-		bindingDescription.stride = sizeof(Vertex);
-		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		return bindingDescription;
-	}
-
-	static std::array<VkVertexInputAttributeDescription, 3>
-		getAttributeDescriptions() {
-
-		std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
-
-		//FORMAT_R32(1ά)G32(2)B3(3)
-		attributeDescriptions[0].binding = 0;
-		attributeDescriptions[0].location = 0;
-		attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[0].offset = offsetof(Vertex, pos);
-
-		attributeDescriptions[1].binding = 0;
-		attributeDescriptions[1].location = 1;
-		attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[1].offset = offsetof(Vertex, color);
-
-		attributeDescriptions[2].binding = 0;
-		attributeDescriptions[2].location = 2;
-		attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-		attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
-
-		return attributeDescriptions;
-	}
-	//----------------------------------------------------//
+	// binding and attribute descriptions are generated, see vertex_format.h
 };
 
 struct QueueFamilyIndices {
 	int graphicsFamily = -1;
 	int presentFamily = -1;
+	int transferFamily = -1;	// optional, transfer only family (DMA)
 
 	bool isComplete() {
 		return graphicsFamily >= 0 &&
@@ -0,0 +1,304 @@
+#include "vk_meshlet_cull.h"
+
+#include <array>
+#include <algorithm>
+#include <stdexcept>
+
+const char* const MeshletCuller::SHADER_FILE = "cull.spv";
+
+// binding order of meshlet_cull.comp
+enum CullBinding : uint32_t {
+	BINDING_MESHLETS = 0,
+	BINDING_SOURCE_INDICES,
+	BINDING_DRAW_INDICES,
+	BINDING_DRAW_COMMAND,
+	BINDING_COUNT
+};
+
+void MeshletCuller::init(
+	DeviceAllocator&		 allocator,
+	VkDevice				 device,
+	UploadEngine&			 uploader,
+	PipelineCache&			 pipelineCache,
+	const std::vector<char>& shaderCode,
+	const Meshlet*			 meshlets,
+	uint32_t				 meshletCount,
+	const MaterialRange*	 ranges,
+	uint32_t				 rangeCount,
+	VkBuffer				 indexBuffer,
+	uint32_t				 indexCount,
+	uint32_t				 frameCount
+) {
+	// one workgroup per meshlet, the guaranteed maxComputeWorkGroupCount
+	if (meshletCount == 0 || meshletCount > 65535) {
+		throw std::runtime_error("failed to fit meshlets into one dispatch");
+	}
+
+	m_allocator	   = &allocator;
+	m_device	   = device;
+	m_meshletCount = meshletCount;
+	m_indexCount   = indexCount;
+
+	uint32_t materialCount = 0;
+	for (uint32_t i = 0; i < rangeCount; i++) {
+		materialCount = std::max(materialCount, ranges[i].material + 1);
+	}
+	VkDrawIndexedIndirectCommand reset = {};
+	reset.instanceCount = 1;
+	m_resetCommands.assign(materialCount, reset);
+	for (uint32_t i = 0; i < rangeCount; i++) {
+		m_resetCommands[ranges[i].material].firstIndex = ranges[i].firstIndex;
+	}
+	// vkCmdUpdateBuffer() resets them, it takes up to 64 KB
+	VkDeviceSize commandBytes =
+		sizeof(VkDrawIndexedIndirectCommand) * VkDeviceSize(materialCount);
+	if (materialCount == 0 || commandBytes > 65536) {
+		throw std::runtime_error("failed to fit the culled draws into one update");
+	}
+
+	VkDeviceSize meshletBytes = sizeof(Meshlet) * VkDeviceSize(meshletCount);
+	m_allocator->createBuffer(
+		meshletBytes,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		MemoryCategory::Mesh,
+		m_meshlets, m_meshletsAlloc
+	);
+	uploader.uploadBuffer(
+		m_meshlets, 0, meshlets, meshletBytes,
+		VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+	);
+
+	_createPipeline(pipelineCache, shaderCode);
+
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type			 = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = BINDING_COUNT * frameCount;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType =
+		VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes	   = &poolSize;
+	poolInfo.maxSets	   = frameCount;
+
+	if (vkCreateDescriptorPool(
+		m_device, &poolInfo, nullptr, &m_descriptorPool
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling descriptor pool");
+	}
+
+	m_frames.resize(frameCount);
+	for (Frame& frame : m_frames) {
+		m_allocator->createBuffer(
+			sizeof(uint32_t) * VkDeviceSize(indexCount),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			MemoryCategory::Mesh,
+			frame.indices, frame.indicesAlloc
+		);
+		// tiny, and read back by the host every frame
+		m_allocator->createBuffer(
+			commandBytes,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MemoryCategory::Mesh,
+			frame.draw, frame.drawAlloc
+		);
+
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType =
+			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool	 = m_descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts		 = &m_setLayout;
+
+		if (vkAllocateDescriptorSets(
+			m_device, &allocInfo, &frame.set
+		) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate culling descriptor set");
+		}
+
+		std::array<VkDescriptorBufferInfo, BINDING_COUNT> buffers = {};
+		buffers[BINDING_MESHLETS]		= { m_meshlets,	  0, VK_WHOLE_SIZE };
+		buffers[BINDING_SOURCE_INDICES] = { indexBuffer,  0, VK_WHOLE_SIZE };
+		buffers[BINDING_DRAW_INDICES]	= { frame.indices, 0, VK_WHOLE_SIZE };
+		buffers[BINDING_DRAW_COMMAND]	= { frame.draw,	  0, VK_WHOLE_SIZE };
+
+		std::array<VkWriteDescriptorSet, BINDING_COUNT> writes = {};
+		for (uint32_t binding = 0; binding < BINDING_COUNT; binding++) {
+			writes[binding].sType =
+				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[binding].dstSet			= frame.set;
+			writes[binding].dstBinding		= binding;
+			writes[binding].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[binding].descriptorCount = 1;
+			writes[binding].pBufferInfo		= &buffers[binding];
+		}
+		vkUpdateDescriptorSets(
+			m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+void MeshletCuller::_createPipeline(PipelineCache& pipelineCache, const std::vector<char>& shaderCode) {
+	std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings = {};
+	for (uint32_t binding = 0; binding < BINDING_COUNT; binding++) {
+		bindings[binding].binding		  = binding;
+		bindings[binding].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[binding].descriptorCount = 1;
+		bindings[binding].stageFlags	  = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType =
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings	= bindings.data();
+
+	if (vkCreateDescriptorSetLayout(
+		m_device, &layoutInfo, nullptr, &m_setLayout
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling descriptor set layout");
+	}
+
+	VkPushConstantRange pushRange = {};
+	pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushRange.offset	 = 0;
+	pushRange.size		 = sizeof(MeshletCullParams);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount		  = 1;
+	pipelineLayoutInfo.pSetLayouts			  = &m_setLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges	  = &pushRange;
+
+	if (vkCreatePipelineLayout(
+		m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling pipeline layout");
+	}
+
+	VkShaderModuleCreateInfo moduleInfo = {};
+	moduleInfo.sType =
+		VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleInfo.codeSize = shaderCode.size();
+	moduleInfo.pCode	= reinterpret_cast<const uint32_t*>(shaderCode.data());
+
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(
+		m_device, &moduleInfo, nullptr, &shaderModule
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling shader module");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType =
+		VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName  = "main";
+	pipelineInfo.layout		  = m_pipelineLayout;
+
+	VkResult result = pipelineCache.createComputePipeline(
+		"meshlet cull", pipelineInfo, m_pipeline);
+	vkDestroyShaderModule(m_device, shaderModule, nullptr);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling pipeline");
+	}
+}
+
+void MeshletCuller::destroy() {
+	for (Frame& frame : m_frames) {
+		m_allocator->destroyBuffer(frame.indices, frame.indicesAlloc);
+		m_allocator->destroyBuffer(frame.draw, frame.drawAlloc);
+	}
+	m_frames.clear();
+	m_resetCommands.clear();
+	if (m_meshlets != VK_NULL_HANDLE) {
+		m_allocator->destroyBuffer(m_meshlets, m_meshletsAlloc);
+	}
+
+	vkDestroyPipeline(m_device, m_pipeline, nullptr);
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+	vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
+	m_pipeline		 = VK_NULL_HANDLE;
+	m_pipelineLayout = VK_NULL_HANDLE;
+	m_descriptorPool = VK_NULL_HANDLE;
+	m_setLayout		 = VK_NULL_HANDLE;
+}
+
+void MeshletCuller::record(
+	VkCommandBuffer commandBuffer, uint32_t frame, const MeshletCullParams& params
+) {
+	Frame& current = m_frames[frame];
+
+	// the fence of this frame has signalled, so its last result is final
+	const VkDrawIndexedIndirectCommand* drawCommands =
+		static_cast<const VkDrawIndexedIndirectCommand*>(current.drawAlloc.mapped);
+	if (current.pending) {
+		for (size_t material = 0; material < m_resetCommands.size(); material++) {
+			m_drawnTriangles += drawCommands[material].indexCount / 3;
+		}
+		m_offeredTriangles += m_indexCount / 3;
+	}
+	current.pending = true;
+
+	vkCmdUpdateBuffer(commandBuffer, current.draw, 0,
+		sizeof(VkDrawIndexedIndirectCommand) * m_resetCommands.size(),
+		m_resetCommands.data());
+
+	VkMemoryBarrier resetBarrier = {};
+	resetBarrier.sType =
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	resetBarrier.dstAccessMask =
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &resetBarrier, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout,
+		0, 1, &current.set, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_pipelineLayout,
+		VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+	vkCmdDispatch(commandBuffer, m_meshletCount, 1, 1);
+
+	VkMemoryBarrier cullBarrier = {};
+	cullBarrier.sType =
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	cullBarrier.dstAccessMask =
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+		VK_ACCESS_INDEX_READ_BIT |
+		VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+		VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+}
+
+void MeshletCuller::bindIndices(VkCommandBuffer commandBuffer, uint32_t frame) const {
+	vkCmdBindIndexBuffer(commandBuffer, m_frames[frame].indices, 0, VK_INDEX_TYPE_UINT32);
+}
+
+void MeshletCuller::draw(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t material) const {
+	vkCmdDrawIndexedIndirect(commandBuffer, m_frames[frame].draw,
+		sizeof(VkDrawIndexedIndirectCommand) * VkDeviceSize(material), 1,
+		sizeof(VkDrawIndexedIndirectCommand));
+}
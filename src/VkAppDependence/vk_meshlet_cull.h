@@ -0,0 +1,90 @@
+#pragma once
+
+#include "vk_allocator.h"
+#include "vk_upload.h"
+#include "vk_pipeline_cache.h"
+#include "mesh_meshlet.h"
+
+#include <vector>
+#include <cstdint>
+
+// GPU meshlet culling for one mesh. Every frame a compute dispatch tests
+// each meshlet's bounding sphere against the frustum and its normal cone
+// against the camera (shaders/meshlet_cull.comp, one workgroup per
+// meshlet) and copies the indices of the survivors into a compacted index
+// buffer, counting them into the VkDrawIndexedIndirectCommand of the
+// meshlet's material. A material's survivors are compacted inside its
+// MaterialRange, so each material is drawn on its own with its own
+// texture. The graphics pipeline draws that buffer unchanged, so culled
+// triangles never reach primitive setup. Both outputs exist once per frame
+// in flight; the draw commands are host visible so the number of drawn
+// triangles can be read back once the frame's fence has signalled.
+class MeshletCuller {
+public:
+	static const char* const SHADER_FILE;		// in the shader directory
+	static const uint32_t	 WORKGROUP_SIZE = 64;
+
+	// `indexBuffer` holds the indices the meshlets refer to and needs
+	// STORAGE_BUFFER usage, its upload must end up visible to compute
+	// shader reads. `ranges` are the mesh's, one per material, and cover
+	// every meshlet. The meshlets are uploaded through `uploader`.
+	void init(
+		DeviceAllocator&		 allocator,
+		VkDevice				 device,
+		UploadEngine&			 uploader,
+		PipelineCache&			 pipelineCache,
+		const std::vector<char>& shaderCode,
+		const Meshlet*			 meshlets,
+		uint32_t				 meshletCount,
+		const MaterialRange*	 ranges,
+		uint32_t				 rangeCount,
+		VkBuffer				 indexBuffer,
+		uint32_t				 indexCount,
+		uint32_t				 frameCount
+	);
+	void destroy();
+
+	// outside a render pass, after the frame's fence has been waited on:
+	// resets the frame's draw, culls, compacts and makes the result visible
+	// to the index fetch and the indirect draw
+	void record(VkCommandBuffer commandBuffer, uint32_t frame, const MeshletCullParams& params);
+	// inside the render pass: binds the frame's compacted indices, then
+	// draws what survived of a material, with the vertex buffer, pipeline
+	// and the material's state bound
+	void bindIndices(VkCommandBuffer commandBuffer, uint32_t frame) const;
+	void draw(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t material) const;
+
+	// triangles drawn and offered over every frame read back so far
+	uint64_t drawnTriangles()	const { return m_drawnTriangles; }
+	uint64_t offeredTriangles() const { return m_offeredTriangles; }
+
+private:
+	struct Frame {
+		VkBuffer		indices = VK_NULL_HANDLE;
+		Allocation		indicesAlloc {};
+		VkBuffer		draw	= VK_NULL_HANDLE;
+		Allocation		drawAlloc {};
+		VkDescriptorSet set		= VK_NULL_HANDLE;
+		bool			pending = false;	// recorded, not read back yet
+	};
+
+	void _createPipeline(PipelineCache& pipelineCache, const std::vector<char>& shaderCode);
+
+	DeviceAllocator*	  m_allocator		= nullptr;
+	VkDevice			  m_device			= VK_NULL_HANDLE;
+	VkBuffer			  m_meshlets		= VK_NULL_HANDLE;
+	Allocation			  m_meshletsAlloc	{};
+	uint32_t			  m_meshletCount	= 0;
+	uint32_t			  m_indexCount		= 0;
+	// one per material id, zero indices from the material's firstIndex
+	std::vector<VkDrawIndexedIndirectCommand> m_resetCommands;
+
+	VkDescriptorSetLayout m_setLayout		= VK_NULL_HANDLE;
+	VkDescriptorPool	  m_descriptorPool	= VK_NULL_HANDLE;
+	VkPipelineLayout	  m_pipelineLayout	= VK_NULL_HANDLE;
+	VkPipeline			  m_pipeline		= VK_NULL_HANDLE;
+	std::vector<Frame>	  m_frames;
+
+	uint64_t			  m_drawnTriangles	 = 0;
+	uint64_t			  m_offeredTriangles = 0;
+};
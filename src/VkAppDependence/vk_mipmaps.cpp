@@ -0,0 +1,395 @@
+#include "vk_mipmaps.h"
+
+#include <array>
+#include <algorithm>
+#include <stdexcept>
+
+const char* const MipGenerator::SHADER_FILE = "mips.spv";
+
+// binding order of mip_downsample.comp
+enum MipBinding : uint32_t {
+	BINDING_SOURCE = 0,		// level i - 1, sampled with texelFetch
+	BINDING_TARGET,			// level i, stored to
+	BINDING_COUNT
+};
+
+uint32_t mipLevelCount(uint32_t width, uint32_t height) {
+	uint32_t levels = 1;
+	while ((std::max(width, height) >> levels) != 0) {
+		levels++;
+	}
+	return levels;
+}
+
+static uint32_t mipExtent(uint32_t extent, uint32_t level) {
+	return std::max(1u, extent >> level);
+}
+
+static VkImageMemoryBarrier levelBarrier(
+	VkImage image, uint32_t baseLevel, uint32_t levelCount,
+	VkImageLayout oldLayout, VkImageLayout newLayout,
+	VkAccessFlags srcAccess, VkAccessFlags dstAccess
+) {
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType =
+		VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = baseLevel;
+	barrier.subresourceRange.levelCount = levelCount;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	return barrier;
+}
+
+void MipGenerator::init(
+	VkPhysicalDevice		 gpu,
+	VkDevice				 device,
+	PipelineCache&			 pipelineCache,
+	const std::vector<char>& shaderCode,
+	bool					 writeWithoutFormat
+) {
+	m_gpu			 = gpu;
+	m_device		 = device;
+	m_computeEnabled = !shaderCode.empty() && writeWithoutFormat;
+	if (m_computeEnabled) {
+		_createPipeline(pipelineCache, shaderCode);
+	}
+}
+
+void MipGenerator::_createPipeline(PipelineCache& pipelineCache, const std::vector<char>& shaderCode) {
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType =
+		VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter	 = VK_FILTER_NEAREST;
+	samplerInfo.minFilter	 = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode	 = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod		 = 0.0f;
+
+	if (vkCreateSampler(
+		m_device, &samplerInfo, nullptr, &m_sampler
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create mip sampler");
+	}
+
+	std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings = {};
+	bindings[BINDING_SOURCE].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[BINDING_SOURCE].pImmutableSamplers = &m_sampler;
+	bindings[BINDING_TARGET].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	for (uint32_t binding = 0; binding < BINDING_COUNT; binding++) {
+		bindings[binding].binding		  = binding;
+		bindings[binding].descriptorCount = 1;
+		bindings[binding].stageFlags	  = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType =
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings	= bindings.data();
+
+	if (vkCreateDescriptorSetLayout(
+		m_device, &layoutInfo, nullptr, &m_setLayout
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create mip descriptor set layout");
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts	  = &m_setLayout;
+
+	if (vkCreatePipelineLayout(
+		m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create mip pipeline layout");
+	}
+
+	VkShaderModuleCreateInfo moduleInfo = {};
+	moduleInfo.sType =
+		VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleInfo.codeSize = shaderCode.size();
+	moduleInfo.pCode	= reinterpret_cast<const uint32_t*>(shaderCode.data());
+
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(
+		m_device, &moduleInfo, nullptr, &shaderModule
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create mip shader module");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType =
+		VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName  = "main";
+	pipelineInfo.layout		  = m_pipelineLayout;
+
+	VkResult result = pipelineCache.createComputePipeline(
+		"mip downsample", pipelineInfo, m_pipeline);
+	vkDestroyShaderModule(m_device, shaderModule, nullptr);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create mip pipeline");
+	}
+}
+
+void MipGenerator::destroy() {
+	collect(UINT64_MAX);
+	vkDestroyPipeline(m_device, m_pipeline, nullptr);
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
+	vkDestroySampler(m_device, m_sampler, nullptr);
+	m_pipeline		 = VK_NULL_HANDLE;
+	m_pipelineLayout = VK_NULL_HANDLE;
+	m_setLayout		 = VK_NULL_HANDLE;
+	m_sampler		 = VK_NULL_HANDLE;
+	m_computeEnabled = false;
+}
+
+MipMethod MipGenerator::method(VkFormat format) const {
+	VkFormatProperties props;
+	vkGetPhysicalDeviceFormatProperties(m_gpu, format, &props);
+	VkFormatFeatureFlags features = props.optimalTilingFeatures;
+
+	const VkFormatFeatureFlags blit =
+		VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+		VK_FORMAT_FEATURE_BLIT_DST_BIT |
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	const VkFormatFeatureFlags compute =
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+		VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT;
+	if ((features & blit) == blit) {
+		return MipMethod::Blit;
+	}
+	if (m_computeEnabled && (features & compute) == compute) {
+		return MipMethod::Compute;
+	}
+	return MipMethod::None;
+}
+
+VkImageUsageFlags MipGenerator::usage(VkFormat format) const {
+	switch (method(format)) {
+	case MipMethod::Blit:
+		return VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	case MipMethod::Compute:
+		return VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+	default:
+		return 0;
+	}
+}
+
+void MipGenerator::record(
+	VkCommandBuffer			commandBuffer,
+	VkImage					image,
+	VkFormat				format,
+	uint32_t				width,
+	uint32_t				height,
+	uint32_t				mipLevels,
+	VkImageLayout			finalLayout,
+	VkAccessFlags			dstAccess,
+	VkPipelineStageFlags	dstStage,
+	uint64_t				serial
+) {
+	MipMethod mipMethod = mipLevels > 1 ? method(format) : MipMethod::None;
+	if (mipLevels > 1 && mipMethod == MipMethod::None) {
+		throw std::runtime_error("failed to find a way to generate mips");
+	}
+
+	// every level ends up in the layout its last writer or reader left it
+	VkImageLayout		 lastLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	VkAccessFlags		 lastAccess = VK_ACCESS_TRANSFER_WRITE_BIT;
+	VkPipelineStageFlags lastStage	= VK_PIPELINE_STAGE_TRANSFER_BIT;
+	if (mipMethod == MipMethod::Blit) {
+		_recordBlit(commandBuffer, image, width, height, mipLevels);
+		lastLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		lastAccess = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	}
+	else if (mipMethod == MipMethod::Compute) {
+		_recordCompute(commandBuffer, image, format, width, height, mipLevels, serial);
+		lastLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		lastAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		lastStage  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	}
+
+	VkImageMemoryBarrier barrier = levelBarrier(image, 0, mipLevels,
+		lastLayout, finalLayout, lastAccess, dstAccess);
+	vkCmdPipelineBarrier(commandBuffer,
+		lastStage, dstStage, 0,
+		0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void MipGenerator::_recordBlit(
+	VkCommandBuffer commandBuffer, VkImage image,
+	uint32_t width, uint32_t height, uint32_t mipLevels
+) {
+	std::array<VkImageMemoryBarrier, 2> start = {
+		levelBarrier(image, 0, 1,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT),
+		levelBarrier(image, 1, mipLevels - 1,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			0, VK_ACCESS_TRANSFER_WRITE_BIT),
+	};
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr, 0, nullptr,
+		static_cast<uint32_t>(start.size()), start.data());
+
+	// each level is read once it has been written, so the chain is serial
+	for (uint32_t level = 1; level < mipLevels; level++) {
+		VkImageBlit blit = {};
+		blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 };
+		blit.srcOffsets[1] = {
+			static_cast<int32_t>(mipExtent(width, level - 1)),
+			static_cast<int32_t>(mipExtent(height, level - 1)), 1 };
+		blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+		blit.dstOffsets[1] = {
+			static_cast<int32_t>(mipExtent(width, level)),
+			static_cast<int32_t>(mipExtent(height, level)), 1 };
+		vkCmdBlitImage(commandBuffer,
+			image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit, VK_FILTER_LINEAR);
+
+		VkImageMemoryBarrier written = levelBarrier(image, level, 1,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &written);
+	}
+}
+
+void MipGenerator::_recordCompute(
+	VkCommandBuffer commandBuffer, VkImage image, VkFormat format,
+	uint32_t width, uint32_t height, uint32_t mipLevels, uint64_t serial
+) {
+	Pending pending;
+	pending.serial = serial;
+
+	std::array<VkDescriptorPoolSize, BINDING_COUNT> poolSizes = {};
+	poolSizes[BINDING_SOURCE] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, mipLevels - 1 };
+	poolSizes[BINDING_TARGET] = { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, mipLevels - 1 };
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType =
+		VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes	   = poolSizes.data();
+	poolInfo.maxSets	   = mipLevels - 1;
+
+	if (vkCreateDescriptorPool(
+		m_device, &poolInfo, nullptr, &pending.pool
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create mip descriptor pool");
+	}
+	// owned from here on, so a throw below still frees it in collect()
+	m_pending.push_back(pending);
+	Pending& owned = m_pending.back();
+
+	for (uint32_t level = 0; level < mipLevels; level++) {
+		VkImageViewCreateInfo viewInfo = {};
+		viewInfo.sType =
+			VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image	  = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format	  = format;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+
+		VkImageView view;
+		if (vkCreateImageView(
+			m_device, &viewInfo, nullptr, &view
+		) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create mip level view");
+		}
+		owned.views.push_back(view);
+	}
+
+	std::array<VkImageMemoryBarrier, 2> start = {
+		levelBarrier(image, 0, 1,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
+		levelBarrier(image, 1, mipLevels - 1,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+			0, VK_ACCESS_SHADER_WRITE_BIT),
+	};
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		0, nullptr, 0, nullptr,
+		static_cast<uint32_t>(start.size()), start.data());
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	for (uint32_t level = 1; level < mipLevels; level++) {
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType =
+			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool	 = owned.pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts		 = &m_setLayout;
+
+		VkDescriptorSet set;
+		if (vkAllocateDescriptorSets(
+			m_device, &allocInfo, &set
+		) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate mip descriptor set");
+		}
+
+		std::array<VkDescriptorImageInfo, BINDING_COUNT> images = {};
+		images[BINDING_SOURCE] = {
+			VK_NULL_HANDLE, owned.views[level - 1], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		images[BINDING_TARGET] = {
+			VK_NULL_HANDLE, owned.views[level], VK_IMAGE_LAYOUT_GENERAL };
+
+		std::array<VkWriteDescriptorSet, BINDING_COUNT> writes = {};
+		for (uint32_t binding = 0; binding < BINDING_COUNT; binding++) {
+			writes[binding].sType =
+				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[binding].dstSet			= set;
+			writes[binding].dstBinding		= binding;
+			writes[binding].descriptorCount = 1;
+			writes[binding].pImageInfo		= &images[binding];
+		}
+		writes[BINDING_SOURCE].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[BINDING_TARGET].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		vkUpdateDescriptorSets(
+			m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+		vkCmdBindDescriptorSets(commandBuffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout,
+			0, 1, &set, 0, nullptr);
+		vkCmdDispatch(commandBuffer,
+			(mipExtent(width, level) + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+			(mipExtent(height, level) + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+		VkImageMemoryBarrier written = levelBarrier(image, level, 1,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &written);
+	}
+}
+
+void MipGenerator::collect(uint64_t completedSerial) {
+	while (!m_pending.empty() && m_pending.front().serial <= completedSerial) {
+		Pending& pending = m_pending.front();
+		for (VkImageView view : pending.views) {
+			vkDestroyImageView(m_device, view, nullptr);
+		}
+		vkDestroyDescriptorPool(m_device, pending.pool, nullptr);
+		m_pending.pop_front();
+	}
+}
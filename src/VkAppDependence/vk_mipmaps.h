@@ -0,0 +1,89 @@
+#pragma once
+
+#include "vk_pipeline_cache.h"
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <vector>
+#include <cstdint>
+
+// How the mips of a format are filled from mip 0.
+enum class MipMethod : uint32_t {
+	None = 0,		// neither path works, the image keeps one level
+	Blit,			// vkCmdBlitImage with linear filtering, level by level
+	Compute,		// 2x2 box filter in shaders/mip_downsample.comp
+};
+
+// levels of a full chain down to 1x1
+uint32_t mipLevelCount(uint32_t width, uint32_t height);
+
+// Fills mip chains on the graphics queue. Blits are used whenever the
+// format allows blitting with linear filtering; formats that cannot be
+// filtered but can be stored to from a shader go through a compute
+// downsample instead. The compute path binds one image view per level,
+// those views live until collect() is told the upload that recorded them
+// has completed.
+class MipGenerator {
+public:
+	static const char* const SHADER_FILE;		// in the shader directory
+	static const uint32_t	 WORKGROUP_SIZE = 8;
+
+	// `shaderCode` may be empty, which leaves out the compute path. That
+	// path also needs shaderStorageImageWriteWithoutFormat enabled.
+	void init(
+		VkPhysicalDevice		 gpu,
+		VkDevice				 device,
+		PipelineCache&			 pipelineCache,
+		const std::vector<char>& shaderCode,
+		bool					 writeWithoutFormat
+	);
+	void destroy();
+
+	MipMethod method(VkFormat format) const;
+	// usage an image of `format` needs on top of its own for method()
+	VkImageUsageFlags usage(VkFormat format) const;
+
+	// Level 0 is in TRANSFER_DST_OPTIMAL with its writes visible to
+	// transfer reads and compute shader reads, the other levels are
+	// UNDEFINED. Leaves every level in `finalLayout`, visible to
+	// `dstAccess` at `dstStage`. `serial` names the recording for collect().
+	void record(
+		VkCommandBuffer			commandBuffer,
+		VkImage					image,
+		VkFormat				format,
+		uint32_t				width,
+		uint32_t				height,
+		uint32_t				mipLevels,
+		VkImageLayout			finalLayout,
+		VkAccessFlags			dstAccess,
+		VkPipelineStageFlags	dstStage,
+		uint64_t				serial
+	);
+
+	// frees what the recordings up to `completedSerial` bound
+	void collect(uint64_t completedSerial);
+
+private:
+	struct Pending {
+		uint64_t				 serial;
+		VkDescriptorPool		 pool;
+		std::vector<VkImageView> views;
+	};
+
+	void _createPipeline(PipelineCache& pipelineCache, const std::vector<char>& shaderCode);
+	void _recordBlit(VkCommandBuffer commandBuffer, VkImage image,
+		uint32_t width, uint32_t height, uint32_t mipLevels);
+	void _recordCompute(VkCommandBuffer commandBuffer, VkImage image, VkFormat format,
+		uint32_t width, uint32_t height, uint32_t mipLevels, uint64_t serial);
+
+	VkPhysicalDevice	  m_gpu				 = VK_NULL_HANDLE;
+	VkDevice			  m_device			 = VK_NULL_HANDLE;
+	bool				  m_computeEnabled	 = false;
+
+	VkSampler			  m_sampler			 = VK_NULL_HANDLE;
+	VkDescriptorSetLayout m_setLayout		 = VK_NULL_HANDLE;
+	VkPipelineLayout	  m_pipelineLayout	 = VK_NULL_HANDLE;
+	VkPipeline			  m_pipeline		 = VK_NULL_HANDLE;
+	std::deque<Pending>	  m_pending;
+};
@@ -0,0 +1,211 @@
+#include "vk_pipeline_cache.h"
+#include "../LCBHSS/lcbhss_hash.h"
+#include "../LCBHSS/lcbhss_space.h"
+#include "../LCBHSS/lcbhss_mapped_file.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+namespace {
+
+const char	   PIPELINE_CACHE_MAGIC[4] = { 'V', 'K', 'P', 'C' };
+const uint32_t PIPELINE_CACHE_VERSION  = 1;
+
+// What the driver's data is for, followed by the data.
+struct PipelineCacheFileHeader {
+	char	 magic[4];
+	uint32_t version;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t	 pipelineCacheUUID[VK_UUID_SIZE];
+	uint32_t reserved;
+	uint64_t dataSize;
+	uint64_t dataHash;		// hash64() of the data
+};
+static_assert(sizeof(PipelineCacheFileHeader) == 56, "pipeline cache file header layout");
+
+// The driver's data starts with a VkPipelineCacheHeaderVersionOne, it has
+// to agree with the file header and the device.
+bool matchesDevice(const uint8_t* data, uint64_t size, const VkPhysicalDeviceProperties& properties) {
+	VkPipelineCacheHeaderVersionOne header;
+	if (size < sizeof(header)) {
+		return false;
+	}
+	std::memcpy(&header, data, sizeof(header));
+	return header.headerSize >= sizeof(header) &&
+		header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header.vendorID == properties.vendorID &&
+		header.deviceID == properties.deviceID &&
+		std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+double msSince(std::chrono::high_resolution_clock::time_point begin) {
+	return std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - begin).count();
+}
+
+}
+
+void PipelineCache::init(VkPhysicalDevice gpu, VkDevice device, const std::string& fileName) {
+	m_device   = device;
+	m_fileName = fileName;
+	vkGetPhysicalDeviceProperties(gpu, &m_properties);
+
+	// the cache is never packed, it belongs to this machine
+	MappedFile		file;
+	const uint8_t*	data = nullptr;
+	uint64_t		size = 0;
+	const char*		rejected = nullptr;
+	if (file.openFromDisk(fileName)) {
+		PipelineCacheFileHeader header;
+		if (file.size() < sizeof(header)) {
+			rejected = "truncated";
+		}
+		else {
+			std::memcpy(&header, file.data(), sizeof(header));
+			data = file.data() + sizeof(header);
+			size = file.size() - sizeof(header);
+			if (std::memcmp(header.magic, PIPELINE_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+				header.version != PIPELINE_CACHE_VERSION) {
+				rejected = "not a pipeline cache of this version";
+			}
+			else if (header.vendorID != m_properties.vendorID ||
+				header.deviceID != m_properties.deviceID ||
+				header.driverVersion != m_properties.driverVersion ||
+				std::memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+				rejected = "made for another device or driver";
+			}
+			else if (header.dataSize != size || hash64(data, static_cast<size_t>(size)) != header.dataHash) {
+				rejected = "corrupt";
+			}
+			else if (!matchesDevice(data, size, m_properties)) {
+				rejected = "holds data of another device";
+			}
+			else {
+				m_loadedHash = header.dataHash;
+			}
+		}
+	}
+
+	VkPipelineCacheCreateInfo createInfo = {};
+	createInfo.sType =
+		VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	if (data && !rejected) {
+		createInfo.initialDataSize = static_cast<size_t>(size);
+		createInfo.pInitialData	   = data;
+	}
+	if (vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline cache");
+	}
+	m_loaded = createInfo.pInitialData != nullptr;
+
+	if (m_loaded) {
+		Log("pipeline cache: %.1f KB loaded from %s", size / 1024.0, fileName.c_str());
+	}
+	else if (rejected) {
+		Log("pipeline cache: %s is %s, starting cold", fileName.c_str(), rejected);
+	}
+	else {
+		Log("pipeline cache: no %s, starting cold", fileName.c_str());
+	}
+}
+
+void PipelineCache::destroy() {
+	if (m_cache == VK_NULL_HANDLE) {
+		return;
+	}
+	Log("pipeline cache: %u pipelines created in %.2f ms",
+		static_cast<uint32_t>(m_created.size()), m_createMs);
+	try {
+		_save();
+	}
+	catch (const std::exception& e) {
+		// a cold start next time, nothing worse
+		Log("pipeline cache: %s", e.what());
+	}
+	vkDestroyPipelineCache(m_device, m_cache, nullptr);
+	m_cache = VK_NULL_HANDLE;
+	m_created.clear();
+}
+
+void PipelineCache::_save() {
+	size_t size = 0;
+	if (vkGetPipelineCacheData(m_device, m_cache, &size, nullptr) != VK_SUCCESS) {
+		throw std::runtime_error("failed to read the pipeline cache size");
+	}
+	std::vector<uint8_t> data(size);
+	if (size > 0 && vkGetPipelineCacheData(m_device, m_cache, &size, data.data()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to read the pipeline cache");
+	}
+	data.resize(size);
+
+	PipelineCacheFileHeader header = {};
+	std::memcpy(header.magic, PIPELINE_CACHE_MAGIC, sizeof(header.magic));
+	header.version		 = PIPELINE_CACHE_VERSION;
+	header.vendorID		 = m_properties.vendorID;
+	header.deviceID		 = m_properties.deviceID;
+	header.driverVersion = m_properties.driverVersion;
+	std::memcpy(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize		 = size;
+	header.dataHash		 = hash64(data.data(), size);
+	if (m_loaded && header.dataHash == m_loadedHash) {
+		return;
+	}
+
+	std::string tempName = m_fileName + ".tmp";
+	{
+		std::ofstream file(tempName, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			throw std::runtime_error("failed to create " + tempName);
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(size));
+		if (!file.flush()) {
+			throw std::runtime_error("failed to write " + tempName);
+		}
+	}
+
+	// rename does not replace an existing file on Windows
+	std::remove(m_fileName.c_str());
+	if (std::rename(tempName.c_str(), m_fileName.c_str()) != 0) {
+		std::remove(tempName.c_str());
+		throw std::runtime_error("failed to replace " + m_fileName);
+	}
+	Log("pipeline cache: %.1f KB saved to %s", size / 1024.0, m_fileName.c_str());
+}
+
+VkResult PipelineCache::createGraphicsPipeline(
+	const char* name, const VkGraphicsPipelineCreateInfo& info, VkPipeline& pipeline
+) {
+	auto	 begin	= std::chrono::high_resolution_clock::now();
+	VkResult result = vkCreateGraphicsPipelines(m_device, m_cache, 1, &info, nullptr, &pipeline);
+	if (result == VK_SUCCESS) {
+		_logCreation(name, msSince(begin));
+	}
+	return result;
+}
+
+VkResult PipelineCache::createComputePipeline(
+	const char* name, const VkComputePipelineCreateInfo& info, VkPipeline& pipeline
+) {
+	auto	 begin	= std::chrono::high_resolution_clock::now();
+	VkResult result = vkCreateComputePipelines(m_device, m_cache, 1, &info, nullptr, &pipeline);
+	if (result == VK_SUCCESS) {
+		_logCreation(name, msSince(begin));
+	}
+	return result;
+}
+
+// Warm when the cache came from disk or made the same pipeline before in
+// this run; the driver may still keep caches of its own.
+void PipelineCache::_logCreation(const char* name, double ms) {
+	bool again = std::find(m_created.begin(), m_created.end(), name) != m_created.end();
+	Log("pipeline: %s in %.2f ms, %s", name, ms,
+		again ? "cache warmed by this run" : m_loaded ? "cache warm from disk" : "cache cold");
+	m_created.push_back(name);
+	m_createMs += ms;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// A VkPipelineCache kept on disk between runs, so the driver loads the
+// pipelines it compiled last time instead of compiling them again, and
+// pipelines made again in a run (the graphics pipeline when the surface
+// format changes) hit it in memory. The file is the driver's cache data
+// behind a header checked on load: data from another vendor, device,
+// driver or cache UUID, cut short or corrupted, is ignored and the cache
+// starts out empty. Pipelines are created through it, which logs how long
+// each took and whether the cache was cold or warm for it.
+class PipelineCache {
+public:
+	void init(VkPhysicalDevice gpu, VkDevice device, const std::string& fileName);
+	// writes the cache back, unless it did not change since it was read
+	void destroy();
+
+	VkPipelineCache handle() const { return m_cache; }
+
+	// vkCreate*Pipelines() for one pipeline, `name` is for the log
+	VkResult createGraphicsPipeline(
+		const char* name, const VkGraphicsPipelineCreateInfo& info, VkPipeline& pipeline);
+	VkResult createComputePipeline(
+		const char* name, const VkComputePipelineCreateInfo& info, VkPipeline& pipeline);
+
+private:
+	void _logCreation(const char* name, double ms);
+	void _save();
+
+	VkDevice				 m_device = VK_NULL_HANDLE;
+	VkPipelineCache			 m_cache  = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties m_properties {};
+	std::string				 m_fileName;
+	bool					 m_loaded	  = false;	// seeded from the file
+	uint64_t				 m_loadedHash = 0;		// hash64() of the data read
+	std::vector<std::string> m_created;				// pipelines made this run
+	double					 m_createMs	  = 0.0;
+};
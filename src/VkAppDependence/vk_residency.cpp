@@ -0,0 +1,107 @@
+#include "vk_residency.h"
+#include "../LCBHSS/lcbhss_space.h"
+
+#include <algorithm>
+
+void TextureResidency::init(
+	DeviceAllocator& allocator, VkDevice device, uint32_t framesInFlight
+) {
+	m_allocator		 = &allocator;
+	m_device		 = device;
+	m_framesInFlight = framesInFlight;
+	m_frame			 = framesInFlight;
+}
+
+void TextureResidency::destroy() {
+	for (auto& entry : m_entries) {
+		_release(entry);
+	}
+	m_entries.clear();
+	m_removed.clear();
+}
+
+uint32_t TextureResidency::add(
+	VkImage image, VkImageView view, const Allocation& allocation
+) {
+	Entry entry;
+	entry.image	   = image;
+	entry.view	   = view;
+	entry.alloc	   = allocation;
+	// not evictable before a full round of frames, pending uploads and
+	// the first draws using it get to finish
+	entry.lastUsed = m_frame;
+	m_entries.push_back(entry);
+
+	m_residentBytes += allocation.size;
+	return static_cast<uint32_t>(m_entries.size() - 1);
+}
+
+void TextureResidency::touch(uint32_t id) {
+	m_entries[id].lastUsed = m_frame;
+}
+
+void TextureResidency::remove(uint32_t id) {
+	m_removed.push_back(id);
+}
+
+void TextureResidency::nextFrame() {
+	m_frame++;
+
+	size_t kept = 0;
+	for (uint32_t id : m_removed) {
+		if (m_entries[id].lastUsed + m_framesInFlight > m_frame) {
+			m_removed[kept++] = id;
+			continue;
+		}
+		_release(m_entries[id]);
+	}
+	m_removed.resize(kept);
+}
+
+bool TextureResidency::evict(uint32_t heapIndex, VkDeviceSize bytesNeeded) {
+	const VkPhysicalDeviceMemoryProperties& memProperties =
+		m_allocator->memoryProperties();
+
+	std::vector<uint32_t> candidates;
+	for (uint32_t i = 0; i < m_entries.size(); i++) {
+		const Entry& entry = m_entries[i];
+		if (entry.image != VK_NULL_HANDLE &&
+			entry.lastUsed + m_framesInFlight <= m_frame &&
+			memProperties.memoryTypes[entry.alloc.memoryType].heapIndex == heapIndex) {
+			candidates.push_back(i);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+		return m_entries[a].lastUsed < m_entries[b].lastUsed;
+	});
+
+	VkDeviceSize freed = 0;
+	for (uint32_t id : candidates) {
+		if (freed >= bytesNeeded) {
+			break;
+		}
+		freed += m_entries[id].alloc.size;
+		if (m_evicted) {
+			m_evicted(id);
+		}
+		_release(m_entries[id]);
+		m_evictions++;
+	}
+
+	if (freed != 0) {
+		Log("residency: evicted %.2f MB of textures from heap %u",
+			freed / (1024.0 * 1024.0), heapIndex);
+	}
+	return freed != 0;
+}
+
+void TextureResidency::_release(Entry& entry) {
+	if (entry.image == VK_NULL_HANDLE) {
+		return;
+	}
+	m_residentBytes -= entry.alloc.size;
+	vkDestroyImageView(m_device, entry.view, nullptr);
+	m_allocator->destroyImage(entry.image, entry.alloc);
+	entry.image = VK_NULL_HANDLE;
+	entry.view	= VK_NULL_HANDLE;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "vk_allocator.h"
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+// Tracks when each registered texture was last bound and gives memory back
+// to the allocator when a heap runs over budget. Only textures nobody has
+// touched for framesInFlight frames are evicted, by then every command
+// buffer that could still reference them has retired. Evicting destroys the
+// image, its view and its memory; the eviction callback tells the owner
+// first, who must not bind the texture again. Touching a texture every
+// frame keeps it resident. Residency is per texture: all of its mips go
+// together, none is dropped on its own.
+class TextureResidency {
+public:
+	using EvictionCallback = std::function<void(uint32_t id)>;
+
+	void init(DeviceAllocator& allocator, VkDevice device, uint32_t framesInFlight);
+	void destroy();
+
+	void setEvictionCallback(EvictionCallback callback) { m_evicted = callback; }
+
+	// takes ownership of image, view and allocation
+	uint32_t add(VkImage image, VkImageView view, const Allocation& allocation);
+	// frees it once the frames that could have bound it have retired
+	void	 remove(uint32_t id);
+	void	 touch(uint32_t id);
+	void	 nextFrame();
+
+	// least recently used first, stops once bytesNeeded are freed on the heap
+	bool evict(uint32_t heapIndex, VkDeviceSize bytesNeeded);
+
+	bool		 isResident(uint32_t id) const { return m_entries[id].image != VK_NULL_HANDLE; }
+	VkImageView	 view(uint32_t id)		 const { return m_entries[id].view; }
+	VkDeviceSize residentBytes()		 const { return m_residentBytes; }
+	uint32_t	 evictionCount()		 const { return m_evictions; }
+
+private:
+	struct Entry {
+		VkImage		image	 = VK_NULL_HANDLE;
+		VkImageView view	 = VK_NULL_HANDLE;
+		Allocation	alloc	 {};
+		uint64_t	lastUsed = 0;
+	};
+
+	void _release(Entry& entry);
+
+	DeviceAllocator*   m_allocator		= nullptr;
+	VkDevice		   m_device			= VK_NULL_HANDLE;
+	uint32_t		   m_framesInFlight = 0;
+	uint64_t		   m_frame			= 0;
+
+	std::vector<Entry>	  m_entries;
+	std::vector<uint32_t> m_removed;
+	EvictionCallback	  m_evicted;
+	VkDeviceSize	   m_residentBytes	= 0;
+	uint32_t		   m_evictions		= 0;
+};
@@ -0,0 +1,41 @@
+#include "vk_resource_cache.h"
+#include "../LCBHSS/lcbhss_hash.h"
+#include "../LCBHSS/lcbhss_pack.h"
+#include "../LCBHSS/lcbhss_mapped_file.h"
+#include "../LCBHSS/lcbhss_space.h"
+
+#include <algorithm>
+
+ContentKey contentKey(const void* data, size_t size, uint64_t seed) {
+	ContentKey key;
+	key.hash = hash64(data, size, seed);
+	key.size = size;
+	return key;
+}
+
+bool fileContentKey(const std::string& fileName, ContentKey& key) {
+	const AssetPack* pack  = mountedAssetPack();
+	const PackEntry* entry = pack ? pack->find(fileName) : nullptr;
+	if (entry) {
+		key.hash = entry->contentHash;
+		key.size = entry->size;
+		return true;
+	}
+
+	MappedFile file;
+	if (!file.open(fileName)) {
+		return false;
+	}
+	key = contentKey(file.data(), file.size());
+	return true;
+}
+
+void ResourceCacheStats::logStats(const char* name) const {
+	Log("cache: %s, %llu of %llu lookups hit (%.0f%%), %.2f MB of decoding and uploads saved, %llu released",
+		name,
+		static_cast<unsigned long long>(m_hits),
+		static_cast<unsigned long long>(m_lookups),
+		m_hits * 100.0 / std::max<uint64_t>(m_lookups, 1),
+		m_savedBytes / (1024.0 * 1024.0),
+		static_cast<unsigned long long>(m_releases));
+}
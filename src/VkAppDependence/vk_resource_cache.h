@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+// What a resource is made from: a hash of the bytes and their count.
+struct ContentKey {
+	uint64_t hash = 0;
+	uint64_t size = 0;
+
+	bool operator==(const ContentKey& other) const {
+		return hash == other.hash && size == other.size;
+	}
+};
+
+// `seed` separates resources made differently from the same bytes
+ContentKey contentKey(const void* data, size_t size, uint64_t seed = 0);
+// the key of a file's contents; taken from the mounted asset pack when it
+// holds the file, hashed from the mapped file otherwise. False when missing.
+bool	   fileContentKey(const std::string& fileName, ContentKey& key);
+
+class ResourceCacheStats {
+public:
+	void logStats(const char* name) const;
+
+protected:
+	uint64_t m_lookups	  = 0;
+	uint64_t m_hits		  = 0;
+	uint64_t m_savedBytes = 0;
+	uint64_t m_releases	  = 0;
+};
+
+// Shares GPU resources made from identical bytes. Entries are keyed by
+// content rather than by file name, so the same image shipped in two asset
+// folders, or named by several materials, is decoded and uploaded once.
+// Every acquire() and insert() holds a reference and every release() drops
+// one; the last hands the resource to the function given to init(), whose
+// owner frees it once no frame in flight uses it.
+template<typename T>
+class ResourceCache : public ResourceCacheStats {
+public:
+	void init(std::function<void(const T&)> release) { m_release = std::move(release); }
+
+	// a hit takes a new reference and sets `resource`
+	bool acquire(const ContentKey& key, T& resource) {
+		m_lookups++;
+		auto found = m_entries.find(key);
+		if (found == m_entries.end()) {
+			return false;
+		}
+		found->second.references++;
+		m_hits++;
+		m_savedBytes += found->second.bytes;
+		resource = found->second.resource;
+		return true;
+	}
+
+	// after a miss, the resource made for it with the caller's reference;
+	// `bytes` are the decoding and uploading each later hit saves
+	void insert(const ContentKey& key, const T& resource, uint64_t bytes) {
+		Entry& entry	 = m_entries[key];
+		entry.resource	 = resource;
+		entry.references = 1;
+		entry.bytes		 = bytes;
+	}
+
+	void release(const ContentKey& key) {
+		auto found = m_entries.find(key);
+		if (found == m_entries.end() || --found->second.references != 0) {
+			return;
+		}
+		T resource = found->second.resource;
+		m_entries.erase(found);
+		m_releases++;
+		m_release(resource);
+	}
+
+	size_t size() const { return m_entries.size(); }
+
+private:
+	struct Entry {
+		T		 resource	{};
+		uint32_t references = 0;
+		uint64_t bytes		= 0;
+	};
+	struct KeyHash {
+		size_t operator()(const ContentKey& key) const { return static_cast<size_t>(key.hash); }
+	};
+
+	std::unordered_map<ContentKey, Entry, KeyHash> m_entries;
+	std::function<void(const T&)>				   m_release;
+};
@@ -0,0 +1,122 @@
+#include "vk_staging.h"
+
+#include <limits>
+#include <stdexcept>
+
+void StagingArena::init(
+	DeviceAllocator& allocator, VkDevice device, VkDeviceSize capacity
+) {
+	m_allocator = &allocator;
+	m_device	= device;
+	m_capacity	= (capacity + 255) & ~VkDeviceSize(255);
+
+	m_allocator->createBuffer(
+		m_capacity,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		MemoryCategory::Staging,
+		m_buffer, m_alloc
+	);
+	m_mapped = static_cast<char*>(m_alloc.mapped);
+	m_head = m_tail = 0;
+}
+
+void StagingArena::destroy() {
+	waitIdle();
+	for (auto fence : m_freeFences) {
+		vkDestroyFence(m_device, fence, nullptr);
+	}
+	m_freeFences.clear();
+
+	if (m_buffer != VK_NULL_HANDLE) {
+		m_allocator->destroyBuffer(m_buffer, m_alloc);
+	}
+	m_mapped = nullptr;
+}
+
+StagingSpan StagingArena::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+	if (size > m_capacity) {
+		throw std::runtime_error("staging request larger than the arena");
+	}
+
+	uint64_t start = (m_head + alignment - 1) & ~uint64_t(alignment - 1);
+	// never let a span straddle the end of the buffer
+	if (start % m_capacity + size > m_capacity) {
+		start = (start / m_capacity + 1) * m_capacity;
+	}
+
+	while (start + size - m_tail > m_capacity) {
+		if (m_pending.empty()) {
+			throw std::runtime_error(
+				"staging arena full of unsubmitted data, submit between chunks");
+		}
+		vkWaitForFences(m_device, 1, &m_pending.front().fence,
+			VK_TRUE, std::numeric_limits<uint64_t>::max());
+		_retireFront();
+	}
+
+	m_head = start + size;
+
+	StagingSpan span;
+	span.buffer = m_buffer;
+	span.offset = start % m_capacity;
+	span.size	= size;
+	span.mapped = m_mapped + span.offset;
+	return span;
+}
+
+VkFence StagingArena::fenceForSubmit() {
+	VkFence fence = _acquireFence();
+	m_pending.push_back({ fence, m_head });
+	m_submitted++;
+	return fence;
+}
+
+void StagingArena::reclaim() {
+	while (!m_pending.empty() &&
+		vkGetFenceStatus(m_device, m_pending.front().fence) == VK_SUCCESS) {
+		_retireFront();
+	}
+}
+
+void StagingArena::waitIdle() {
+	waitForSerial(m_submitted);
+}
+
+void StagingArena::waitForSerial(uint64_t serial) {
+	while (m_completed < serial && !m_pending.empty()) {
+		vkWaitForFences(m_device, 1, &m_pending.front().fence,
+			VK_TRUE, std::numeric_limits<uint64_t>::max());
+		_retireFront();
+	}
+}
+
+VkFence StagingArena::_acquireFence() {
+	reclaim();
+	if (!m_freeFences.empty()) {
+		VkFence fence = m_freeFences.back();
+		m_freeFences.pop_back();
+		return fence;
+	}
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType =
+		VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	VkFence fence;
+	if (vkCreateFence(m_device, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create staging fence");
+	}
+	return fence;
+}
+
+void StagingArena::_retireFront() {
+	Region region = m_pending.front();
+	m_pending.pop_front();
+
+	vkResetFences(m_device, 1, &region.fence);
+	m_freeFences.push_back(region.fence);
+	m_tail = region.end;
+	m_completed++;
+}
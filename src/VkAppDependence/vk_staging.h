@@ -0,0 +1,77 @@
+#pragma once
+
+#include "vk_allocator.h"
+
+#include <deque>
+#include <vector>
+#include <cstdint>
+
+// A slice of the staging arena, valid until the fence it was retired with
+// has signalled.
+struct StagingSpan {
+	VkBuffer	 buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size	= 0;
+	void*		 mapped = nullptr;
+};
+
+// Persistently mapped ring of TRANSFER_SRC memory shared by every upload.
+// Spans are bump allocated; fenceForSubmit() closes everything handed out
+// since the previous call into a region guarded by the returned fence, which
+// has to be passed to the vkQueueSubmit that reads those spans. Regions are
+// reclaimed in order once their fence signals; allocate() blocks on the
+// oldest region when the ring is full. Every fence handed out gets a serial,
+// so callers can track completion of their submits without owning fences.
+class StagingArena {
+public:
+	void init(DeviceAllocator& allocator, VkDevice device,
+		VkDeviceSize capacity = 8ull * 1024 * 1024);
+	void destroy();
+
+	// alignment must be a power of two, size at most maxChunk()
+	StagingSpan allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+	VkFence fenceForSubmit();
+	void	reclaim();
+	void	waitIdle();
+	void	waitForSerial(uint64_t serial);
+
+	// serial of the fence last returned by fenceForSubmit()
+	uint64_t submittedSerial() const { return m_submitted; }
+	uint64_t completedSerial() const { return m_completed; }
+
+	// largest span callers should ask for; keeps at least two chunks in flight
+	VkDeviceSize maxChunk() const { return m_capacity / 2; }
+	VkDeviceSize capacity() const { return m_capacity; }
+	VkBuffer	 buffer()	const { return m_buffer; }
+	// bytes handed out since the last fenceForSubmit()
+	VkDeviceSize unsubmittedBytes() const {
+		return m_head - (m_pending.empty() ? m_tail : m_pending.back().end);
+	}
+
+private:
+	struct Region {
+		VkFence		 fence;
+		uint64_t	 end;		// virtual offset one past the region
+	};
+
+	VkFence _acquireFence();
+	void	_retireFront();
+
+	DeviceAllocator*	 m_allocator = nullptr;
+	VkDevice			 m_device	 = VK_NULL_HANDLE;
+	VkBuffer			 m_buffer	 = VK_NULL_HANDLE;
+	Allocation			 m_alloc	 {};
+	char*				 m_mapped	 = nullptr;
+	VkDeviceSize		 m_capacity	 = 0;
+
+	// virtual offsets grow monotonically, physical = virtual % capacity
+	uint64_t			 m_head		 = 0;
+	uint64_t			 m_tail		 = 0;
+
+	uint64_t			 m_submitted = 0;
+	uint64_t			 m_completed = 0;
+
+	std::deque<Region>	 m_pending;
+	std::vector<VkFence> m_freeFences;
+};
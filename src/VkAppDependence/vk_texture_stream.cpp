@@ -0,0 +1,342 @@
+#include "vk_texture_stream.h"
+#include "../LCBHSS/lcbhss_space.h"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+void TextureStreamer::init(
+	VkDevice		 device,
+	DeviceAllocator& allocator,
+	UploadEngine&	 uploader,
+	uint32_t		 framesInFlight,
+	VkDeviceSize	 poolBytes,
+	VkDeviceSize	 frameUploadBytes
+) {
+	m_device		   = device;
+	m_allocator		   = &allocator;
+	m_uploader		   = &uploader;
+	m_framesInFlight   = framesInFlight;
+	m_poolBytes		   = poolBytes;
+	m_frameUploadBytes = frameUploadBytes;
+	m_frame			   = framesInFlight;
+	m_retired.reserve(64);
+}
+
+void TextureStreamer::destroy() {
+	for (Texture& texture : m_textures) {
+		_retire(texture.image, texture.alloc, texture.view);
+	}
+	for (Retired& retired : m_retired) {
+		vkDestroyImageView(m_device, retired.view, nullptr);
+		if (retired.image != VK_NULL_HANDLE) {
+			m_allocator->destroyImage(retired.image, retired.alloc);
+		}
+	}
+	m_textures.clear();
+	m_retired.clear();
+	m_textureCount	= 0;
+	m_usedBytes		= 0;
+	m_retiringBytes = 0;
+}
+
+uint32_t TextureStreamer::add(
+	const std::string& name, std::unique_ptr<DdsFile> file, VkFormat format
+) {
+	const TextureCodecInfo& info = textureCodecInfo(file->codec());
+
+	Texture texture;
+	texture.name		= name;
+	texture.format		= format;
+	texture.blockExtent = info.blockExtent;
+	texture.blockSize	= info.blockSize;
+	while (texture.tailMip + 1 < file->mipCount() &&
+		std::max(file->width() >> texture.tailMip, file->height() >> texture.tailMip) > TAIL_EXTENT) {
+		texture.tailMip++;
+	}
+	texture.file	  = std::move(file);
+	texture.viewMip	  = texture.tailMip;
+	texture.wantedMip = texture.tailMip;
+	m_textures.push_back(std::move(texture));
+	m_order.reserve(m_textures.size());
+	m_textureCount++;
+
+	// joins whatever batch the caller has open
+	_reallocate(m_textures.back(), m_textures.back().tailMip);
+	if (m_usedBytes > m_poolBytes) {
+		Log("stream: the tails alone need %.2f MB, more than the %.2f MB pool",
+			m_usedBytes / (1024.0 * 1024.0), m_poolBytes / (1024.0 * 1024.0));
+	}
+	return static_cast<uint32_t>(m_textures.size() - 1);
+}
+
+void TextureStreamer::remove(uint32_t id) {
+	Texture& texture = m_textures[id];
+	_retire(texture.image, texture.alloc, texture.view);
+	texture.image = VK_NULL_HANDLE;
+	texture.view  = VK_NULL_HANDLE;
+	texture.file.reset();
+	m_textureCount--;
+}
+
+void TextureStreamer::requestScreenSize(uint32_t id, float pixels) {
+	Texture& texture = m_textures[id];
+	texture.reported = std::max(texture.reported, pixels);
+}
+
+void TextureStreamer::update() {
+	m_frame++;
+
+	size_t kept = 0;
+	for (const Retired& retired : m_retired) {
+		if (retired.frame + m_framesInFlight > m_frame) {
+			m_retired[kept++] = retired;
+			continue;
+		}
+		Retired done = retired;
+		vkDestroyImageView(m_device, done.view, nullptr);
+		if (done.image != VK_NULL_HANDLE) {
+			m_usedBytes		-= done.alloc.size;
+			m_retiringBytes -= done.alloc.size;
+			m_allocator->destroyImage(done.image, done.alloc);
+		}
+	}
+	m_retired.resize(kept);
+
+	// a texture of `extent` texels covering `pixels` pixels wants the mip
+	// with as many texels as pixels
+	m_order.clear();
+	for (uint32_t id = 0; id < m_textures.size(); id++) {
+		Texture& texture = m_textures[id];
+		if (!texture.file) {
+			continue;
+		}
+		uint32_t extent	 = std::max(texture.file->width(), texture.file->height());
+		texture.pixels	  = texture.reported;
+		texture.reported  = 0.0f;
+		texture.wantedMip = texture.tailMip;
+		if (texture.pixels > 0.0f) {
+			float ratio = extent / texture.pixels;
+			texture.wantedMip = ratio <= 1.0f ? 0 :
+				std::min(texture.tailMip, static_cast<uint32_t>(std::log2(ratio)));
+		}
+		if (texture.wantedMip < texture.viewMip) {
+			m_order.push_back(id);
+		}
+	}
+	if (m_order.empty()) {
+		return;
+	}
+	// the blurriest on screen right now first
+	std::sort(m_order.begin(), m_order.end(), [this](uint32_t a, uint32_t b) {
+		return _blur(m_textures[a], m_textures[a].viewMip) >
+			_blur(m_textures[b], m_textures[b].viewMip);
+	});
+
+	m_uploader->beginBatch();
+	VkDeviceSize uploaded = 0;
+	for (uint32_t id : m_order) {
+		if (uploaded >= m_frameUploadBytes) {
+			break;
+		}
+		Texture& texture = m_textures[id];
+		if (texture.wantedMip < texture.imageMip) {
+			if (!_makeRoom(texture, _chainBytes(texture, texture.wantedMip))) {
+				continue;
+			}
+			VkDeviceSize before = m_uploadedBytes;
+			_reallocate(texture, texture.wantedMip);
+			uploaded += m_uploadedBytes - before;
+			m_grows++;
+		}
+		if (texture.viewMip > texture.imageMip) {
+			VkDeviceSize before = m_uploadedBytes;
+			_uploadLevels(texture, texture.viewMip - 1, texture.viewMip - 1);
+			uploaded += m_uploadedBytes - before;
+			texture.viewMip--;
+			_replaceView(texture);
+		}
+	}
+	m_uploader->endBatch();
+}
+
+void TextureStreamer::logStats() const {
+	uint32_t finest = 0;
+	for (const Texture& texture : m_textures) {
+		finest += texture.file && texture.viewMip < texture.tailMip;
+	}
+	Log("stream: %u textures, %u above their tail, %.2f of %.2f MB pool in use, "
+		"%.2f MB uploaded, %u grown, %u shrunk",
+		textureCount(), finest,
+		m_usedBytes / (1024.0 * 1024.0), m_poolBytes / (1024.0 * 1024.0),
+		m_uploadedBytes / (1024.0 * 1024.0), m_grows, m_shrinks);
+}
+
+float TextureStreamer::_blur(const Texture& texture, uint32_t mip) const {
+	uint32_t extent = std::max(texture.file->width(), texture.file->height());
+	return texture.pixels / std::max(1u, extent >> mip);
+}
+
+VkDeviceSize TextureStreamer::_chainBytes(const Texture& texture, uint32_t firstMip) const {
+	VkDeviceSize bytes = 0;
+	for (uint32_t mip = firstMip; mip < texture.file->mipCount(); mip++) {
+		bytes += texture.file->levelSize(mip);
+	}
+	return bytes;
+}
+
+// A new image with room for imageMip.., filled with what the old one showed
+// (the tail for a new texture), or with imageMip.. when that is less.
+void TextureStreamer::_reallocate(Texture& texture, uint32_t imageMip) {
+	const DdsFile& file = *texture.file;
+
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType			= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType		= VK_IMAGE_TYPE_2D;
+	imageInfo.format		= texture.format;
+	imageInfo.extent		= {
+		std::max(1u, file.width() >> imageMip), std::max(1u, file.height() >> imageMip), 1 };
+	imageInfo.mipLevels		= file.mipCount() - imageMip;
+	imageInfo.arrayLayers	= 1;
+	imageInfo.samples		= VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling		= VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage			= VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.sharingMode	= VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkImage		oldImage = texture.image;
+	Allocation	oldAlloc = texture.alloc;
+	VkImageView oldView	 = texture.view;
+	m_allocator->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		MemoryCategory::Texture, texture.image, texture.alloc);
+	m_usedBytes += texture.alloc.size;
+
+	if (oldImage != VK_NULL_HANDLE && imageMip > texture.imageMip) {
+		m_shrinks++;
+	}
+	texture.imageMip = imageMip;
+	texture.viewMip	 = std::max(texture.viewMip, imageMip);
+	_uploadLevels(texture, texture.viewMip, file.mipCount() - 1);
+
+	texture.view = VK_NULL_HANDLE;
+	_replaceView(texture);
+	if (oldImage != VK_NULL_HANDLE) {
+		_retire(oldImage, oldAlloc, oldView);
+	}
+	Log("stream: %s holds mips %u-%u, %.2f MB, pool %.2f of %.2f MB",
+		texture.name.c_str(), imageMip, file.mipCount() - 1,
+		texture.alloc.size / (1024.0 * 1024.0),
+		m_usedBytes / (1024.0 * 1024.0), m_poolBytes / (1024.0 * 1024.0));
+}
+
+// mips firstMip..lastMip of the full chain, straight from the mapping
+void TextureStreamer::_uploadLevels(Texture& texture, uint32_t firstMip, uint32_t lastMip) {
+	const DdsFile& file = *texture.file;
+
+	ImageLevel levels[32];
+	uint32_t   levelCount = lastMip - firstMip + 1;
+	for (uint32_t i = 0; i < levelCount; i++) {
+		uint32_t mip = firstMip + i;
+		levels[i].data	 = file.level(mip);
+		levels[i].width	 = std::max(1u, file.width() >> mip);
+		levels[i].height = std::max(1u, file.height() >> mip);
+		m_uploadedBytes += file.levelSize(mip);
+	}
+	m_uploader->uploadImage(
+		texture.image, levels, levelCount,
+		texture.blockExtent, texture.blockSize,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		firstMip - texture.imageMip
+	);
+}
+
+// The uploads are queued before anything recorded after this, so the new
+// view can be bound right away.
+void TextureStreamer::_replaceView(Texture& texture) {
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType		= VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image		= texture.image;
+	viewInfo.viewType	= VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format		= texture.format;
+	viewInfo.subresourceRange.aspectMask	 = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel	 = texture.viewMip - texture.imageMip;
+	viewInfo.subresourceRange.levelCount	 = texture.file->mipCount() - texture.viewMip;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount	 = 1;
+
+	VkImageView view;
+	if (vkCreateImageView(m_device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create streamed texture view");
+	}
+	if (texture.view != VK_NULL_HANDLE) {
+		_retire(VK_NULL_HANDLE, Allocation(), texture.view);
+	}
+	texture.view = view;
+	m_viewVersion++;
+}
+
+void TextureStreamer::_retire(VkImage image, const Allocation& alloc, VkImageView view) {
+	if (view == VK_NULL_HANDLE) {
+		return;
+	}
+	if (image != VK_NULL_HANDLE) {
+		m_retiringBytes += alloc.size;
+	}
+	m_retired.push_back({ image, alloc, view, m_frame });
+}
+
+// Shrinks other textures until, once the images they replace have
+// retired, `bytes` fit the pool. True when they fit right now.
+bool TextureStreamer::_makeRoom(const Texture& grower, VkDeviceSize bytes) {
+	if (m_usedBytes + bytes <= m_poolBytes) {
+		return true;
+	}
+	if (bytes > m_poolBytes) {
+		return false;
+	}
+	VkDeviceSize settled = m_usedBytes - m_retiringBytes + bytes;
+	if (settled <= m_poolBytes) {
+		return false;
+	}
+	VkDeviceSize needed = settled - m_poolBytes, freed = 0;
+
+	// mips nobody wants first, then the level whose loss blurs the least,
+	// while that still leaves it sharper than the grower is going to be
+	float growerBlur = _blur(grower, grower.wantedMip);
+	for (Texture& texture : m_textures) {
+		texture.plannedMip = std::max(texture.imageMip, texture.wantedMip);
+		if (texture.file) {
+			freed += _chainBytes(texture, texture.imageMip) - _chainBytes(texture, texture.plannedMip);
+		}
+	}
+	while (freed < needed) {
+		Texture* victim = nullptr;
+		for (Texture& texture : m_textures) {
+			if (texture.file && &texture != &grower && texture.plannedMip < texture.tailMip &&
+				_blur(texture, texture.plannedMip + 1) < growerBlur &&
+				(victim == nullptr ||
+					_blur(texture, texture.plannedMip) < _blur(*victim, victim->plannedMip))) {
+				victim = &texture;
+			}
+		}
+		if (victim == nullptr) {
+			break;
+		}
+		freed += _chainBytes(*victim, victim->plannedMip) -
+			_chainBytes(*victim, victim->plannedMip + 1);
+		victim->plannedMip++;
+	}
+
+	// nothing moves unless the grower fits in the end
+	if (freed < needed) {
+		return false;
+	}
+	for (Texture& texture : m_textures) {
+		if (texture.file && texture.plannedMip != texture.imageMip) {
+			_reallocate(texture, texture.plannedMip);
+		}
+	}
+	return false;
+}
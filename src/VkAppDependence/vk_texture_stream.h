@@ -0,0 +1,127 @@
+#pragma once
+
+#include "vk_upload.h"
+#include "vk_allocator.h"
+#include "dds_file.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Streams the mip chains of DDS textures through a fixed amount of device
+// memory. A texture starts out with its tail resident, the levels no
+// larger than TAIL_EXTENT texels. Every frame the draw pass reports how
+// many pixels each texture it samples covers on screen, which gives the
+// finest mip worth having; textures short of it are served in order of
+// screen pixels per resident texel.
+//
+// Without sparse binding an image can not grow, so a texture that needs
+// finer mips gets a new image with room for them. The levels already shown
+// are copied into it from the mapped file at once and the view moves over;
+// the finer levels follow one per frame, finest last, each moving the
+// view's base mip down by one. That base mip is the texture's minLod clamp:
+// the sampler never reaches a level that has not landed. Old images and
+// views are kept until every frame that could use them has retired.
+//
+// A texture only grows when its new image fits the pool. When it does not,
+// textures holding mips finer than they want give them back first. Then
+// others lose their finest levels, as long as each would still have more
+// texels per screen pixel without that level than the growing texture
+// would get. The grow goes ahead once the images they replace have
+// retired. Shrinking copies are the only thing that may briefly take the
+// pool over its size.
+class TextureStreamer {
+public:
+	static const uint32_t TAIL_EXTENT = 64;
+
+	void init(
+		VkDevice		 device,
+		DeviceAllocator& allocator,
+		UploadEngine&	 uploader,
+		uint32_t		 framesInFlight,
+		VkDeviceSize	 poolBytes,
+		VkDeviceSize	 frameUploadBytes		// soft, a frame uploads at least one level
+	);
+	void destroy();
+
+	// Keeps `file` mapped for as long as the streamer lives. Its levels are
+	// copied as stored, `format` has to match them. Uploads the tail.
+	uint32_t add(const std::string& name, std::unique_ptr<DdsFile> file, VkFormat format);
+	// retires the texture's image and view and unmaps its file; the id is
+	// not reused
+	void	 remove(uint32_t id);
+
+	// pixels the texture covers along its larger side this frame, the
+	// largest report of a frame counts; textures without one drop to the tail
+	void requestScreenSize(uint32_t id, float pixels);
+
+	// Once a frame, after its fence: frees what no frame uses any more,
+	// turns the frame's reports into wanted mips, makes room and uploads.
+	// Bumps viewVersion() when any view changed.
+	void update();
+
+	VkImageView view(uint32_t id)		 const { return m_textures[id].view; }
+	// finest mip of the full chain the view shows
+	uint32_t	residentMip(uint32_t id) const { return m_textures[id].viewMip; }
+	uint64_t	viewVersion()			 const { return m_viewVersion; }
+	uint32_t	textureCount()			 const { return m_textureCount; }
+
+	void logStats() const;
+
+private:
+	struct Texture {
+		std::string				 name;
+		std::unique_ptr<DdsFile> file;			// null once removed
+		VkFormat				 format		 = VK_FORMAT_UNDEFINED;
+		uint32_t				 blockExtent = 1;
+		uint32_t				 blockSize	 = 4;
+		uint32_t				 tailMip	 = 0;
+
+		VkImage					 image		 = VK_NULL_HANDLE;
+		Allocation				 alloc		 {};
+		VkImageView				 view		 = VK_NULL_HANDLE;
+		uint32_t				 imageMip	 = 0;		// the image holds imageMip..
+		uint32_t				 viewMip	 = 0;		// and viewMip.. have landed
+
+		float					 reported	= 0.0f;		// this frame's reports so far
+		float					 pixels		= 0.0f;		// last frame's
+		uint32_t				 wantedMip	= 0;
+		uint32_t				 plannedMip = 0;		// _makeRoom()'s scratch
+	};
+	struct Retired {
+		VkImage		image;			// VK_NULL_HANDLE when only the view goes
+		Allocation	alloc;
+		VkImageView view;
+		uint64_t	frame;
+	};
+
+	VkDeviceSize _chainBytes(const Texture& texture, uint32_t firstMip) const;
+	// screen pixels per texel with `mip` as the finest, above 1 is blurry
+	float		 _blur(const Texture& texture, uint32_t mip) const;
+	void		 _reallocate(Texture& texture, uint32_t imageMip);
+	void		 _uploadLevels(Texture& texture, uint32_t firstMip, uint32_t lastMip);
+	void		 _replaceView(Texture& texture);
+	void		 _retire(VkImage image, const Allocation& alloc, VkImageView view);
+	bool		 _makeRoom(const Texture& grower, VkDeviceSize bytes);
+
+	VkDevice		 m_device	  = VK_NULL_HANDLE;
+	DeviceAllocator* m_allocator  = nullptr;
+	UploadEngine*	 m_uploader	  = nullptr;
+	uint32_t		 m_framesInFlight = 0;
+	VkDeviceSize	 m_poolBytes  = 0;
+	VkDeviceSize	 m_frameUploadBytes = 0;
+
+	std::vector<Texture>  m_textures;
+	std::vector<Retired>  m_retired;
+	std::vector<uint32_t> m_order;			// update()'s scratch, kept to stay off the heap
+	uint32_t			  m_textureCount  = 0;		// not removed
+	uint64_t			  m_frame		  = 0;
+	uint64_t			  m_viewVersion	  = 0;
+	VkDeviceSize		  m_usedBytes	  = 0;		// live and retired images
+	VkDeviceSize		  m_retiringBytes = 0;
+
+	uint64_t			  m_uploadedBytes = 0;
+	uint32_t			  m_grows		  = 0;
+	uint32_t			  m_shrinks		  = 0;
+};
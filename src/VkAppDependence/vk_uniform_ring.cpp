@@ -0,0 +1,62 @@
+#include "vk_uniform_ring.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void UniformRing::init(
+	DeviceAllocator&	allocator,
+	VkPhysicalDevice	gpu,
+	uint32_t			frameCount,
+	VkDeviceSize		bytesPerFrame
+) {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(gpu, &properties);
+
+	m_allocator	 = &allocator;
+	m_alignment	 = std::max<VkDeviceSize>(
+		properties.limits.minUniformBufferOffsetAlignment, 16);
+	m_frameSize	 = (bytesPerFrame + m_alignment - 1) & ~(m_alignment - 1);
+	m_frameCount = frameCount;
+
+	m_allocator->createBuffer(
+		m_frameSize * m_frameCount,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		MemoryCategory::Uniform,
+		m_buffer, m_alloc
+	);
+	m_mapped = static_cast<char*>(m_alloc.mapped);
+
+	beginFrame(0);
+}
+
+void UniformRing::destroy() {
+	if (m_buffer != VK_NULL_HANDLE) {
+		m_allocator->destroyBuffer(m_buffer, m_alloc);
+	}
+	m_mapped = nullptr;
+}
+
+void UniformRing::beginFrame(uint32_t frameIndex) {
+	m_frameBegin = m_frameSize * (frameIndex % m_frameCount);
+	m_head		 = m_frameBegin;
+}
+
+void* UniformRing::allocate(size_t size, uint32_t& dynamicOffset) {
+	VkDeviceSize end = m_head + size;
+	if (end > m_frameBegin + m_frameSize) {
+		throw std::runtime_error("uniform ring partition overflow");
+	}
+
+	dynamicOffset = static_cast<uint32_t>(m_head);
+	void* ptr	  = m_mapped + m_head;
+	m_head		  = (end + m_alignment - 1) & ~(m_alignment - 1);
+	return ptr;
+}
+
+uint32_t UniformRing::push(const void* data, size_t size) {
+	uint32_t dynamicOffset;
+	memcpy(allocate(size, dynamicOffset), data, size);
+	return dynamicOffset;
+}
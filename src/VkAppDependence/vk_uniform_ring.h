@@ -0,0 +1,51 @@
+#pragma once
+
+#include "vk_allocator.h"
+
+#include <cstdint>
+#include <cstring>
+
+// One persistently mapped uniform buffer split into a partition per frame
+// in flight. Constants are bump allocated from the partition of the current
+// frame and bound through VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC offsets,
+// so the hot path is a memcpy and an add. beginFrame() may only be called
+// once the fence of that frame has been waited on.
+class UniformRing {
+public:
+	void init(
+		DeviceAllocator&	allocator,
+		VkPhysicalDevice	gpu,
+		uint32_t			frameCount,
+		VkDeviceSize		bytesPerFrame
+	);
+	void destroy();
+
+	void beginFrame(uint32_t frameIndex);
+
+	// returns the dynamic offset of the copied block
+	uint32_t push(const void* data, size_t size);
+
+	template<typename T>
+	uint32_t push(const T& value) { return push(&value, sizeof(T)); }
+
+	// reserve space and write it in place, useful for large arrays
+	void* allocate(size_t size, uint32_t& dynamicOffset);
+
+	VkBuffer	 buffer()		 const { return m_buffer; }
+	VkDeviceSize alignment()	 const { return m_alignment; }
+	VkDeviceSize bytesPerFrame() const { return m_frameSize; }
+	VkDeviceSize usedThisFrame() const { return m_head - m_frameBegin; }
+
+private:
+	DeviceAllocator* m_allocator  = nullptr;
+	VkBuffer		 m_buffer	  = VK_NULL_HANDLE;
+	Allocation		 m_alloc	  {};
+	char*			 m_mapped	  = nullptr;
+
+	VkDeviceSize	 m_alignment  = 256;
+	VkDeviceSize	 m_frameSize  = 0;
+	uint32_t		 m_frameCount = 0;
+
+	VkDeviceSize	 m_frameBegin = 0;
+	VkDeviceSize	 m_head		  = 0;
+};
@@ -0,0 +1,580 @@
+#include "vk_upload.h"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+static VkCommandPool createTransientPool(VkDevice device, uint32_t family) {
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType =
+		VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = family;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	VkCommandPool pool;
+	if (vkCreateCommandPool(
+		device, &poolInfo, nullptr, &pool
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create upload command pool");
+	}
+	return pool;
+}
+
+void UploadEngine::init(
+	VkDevice		device,
+	StagingArena&	staging,
+	uint32_t		graphicsFamily,
+	VkQueue			graphicsQueue,
+	int				transferFamily,
+	VkQueue			transferQueue,
+	MipGenerator*	mipGenerator
+) {
+	m_device		 = device;
+	m_staging		 = &staging;
+	m_mipGenerator	 = mipGenerator;
+	m_graphicsFamily = graphicsFamily;
+	m_graphicsQueue	 = graphicsQueue;
+	m_dedicated		 = transferFamily >= 0 &&
+		static_cast<uint32_t>(transferFamily) != graphicsFamily;
+
+	m_graphicsPool = createTransientPool(m_device, m_graphicsFamily);
+	if (m_dedicated) {
+		m_transferFamily = static_cast<uint32_t>(transferFamily);
+		m_transferQueue	 = transferQueue;
+		m_transferPool	 = createTransientPool(m_device, m_transferFamily);
+	}
+	else {
+		m_transferFamily = m_graphicsFamily;
+		m_transferQueue	 = m_graphicsQueue;
+		m_transferPool	 = m_graphicsPool;
+	}
+}
+
+void UploadEngine::destroy() {
+	if (m_batch.open) {
+		endBatch();
+	}
+	waitIdle();
+
+	for (auto semaphore : m_freeSemaphores) {
+		vkDestroySemaphore(m_device, semaphore, nullptr);
+	}
+	m_freeSemaphores.clear();
+
+	if (m_dedicated) {
+		vkDestroyCommandPool(m_device, m_transferPool, nullptr);
+	}
+	vkDestroyCommandPool(m_device, m_graphicsPool, nullptr);
+	m_transferPool = m_graphicsPool = VK_NULL_HANDLE;
+}
+
+void UploadEngine::beginBatch() {
+	if (m_batch.open) {
+		throw std::runtime_error("upload batch already open");
+	}
+	m_batch		   = Batch();
+	m_batch.open   = true;
+	m_batch.ticket = m_nextTicket;
+}
+
+UploadTicket UploadEngine::endBatch() {
+	if (!m_batch.open) {
+		throw std::runtime_error("no upload batch open");
+	}
+	m_batch.open = false;
+
+	bool empty = m_batch.transferCommands.empty() &&
+		m_batch.toTransferDst.empty() &&
+		m_batch.bufferCopies.empty() && m_batch.imageCopies.empty() &&
+		m_batch.bufferFinal.empty() && m_batch.imageFinal.empty();
+	if (empty) {
+		return { m_batch.ticket - 1 };
+	}
+
+	_flush(true);
+
+	InFlight upload;
+	upload.ticket			= m_batch.ticket;
+	upload.serial			= m_staging->submittedSerial();
+	upload.semaphore		= m_batch.semaphore;
+	upload.transferCommands = std::move(m_batch.transferCommands);
+	upload.graphicsCommand	= m_batch.graphicsCommand;
+	m_inFlight.push_back(std::move(upload));
+
+	m_nextTicket++;
+	m_batch = Batch();
+	return { m_nextTicket - 1 };
+}
+
+bool UploadEngine::_beginImplicit() {
+	if (m_batch.open) {
+		return false;
+	}
+	beginBatch();
+	return true;
+}
+
+UploadTicket UploadEngine::_endImplicit(bool opened) {
+	return opened ? endBatch() : UploadTicket{ m_batch.ticket };
+}
+
+void UploadEngine::_reserveStaging(VkDeviceSize size) {
+	bool pending = !m_batch.bufferCopies.empty() || !m_batch.imageCopies.empty();
+	if (pending &&
+		m_staging->unsubmittedBytes() + size > m_staging->maxChunk()) {
+		_flush(false);
+	}
+}
+
+VkCommandBuffer UploadEngine::_beginCommands(VkCommandPool pool) {
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType =
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = pool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	if (vkAllocateCommandBuffers(
+		m_device, &allocInfo, &commandBuffer
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate upload command buffer");
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType =
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags =
+		VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	return commandBuffer;
+}
+
+void UploadEngine::_submit(
+	VkQueue queue, VkCommandBuffer commandBuffer,
+	VkSemaphore wait, VkPipelineStageFlags waitStage,
+	VkSemaphore signal
+) {
+	vkEndCommandBuffer(commandBuffer);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType =
+		VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = wait != VK_NULL_HANDLE ? 1 : 0;
+	submitInfo.pWaitSemaphores = &wait;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.signalSemaphoreCount = signal != VK_NULL_HANDLE ? 1 : 0;
+	submitInfo.pSignalSemaphores = &signal;
+
+	// every submit is guarded by a staging fence, its serial doubles as
+	// the completion marker of the batch
+	if (vkQueueSubmit(
+		queue, 1, &submitInfo, m_staging->fenceForSubmit()
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit upload commands");
+	}
+	m_submitCount++;
+}
+
+void UploadEngine::_flush(bool last) {
+	Batch& batch = m_batch;
+	VkCommandBuffer commandBuffer = _beginCommands(m_transferPool);
+	batch.transferCommands.push_back(commandBuffer);
+
+	if (!batch.toTransferDst.empty()) {
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr,
+			static_cast<uint32_t>(batch.toTransferDst.size()),
+			batch.toTransferDst.data()
+		);
+		batch.toTransferDst.clear();
+	}
+
+	for (const auto& copy : batch.bufferCopies) {
+		vkCmdCopyBuffer(commandBuffer,
+			m_staging->buffer(), copy.dst, 1, &copy.region);
+	}
+	for (const auto& copy : batch.imageCopies) {
+		vkCmdCopyBufferToImage(commandBuffer,
+			m_staging->buffer(), copy.dst,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy.region);
+	}
+	batch.bufferCopies.clear();
+	batch.imageCopies.clear();
+
+	if (!last) {
+		_submit(m_transferQueue, commandBuffer,
+			VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+		return;
+	}
+
+	uint32_t bufferCount = static_cast<uint32_t>(batch.bufferFinal.size());
+	uint32_t imageCount	 = static_cast<uint32_t>(batch.imageFinal.size());
+	if (bufferCount + imageCount == 0) {
+		_submit(m_transferQueue, commandBuffer,
+			VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+		return;
+	}
+
+	if (!m_dedicated) {
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, batch.dstStages, 0,
+			0, nullptr,
+			bufferCount, batch.bufferFinal.data(),
+			imageCount, batch.imageFinal.data()
+		);
+		_recordMipChains(commandBuffer);
+		_submit(m_transferQueue, commandBuffer,
+			VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+		return;
+	}
+
+	// release: dstAccess is ignored on the releasing queue
+	std::vector<VkBufferMemoryBarrier> bufferRelease = batch.bufferFinal;
+	std::vector<VkImageMemoryBarrier>  imageRelease	 = batch.imageFinal;
+	for (auto& barrier : bufferRelease) barrier.dstAccessMask = 0;
+	for (auto& barrier : imageRelease)	barrier.dstAccessMask = 0;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+		0, nullptr,
+		bufferCount, bufferRelease.data(),
+		imageCount, imageRelease.data()
+	);
+	batch.semaphore = _acquireSemaphore();
+	_submit(m_transferQueue, commandBuffer,
+		VK_NULL_HANDLE, 0, batch.semaphore);
+
+	// acquire: srcAccess is ignored on the acquiring queue, the semaphore
+	// wait stage chains into the barrier's source stage
+	for (auto& barrier : batch.bufferFinal) barrier.srcAccessMask = 0;
+	for (auto& barrier : batch.imageFinal)	barrier.srcAccessMask = 0;
+
+	batch.graphicsCommand = _beginCommands(m_graphicsPool);
+	vkCmdPipelineBarrier(
+		batch.graphicsCommand,
+		batch.dstStages, batch.dstStages, 0,
+		0, nullptr,
+		bufferCount, batch.bufferFinal.data(),
+		imageCount, batch.imageFinal.data()
+	);
+	_recordMipChains(batch.graphicsCommand);
+	_submit(m_graphicsQueue, batch.graphicsCommand,
+		batch.semaphore, batch.dstStages, VK_NULL_HANDLE);
+}
+
+void UploadEngine::_recordMipChains(VkCommandBuffer commandBuffer) {
+	for (const MipChain& chain : m_batch.mipChains) {
+		m_mipGenerator->record(commandBuffer,
+			chain.image, chain.format, chain.width, chain.height, chain.mipLevels,
+			chain.finalLayout, chain.dstAccess, chain.dstStage, m_batch.ticket);
+	}
+	m_batch.mipChains.clear();
+}
+
+UploadTicket UploadEngine::uploadBuffer(
+	VkBuffer				dstBuffer,
+	VkDeviceSize			dstOffset,
+	const void*				data,
+	VkDeviceSize			size,
+	VkAccessFlags			dstAccess,
+	VkPipelineStageFlags	dstStage
+) {
+	bool opened = _beginImplicit();
+
+	const char* src = static_cast<const char*>(data);
+	for (VkDeviceSize done = 0; done < size; ) {
+		VkDeviceSize chunk = std::min(size - done, m_staging->maxChunk());
+		_reserveStaging(chunk);
+
+		StagingSpan span = m_staging->allocate(chunk);
+		memcpy(span.mapped, src + done, static_cast<size_t>(chunk));
+
+		BufferCopy copy;
+		copy.dst			  = dstBuffer;
+		copy.region.srcOffset = span.offset;
+		copy.region.dstOffset = dstOffset + done;
+		copy.region.size	  = chunk;
+		m_batch.bufferCopies.push_back(copy);
+		done += chunk;
+	}
+
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType =
+		VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex =
+		m_dedicated ? m_transferFamily : VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex =
+		m_dedicated ? m_graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = dstBuffer;
+	barrier.offset = dstOffset;
+	barrier.size = size;
+
+	m_batch.bufferFinal.push_back(barrier);
+	m_batch.dstStages |= dstStage;
+
+	return _endImplicit(opened);
+}
+
+UploadTicket UploadEngine::uploadImage(
+	VkImage					image,
+	const void*				pixels,
+	uint32_t				width,
+	uint32_t				height,
+	uint32_t				texelSize,
+	VkImageLayout			finalLayout,
+	VkAccessFlags			dstAccess,
+	VkPipelineStageFlags	dstStage
+) {
+	ImageLevel level = { pixels, width, height };
+	return uploadImage(image, &level, 1, 1, texelSize, finalLayout, dstAccess, dstStage);
+}
+
+UploadTicket UploadEngine::uploadImage(
+	VkImage					image,
+	const ImageLevel*		levels,
+	uint32_t				levelCount,
+	uint32_t				blockExtent,
+	uint32_t				blockSize,
+	VkImageLayout			finalLayout,
+	VkAccessFlags			dstAccess,
+	VkPipelineStageFlags	dstStage,
+	uint32_t				firstLevel
+) {
+	bool opened = _beginImplicit();
+	_queueImageLevels(image, levels, levelCount, blockExtent, blockSize, firstLevel);
+	_queueImageFinal(image, firstLevel, levelCount, finalLayout, dstAccess, dstStage);
+	return _endImplicit(opened);
+}
+
+UploadTicket UploadEngine::uploadImageMipmapped(
+	VkImage					image,
+	const void*				pixels,
+	uint32_t				width,
+	uint32_t				height,
+	uint32_t				texelSize,
+	VkFormat				format,
+	uint32_t				mipLevels,
+	VkImageLayout			finalLayout,
+	VkAccessFlags			dstAccess,
+	VkPipelineStageFlags	dstStage,
+	const PixelConversion*	conversion
+) {
+	if (mipLevels > 1 && m_mipGenerator == nullptr) {
+		throw std::runtime_error("mip generation needs a MipGenerator");
+	}
+
+	bool opened = _beginImplicit();
+	ImageLevel level = { pixels, width, height };
+	_queueImageLevels(image, &level, 1, 1, texelSize, 0, conversion);
+	if (mipLevels <= 1) {
+		_queueImageFinal(image, 0, 1, finalLayout, dstAccess, dstStage);
+		return _endImplicit(opened);
+	}
+
+	// mip 0 stays in TRANSFER_DST, the generator starts from there on the
+	// graphics queue; the other levels are never touched before that, so
+	// they need no ownership transfer
+	_queueImageFinal(image, 0, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	MipChain chain;
+	chain.image		  = image;
+	chain.format	  = format;
+	chain.width		  = width;
+	chain.height	  = height;
+	chain.mipLevels	  = mipLevels;
+	chain.finalLayout = finalLayout;
+	chain.dstAccess	  = dstAccess;
+	chain.dstStage	  = dstStage;
+	m_batch.mipChains.push_back(chain);
+
+	return _endImplicit(opened);
+}
+
+void UploadEngine::_queueImageLevels(
+	VkImage				image,
+	const ImageLevel*	levels,
+	uint32_t			levelCount,
+	uint32_t			blockExtent,
+	uint32_t			blockSize,
+	uint32_t			firstLevel,
+	const PixelConversion*	conversion
+) {
+	if (conversion && (blockExtent != 1 || blockSize != 4)) {
+		throw std::runtime_error("pixel conversions only write RGBA8 texels");
+	}
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType =
+		VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = firstLevel;
+	barrier.subresourceRange.levelCount = levelCount;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	m_batch.toTransferDst.push_back(barrier);
+
+	for (uint32_t mip = 0; mip < levelCount; mip++) {
+		const ImageLevel& level = levels[mip];
+
+		// split by rows of blocks so that big levels go through the arena
+		// in several chunks
+		uint32_t	 blockColumns = (level.width + blockExtent - 1) / blockExtent;
+		uint32_t	 blockRows	  = (level.height + blockExtent - 1) / blockExtent;
+		VkDeviceSize rowPitch	  = static_cast<VkDeviceSize>(blockColumns) * blockSize;
+		if (rowPitch > m_staging->maxChunk()) {
+			throw std::runtime_error("image row does not fit the staging arena");
+		}
+		uint32_t rowsPerChunk = static_cast<uint32_t>(m_staging->maxChunk() / rowPitch);
+
+		// converted rows are read with their own pitch
+		const char*	 src	  = static_cast<const char*>(level.data);
+		VkDeviceSize srcPitch = conversion ?
+			VkDeviceSize(level.width) * conversion->srcChannels : rowPitch;
+		for (uint32_t row = 0; row < blockRows; row += rowsPerChunk) {
+			uint32_t	 rows  = std::min(rowsPerChunk, blockRows - row);
+			VkDeviceSize bytes = rowPitch * rows;
+			_reserveStaging(bytes);
+
+			StagingSpan span = m_staging->allocate(
+				bytes, std::max<VkDeviceSize>(blockSize, 4));
+			if (conversion) {
+				convertPixels(reinterpret_cast<const uint8_t*>(src + srcPitch * row),
+					static_cast<uint8_t*>(span.mapped), size_t(level.width) * rows, *conversion);
+			}
+			else {
+				memcpy(span.mapped, src + rowPitch * row, static_cast<size_t>(bytes));
+			}
+
+			// extents of block images are in texels and stop at the level's edge
+			uint32_t top = row * blockExtent;
+			ImageCopy copy = {};
+			copy.dst = image;
+			copy.region.bufferOffset = span.offset;
+			copy.region.bufferRowLength = 0;
+			copy.region.bufferImageHeight = 0;
+			copy.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			copy.region.imageSubresource.mipLevel = firstLevel + mip;
+			copy.region.imageSubresource.baseArrayLayer = 0;
+			copy.region.imageSubresource.layerCount = 1;
+			copy.region.imageOffset = { 0, static_cast<int32_t>(top), 0 };
+			copy.region.imageExtent = {
+				level.width, std::min(rows * blockExtent, level.height - top), 1 };
+			m_batch.imageCopies.push_back(copy);
+		}
+	}
+}
+
+void UploadEngine::_queueImageFinal(
+	VkImage					image,
+	uint32_t				firstLevel,
+	uint32_t				levelCount,
+	VkImageLayout			finalLayout,
+	VkAccessFlags			dstAccess,
+	VkPipelineStageFlags	dstStage
+) {
+	// release and acquire must agree on the layouts and families
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType =
+		VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = finalLayout;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex =
+		m_dedicated ? m_transferFamily : VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex =
+		m_dedicated ? m_graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = firstLevel;
+	barrier.subresourceRange.levelCount = levelCount;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	m_batch.imageFinal.push_back(barrier);
+	m_batch.dstStages |= dstStage;
+}
+
+void UploadEngine::collect() {
+	m_staging->reclaim();
+	while (!m_inFlight.empty() &&
+		m_inFlight.front().serial <= m_staging->completedSerial()) {
+		InFlight& upload = m_inFlight.front();
+
+		vkFreeCommandBuffers(m_device, m_transferPool,
+			static_cast<uint32_t>(upload.transferCommands.size()),
+			upload.transferCommands.data());
+		if (upload.graphicsCommand != VK_NULL_HANDLE) {
+			vkFreeCommandBuffers(m_device, m_graphicsPool,
+				1, &upload.graphicsCommand);
+		}
+		if (upload.semaphore != VK_NULL_HANDLE) {
+			m_freeSemaphores.push_back(upload.semaphore);
+		}
+
+		m_completedTicket = upload.ticket;
+		m_inFlight.pop_front();
+	}
+	if (m_mipGenerator != nullptr) {
+		m_mipGenerator->collect(m_completedTicket);
+	}
+}
+
+bool UploadEngine::isComplete(UploadTicket ticket) {
+	collect();
+	return ticket.value <= m_completedTicket;
+}
+
+void UploadEngine::wait(UploadTicket ticket) {
+	if (m_batch.open && ticket.value >= m_batch.ticket) {
+		throw std::runtime_error("waiting on an upload batch that is still open");
+	}
+	while (!isComplete(ticket) && !m_inFlight.empty()) {
+		m_staging->waitForSerial(m_inFlight.front().serial);
+	}
+}
+
+void UploadEngine::waitIdle() {
+	wait({ m_nextTicket - 1 });
+}
+
+VkSemaphore UploadEngine::_acquireSemaphore() {
+	if (!m_freeSemaphores.empty()) {
+		VkSemaphore semaphore = m_freeSemaphores.back();
+		m_freeSemaphores.pop_back();
+		return semaphore;
+	}
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType =
+		VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	VkSemaphore semaphore;
+	if (vkCreateSemaphore(
+		m_device, &semaphoreInfo, nullptr, &semaphore
+	) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create upload semaphore");
+	}
+	return semaphore;
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include "vk_staging.h"
+#include "vk_mipmaps.h"
+#include "pixel_convert.h"
+
+#include <deque>
+#include <vector>
+#include <cstdint>
+
+// One level of an image: tightly packed rows of texels, or of blocks for
+// block compressed formats.
+struct ImageLevel {
+	const void* data;
+	uint32_t	width;		// in texels
+	uint32_t	height;
+};
+
+// Handle of a queued upload; tickets complete in the order they were issued.
+struct UploadTicket {
+	uint64_t value = 0;
+};
+
+// Records staging copies on a dedicated transfer queue family when the
+// device has one and hands the resources over to the graphics family with
+// a release/acquire barrier pair, chained by a binary semaphore. Without a
+// transfer family the copies are recorded on the graphics queue instead.
+// Either way nothing here blocks the CPU: later graphics submits are ordered
+// behind the final barriers by the queue itself. Completion is tracked with
+// the staging arena's fence serials, collect() recycles command buffers and
+// semaphores of finished uploads.
+//
+// Uploads issued between beginBatch() and endBatch() share one command
+// buffer: all layout transitions before the copies go into one
+// vkCmdPipelineBarrier, all copies follow, and all release (or final)
+// barriers go into one more. A batch costs a single submit on a shared
+// queue and two with a transfer family, unless the staging arena fills up
+// and forces an intermediate submit. Uploads outside a batch form a batch
+// of their own.
+//
+// Mip chains are generated after the copies, on the graphics queue: after
+// the acquire barrier with a transfer family, in the same command buffer
+// without one.
+class UploadEngine {
+public:
+	void init(
+		VkDevice		device,
+		StagingArena&	staging,
+		uint32_t		graphicsFamily,
+		VkQueue			graphicsQueue,
+		int				transferFamily,		// -1 when there is none
+		VkQueue			transferQueue,
+		MipGenerator*	mipGenerator = nullptr	// for uploadImageMipmapped()
+	);
+	void destroy();
+
+	void		 beginBatch();
+	UploadTicket endBatch();
+
+	UploadTicket uploadBuffer(
+		VkBuffer				dstBuffer,
+		VkDeviceSize			dstOffset,
+		const void*				data,
+		VkDeviceSize			size,
+		VkAccessFlags			dstAccess,
+		VkPipelineStageFlags	dstStage
+	);
+
+	// tightly packed rows, mip 0 / layer 0, image starts out UNDEFINED
+	UploadTicket uploadImage(
+		VkImage					image,
+		const void*				pixels,
+		uint32_t				width,
+		uint32_t				height,
+		uint32_t				texelSize,
+		VkImageLayout			finalLayout,
+		VkAccessFlags			dstAccess,
+		VkPipelineStageFlags	dstStage
+	);
+
+	// mips firstLevel..firstLevel+levelCount-1 / layer 0, those mips start
+	// out UNDEFINED, the others are left alone; `blockSize` bytes cover
+	// `blockExtent` x `blockExtent` texels, 1 x 1 for uncompressed formats
+	UploadTicket uploadImage(
+		VkImage					image,
+		const ImageLevel*		levels,
+		uint32_t				levelCount,
+		uint32_t				blockExtent,
+		uint32_t				blockSize,
+		VkImageLayout			finalLayout,
+		VkAccessFlags			dstAccess,
+		VkPipelineStageFlags	dstStage,
+		uint32_t				firstLevel = 0
+	);
+
+	// tightly packed rows of mip 0, mips 1..mipLevels-1 are generated from
+	// it; the image needs the usage MipGenerator::usage() asks for. With a
+	// `conversion` the rows hold its srcChannels bytes per texel and are
+	// converted to RGBA8 (texelSize 4) as they are written into staging.
+	UploadTicket uploadImageMipmapped(
+		VkImage					image,
+		const void*				pixels,
+		uint32_t				width,
+		uint32_t				height,
+		uint32_t				texelSize,
+		VkFormat				format,
+		uint32_t				mipLevels,
+		VkImageLayout			finalLayout,
+		VkAccessFlags			dstAccess,
+		VkPipelineStageFlags	dstStage,
+		const PixelConversion*	conversion = nullptr
+	);
+
+	bool isComplete(UploadTicket ticket);
+	void wait(UploadTicket ticket);
+	void waitIdle();
+	void collect();
+
+	bool	 hasTransferQueue() const { return m_dedicated; }
+	uint64_t submitCount()		const { return m_submitCount; }
+
+private:
+	struct BufferCopy {
+		VkBuffer		  dst;
+		VkBufferCopy	  region;
+	};
+	struct ImageCopy {
+		VkImage			  dst;
+		VkBufferImageCopy region;
+	};
+	struct MipChain {
+		VkImage				 image;
+		VkFormat			 format;
+		uint32_t			 width;
+		uint32_t			 height;
+		uint32_t			 mipLevels;
+		VkImageLayout		 finalLayout;
+		VkAccessFlags		 dstAccess;
+		VkPipelineStageFlags dstStage;
+	};
+
+	struct Batch {
+		bool								open	  = false;
+		uint64_t							ticket	  = 0;
+		VkPipelineStageFlags				dstStages = 0;
+
+		// not recorded yet, emitted by the next _flush()
+		std::vector<VkImageMemoryBarrier>	toTransferDst;
+		std::vector<BufferCopy>				bufferCopies;
+		std::vector<ImageCopy>				imageCopies;
+
+		// emitted by the last _flush() of the batch
+		std::vector<VkBufferMemoryBarrier>	bufferFinal;
+		std::vector<VkImageMemoryBarrier>	imageFinal;
+		std::vector<MipChain>				mipChains;		// after imageFinal
+
+		std::vector<VkCommandBuffer>		transferCommands;
+		VkCommandBuffer						graphicsCommand = VK_NULL_HANDLE;
+		VkSemaphore							semaphore		= VK_NULL_HANDLE;
+	};
+
+	struct InFlight {
+		uint64_t					 ticket;
+		uint64_t					 serial;	// staging arena fence serial
+		VkSemaphore					 semaphore;
+		std::vector<VkCommandBuffer> transferCommands;
+		VkCommandBuffer				 graphicsCommand;
+	};
+
+	bool			_beginImplicit();
+	UploadTicket	_endImplicit(bool opened);
+	void			_reserveStaging(VkDeviceSize size);
+	void			_queueImageLevels(VkImage image, const ImageLevel* levels,
+						uint32_t levelCount, uint32_t blockExtent, uint32_t blockSize,
+						uint32_t firstLevel, const PixelConversion* conversion = nullptr);
+	void			_queueImageFinal(VkImage image, uint32_t firstLevel, uint32_t levelCount,
+						VkImageLayout finalLayout, VkAccessFlags dstAccess,
+						VkPipelineStageFlags dstStage);
+	void			_recordMipChains(VkCommandBuffer commandBuffer);
+	void			_flush(bool last);
+	VkCommandBuffer _beginCommands(VkCommandPool pool);
+	void			_submit(VkQueue queue, VkCommandBuffer commandBuffer,
+						VkSemaphore wait, VkPipelineStageFlags waitStage,
+						VkSemaphore signal);
+
+	VkSemaphore _acquireSemaphore();
+
+	VkDevice	  m_device		   = VK_NULL_HANDLE;
+	StagingArena* m_staging		   = nullptr;
+	MipGenerator* m_mipGenerator   = nullptr;
+	bool		  m_dedicated	   = false;
+
+	uint32_t	  m_graphicsFamily = 0;
+	uint32_t	  m_transferFamily = 0;
+	VkQueue		  m_graphicsQueue  = VK_NULL_HANDLE;
+	VkQueue		  m_transferQueue  = VK_NULL_HANDLE;
+	VkCommandPool m_graphicsPool   = VK_NULL_HANDLE;
+	VkCommandPool m_transferPool   = VK_NULL_HANDLE;
+
+	Batch						 m_batch;
+	std::deque<InFlight>		 m_inFlight;
+	std::vector<VkSemaphore>	 m_freeSemaphores;
+	uint64_t					 m_nextTicket	   = 1;
+	uint64_t					 m_completedTicket = 0;
+	uint64_t					 m_submitCount	   = 0;
+};